@@ -862,6 +862,7 @@ typedef u_int16_t ipsec_auth_t;
 #define OAKLEY_CAMELLIA_CBC	8
 #define OAKLEY_SERPENT_CBC              65004
 #define OAKLEY_TWOFISH_CBC              65005
+#define OAKLEY_AES_GCM_C                65006	/* private: IKEv2 AES-GCM-16 only */
 #define OAKLEY_TWOFISH_CBC_SSH          65289
 
 #define OAKLEY_ENCRYPT_MAX      65535	/* pretty useless :) */
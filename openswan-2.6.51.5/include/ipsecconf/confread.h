@@ -33,6 +33,7 @@ extern char rootdir2[PATH_MAX];       /* when evaluating paths, prefix this to t
 #define ALSO_LIMIT 32
 
 struct whack_message;
+struct starter_whack_batch;
 
 enum keyword_set {
     k_unset   =FALSE,
@@ -153,6 +154,7 @@ struct starter_config {
 
     /* abstract the sending part for building unit tests */
     int (*send_whack_msg)(struct starter_config *cfg, struct whack_message *msg);
+    struct starter_whack_batch *whack_batch;	/* while messages are batched */
 
     /* connections list (without %default) */
     TAILQ_HEAD(, starter_conn) conns;
@@ -163,6 +165,13 @@ extern struct starter_config *confread_load(const char *file
 					    , bool resolvip
 					    , char *ctlbase
 					    , bool setuponly);
+extern struct starter_config *confread_load_batch(const char *file
+						  , err_t *perr
+						  , bool resolvip
+						  , char *ctlbase
+						  , int workers
+						  , int (*operation)(struct starter_config *cfg
+								     , struct starter_conn *conn));
 extern struct starter_conn *alloc_add_conn(struct starter_config *cfg
 					   , char *name, err_t *perr);
 void confread_free(struct starter_config *cfg);
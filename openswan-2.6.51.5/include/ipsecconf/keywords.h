@@ -132,6 +132,8 @@ enum keyword_numeric_config_field {
 
     /* new ones here */
     KBF_ENDADDRFAMILY,
+    KBF_RATELIMIT_NEW,
+    KBF_RATELIMIT_EXISTING,
 
     KBF_MAX
 };
@@ -31,6 +31,24 @@ int starter_whack_shutdown (struct starter_config *cfg);
 void starter_whack_init_cfg(struct starter_config *cfg);
 void init_whack_msg (struct whack_message *msg);
 
+/* messages packed for one batched whack request (see struct whack_batch) */
+struct starter_whack_batch {
+    unsigned char *buf;		/* struct whack_batch, then the records */
+    size_t len, size;
+    unsigned int count;
+    unsigned int flags;		/* WHACK_BATCH_* */
+    int (*send_whack_msg)(struct starter_config *cfg	/* the sender to restore */
+			  , struct whack_message *msg);
+};
+
+/* until the batch is sent, messages for cfg are packed into the batch */
+extern void starter_whack_batch_begin(struct starter_config *cfg);
+extern void starter_whack_batch_append(struct starter_config *cfg
+				       , const unsigned char *recs, size_t len
+				       , unsigned int count);
+extern int starter_whack_batch_send(struct starter_config *cfg);
+extern void starter_whack_batch_free(struct starter_config *cfg);
+
 /* build whack message from starter structures */
 extern int starter_whack_build_pkmsg(struct starter_config *cfg,
                                      struct whack_message *msg,
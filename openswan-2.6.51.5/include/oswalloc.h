@@ -27,6 +27,7 @@ extern void *clone_bytes2(const void *orig, size_t size
 
 extern int leak_detective;
 extern void report_leaks(void);
+extern void leak_detective_usage(unsigned long *items, unsigned long *bytes);
 # define pfree(ptr) leak_pfree(ptr, leak_detective)
 # define alloc_bytes(size, name) (alloc_bytes2(size, name, leak_detective))
 # define clone_bytes(orig, size, name) (clone_bytes2(orig,size,name,leak_detective))
@@ -92,14 +93,15 @@ extern void set_exit_log_func(exit_log_func_t func);
 #endif
 
 #ifdef HAVE_LIBNSS
+/* the chunk starts with the PK11SymKey pointer; an AEAD key's salt may follow */
 #define free_osw_nss_symkey(ch)  \
                { PK11SymKey *ptr=0; \
-                 if((ch).ptr!=NULL) { memcpy(&ptr, (ch).ptr, (ch).len); memset((ch).ptr,0,(ch).len );} \
+                 if((ch).ptr!=NULL && (ch).len>=sizeof(ptr)) { memcpy(&ptr, (ch).ptr, sizeof(ptr)); memset((ch).ptr,0,(ch).len );} \
                  if(ptr!=NULL) { PK11_FreeSymKey(ptr);} }
 
 #define dup_osw_nss_symkey(ch)  \
                { PK11SymKey *ptr=0; \
-                  if((ch).ptr!=NULL) { memcpy(&ptr, (ch).ptr, (ch).len);} \
+                  if((ch).ptr!=NULL && (ch).len>=sizeof(ptr)) { memcpy(&ptr, (ch).ptr, sizeof(ptr));} \
                   if(ptr!=NULL) { PK11_ReferenceSymKey(ptr);} }
 
 #endif
@@ -23,12 +23,22 @@
 
 /* a struct_desc describes a structure for the struct I/O routines.
  * This requires arrays of field_desc values to describe struct fields.
+ * in and out, when present, are fields compiled by packet_codec.pl;
+ * otherwise in_struct() and out_struct() interpret fields.
  */
 
+struct packet_byte_stream;
+
 typedef const struct struct_desc {
     const char *name;
     const struct field_desc *fields;
     size_t size;
+    bool (*in)(void *struct_ptr, const struct struct_desc *sd
+	       , struct packet_byte_stream *ins
+	       , struct packet_byte_stream *obj_pbs);
+    bool (*out)(const void *struct_ptr, const struct struct_desc *sd
+		, struct packet_byte_stream *outs
+		, struct packet_byte_stream *obj_pbs);
 } struct_desc;
 
 /* Note: if an ft_af_enum field has the ISAKMP_ATTR_AF_TV bit set,
@@ -105,6 +115,12 @@ extern bool in_raw(void *bytes, size_t len, pb_stream *ins, const char *name);
 
 extern bool out_struct(const void *struct_ptr, struct_desc *sd,
     pb_stream *outs, pb_stream *obj_pbs);
+
+/* in_struct() and out_struct() without the compiled sd->in and sd->out */
+extern bool in_struct_interp(void *struct_ptr, struct_desc *sd,
+    pb_stream *ins, pb_stream *obj_pbs);
+extern bool out_struct_interp(const void *struct_ptr, struct_desc *sd,
+    pb_stream *outs, pb_stream *obj_pbs);
 extern void pbs_set_np(pb_stream *outs, u_int8_t np);
 extern void pbs_copy_np(pb_stream *from, pb_stream *to);
 
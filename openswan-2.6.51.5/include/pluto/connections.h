@@ -125,9 +125,13 @@ extern void fmt_policy_prio(policy_prio_t pp, char buf[POLICY_PRIO_BUF]);
 #include "certs.h"
 #include "pluto/defs.h"
 #include "pluto/log.h"
+#include <sysqueue.h>
 
 struct virtual_t;
 
+/* the states using one connection; see state.c */
+LIST_HEAD(state_list, state);
+
 #ifdef XAUTH_USEPAM
 #include <security/pam_appl.h>
 #endif
@@ -222,6 +226,10 @@ struct connection {
     time_t          dpd_timeout;            /* time after which we are dead */
     enum dpd_action dpd_action;             /* what to do when we die */
 
+    /* per-peer admission control, packets/s; 0: the global limit */
+    u_int32_t       ratelimit_new;          /* that start an SA */
+    u_int32_t       ratelimit_existing;     /* for an SA we have */
+
     /*Cisco interop: remote peer type*/
     enum keyword_remotepeertype remotepeertype;
 
@@ -261,6 +269,7 @@ struct connection {
     so_serial_t	prospective_parent_sa;  /* state we are still negotiating */
     so_serial_t newest_isakmp_sa;       /* state that is negotiated/up */
     so_serial_t newest_ipsec_sa;        /* child SA state (should be array!) */
+    struct state_list states;           /* hashed states with st_connection == this */
 
     lset_t extra_debugging;
 
@@ -281,6 +290,15 @@ struct connection {
     struct connection *IDhp_next;	/* host pair list link */
 
     struct connection *ac_next;	/* all connections list link */
+    struct connection **ac_prevp;	/* ... and what points at us */
+    struct connection *name_next;	/* con_by_name() hash chain */
+
+    /* digests of the whack message from ipsec.conf that defined us;
+     * zero if we were not loaded by a whack batch (see reload_connection())
+     */
+    u_int64_t config_digest;		/* of the whole message */
+    u_int64_t config_sa_digest;		/* without what live SAs can ignore */
+    unsigned long config_generation;	/* last reload that mentioned us */
 
     generalName_t *requested_ca;	/* collected certificate requests */
 #ifdef XAUTH_USEPAM
@@ -326,7 +344,7 @@ extern size_t format_end(char *buf, size_t buf_len
     , bool is_left, lset_t policy);
 
 struct whack_message;	/* forward declaration of tag whack_msg */
-extern void add_connection(const struct whack_message *wm);
+extern bool add_connection(const struct whack_message *wm);
 extern void initiate_connection(const char *name
 				, int whackfd
 				, lset_t moredebug
@@ -360,6 +378,33 @@ extern struct connection *route_owner(struct connection *c
 extern struct connection *shunt_owner(const ip_subnet *ours
     , const ip_subnet *his);
 
+/* reloading ipsec.conf without disturbing connections that did not change */
+enum reload_change {
+    RELOAD_SAME,	/* nothing changed */
+    RELOAD_UPDATED,	/* only timers changed: updated in place */
+    RELOAD_REPLACED,	/* deleted and added again */
+    RELOAD_ADDED,
+    RELOAD_FAILED,
+    RELOAD_ROOF
+};
+
+extern void reload_begin(void);
+extern enum reload_change reload_connection(const struct whack_message *wm
+					    , u_int64_t digest
+					    , u_int64_t sa_digest);
+extern void note_config_connection(const char *name
+				   , u_int64_t digest
+				   , u_int64_t sa_digest);
+extern unsigned int reload_end(void);
+
+/* changes whenever a connection's rate limits may have (see ratelimit.c) */
+extern unsigned long connection_ratelimit_generation;
+
+/* routed connection indexes: call when c is routed or its clients change */
+extern void route_index_update(struct connection *c);
+extern void route_index_remove(struct connection *c);
+extern void show_route_index_status(void);
+
 extern bool uniqueIDs;	/* --uniqueids? */
 extern void ISAKMP_SA_established(struct connection *c, so_serial_t serial);
 
@@ -21,8 +21,24 @@
 
 struct state;	/* forward declaration of tag */
 extern void init_demux(void);
+
+/* FALSE if the packet could not be sent or, with HAVE_SENDMMSG, queued.
+ * A queued packet that the kernel refuses is logged when the queue is
+ * flushed, and left to retransmission.
+ */
 extern bool send_packet(struct state *st, const char *where, bool verbose);
-extern void comm_handle(const struct iface_port *ifp);
+extern int comm_handle(struct iface_port *ifp);
+extern void show_comm_status(void);
+
+/* comm_handle reads up to COMM_RECV_BATCH datagrams per call (one
+ * without HAVE_RECVMMSG).  Each lands in an MD_SLAB_SIZE slab, and is
+ * copied into a buffer of its own size for the msg_digest, so a
+ * msg_digest waiting on a crypto helper does not pin a slab.  The
+ * slabs are kept for the next read.
+ */
+#define COMM_RECV_BATCH		16
+#define MD_SLAB_SIZE		MAX_INPUT_UDP_SIZE
+#define MD_SLAB_POOL_MAX	COMM_RECV_BATCH
 
 extern pb_stream reply_stream;
 extern u_int8_t reply_buffer[MAX_OUTPUT_UDP_SIZE];
@@ -90,6 +106,8 @@ struct msg_digest {
 
 extern struct msg_digest *alloc_md(void);
 extern void release_md(struct msg_digest *md);
+extern u_int8_t *alloc_md_slab(void);
+extern void release_md_slab(u_int8_t *slab);
 
 typedef stf_status state_transition_fn(struct msg_digest *md);
 
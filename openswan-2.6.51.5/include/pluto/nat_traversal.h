@@ -105,8 +105,10 @@ bool nat_traversal_add_natoa(u_int8_t np, pb_stream *outs,
 /**
  * NAT-keep_alive
  */
-void nat_traversal_new_ka_event (void);
+void nat_traversal_ka_track (struct state *st);
 void nat_traversal_ka_event (void);
+void free_nat_traversal_ka (void);
+void show_nat_traversal_ka_status (void);
 
 void nat_traversal_show_result (u_int32_t nt, u_int16_t sport);
 
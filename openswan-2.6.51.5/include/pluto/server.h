@@ -53,6 +53,8 @@ struct iface_dev {
     char *id_rname;	/* real device name */
 };
 
+struct send_queue;	/* private to server.c */
+
 struct iface_port {
     struct iface_dev   *ip_dev;
     char                addrname[ADDRTOT_BUF];
@@ -63,6 +65,8 @@ struct iface_port {
     struct iface_port *next;
     bool ike_float;
     enum { IFN_ADD, IFN_KEEP, IFN_DELETE } change;
+    u_int32_t rx_dropped;	/* last SO_RXQ_OVFL count seen on fd */
+    struct send_queue *sendq;	/* packets waiting for sendmmsg(2) */
 };
 
 extern struct iface_port  *interfaces;	 /* public interfaces */
@@ -73,6 +77,8 @@ extern void show_ifaces_status(void);
 extern void free_ifaces(void);
 extern void show_debug_status(void);
 extern void call_server(void);
+extern void flush_send_queues(void);
+extern void show_send_queue_status(void);
 extern void init_iface_port(struct iface_port *q);
 
 /* in rcv_info.c */
@@ -38,7 +38,7 @@
 
 #define WHACK_BASIC_MAGIC (((((('w' << 8) + 'h') << 8) + 'k') << 8) + 25)
 
-#define WHACK_MAGIC_BASE (u_int32_t)(((((('o' << 8) + 'h') << 8) + 'k') << 8) + 39UL)
+#define WHACK_MAGIC_BASE (u_int32_t)(((((('o' << 8) + 'h') << 8) + 'k') << 8) + 40UL)
 
 /* mark top-bit with size of int,
  * so that mis-matches in integer size are easier to diagnose */
@@ -48,6 +48,24 @@
 
 #define WHACK_MAGIC (u_int32_t)((WHACK_MAGIC_BASE) | WHACK_MAGIC_INTVALUE)
 
+/* A batch carries many messages over one whack connection, for loading
+ * a large ipsec.conf.  It is a struct whack_batch, followed by count
+ * records, each a u_int32_t length and then a whack_message packed by
+ * pack_whack_msg().  Pluto answers the whole batch with one summary.
+ * The magic must not equal any WHACK_MAGIC or WHACK_BASIC_MAGIC.
+ */
+#define WHACK_BATCH_MAGIC (u_int32_t)((((((('w' << 8) + 'h') << 8) + 'b') << 8) + 1) | WHACK_MAGIC_INTVALUE)
+
+struct whack_batch {
+    u_int32_t magic;
+    u_int32_t count;
+    u_int32_t flags;
+};
+
+/* the batch is all of ipsec.conf: only change the connections that differ,
+ * and delete those it no longer has (see reload_connection()) */
+#define WHACK_BATCH_RELOAD	0x1
+
 
 /* struct whack_end is a lot like connection.h's struct end
  * It differs because it is going to be shipped down a socket
@@ -157,6 +175,10 @@ struct whack_message {
     /* Force the MTU for this connection */
     u_int32_t connmtu;
 
+    /* IKE packets/s admitted from each peer; 0: pluto's global limit */
+    u_int32_t ratelimit_new;		/* that start an SA */
+    u_int32_t ratelimit_existing;	/* for an SA we have */
+
     bool loopback;
     bool labeled_ipsec;
     char *policy_label;
@@ -334,7 +356,7 @@ extern size_t whack_get_secret(char *buf, size_t bufsize);
 extern int whack_get_value(char *buf, size_t bufsize);
 
 extern bool osw_alias_cmp(const char *needle, const char *haystack);
-extern void whack_process(int whackfd, struct whack_message msg);
+extern bool whack_process(int whackfd, struct whack_message msg);
 
 #endif /* _WHACK_H */
 
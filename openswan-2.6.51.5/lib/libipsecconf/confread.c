@@ -33,11 +33,16 @@
 #include <limits.h>
 #include <assert.h>
 #include <sys/queue.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "oswalloc.h"
 #include "libopenswan.h"
 #include "secrets.h"
 #include "oswkeys.h"
+#include "whack.h"
 
 #include "ipsecconf/parser.h"
 #include "ipsecconf/files.h"
@@ -1392,22 +1397,25 @@ struct starter_conn *alloc_add_conn(struct starter_config *cfg, char *name, err_
     return conn;
 }
 
-int init_load_conn(struct starter_config *cfg
-		   , struct config_parsed *cfgp
-		   , struct section_list *sconn
-		   , bool alsoprocessing
-		   , bool defaultconn
-		   , bool resolvip
-		   , err_t *perr)
+/* load one conn section; *pconn is set to the conn, even if it failed */
+static int load_section_conn(struct starter_config *cfg
+			     , struct config_parsed *cfgp
+			     , struct section_list *sconn
+			     , bool defaultconn
+			     , bool resolvip
+			     , err_t *perr
+			     , struct starter_conn **pconn)
 {
     int connerr;
     struct starter_conn *conn;
     starter_log(LOG_LEVEL_DEBUG, "Loading conn %s", sconn->name);
 
+    *pconn = NULL;
     conn = alloc_add_conn(cfg, sconn->name, perr);
     if(conn == NULL) {
 	return -1;
     }
+    *pconn = conn;
 
     connerr = load_conn (cfg, conn, cfgp, sconn, TRUE,
 			 defaultconn, resolvip, perr);
@@ -1423,17 +1431,35 @@ int init_load_conn(struct starter_config *cfg
     return connerr;
 }
 
+int init_load_conn(struct starter_config *cfg
+		   , struct config_parsed *cfgp
+		   , struct section_list *sconn
+		   , bool alsoprocessing
+		   , bool defaultconn
+		   , bool resolvip
+		   , err_t *perr)
+{
+    struct starter_conn *conn;
 
-struct starter_config *confread_load(const char *file
-				     , err_t *perr
-				     , bool resolvip
-				     , char *ctlbase
-				     , bool setuponly)
+    return load_section_conn(cfg, cfgp, sconn, defaultconn, resolvip
+			     , perr, &conn);
+}
+
+/*
+ * parse file, and load its config setup and %default conns.
+ * The parsed file is left in *pcfgp for loading the other conns.
+ */
+static struct starter_config *confread_load_setup(const char *file
+						  , err_t *perr
+						  , bool resolvip
+						  , char *ctlbase
+						  , bool setuponly
+						  , struct config_parsed **pcfgp)
 {
 	struct starter_config *cfg = NULL;
 	struct config_parsed *cfgp;
 	struct section_list *sconn;
-	unsigned int err = 0, connerr;
+	unsigned int err = 0;
 
 	/**
 	 * Load file
@@ -1493,7 +1519,27 @@ struct starter_config *confread_load(const char *file
 			}
 		}
 	   }
+	}
+
+	*pcfgp = cfgp;
+	return cfg;
+}
+
+struct starter_config *confread_load(const char *file
+				     , err_t *perr
+				     , bool resolvip
+				     , char *ctlbase
+				     , bool setuponly)
+{
+	struct starter_config *cfg = NULL;
+	struct config_parsed *cfgp;
+	struct section_list *sconn;
+	unsigned int err = 0, connerr;
 
+	cfg = confread_load_setup(file, perr, resolvip, ctlbase, setuponly, &cfgp);
+	if (cfg == NULL) return NULL;
+
+	if(!setuponly) {
 	   /**
 	    * Load other conns
 	    */
@@ -1525,6 +1571,268 @@ struct starter_config *confread_load(const char *file
 	return cfg;
 }
 
+/* fewest conn sections worth handing to a worker process */
+#define CONFREAD_MIN_RUN	64
+
+/* load the conn sections first..last-1 and apply operation to each */
+static int confread_load_run(struct starter_config *cfg
+			     , struct config_parsed *cfgp
+			     , struct section_list **secs
+			     , unsigned int first, unsigned int last
+			     , bool resolvip
+			     , int (*operation)(struct starter_config *cfg
+						, struct starter_conn *conn)
+			     , err_t *perr)
+{
+	struct starter_conn *conn;
+	unsigned int i;
+	int err = 0, connerr;
+
+	for(i = first; i < last; i++) {
+		connerr = load_section_conn(cfg, cfgp, secs[i], FALSE,
+					    resolvip, perr, &conn);
+		if(connerr == -1) {
+			return -1;
+		}
+		err += connerr;
+		(*operation)(cfg, conn);
+	}
+	return err;
+}
+
+static bool confread_write_all(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while(len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static bool confread_read_all(int fd, void *buf, size_t len)
+{
+	unsigned char *p = buf;
+
+	while(len > 0) {
+		ssize_t n = read(fd, p, len);
+
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/*
+ * a worker loads its run of conn sections, and sends back what its
+ * batch gathered: the number of messages, the error count, the length
+ * of the packed messages, and then the messages themselves.
+ */
+static void confread_run_worker(int fd
+				, struct starter_config *cfg
+				, struct config_parsed *cfgp
+				, struct section_list **secs
+				, unsigned int first, unsigned int last
+				, bool resolvip
+				, int (*operation)(struct starter_config *cfg
+						   , struct starter_conn *conn)
+				, err_t *perr)
+{
+	struct starter_whack_batch *b = cfg->whack_batch;
+	u_int32_t hdr[3];
+	int err;
+
+	err = confread_load_run(cfg, cfgp, secs, first, last, resolvip,
+				operation, perr);
+
+	hdr[0] = b->count;
+	hdr[1] = err;
+	hdr[2] = b->len - sizeof(struct whack_batch);
+	fflush(stdout);
+	if(err == -1
+	   || !confread_write_all(fd, hdr, sizeof(hdr))
+	   || !confread_write_all(fd, b->buf + sizeof(struct whack_batch), hdr[2])) {
+		_exit(1);
+	}
+	_exit(0);
+}
+
+/* collect what a worker sent back into cfg's batch */
+static int confread_run_collect(struct starter_config *cfg, int fd, pid_t pid)
+{
+	u_int32_t hdr[3];
+	unsigned char *recs;
+	int status = 0;
+	int err = -1;
+
+	if(confread_read_all(fd, hdr, sizeof(hdr))) {
+		recs = alloc_bytes(hdr[2] + 1, "worker whack batch");
+		if(confread_read_all(fd, recs, hdr[2])) {
+			starter_whack_batch_append(cfg, recs, hdr[2], hdr[0]);
+			err = hdr[1];
+		}
+		pfree(recs);
+	}
+	close(fd);
+
+	while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	if(err != -1 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+		err = -1;
+	}
+	return err;
+}
+
+/*
+ * confread_load_batch - load file, and apply operation to each conn as
+ * soon as it has been loaded.  Messages that operation sends to pluto
+ * are packed into a batch, for starter_whack_batch_send().
+ *
+ * With workers > 1 the conn sections are split into that many runs of
+ * consecutive sections, and each run is loaded by a child process that
+ * sends its part of the batch back.  The batch is in ipsec.conf order
+ * either way, but conns that a worker loaded are not on cfg->conns.
+ */
+struct starter_config *confread_load_batch(const char *file
+					   , err_t *perr
+					   , bool resolvip
+					   , char *ctlbase
+					   , int workers
+					   , int (*operation)(struct starter_config *cfg
+							      , struct starter_conn *conn))
+{
+	struct starter_config *cfg = NULL;
+	struct config_parsed *cfgp;
+	struct section_list *sconn;
+	struct section_list **secs;
+	struct starter_conn *conn, *last;
+	unsigned int nsecs, runs, run;
+	pid_t *pids;
+	int *fds;
+	int err = 0;
+
+	cfg = confread_load_setup(file, perr, resolvip, ctlbase, FALSE, &cfgp);
+	if (cfg == NULL) return NULL;
+
+	starter_whack_batch_begin(cfg);
+
+	nsecs = 0;
+	for(sconn = cfgp->sections.tqh_first; sconn != NULL; sconn = sconn->link.tqe_next)
+		nsecs++;
+	secs = alloc_bytes((nsecs + 1) * sizeof(*secs), "conn sections");
+	nsecs = 0;
+	for(sconn = cfgp->sections.tqh_first; sconn != NULL; sconn = sconn->link.tqe_next)
+	{
+		if (strcmp(sconn->name,"%default")==0) continue;
+		if (strcmp(sconn->name,"%oedefault")==0) continue;
+		secs[nsecs++] = sconn;
+	}
+
+	runs = workers > 1 ? workers : 1;
+	if(runs > nsecs / CONFREAD_MIN_RUN) {
+		runs = nsecs / CONFREAD_MIN_RUN;
+	}
+	if(runs < 1) {
+		runs = 1;
+	}
+
+	pids = alloc_bytes(runs * sizeof(*pids), "conn workers");
+	fds  = alloc_bytes(runs * sizeof(*fds), "conn workers");
+
+	/* the first run is loaded here, while the workers do the rest */
+	for(run = 1; run < runs; run++)
+	{
+		unsigned int first = (unsigned long)nsecs * run / runs;
+		unsigned int end = (unsigned long)nsecs * (run + 1) / runs;
+		int pfd[2];
+
+		pids[run] = -1;
+		if(pipe(pfd) < 0) {
+			starter_log(LOG_LEVEL_ERR, "pipe() failed: %s", strerror(errno));
+			continue;
+		}
+		fflush(stdout);
+		fflush(stderr);
+		pids[run] = fork();
+		if(pids[run] == 0) {
+			close(pfd[0]);
+			confread_run_worker(pfd[1], cfg, cfgp, secs, first, end,
+					    resolvip, operation, perr);
+		}
+		close(pfd[1]);
+		if(pids[run] < 0) {
+			starter_log(LOG_LEVEL_ERR, "fork() failed: %s", strerror(errno));
+			close(pfd[0]);
+			continue;
+		}
+		fds[run] = pfd[0];
+	}
+
+	for(run = 0; err != -1 && run < runs; run++)
+	{
+		unsigned int first = (unsigned long)nsecs * run / runs;
+		unsigned int end = (unsigned long)nsecs * (run + 1) / runs;
+		int connerr;
+
+		if(run == 0 || pids[run] < 0) {
+			/* no worker for this run: load it here, in its turn */
+			connerr = confread_load_run(cfg, cfgp, secs, first, end,
+						    resolvip, operation, perr);
+		} else {
+			connerr = confread_run_collect(cfg, fds[run], pids[run]);
+			pids[run] = -1;
+			if(connerr == -1) {
+				*perr = "conn loading worker failed";
+			}
+		}
+		err = connerr == -1 ? -1 : err + connerr;
+	}
+
+	/* reap any workers left behind by a failure */
+	for(run = 1; run < runs; run++)
+	{
+		if(pids[run] > 0) {
+			close(fds[run]);
+			waitpid(pids[run], NULL, 0);
+		}
+	}
+	pfree(fds);
+	pfree(pids);
+	pfree(secs);
+
+	if(err == -1) {
+		parser_free_conf(cfgp);
+		confread_free(cfg);
+		return NULL;
+	}
+
+	/* if we have OE on, then create any missing OE conns! */
+	if(cfg->setup.options[KBF_OPPOENCRYPT]) {
+		last = NULL;
+		for(conn = cfg->conns.tqh_first; conn != NULL; conn = conn->link.tqe_next)
+			last = conn;
+
+		starter_log(LOG_LEVEL_DEBUG, "Enabling OE conns\n");
+		add_any_oeconns(cfg, cfgp);
+
+		for(conn = last ? last->link.tqe_next : cfg->conns.tqh_first;
+		    conn != NULL;
+		    conn = conn->link.tqe_next)
+			(*operation)(cfg, conn);
+	}
+
+	parser_free_conf(cfgp);
+
+	return cfg;
+}
+
 static void confread_free_conn(struct starter_conn *conn)
 {
     int i;
@@ -1583,6 +1891,7 @@ void confread_free(struct starter_config *cfg)
         confread_free_conn(c);
         pfree(c);
     }
+    starter_whack_batch_free(cfg);
     pfree(cfg);
 }
 
@@ -442,6 +442,10 @@ struct keyword_def ipsec_conf_keywords_v2[]={
 
     {"mtu",            kv_conn|kv_auto,kt_number, KBF_CONNMTU, NOT_ENUM},
 
+    /* per-peer admission control */
+    {"ratelimit-new",      kv_conn|kv_auto,kt_number, KBF_RATELIMIT_NEW, NOT_ENUM},
+    {"ratelimit-existing", kv_conn|kv_auto,kt_number, KBF_RATELIMIT_EXISTING, NOT_ENUM},
+
     /* aggr/xauth/modeconfig */
     {"aggrmode",    kv_conn|kv_auto, kt_invertbool,      KBF_AGGRMODE,NOT_ENUM},
     {"aggressive",  kv_conn|kv_auto, kt_invertbool,      KBF_AGGRMODE,NOT_ENUM},
@@ -220,20 +220,18 @@ static int send_whack_msg(struct starter_config *cfg, struct whack_message *msg)
   }
 }
 
-static int send_whack_msg_to_socket(struct starter_config *cfg, struct whack_message *msg)
+/* send len bytes at buf to pluto, and pass on its reply */
+static int send_to_pluto(struct starter_config *cfg, const void *buf, size_t len)
 {
 	struct sockaddr_un ctl_addr =
 	    { .sun_family = AF_UNIX };
+	const unsigned char *p = buf;
 	int sock;
-	ssize_t len;
 	int ret;
 
 	/* copy socket location */
 	strncpy(ctl_addr.sun_path, cfg->ctlbase, sizeof(ctl_addr.sun_path));
 
-        len = serialize_whack_msg(msg);
-        if(len == -1) return -1;   /* already logged error */
-
 	/**
 	 * Connect to pluto ctl
 	 */
@@ -251,13 +249,21 @@ static int send_whack_msg_to_socket(struct starter_config *cfg, struct whack_mes
 	}
 
 	/**
-	 * Send message
+	 * Send message; a batch may take more than one write
 	 */
-	if (write(sock, msg, len) != len) {
-		starter_log(LOG_LEVEL_ERR, "write(pluto_ctl) failed: %s",
-			strerror(errno));
-		close(sock);
-		return -1;
+	while (len > 0) {
+		ssize_t n = write(sock, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			starter_log(LOG_LEVEL_ERR, "write(pluto_ctl) failed: %s",
+				strerror(errno));
+			close(sock);
+			return -1;
+		}
+		p += n;
+		len -= n;
 	}
 
 	/**
@@ -274,6 +280,116 @@ static int send_whack_msg_to_socket(struct starter_config *cfg, struct whack_mes
 	return ret;
 }
 
+static int send_whack_msg_to_socket(struct starter_config *cfg, struct whack_message *msg)
+{
+	ssize_t len;
+
+        len = serialize_whack_msg(msg);
+        if(len == -1) return -1;   /* already logged error */
+
+	return send_to_pluto(cfg, msg, len);
+}
+
+/* make room for len more bytes in the batch */
+static void batch_reserve(struct starter_whack_batch *b, size_t len)
+{
+	unsigned char *nb;
+	size_t size;
+
+	if (b->len + len <= b->size)
+		return;
+
+	size = b->size * 2;
+	if (size < b->len + len)
+		size = b->len + len;
+	nb = alloc_bytes(size, "whack batch");
+	memcpy(nb, b->buf, b->len);
+	pfree(b->buf);
+	b->buf = nb;
+	b->size = size;
+}
+
+static int send_whack_msg_to_batch(struct starter_config *cfg, struct whack_message *msg)
+{
+	struct starter_whack_batch *b = cfg->whack_batch;
+	u_int32_t len;
+	int n;
+
+	n = serialize_whack_msg(msg);
+	if (n == -1) return -1;   /* already logged error */
+
+	len = n;
+	batch_reserve(b, sizeof(len) + len);
+	memcpy(b->buf + b->len, &len, sizeof(len));
+	memcpy(b->buf + b->len + sizeof(len), msg, len);
+	b->len += sizeof(len) + len;
+	b->count++;
+	return 0;
+}
+
+void starter_whack_batch_begin(struct starter_config *cfg)
+{
+	struct starter_whack_batch *b;
+
+	if (cfg->whack_batch != NULL)
+		return;
+
+	b = alloc_thing(struct starter_whack_batch, "whack batch");
+	b->size = 64 * 1024;
+	b->buf = alloc_bytes(b->size, "whack batch");
+	b->len = sizeof(struct whack_batch);	/* filled in when sent */
+	b->send_whack_msg = cfg->send_whack_msg;
+	cfg->whack_batch = b;
+	cfg->send_whack_msg = send_whack_msg_to_batch;
+}
+
+/* add count records, already packed by another batch */
+void starter_whack_batch_append(struct starter_config *cfg
+				, const unsigned char *recs, size_t len
+				, unsigned int count)
+{
+	struct starter_whack_batch *b = cfg->whack_batch;
+
+	batch_reserve(b, len);
+	memcpy(b->buf + b->len, recs, len);
+	b->len += len;
+	b->count += count;
+}
+
+void starter_whack_batch_free(struct starter_config *cfg)
+{
+	struct starter_whack_batch *b = cfg->whack_batch;
+
+	if (b == NULL)
+		return;
+	cfg->send_whack_msg = b->send_whack_msg;
+	cfg->whack_batch = NULL;
+	pfree(b->buf);
+	pfree(b);
+}
+
+/* send everything batched, in one request; pluto replies once for all */
+int starter_whack_batch_send(struct starter_config *cfg)
+{
+	struct starter_whack_batch *b = cfg->whack_batch;
+	struct whack_batch wb;
+	int ret = 0;
+
+	if (b == NULL)
+		return 0;
+
+	/* an empty reload still removes everything it loaded before */
+	if (b->count > 0 || (b->flags & WHACK_BATCH_RELOAD)) {
+		wb.magic = WHACK_BATCH_MAGIC;
+		wb.count = b->count;
+		wb.flags = b->flags;
+		memcpy(b->buf, &wb, sizeof(wb));
+		ret = send_to_pluto(cfg, b->buf, b->len);
+	}
+	starter_whack_batch_free(cfg);
+	return ret;
+}
+
 void init_whack_msg (struct whack_message *msg)
 {
 	memset(msg, 0, sizeof(struct whack_message));
@@ -591,6 +707,13 @@ int starter_whack_build_basic_conn(struct starter_config *cfg
 		msg->connmtu   = conn->options[KBF_CONNMTU];
 	}
 
+	if(conn->options_set[KBF_RATELIMIT_NEW]) {
+		msg->ratelimit_new = conn->options[KBF_RATELIMIT_NEW];
+	}
+	if(conn->options_set[KBF_RATELIMIT_EXISTING]) {
+		msg->ratelimit_existing = conn->options[KBF_RATELIMIT_EXISTING];
+	}
+
 	if(conn->options_set[KBF_DPDDELAY] &&
 	   conn->options_set[KBF_DPDTIMEOUT]) {
 		msg->dpd_delay   = conn->options[KBF_DPDDELAY];
@@ -196,6 +196,26 @@ report_leaks(void)
 
 #endif /* !LEAK_DETECTIVE */
 
+/*
+ * add up the live allocations, so that a test can tell how much
+ * memory some set of objects costs.  Only allocations made while
+ * leak_detective was on are counted.
+ */
+void
+leak_detective_usage(unsigned long *items, unsigned long *bytes)
+{
+    union mhdr *p;
+
+    *items = 0;
+    *bytes = 0;
+    for (p = allocs; p != NULL; p = p->i.older)
+    {
+	passert(p->i.magic == LEAK_MAGIC);
+	(*items)++;
+	*bytes += p->i.size;
+    }
+}
+
 void *alloc_bytes2(size_t size, const char *name, int leak_detective)
 {
     void *p = alloc_bytes1(size, name, leak_detective);
@@ -782,9 +782,16 @@ static const char *const oakley_enc_name[] = {
 	"OAKLEY_AES_CBC",
     };
 
+/* has no IKEv1 code point: only the IKEv2 ENCR transform it maps to */
+static const char *const oakley_enc_name_aead[] = {
+	"OAKLEY_AES_GCM_C",
+};
+enum_names oakley_enc_names_aead =
+    { OAKLEY_AES_GCM_C, OAKLEY_AES_GCM_C, oakley_enc_name_aead, NULL };
+
 #ifdef NO_EXTRA_IKE
 enum_names oakley_enc_names =
-    { OAKLEY_DES_CBC, OAKLEY_AES_CBC, oakley_enc_name, NULL };
+    { OAKLEY_DES_CBC, OAKLEY_AES_CBC, oakley_enc_name, &oakley_enc_names_aead };
 #else
 static const char *const oakley_enc_name_draft_aes_cbc_02[] = {
 	"OAKLEY_MARS_CBC"	/*	65001	*/,
@@ -797,7 +804,7 @@ static const char *const oakley_enc_name_ssh[] = {
 	"OAKLEY_TWOFISH_CBC_SSH",
 };
 enum_names oakley_enc_names_ssh =
-    { 65289, 65289, oakley_enc_name_ssh, NULL };
+    { 65289, 65289, oakley_enc_name_ssh, &oakley_enc_names_aead };
 enum_names oakley_enc_names_draft_aes_cbc_02 =
     { 65001, 65005, oakley_enc_name_draft_aes_cbc_02, &oakley_enc_names_ssh };
 enum_names oakley_enc_names =
@@ -1211,9 +1218,16 @@ const char *const trans_type_encr_name[]={
     "null",
     "aes-cbc",
     "aes-ctr",
+    "aes-ccm-8",
+    "aes-ccm-12",
+    "aes-ccm-16",
+    "res17",
+    "aes-gcm-8",
+    "aes-gcm-12",
+    "aes-gcm-16",
 };
 enum_names trans_type_encr_names =
-{ IKEv2_ENCR_DES_IV64, IKEv2_ENCR_AES_CTR, trans_type_encr_name, NULL};
+{ IKEv2_ENCR_DES_IV64, IKEv2_ENCR_AES_GCM_16, trans_type_encr_name, NULL};
 
 /* Transform-type PRF */
 const char *const trans_type_prf_name[]={
@@ -29,6 +29,37 @@
 
 #include "packet.h"
 
+/* Each struct_desc below names its field list a second time, as
+ * PACKET_CODEC(fields): packet_codec.pl compiles that list into
+ * in_<fields>() and out_<fields>(), which in_struct() and out_struct()
+ * call instead of interpreting the list.  They share these helpers with
+ * the interpreter, so that both say the same things about bad packets.
+ */
+static err_t in_room_diag(struct_desc *sd, const pb_stream *ins);
+static err_t out_room_diag(struct_desc *sd);
+static err_t mbz_diag(struct_desc *sd, int byte);
+static void zig_log(struct_desc *sd, int byte);
+static err_t in_len_check(field_desc *fp, struct_desc *sd
+			  , const pb_stream *ins, u_int32_t len, u_int8_t **roof);
+static err_t enum_check(field_desc *fp, struct_desc *sd, u_int32_t n);
+static err_t set_check(field_desc *fp, struct_desc *sd, u_int32_t n);
+static bool in_struct_done(void *struct_ptr, struct_desc *sd
+			   , pb_stream *ins, pb_stream *obj_pbs
+			   , u_int8_t *cur, u_int8_t *roof);
+static bool in_struct_failed(err_t ugh);
+static bool out_struct_done(struct_desc *sd, pb_stream *outs
+			    , pb_stream *obj_pbs, pb_stream *obj, u_int8_t *cur);
+static bool out_struct_failed(err_t ugh);
+#ifdef DEBUG
+static void DBG_prefix_print_struct(const pb_stream *pbs
+				    , const char *label, const void *struct_ptr
+				    , struct_desc *sd, bool len_meaningful);
+#endif
+
+#include "packet_codec.c"
+
+#define PACKET_CODEC(fields) in_##fields, out_##fields
+
 /* ISAKMP Header: for all messages
  * layout from RFC 2408 "ISAKMP" section 3.1
  *                      1                   2                   3
@@ -60,7 +91,7 @@ static field_desc isa_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_hdr_desc = { "ISAKMP Message", isa_fields, sizeof(struct isakmp_hdr) };
+struct_desc isakmp_hdr_desc = { "ISAKMP Message", isa_fields, sizeof(struct isakmp_hdr), PACKET_CODEC(isa_fields) };
 
 /* Generic portion of all ISAKMP payloads.
  * layout from RFC 2408 "ISAKMP" section 3.2
@@ -80,7 +111,7 @@ static field_desc isag_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_generic_desc = { "ISAKMP Generic Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_generic_desc = { "ISAKMP Generic Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 
 /* ISAKMP Data Attribute (generic representation within payloads)
@@ -107,7 +138,7 @@ static field_desc isaat_fields_oakley[] = {
 
 struct_desc isakmp_oakley_attribute_desc = {
     "ISAKMP Oakley attribute",
-    isaat_fields_oakley, sizeof(struct isakmp_attribute) };
+    isaat_fields_oakley, sizeof(struct isakmp_attribute), PACKET_CODEC(isaat_fields_oakley) };
 
 /* IPsec DOI Attributes */
 static field_desc isaat_fields_ipsec[] = {
@@ -118,7 +149,7 @@ static field_desc isaat_fields_ipsec[] = {
 
 struct_desc isakmp_ipsec_attribute_desc = {
     "ISAKMP IPsec DOI attribute",
-    isaat_fields_ipsec, sizeof(struct isakmp_attribute) };
+    isaat_fields_ipsec, sizeof(struct isakmp_attribute), PACKET_CODEC(isaat_fields_ipsec) };
 
 /* XAUTH Attributes */
 static field_desc isaat_fields_xauth[] = {
@@ -129,7 +160,7 @@ static field_desc isaat_fields_xauth[] = {
 
 struct_desc isakmp_xauth_attribute_desc = {
     "ISAKMP ModeCfg attribute",
-    isaat_fields_xauth, sizeof(struct isakmp_attribute) };
+    isaat_fields_xauth, sizeof(struct isakmp_attribute), PACKET_CODEC(isaat_fields_xauth) };
 
 /* ISAKMP Security Association Payload
  * layout from RFC 2408 "ISAKMP" section 3.4
@@ -155,14 +186,14 @@ static field_desc isasa_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_sa_desc = { "ISAKMP Security Association Payload", isasa_fields, sizeof(struct isakmp_sa) };
+struct_desc isakmp_sa_desc = { "ISAKMP Security Association Payload", isasa_fields, sizeof(struct isakmp_sa), PACKET_CODEC(isasa_fields) };
 
 static field_desc ipsec_sit_field[] = {
     { ft_set, 32/BITS_PER_BYTE, "IPsec DOI SIT", &sit_bit_names },
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc ipsec_sit_desc = { "IPsec DOI SIT", ipsec_sit_field, sizeof(u_int32_t) };
+struct_desc ipsec_sit_desc = { "IPsec DOI SIT", ipsec_sit_field, sizeof(u_int32_t), PACKET_CODEC(ipsec_sit_field) };
 
 /* ISAKMP Proposal Payload
  * layout from RFC 2408 "ISAKMP" section 3.5
@@ -189,7 +220,7 @@ static field_desc isap_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc b = { "ISAKMP Proposal Payload", isap_fields, sizeof(struct isakmp_proposal) };
+struct_desc isakmp_proposal_desc = { "ISAKMP Proposal Payload", isap_fields, sizeof(struct isakmp_proposal), PACKET_CODEC(isap_fields) };
 
 /* ISAKMP Transform Payload
  * layout from RFC 2408 "ISAKMP" section 3.6
@@ -221,7 +252,7 @@ static field_desc isat_fields_isakmp[] = {
 
 struct_desc isakmp_isakmp_transform_desc = {
     "ISAKMP Transform Payload (ISAKMP)",
-    isat_fields_isakmp, sizeof(struct isakmp_transform) };
+    isat_fields_isakmp, sizeof(struct isakmp_transform), PACKET_CODEC(isat_fields_isakmp) };
 
 /* PROTO_IPSEC_AH */
 static field_desc isat_fields_ah[] = {
@@ -236,7 +267,7 @@ static field_desc isat_fields_ah[] = {
 
 struct_desc isakmp_ah_transform_desc = {
     "ISAKMP Transform Payload (AH)",
-    isat_fields_ah, sizeof(struct isakmp_transform) };
+    isat_fields_ah, sizeof(struct isakmp_transform), PACKET_CODEC(isat_fields_ah) };
 
 /* PROTO_IPSEC_ESP */
 static field_desc isat_fields_esp[] = {
@@ -251,7 +282,7 @@ static field_desc isat_fields_esp[] = {
 
 struct_desc isakmp_esp_transform_desc = {
     "ISAKMP Transform Payload (ESP)",
-    isat_fields_esp, sizeof(struct isakmp_transform) };
+    isat_fields_esp, sizeof(struct isakmp_transform), PACKET_CODEC(isat_fields_esp) };
 
 /* PROTO_IPCOMP */
 static field_desc isat_fields_ipcomp[] = {
@@ -266,7 +297,7 @@ static field_desc isat_fields_ipcomp[] = {
 
 struct_desc isakmp_ipcomp_transform_desc = {
     "ISAKMP Transform Payload (COMP)",
-    isat_fields_ipcomp, sizeof(struct isakmp_transform) };
+    isat_fields_ipcomp, sizeof(struct isakmp_transform), PACKET_CODEC(isat_fields_ipcomp) };
 
 
 /* ISAKMP Key Exchange Payload: no fixed fields beyond the generic ones.
@@ -283,7 +314,7 @@ struct_desc isakmp_ipcomp_transform_desc = {
  * !                                                               !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_keyex_desc = { "ISAKMP Key Exchange Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_keyex_desc = { "ISAKMP Key Exchange Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* ISAKMP Identification Payload
  * layout from RFC 2408 "ISAKMP" section 3.8
@@ -312,7 +343,7 @@ static field_desc isaid_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_identification_desc = { "ISAKMP Identification Payload", isaid_fields, sizeof(struct isakmp_id) };
+struct_desc isakmp_identification_desc = { "ISAKMP Identification Payload", isaid_fields, sizeof(struct isakmp_id), PACKET_CODEC(isaid_fields) };
 
 /* IPSEC Identification Payload Content
  * layout from RFC 2407 "IPsec DOI" section 4.6.2
@@ -339,7 +370,7 @@ static field_desc isaiid_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_ipsec_identification_desc = { "ISAKMP Identification Payload (IPsec DOI)", isaiid_fields, sizeof(struct isakmp_ipsec_id) };
+struct_desc isakmp_ipsec_identification_desc = { "ISAKMP Identification Payload (IPsec DOI)", isaiid_fields, sizeof(struct isakmp_ipsec_id), PACKET_CODEC(isaiid_fields) };
 
 /* ISAKMP Certificate Payload: oddball fixed field beyond the generic ones.
  * layout from RFC 2408 "ISAKMP" section 3.9
@@ -367,7 +398,7 @@ static field_desc isacert_fields[] = {
 /* Note: the size field of isakmp_ipsec_certificate_desc cannot be
  * sizeof(struct isakmp_cert) because that will rounded up for padding.
  */
- struct_desc isakmp_ipsec_certificate_desc = { "ISAKMP Certificate Payload", isacert_fields, ISAKMP_CERT_SIZE };
+ struct_desc isakmp_ipsec_certificate_desc = { "ISAKMP Certificate Payload", isacert_fields, ISAKMP_CERT_SIZE, PACKET_CODEC(isacert_fields) };
 /* ISAKMP Certificate Request Payload: oddball field beyond the generic ones.
  * layout from RFC 2408 "ISAKMP" section 3.10
  * Variable length Certificate Types and Certificate Authorities follow.
@@ -394,7 +425,7 @@ static field_desc isacr_fields[] = {
 /* Note: the size field of isakmp_ipsec_cert_req_desc cannot be
  * sizeof(struct isakmp_cr) because that will rounded up for padding.
  */
-struct_desc isakmp_ipsec_cert_req_desc = { "ISAKMP Certificate RequestPayload", isacr_fields, ISAKMP_CR_SIZE };
+struct_desc isakmp_ipsec_cert_req_desc = { "ISAKMP Certificate RequestPayload", isacr_fields, ISAKMP_CR_SIZE, PACKET_CODEC(isacr_fields) };
 
 /* ISAKMP Hash Payload: no fixed fields beyond the generic ones.
  * layout from RFC 2408 "ISAKMP" section 3.11
@@ -410,7 +441,7 @@ struct_desc isakmp_ipsec_cert_req_desc = { "ISAKMP Certificate RequestPayload",
  * !                                                               !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_hash_desc = { "ISAKMP Hash Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_hash_desc = { "ISAKMP Hash Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* ISAKMP Signature Payload: no fixed fields beyond the generic ones.
  * layout from RFC 2408 "ISAKMP" section 3.12
@@ -426,7 +457,7 @@ struct_desc isakmp_hash_desc = { "ISAKMP Hash Payload", isag_fields, sizeof(stru
  * !                                                               !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_signature_desc = { "ISAKMP Signature Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_signature_desc = { "ISAKMP Signature Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* ISAKMP Nonce Payload: no fixed fields beyond the generic ones.
  * layout from RFC 2408 "ISAKMP" section 3.13
@@ -442,7 +473,7 @@ struct_desc isakmp_signature_desc = { "ISAKMP Signature Payload", isag_fields, s
  * !                                                               !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_nonce_desc = { "ISAKMP Nonce Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_nonce_desc = { "ISAKMP Nonce Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* ISAKMP Notification Payload
  * layout from RFC 2408 "ISAKMP" section 3.14
@@ -478,7 +509,7 @@ static field_desc isan_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_notification_desc = { "ISAKMP Notification Payload", isan_fields, sizeof(struct isakmp_notification) };
+struct_desc isakmp_notification_desc = { "ISAKMP Notification Payload", isan_fields, sizeof(struct isakmp_notification), PACKET_CODEC(isan_fields) };
 
 /* ISAKMP Delete Payload
  * layout from RFC 2408 "ISAKMP" section 3.15
@@ -509,7 +540,7 @@ static field_desc isad_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_delete_desc = { "ISAKMP Delete Payload", isad_fields, sizeof(struct isakmp_delete) };
+struct_desc isakmp_delete_desc = { "ISAKMP Delete Payload", isad_fields, sizeof(struct isakmp_delete), PACKET_CODEC(isad_fields) };
 
 /* ISAKMP Vendor ID Payload
  * layout from RFC 2408 "ISAKMP" section 3.15
@@ -525,7 +556,7 @@ struct_desc isakmp_delete_desc = { "ISAKMP Delete Payload", isad_fields, sizeof(
  * !                                                               !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_vendor_id_desc = { "ISAKMP Vendor ID Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_vendor_id_desc = { "ISAKMP Vendor ID Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* MODECFG */
 /*
@@ -570,7 +601,7 @@ static field_desc isaattr_fields[] = {
      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 */
 
-struct_desc isakmp_attr_desc = { "ISAKMP Mode Attribute", isaattr_fields, sizeof(struct isakmp_mode_attr) };
+struct_desc isakmp_attr_desc = { "ISAKMP Mode Attribute", isaattr_fields, sizeof(struct isakmp_mode_attr), PACKET_CODEC(isaattr_fields) };
 
 /* ISAKMP NAT-Traversal NAT-D
  * layout from draft-ietf-ipsec-nat-t-ike-01.txt section 3.2
@@ -582,7 +613,7 @@ struct_desc isakmp_attr_desc = { "ISAKMP Mode Attribute", isaattr_fields, sizeof
  * !                 HASH of the address and port                  !
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
-struct_desc isakmp_nat_d = { "ISAKMP NAT-D Payload", isag_fields, sizeof(struct isakmp_generic) };
+struct_desc isakmp_nat_d = { "ISAKMP NAT-D Payload", isag_fields, sizeof(struct isakmp_generic), PACKET_CODEC(isag_fields) };
 
 /* ISAKMP NAT-Traversal NAT-OA
  * layout from draft-ietf-ipsec-nat-t-ike-01.txt section 4.2
@@ -605,7 +636,7 @@ static field_desc isanat_oa_fields[] = {
     { ft_end, 0, NULL, NULL }
 };
 
-struct_desc isakmp_nat_oa = { "ISAKMP NAT-OA Payload", isanat_oa_fields, sizeof(struct isakmp_nat_oa) };
+struct_desc isakmp_nat_oa = { "ISAKMP NAT-OA Payload", isanat_oa_fields, sizeof(struct isakmp_nat_oa), PACKET_CODEC(isanat_oa_fields) };
 
 /*
  * GENERIC IKEv2 header.
@@ -619,7 +650,7 @@ static field_desc ikev2generic_fields[] = {
 };
 struct_desc ikev2_generic_desc = { "IKEv2 Generic Payload",
 				   ikev2generic_fields,
-				   sizeof(struct ikev2_generic) };
+				   sizeof(struct ikev2_generic), PACKET_CODEC(ikev2generic_fields) };
 
 /*
  * IKEv2 - Security Association Payload
@@ -639,7 +670,7 @@ struct_desc ikev2_generic_desc = { "IKEv2 Generic Payload",
  *
  */
 struct_desc ikev2_sa_desc = { "IKEv2 Security Association Payload",
-			      ikev2generic_fields, sizeof(struct ikev2_sa) };
+			      ikev2generic_fields, sizeof(struct ikev2_sa), PACKET_CODEC(ikev2generic_fields) };
 
 
 /* IKEv2 - Proposal sub-structure
@@ -675,7 +706,7 @@ static field_desc ikev2prop_fields[] = {
 };
 
 struct_desc ikev2_prop_desc = { "IKEv2 Proposal Substructure Payload",
-			      ikev2prop_fields, sizeof(struct ikev2_prop) };
+			      ikev2prop_fields, sizeof(struct ikev2_prop), PACKET_CODEC(ikev2prop_fields) };
 
 
 /*
@@ -705,7 +736,7 @@ static field_desc ikev2trans_fields[] = {
 };
 
 struct_desc ikev2_trans_desc = { "IKEv2 Transform Substructure Payload",
-			      ikev2trans_fields, sizeof(struct ikev2_trans) };
+			      ikev2trans_fields, sizeof(struct ikev2_trans), PACKET_CODEC(ikev2trans_fields) };
 
 /*
  * 3.3.5.   [Transform] Attribute substructure
@@ -729,7 +760,7 @@ static field_desc ikev2_trans_attr_fields[] = {
 
 struct_desc ikev2_trans_attr_desc = {
     "IKEv2 Attribute Substructure Payload",
-    ikev2_trans_attr_fields, sizeof(struct ikev2_trans_attr) };
+    ikev2_trans_attr_fields, sizeof(struct ikev2_trans_attr), PACKET_CODEC(ikev2_trans_attr_fields) };
 
 /* 3.4.  Key Exchange Payload
  *
@@ -763,7 +794,7 @@ static field_desc ikev2ke_fields[] = {
 };
 
 struct_desc ikev2_ke_desc = { "IKEv2 Key Exchange Payload",
-			      ikev2ke_fields, sizeof(struct ikev2_ke) };
+			      ikev2ke_fields, sizeof(struct ikev2_ke), PACKET_CODEC(ikev2ke_fields) };
 
 /*
  * 3.5.  Identification Payloads
@@ -807,7 +838,7 @@ static field_desc ikev2id_fields[] = {
 };
 
 struct_desc ikev2_id_desc = { "IKEv2 Identification Payload",
-			      ikev2id_fields, sizeof(struct ikev2_id) };
+			      ikev2id_fields, sizeof(struct ikev2_id), PACKET_CODEC(ikev2id_fields) };
 
 /* section 3.6
  * The Certificate Payload is defined as follows:
@@ -833,7 +864,7 @@ static field_desc ikev2_cert_fields[] = {
   { ft_end,  0, NULL, NULL }
 };
 
-struct_desc ikev2_certificate_desc = { "IKEv2 Certificate Payload", ikev2_cert_fields, IKEV2_CERT_SIZE };
+struct_desc ikev2_certificate_desc = { "IKEv2 Certificate Payload", ikev2_cert_fields, IKEV2_CERT_SIZE, PACKET_CODEC(ikev2_cert_fields) };
 
 /* section 3.7
  *
@@ -861,7 +892,7 @@ static field_desc ikev2_cert_req_fields[] = {
   { ft_end,  0, NULL, NULL }
 };
 
-struct_desc ikev2_certificate_req_desc = { "IKEv2 Certificate Request Payload", ikev2_cert_fields, IKEV2_CERT_SIZE };
+struct_desc ikev2_certificate_req_desc = { "IKEv2 Certificate Request Payload", ikev2_cert_fields, IKEV2_CERT_SIZE, PACKET_CODEC(ikev2_cert_fields) };
 
 /*
  * 3.8.  Authentication Payload
@@ -892,7 +923,7 @@ static field_desc ikev2a_fields[] = {
 };
 
 struct_desc ikev2_a_desc = { "IKEv2 Authentication Payload",
-			     ikev2a_fields, sizeof(struct ikev2_a) };
+			     ikev2a_fields, sizeof(struct ikev2_a), PACKET_CODEC(ikev2a_fields) };
 
 
 /*
@@ -919,7 +950,7 @@ struct_desc ikev2_a_desc = { "IKEv2 Authentication Payload",
  */
 struct_desc ikev2_nonce_desc = { "IKEv2 Nonce Payload",
 				 ikev2generic_fields,
-				 sizeof(struct ikev2_generic) };
+				 sizeof(struct ikev2_generic), PACKET_CODEC(ikev2generic_fields) };
 
 
 /*    3.10 Notify Payload
@@ -979,11 +1010,11 @@ static field_desc ikev2_delete_fields[] = {
 };
 
 struct_desc ikev2_delete_desc = { "IKEv2 Delete Payload",
-                            ikev2_delete_fields, sizeof(struct ikev2_delete) };
+                            ikev2_delete_fields, sizeof(struct ikev2_delete), PACKET_CODEC(ikev2_delete_fields) };
 
 
 struct_desc ikev2_notify_desc = { "IKEv2 Notify Payload",
-			     ikev2_notify_fields, sizeof(struct ikev2_notify) };
+			     ikev2_notify_fields, sizeof(struct ikev2_notify), PACKET_CODEC(ikev2_notify_fields) };
 
 /*
  * 3.12.  Vendor ID Payload
@@ -1003,7 +1034,7 @@ struct_desc ikev2_notify_desc = { "IKEv2 Notify Payload",
  */
 struct_desc ikev2_vendor_id_desc = { "IKEv2 Vendor ID Payload",
 				     ikev2generic_fields,
-				     sizeof(struct ikev2_generic) };
+				     sizeof(struct ikev2_generic), PACKET_CODEC(ikev2generic_fields) };
 
 
 /*
@@ -1037,7 +1068,7 @@ static field_desc ikev2ts_fields[] = {
     { ft_end,  0, NULL, NULL }
 };
 struct_desc ikev2_ts_desc = { "IKEv2 Traffic Selector Payload",
-			     ikev2ts_fields, sizeof(struct ikev2_ts) };
+			     ikev2ts_fields, sizeof(struct ikev2_ts), PACKET_CODEC(ikev2ts_fields) };
 
 
 /*
@@ -1070,7 +1101,7 @@ static field_desc ikev2ts1_fields[] = {
     { ft_end,  0, NULL, NULL }
 };
 struct_desc ikev2_ts1_desc = { "IKEv2 Traffic Selector",
-			       ikev2ts1_fields, sizeof(struct ikev2_ts1) };
+			       ikev2ts1_fields, sizeof(struct ikev2_ts1), PACKET_CODEC(ikev2ts1_fields) };
 
 
 /*
@@ -1108,7 +1139,7 @@ static field_desc ikev2e_fields[] = {
 
 struct_desc ikev2_e_desc = { "IKEv2 Encryption Payload",
 			      ikev2e_fields,
-			     sizeof(struct ikev2_generic)};
+			     sizeof(struct ikev2_generic), PACKET_CODEC(ikev2e_fields)};
 
 
 
@@ -1333,6 +1364,109 @@ DBG_prefix_print_struct(const pb_stream *pbs
 
 #endif
 
+/* helpers of in_struct() and out_struct(): see PACKET_CODEC() */
+
+static err_t
+in_room_diag(struct_desc *sd, const pb_stream *ins)
+{
+    return builddiag("not enough room in input packet for %s"
+		     " (remain=%li, sd->size=%zu)"
+		     , sd->name, (long int)(ins->roof - ins->cur), sd->size);
+}
+
+static err_t
+out_room_diag(struct_desc *sd)
+{
+    return builddiag("not enough room left in output packet to place %s"
+		     , sd->name);
+}
+
+/* byte counts from 1 */
+static err_t
+mbz_diag(struct_desc *sd, int byte)
+{
+    return builddiag("byte %d of %s must be zero, but is not"
+		     , byte, sd->name);
+}
+
+static void
+zig_log(struct_desc *sd, int byte)
+{
+    openswan_log("byte %d of %s should have been zero, but was not"
+		 , byte, sd->name);
+    /*
+     * We cannot zeroize it, it would break our hash calculation
+     * *cur = '\0';
+     */
+}
+
+/* len is what an ft_len or ft_lv field says the struct and its
+ * variable part come to; on success, *roof is set to their end.
+ */
+static err_t
+in_len_check(field_desc *fp, struct_desc *sd
+	     , const pb_stream *ins, u_int32_t len, u_int8_t **roof)
+{
+    if (len < sd->size)
+	return builddiag("%s of %s is smaller than minimum"
+			 , fp->name, sd->name);
+    if (pbs_left(ins) < len)
+	return builddiag("%s of %s is larger than can fit"
+			 , fp->name, sd->name);
+    *roof = ins->cur + len;
+    return NULL;
+}
+
+static err_t
+enum_check(field_desc *fp, struct_desc *sd, u_int32_t n)
+{
+    if (enum_name(fp->desc, n) == NULL)
+	return builddiag("%s of %s has an unknown value: %lu"
+			 , fp->name, sd->name, (unsigned long)n);
+    return NULL;
+}
+
+static err_t
+set_check(field_desc *fp, struct_desc *sd, u_int32_t n)
+{
+    if (!testset(fp->desc, n))
+	return builddiag("bitset %s of %s has unknown member(s): %s"
+			 , fp->name, sd->name, bitnamesof(fp->desc, n));
+    return NULL;
+}
+
+/* the fixed part of the struct, ins->cur up to cur, has been parsed */
+static bool
+in_struct_done(void *struct_ptr, struct_desc *sd
+	       , pb_stream *ins, pb_stream *obj_pbs
+	       , u_int8_t *cur, u_int8_t *roof)
+{
+    if (obj_pbs != NULL)/*ò*/
+    {
+        /******************************************************************************
+        *ͨinit_pbs()obj_pbsָinsݵĿʼͽλã
+        *Ȼobj_pbscurָΪѾλ(ȷе˵Ѿɹֵһֽ)
+        *б䳤֣curָΪ䳤ֵһֽڣûпstruct_ptr
+        ******************************************************************************/
+        init_pbs(obj_pbs, ins->cur, roof - ins->cur, sd->name);
+        obj_pbs->container = ins;
+        obj_pbs->desc = sd;
+        obj_pbs->cur = cur;
+    }
+    ins->cur = roof;/*curָ뵽ݵsdṹ֮ڱ䳤غӦcurָλͬڵĻͬ*/
+    /*ע: 䳤غݲûмҲͨinsȡǿͨobj_pbsȡ䳤غɵݲ*/
+    DBG(DBG_PARSING
+        , DBG_prefix_print_struct(ins, "parse ", struct_ptr, sd, TRUE));
+    return TRUE;
+}
+
+static bool
+in_struct_failed(err_t ugh)
+{
+    openswan_loglog(RC_LOG_SERIOUS, "%s", ugh);
+    return FALSE;
+}
+
 /* "parse" a network struct into a host struct.
  *
  * This code assumes that the network and host structure
@@ -1355,7 +1489,7 @@ DBG_prefix_print_struct(const pb_stream *pbs
 *****************************************************/
 
 bool
-in_struct(void *struct_ptr, struct_desc *sd
+in_struct_interp(void *struct_ptr, struct_desc *sd
 , pb_stream *ins, pb_stream *obj_pbs)
 {
     err_t ugh = NULL;
@@ -1363,9 +1497,7 @@ in_struct(void *struct_ptr, struct_desc *sd
 	/*ȷдݴС㹻޷ɹΪsdĴС*/
     if (ins->roof - cur < (ptrdiff_t)sd->size)
     {
-        ugh = builddiag("not enough room in input packet for %s"
-                        " (remain=%li, sd->size=%zu)"
-                        , sd->name, (long int)(ins->roof - cur), sd->size);
+        ugh = in_room_diag(sd, ins);
 
     }
     else
@@ -1395,8 +1527,7 @@ in_struct(void *struct_ptr, struct_desc *sd
 		{
 		    if (*cur++ != 0)
 		    {
-			ugh = builddiag("byte %d of %s must be zero, but is not"
-			    , (int) (cur - ins->cur), sd->name);
+			ugh = mbz_diag(sd, (int) (cur - ins->cur));
 			break;
 		    }
 		    *outp++ = '\0';	/* probably redundant */
@@ -1407,8 +1538,7 @@ in_struct(void *struct_ptr, struct_desc *sd
 		{
 		    if (*cur++ != 0)
 		    {
-			openswan_log("byte %d of %s should have been zero, but was not"
-			    , (int) (cur - ins->cur), sd->name);
+			zig_log(sd, (int) (cur - ins->cur));
 			/*
 			 * We cannot zeroize it, it would break our hash calculation
 			 * *cur = '\0';
@@ -1444,20 +1574,7 @@ in_struct(void *struct_ptr, struct_desc *sd
 				    u_int32_t len = fp->field_type == ft_len? n
 					: immediate? sd->size : n + sd->size;
 
-				    if (len < sd->size)
-				    {
-					ugh = builddiag("%s of %s is smaller than minimum"
-					    , fp->name, sd->name);
-				    }
-				    else if (pbs_left(ins) < len)
-				    {
-					ugh = builddiag("%s of %s is larger than can fit"
-					    , fp->name, sd->name);
-				    }
-				    else
-				    {/*ǰغɵroof*/
-					roof = ins->cur + len;/*ݱʵʵĳȶλĩβ*/
-				    }
+				    ugh = in_len_check(fp, sd, ins, len, &roof);
 				    break;
 				}
 				case ft_af_loose_enum:	/* Attribute Format + value from an enumeration */
@@ -1470,20 +1587,12 @@ in_struct(void *struct_ptr, struct_desc *sd
 					immediate = TRUE;
 				    /* FALL THROUGH */
 				case ft_enum:	/* value from an enumeration */
-				    if (enum_name(fp->desc, n) == NULL)/*жϱö͵ֵǷϷ*/
-				    {
-					ugh = builddiag("%s of %s has an unknown value: %lu"
-					    , fp->name, sd->name, (unsigned long)n);
-				    }
+				    ugh = enum_check(fp, sd, n);/*жϱö͵ֵǷϷ*/
 				    /* FALL THROUGH */
 				case ft_loose_enum:	/* value from an enumeration with only some names known */
 				    break;
 				case ft_set:	/* bits representing set */
-				    if (!testset(fp->desc, n))/*жϱĳЩbit־λǷϷ*/
-				    {
-					ugh = builddiag("bitset %s of %s has unknown member(s): %s"
-					    , fp->name, sd->name, bitnamesof(fp->desc, n));
-				    }
+				    ugh = set_check(fp, sd, n);/*жϱĳЩbit־λǷϷ*/
 				    break;
 				default:
 					break;
@@ -1517,23 +1626,7 @@ in_struct(void *struct_ptr, struct_desc *sd
 
 	    case ft_end:	/* end of field list *//*ṹĩβ*/
 		passert(cur == ins->cur + sd->size);/*ĳǷȷ*/
-		if (obj_pbs != NULL)/*ò*/
-		{
-		    /******************************************************************************
-		    *ͨinit_pbs()obj_pbsָinsݵĿʼͽλã
-		    *Ȼobj_pbscurָΪѾλ(ȷе˵Ѿɹֵһֽ)
-		    *б䳤֣curָΪ䳤ֵһֽڣûпstruct_ptr
-		    ******************************************************************************/
-		    init_pbs(obj_pbs, ins->cur, roof - ins->cur, sd->name);
-		    obj_pbs->container = ins;
-		    obj_pbs->desc = sd;
-		    obj_pbs->cur = cur;
-		}
-		ins->cur = roof;/*curָ뵽ݵsdṹ֮ڱ䳤غӦcurָλͬڵĻͬ*/
-		/*ע: 䳤غݲûмҲͨinsȡǿͨobj_pbsȡ䳤غɵݲ*/
-		DBG(DBG_PARSING
-		    , DBG_prefix_print_struct(ins, "parse ", struct_ptr, sd, TRUE));
-		return TRUE;
+		return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur, roof);
 
 	    default:
 		bad_case(fp->field_type);
@@ -1542,8 +1635,16 @@ in_struct(void *struct_ptr, struct_desc *sd
     }
 
     /* some failure got us here: report it */
-    openswan_loglog(RC_LOG_SERIOUS, "%s", ugh);
-    return FALSE;
+    return in_struct_failed(ugh);
+}
+
+bool
+in_struct(void *struct_ptr, struct_desc *sd
+, pb_stream *ins, pb_stream *obj_pbs)
+{
+    if (sd->in != NULL)
+	return sd->in(struct_ptr, sd, ins, obj_pbs);
+    return in_struct_interp(struct_ptr, sd, ins, obj_pbs);
 }
 
 bool
@@ -1578,6 +1679,44 @@ in_raw(void *bytes, size_t len, pb_stream *ins, const char *name)
     }
 }
 
+/* the fixed part of the struct, outs->cur up to cur, has been emitted;
+ * obj has its lenfld, lenfld_desc and next_payload_pointer
+ */
+static bool
+out_struct_done(struct_desc *sd, pb_stream *outs
+		, pb_stream *obj_pbs, pb_stream *obj, u_int8_t *cur)
+{
+    obj->container = outs;
+    obj->desc = sd;
+    obj->name = sd->name;
+    obj->start = outs->cur;
+    obj->cur = cur;
+    obj->roof = outs->roof;	/* limit of possible */
+
+    if (obj_pbs == NULL)
+    {
+	close_output_pbs(obj); /* fill in length field, if any */
+    }
+    else
+    {
+	/* We set outs->cur to outs->roof so that
+	 * any attempt to output something into outs
+	 * before obj is closed will trigger an error.
+	 */
+	outs->cur = outs->roof;
+
+	*obj_pbs = *obj;
+    }
+    return TRUE;
+}
+
+static bool
+out_struct_failed(err_t ugh)
+{
+    loglog(RC_LOG_SERIOUS, "%s", ugh);	/* ??? serious, but errno not relevant */
+    return FALSE;
+}
+
 /* "emit" a host struct into a network packet.
  *
  * This code assumes that the network and host structure
@@ -1602,7 +1741,7 @@ in_raw(void *bytes, size_t len, pb_stream *ins, const char *name)
 Ȼoutscurõٲouts,ʹclose_output_pbs²
 ****************************************************************/
 bool
-out_struct(const void *struct_ptr, struct_desc *sd
+out_struct_interp(const void *struct_ptr, struct_desc *sd
 	   , pb_stream *outs, pb_stream *obj_pbs)
 {
     err_t ugh = NULL;
@@ -1614,8 +1753,7 @@ out_struct(const void *struct_ptr, struct_desc *sd
 
     if (outs->roof - cur < (ptrdiff_t)sd->size)
     {
-	ugh = builddiag("not enough room left in output packet to place %s"
-	    , sd->name);
+	ugh = out_room_diag(sd);
     }
     else
     {
@@ -1625,6 +1763,7 @@ out_struct(const void *struct_ptr, struct_desc *sd
 
 	obj.lenfld = NULL;  /* until a length field is discovered */
 	obj.lenfld_desc = NULL;
+	obj.next_payload_pointer = NULL;  /* unless there is an ft_np_in */
 
 	for (fp = sd->fields; ugh == NULL; fp++)
 	{
@@ -1712,20 +1851,12 @@ out_struct(const void *struct_ptr, struct_desc *sd
 			immediate = TRUE;
 		    /* FALL THROUGH */
 		case ft_enum:	/* value from an enumeration */
-		    if (enum_name(fp->desc, n) == NULL)
-		    {
-			ugh = builddiag("%s of %s has an unknown value: %lu"
-			    , fp->name, sd->name, (unsigned long)n);
-		    }
+		    ugh = enum_check(fp, sd, n);
 		    /* FALL THROUGH */
 		case ft_loose_enum:	/* value from an enumeration with only some names known */
 		    break;
 		case ft_set:	/* bits representing set */
-		    if (!testset(fp->desc, n))
-		    {
-			ugh = builddiag("bitset %s of %s has unknown member(s): %s"
-			    , fp->name, sd->name, bitnamesof(fp->desc, n));
-		    }
+		    ugh = set_check(fp, sd, n);
 		    break;
 		default:
 		    break;
@@ -1747,29 +1878,7 @@ out_struct(const void *struct_ptr, struct_desc *sd
 	    case ft_end:	/* end of field list */
 		passert(cur == outs->cur + sd->size);
 
-		obj.container = outs;
-		obj.desc = sd;
-		obj.name = sd->name;
-		obj.start = outs->cur;
-		obj.cur = cur;
-		obj.roof = outs->roof;	/* limit of possible */
-		/* obj.lenfld and obj.lenfld_desc already set */
-
-		if (obj_pbs == NULL)
-		{
-		    close_output_pbs(&obj); /* fill in length field, if any */
-		}
-		else
-		{
-		    /* We set outs->cur to outs->roof so that
-		     * any attempt to output something into outs
-		     * before obj is closed will trigger an error.
-		     */
-		    outs->cur = outs->roof;
-
-		    *obj_pbs = obj;
-		}
-		return TRUE;
+		return out_struct_done(sd, outs, obj_pbs, &obj, cur);
 
 	    default:
 		bad_case(fp->field_type);
@@ -1778,10 +1887,19 @@ out_struct(const void *struct_ptr, struct_desc *sd
     }
 
     /* some failure got us here: report it */
-    loglog(RC_LOG_SERIOUS, "%s", ugh);	/* ??? serious, but errno not relevant */
-    return FALSE;
+    return out_struct_failed(ugh);
 }
 
+bool
+out_struct(const void *struct_ptr, struct_desc *sd
+	   , pb_stream *outs, pb_stream *obj_pbs)
+{
+    if (sd->out != NULL)
+	return sd->out(struct_ptr, sd, outs, obj_pbs);
+    return out_struct_interp(struct_ptr, sd, outs, obj_pbs);
+}
+
+
 /* Find last complete top-level payload and change its np
  *  * Note: we must deal with payloads already formatted for the network.
  *  _*_Note:_we_don't_think_a_FALSE_return_should_happen_but_old_routine_did.
@@ -0,0 +1,2607 @@
+/* in_struct() and out_struct() compiled from the field tables of packet.c
+ *
+ * DO NOT EDIT: this file is generated from packet.c by packet_codec.pl.
+ * It is included by packet.c, and the Makefile remakes it whenever
+ * packet.c changes.
+ */
+
+/* isa_fields */
+
+static bool
+in_isa_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 2 * COOKIE_SIZE + 12);
+    roof = cur + sd->size;
+
+    memcpy(outp + 0, cur + 0, COOKIE_SIZE);	/* initiator cookie */
+    memcpy(outp + COOKIE_SIZE, cur + COOKIE_SIZE, COOKIE_SIZE);	/* responder cookie */
+    n = cur[2 * COOKIE_SIZE];	/* next payload type */
+    *(u_int8_t *)(outp + 2 * COOKIE_SIZE) = n;
+    n = cur[2 * COOKIE_SIZE + 1];	/* ISAKMP version */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 2 * COOKIE_SIZE + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2 * COOKIE_SIZE + 2];	/* exchange type */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 2 * COOKIE_SIZE + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2 * COOKIE_SIZE + 3];	/* flags */
+    ugh = set_check(&sd->fields[5], sd, n);
+    *(u_int8_t *)(outp + 2 * COOKIE_SIZE + 3) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    memcpy(outp + 2 * COOKIE_SIZE + 4, cur + 2 * COOKIE_SIZE + 4, 4);	/* message ID */
+    n = (u_int32_t)cur[2 * COOKIE_SIZE + 8] << 24 | cur[2 * COOKIE_SIZE + 9] << 16
+	| cur[2 * COOKIE_SIZE + 10] << 8 | cur[2 * COOKIE_SIZE + 11];	/* length */
+    ugh = in_len_check(&sd->fields[7], sd, ins, n, &roof);
+    *(u_int32_t *)(outp + 2 * COOKIE_SIZE + 8) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 2 * COOKIE_SIZE + 12, roof);
+}
+
+static bool
+out_isa_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 2 * COOKIE_SIZE + 12);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    memcpy(cur + 0, inp + 0, COOKIE_SIZE);	/* initiator cookie */
+    memcpy(cur + COOKIE_SIZE, inp + COOKIE_SIZE, COOKIE_SIZE);	/* responder cookie */
+    obj.next_payload_pointer = cur + 2 * COOKIE_SIZE;
+    n = *(const u_int8_t *)(inp + 2 * COOKIE_SIZE);	/* next payload type */
+    cur[2 * COOKIE_SIZE] = n;
+    n = *(const u_int8_t *)(inp + 2 * COOKIE_SIZE + 1);	/* ISAKMP version */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[2 * COOKIE_SIZE + 1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 2 * COOKIE_SIZE + 2);	/* exchange type */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[2 * COOKIE_SIZE + 2] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 2 * COOKIE_SIZE + 3);	/* flags */
+    ugh = set_check(&sd->fields[5], sd, n);
+    cur[2 * COOKIE_SIZE + 3] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    memcpy(cur + 2 * COOKIE_SIZE + 4, inp + 2 * COOKIE_SIZE + 4, 4);	/* message ID */
+    n = *(const u_int32_t *)(inp + 2 * COOKIE_SIZE + 8);	/* length */
+    obj.lenfld = cur + 2 * COOKIE_SIZE + 8;
+    obj.lenfld_desc = &sd->fields[7];
+    cur[2 * COOKIE_SIZE + 8] = n >> 24;
+    cur[2 * COOKIE_SIZE + 9] = n >> 16;
+    cur[2 * COOKIE_SIZE + 10] = n >> 8;
+    cur[2 * COOKIE_SIZE + 11] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 2 * COOKIE_SIZE + 12);
+}
+
+/* isag_fields */
+
+static bool
+in_isag_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_isag_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* isaat_fields_oakley */
+
+static bool
+in_isaat_fields_oakley(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0] << 8 | cur[1];	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    *(u_int16_t *)(outp + 0) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length/value */
+    ugh = in_len_check(&sd->fields[1], sd, ins, immediate? sd->size : n + sd->size, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_isaat_fields_oakley(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int16_t *)(inp + 0);	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    cur[0] = n >> 8;
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length/value */
+    if (!immediate)
+    {
+	obj.lenfld = cur + 2;
+	obj.lenfld_desc = &sd->fields[1];
+    }
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* isaat_fields_ipsec */
+
+static bool
+in_isaat_fields_ipsec(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0] << 8 | cur[1];	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    *(u_int16_t *)(outp + 0) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length/value */
+    ugh = in_len_check(&sd->fields[1], sd, ins, immediate? sd->size : n + sd->size, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_isaat_fields_ipsec(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int16_t *)(inp + 0);	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    cur[0] = n >> 8;
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length/value */
+    if (!immediate)
+    {
+	obj.lenfld = cur + 2;
+	obj.lenfld_desc = &sd->fields[1];
+    }
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* isaat_fields_xauth */
+
+static bool
+in_isaat_fields_xauth(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0] << 8 | cur[1];	/* ModeCfg attr type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    *(u_int16_t *)(outp + 0) = n;
+    n = cur[2] << 8 | cur[3];	/* length/value */
+    ugh = in_len_check(&sd->fields[1], sd, ins, immediate? sd->size : n + sd->size, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_isaat_fields_xauth(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    bool immediate = FALSE;
+    u_int32_t n;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int16_t *)(inp + 0);	/* ModeCfg attr type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    cur[0] = n >> 8;
+    cur[1] = n;
+    n = *(const u_int16_t *)(inp + 2);	/* length/value */
+    if (!immediate)
+    {
+	obj.lenfld = cur + 2;
+	obj.lenfld_desc = &sd->fields[1];
+    }
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* isasa_fields */
+
+static bool
+in_isasa_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = (u_int32_t)cur[4] << 24 | cur[5] << 16
+	| cur[6] << 8 | cur[7];	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int32_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isasa_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int32_t *)(inp + 4);	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n >> 24;
+    cur[5] = n >> 16;
+    cur[6] = n >> 8;
+    cur[7] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ipsec_sit_field */
+
+static bool
+in_ipsec_sit_field(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = (u_int32_t)cur[0] << 24 | cur[1] << 16
+	| cur[2] << 8 | cur[3];	/* IPsec DOI SIT */
+    ugh = set_check(&sd->fields[0], sd, n);
+    *(u_int32_t *)(outp + 0) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_ipsec_sit_field(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int32_t *)(inp + 0);	/* IPsec DOI SIT */
+    ugh = set_check(&sd->fields[0], sd, n);
+    cur[0] = n >> 24;
+    cur[1] = n >> 16;
+    cur[2] = n >> 8;
+    cur[3] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* isap_fields */
+
+static bool
+in_isap_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* proposal number */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* protocol ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 5) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[6];	/* SPI size */
+    *(u_int8_t *)(outp + 6) = n;
+    n = cur[7];	/* number of transforms */
+    *(u_int8_t *)(outp + 7) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isap_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* proposal number */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* protocol ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[5] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 6);	/* SPI size */
+    cur[6] = n;
+    n = *(const u_int8_t *)(inp + 7);	/* number of transforms */
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isat_fields_isakmp */
+
+static bool
+in_isat_fields_isakmp(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* transform number */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 5) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[6] != 0)
+	return in_struct_failed(mbz_diag(sd, 7));
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	return in_struct_failed(mbz_diag(sd, 8));
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isat_fields_isakmp(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* transform number */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[5] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isat_fields_ah */
+
+static bool
+in_isat_fields_ah(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* transform number */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 5) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[6] != 0)
+	return in_struct_failed(mbz_diag(sd, 7));
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	return in_struct_failed(mbz_diag(sd, 8));
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isat_fields_ah(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* transform number */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[5] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isat_fields_esp */
+
+static bool
+in_isat_fields_esp(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* transform number */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 5) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[6] != 0)
+	return in_struct_failed(mbz_diag(sd, 7));
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	return in_struct_failed(mbz_diag(sd, 8));
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isat_fields_esp(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* transform number */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[5] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isat_fields_ipcomp */
+
+static bool
+in_isat_fields_ipcomp(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* transform number */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    *(u_int8_t *)(outp + 5) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[6] != 0)
+	return in_struct_failed(mbz_diag(sd, 7));
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	return in_struct_failed(mbz_diag(sd, 8));
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isat_fields_ipcomp(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* transform number */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* transform ID */
+    ugh = enum_check(&sd->fields[4], sd, n);
+    cur[5] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isaid_fields */
+
+static bool
+in_isaid_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[5];	/* DOI specific A */
+    *(u_int8_t *)(outp + 5) = n;
+    n = cur[6] << 8 | cur[7];	/* DOI specific B */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isaid_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 5);	/* DOI specific A */
+    cur[5] = n;
+    n = *(const u_int16_t *)(inp + 6);	/* DOI specific B */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isaiid_fields */
+
+static bool
+in_isaiid_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[5];	/* Protocol ID */
+    *(u_int8_t *)(outp + 5) = n;
+    n = cur[6] << 8 | cur[7];	/* port */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isaiid_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 5);	/* Protocol ID */
+    cur[5] = n;
+    n = *(const u_int16_t *)(inp + 6);	/* port */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isacert_fields */
+
+static bool
+in_isacert_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 5);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* cert encoding */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 5, roof);
+}
+
+static bool
+out_isacert_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 5);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* cert encoding */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 5);
+}
+
+/* isacr_fields */
+
+static bool
+in_isacr_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 5);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* cert type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 5, roof);
+}
+
+static bool
+out_isacr_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 5);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* cert type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 5);
+}
+
+/* isan_fields */
+
+static bool
+in_isan_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 12);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = (u_int32_t)cur[4] << 24 | cur[5] << 16
+	| cur[6] << 8 | cur[7];	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int32_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[8];	/* protocol ID */
+    *(u_int8_t *)(outp + 8) = n;
+    n = cur[9];	/* SPI size */
+    *(u_int8_t *)(outp + 9) = n;
+    n = cur[10] << 8 | cur[11];	/* Notify Message Type */
+    ugh = enum_check(&sd->fields[6], sd, n);
+    *(u_int16_t *)(outp + 10) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 12, roof);
+}
+
+static bool
+out_isan_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 12);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int32_t *)(inp + 4);	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n >> 24;
+    cur[5] = n >> 16;
+    cur[6] = n >> 8;
+    cur[7] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 8);	/* protocol ID */
+    cur[8] = n;
+    n = *(const u_int8_t *)(inp + 9);	/* SPI size */
+    cur[9] = n;
+    n = *(const u_int16_t *)(inp + 10);	/* Notify Message Type */
+    ugh = enum_check(&sd->fields[6], sd, n);
+    cur[10] = n >> 8;
+    cur[11] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 12);
+}
+
+/* isad_fields */
+
+static bool
+in_isad_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 12);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = (u_int32_t)cur[4] << 24 | cur[5] << 16
+	| cur[6] << 8 | cur[7];	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int32_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[8];	/* protocol ID */
+    *(u_int8_t *)(outp + 8) = n;
+    n = cur[9];	/* SPI size */
+    *(u_int8_t *)(outp + 9) = n;
+    n = cur[10] << 8 | cur[11];	/* number of SPIs */
+    *(u_int16_t *)(outp + 10) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 12, roof);
+}
+
+static bool
+out_isad_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 12);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int32_t *)(inp + 4);	/* DOI */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n >> 24;
+    cur[5] = n >> 16;
+    cur[6] = n >> 8;
+    cur[7] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 8);	/* protocol ID */
+    cur[8] = n;
+    n = *(const u_int8_t *)(inp + 9);	/* SPI size */
+    cur[9] = n;
+    n = *(const u_int16_t *)(inp + 10);	/* number of SPIs */
+    cur[10] = n >> 8;
+    cur[11] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 12);
+}
+
+/* isaattr_fields */
+
+static bool
+in_isaattr_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	return in_struct_failed(mbz_diag(sd, 2));
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* Attr Msg Type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[5] != 0)
+	return in_struct_failed(mbz_diag(sd, 6));
+    outp[5] = '\0';
+    n = cur[6] << 8 | cur[7];	/* Identifier */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isaattr_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* Attr Msg Type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[5] = '\0';
+    n = *(const u_int16_t *)(inp + 6);	/* Identifier */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* isanat_oa_fields */
+
+static bool
+in_isanat_oa_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	zig_log(sd, 2);
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[5] != 0)
+	zig_log(sd, 6);
+    outp[5] = '\0';
+    if (cur[6] != 0)
+	zig_log(sd, 7);
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	zig_log(sd, 8);
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_isanat_oa_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* ID type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[5] = '\0';
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2generic_fields */
+
+static bool
+in_ikev2generic_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_ikev2generic_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* ikev2prop_fields */
+
+static bool
+in_ikev2prop_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	zig_log(sd, 2);
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* prop # */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* proto ID */
+    *(u_int8_t *)(outp + 5) = n;
+    n = cur[6];	/* spi size */
+    *(u_int8_t *)(outp + 6) = n;
+    n = cur[7];	/* # transforms */
+    *(u_int8_t *)(outp + 7) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2prop_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* prop # */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* proto ID */
+    cur[5] = n;
+    n = *(const u_int8_t *)(inp + 6);	/* spi size */
+    cur[6] = n;
+    n = *(const u_int8_t *)(inp + 7);	/* # transforms */
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2trans_fields */
+
+static bool
+in_ikev2trans_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    if (cur[1] != 0)
+	zig_log(sd, 2);
+    outp[1] = '\0';
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* transform type */
+    *(u_int8_t *)(outp + 4) = n;
+    if (cur[5] != 0)
+	zig_log(sd, 6);
+    outp[5] = '\0';
+    n = cur[6] << 8 | cur[7];	/* transform ID */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2trans_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    cur[1] = '\0';
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* transform type */
+    cur[4] = n;
+    cur[5] = '\0';
+    n = *(const u_int16_t *)(inp + 6);	/* transform ID */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2_trans_attr_fields */
+
+static bool
+in_ikev2_trans_attr_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0] << 8 | cur[1];	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    *(u_int16_t *)(outp + 0) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length/value */
+    ugh = in_len_check(&sd->fields[1], sd, ins, immediate? sd->size : n + sd->size, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_ikev2_trans_attr_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    bool immediate = FALSE;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int16_t *)(inp + 0);	/* af+type */
+    if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)
+	immediate = TRUE;
+    ugh = enum_check(&sd->fields[0], sd, n);
+    cur[0] = n >> 8;
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length/value */
+    if (!immediate)
+    {
+	obj.lenfld = cur + 2;
+	obj.lenfld_desc = &sd->fields[1];
+    }
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
+/* ikev2ke_fields */
+
+static bool
+in_ikev2ke_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4] << 8 | cur[5];	/* transform type */
+    *(u_int16_t *)(outp + 4) = n;
+    if (cur[6] != 0)
+	zig_log(sd, 7);
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	zig_log(sd, 8);
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2ke_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int16_t *)(inp + 4);	/* transform type */
+    cur[4] = n >> 8;
+    cur[5] = n;
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2id_fields */
+
+static bool
+in_ikev2id_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* id_type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[5] != 0)
+	return in_struct_failed(mbz_diag(sd, 6));
+    outp[5] = '\0';
+    if (cur[6] != 0)
+	return in_struct_failed(mbz_diag(sd, 7));
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	return in_struct_failed(mbz_diag(sd, 8));
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2id_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* id_type */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[5] = '\0';
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2_cert_fields */
+
+static bool
+in_ikev2_cert_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 5);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* ikev2 cert encoding */
+    *(u_int8_t *)(outp + 4) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 5, roof);
+}
+
+static bool
+out_ikev2_cert_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 5);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* ikev2 cert encoding */
+    cur[4] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 5);
+}
+
+/* ikev2a_fields */
+
+static bool
+in_ikev2a_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* auth method */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    if (cur[5] != 0)
+	zig_log(sd, 6);
+    outp[5] = '\0';
+    if (cur[6] != 0)
+	zig_log(sd, 7);
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	zig_log(sd, 8);
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2a_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* auth method */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    cur[5] = '\0';
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2_delete_fields */
+
+static bool
+in_ikev2_delete_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* protocol ID */
+    *(u_int8_t *)(outp + 4) = n;
+    n = cur[5];	/* SPI size */
+    *(u_int8_t *)(outp + 5) = n;
+    n = cur[6] << 8 | cur[7];	/* number of SPIs */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2_delete_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* protocol ID */
+    cur[4] = n;
+    n = *(const u_int8_t *)(inp + 5);	/* SPI size */
+    cur[5] = n;
+    n = *(const u_int16_t *)(inp + 6);	/* number of SPIs */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2_notify_fields */
+
+static bool
+in_ikev2_notify_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* Protocol ID */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    *(u_int8_t *)(outp + 4) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[5];	/* SPI size */
+    *(u_int8_t *)(outp + 5) = n;
+    n = cur[6] << 8 | cur[7];	/* Notify Message Type */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2_notify_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* Protocol ID */
+    ugh = enum_check(&sd->fields[3], sd, n);
+    cur[4] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 5);	/* SPI size */
+    cur[5] = n;
+    n = *(const u_int16_t *)(inp + 6);	/* Notify Message Type */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2ts_fields */
+
+static bool
+in_ikev2ts_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4];	/* number of TS */
+    *(u_int8_t *)(outp + 4) = n;
+    if (cur[5] != 0)
+	zig_log(sd, 6);
+    outp[5] = '\0';
+    if (cur[6] != 0)
+	zig_log(sd, 7);
+    outp[6] = '\0';
+    if (cur[7] != 0)
+	zig_log(sd, 8);
+    outp[7] = '\0';
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2ts_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    outs->next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int8_t *)(inp + 4);	/* number of TS */
+    cur[4] = n;
+    cur[5] = '\0';
+    cur[6] = '\0';
+    cur[7] = '\0';
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2ts1_fields */
+
+static bool
+in_ikev2ts1_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 8);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* TS type */
+    ugh = enum_check(&sd->fields[0], sd, n);
+    *(u_int8_t *)(outp + 0) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[1];	/* IP Protocol ID */
+    *(u_int8_t *)(outp + 1) = n;
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[4] << 8 | cur[5];	/* start port */
+    *(u_int16_t *)(outp + 4) = n;
+    n = cur[6] << 8 | cur[7];	/* end port */
+    *(u_int16_t *)(outp + 6) = n;
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 8, roof);
+}
+
+static bool
+out_ikev2ts1_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 8);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    n = *(const u_int8_t *)(inp + 0);	/* TS type */
+    ugh = enum_check(&sd->fields[0], sd, n);
+    cur[0] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int8_t *)(inp + 1);	/* IP Protocol ID */
+    cur[1] = n;
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    n = *(const u_int16_t *)(inp + 4);	/* start port */
+    cur[4] = n >> 8;
+    cur[5] = n;
+    n = *(const u_int16_t *)(inp + 6);	/* end port */
+    cur[6] = n >> 8;
+    cur[7] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 8);
+}
+
+/* ikev2e_fields */
+
+static bool
+in_ikev2e_fields(void *struct_ptr, struct_desc *sd
+	, pb_stream *ins, pb_stream *obj_pbs)
+{
+    u_int8_t *cur = ins->cur;
+    u_int8_t *outp = struct_ptr;
+    u_int8_t *roof;
+    u_int32_t n;
+    err_t ugh;
+
+    if (ins->roof - cur < (ptrdiff_t)sd->size)
+	return in_struct_failed(in_room_diag(sd, ins));
+    passert(sd->size == 4);
+    roof = cur + sd->size;
+
+    n = cur[0];	/* next payload type */
+    *(u_int8_t *)(outp + 0) = n;
+    n = cur[1];	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    *(u_int8_t *)(outp + 1) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    n = cur[2] << 8 | cur[3];	/* length */
+    ugh = in_len_check(&sd->fields[2], sd, ins, n, &roof);
+    *(u_int16_t *)(outp + 2) = n;
+    if (ugh != NULL)
+	return in_struct_failed(ugh);
+    return in_struct_done(struct_ptr, sd, ins, obj_pbs, cur + 4, roof);
+}
+
+static bool
+out_ikev2e_fields(const void *struct_ptr, struct_desc *sd
+	, pb_stream *outs, pb_stream *obj_pbs)
+{
+    const u_int8_t *inp = struct_ptr;
+    u_int8_t *cur = outs->cur;
+    pb_stream obj;
+    u_int32_t n;
+    err_t ugh;
+
+    DBG(DBG_EMITTING
+	, DBG_prefix_print_struct(outs, "emit ", struct_ptr, sd, obj_pbs==NULL));
+
+    if (outs->roof - cur < (ptrdiff_t)sd->size)
+	return out_struct_failed(out_room_diag(sd));
+    passert(sd->size == 4);
+    obj.lenfld = NULL;
+    obj.lenfld_desc = NULL;
+    obj.next_payload_pointer = NULL;
+
+    obj.next_payload_pointer = cur + 0;
+    n = *(const u_int8_t *)(inp + 0);	/* next payload type */
+    cur[0] = n;
+    n = *(const u_int8_t *)(inp + 1);	/* critical bit */
+    ugh = set_check(&sd->fields[1], sd, n);
+    cur[1] = n;
+    if (ugh != NULL)
+	return out_struct_failed(ugh);
+    n = *(const u_int16_t *)(inp + 2);	/* length */
+    obj.lenfld = cur + 2;
+    obj.lenfld_desc = &sd->fields[2];
+    cur[2] = n >> 8;
+    cur[3] = n;
+    return out_struct_done(sd, outs, obj_pbs, &obj, cur + 4);
+}
+
@@ -0,0 +1,342 @@
+#!/usr/bin/perl
+#
+# compile the field_desc tables of packet.c into C
+#
+# in_struct() and out_struct() walk a struct_desc's field list one field
+# at a time, switching on the type and size of each.  Every field list
+# that a struct_desc in packet.c names with PACKET_CODEC() is turned into
+# a pair of straight line functions instead, in_<fields>() and
+# out_<fields>(), in which the types, sizes and offsets are constants.
+# They check the same things, in the same order, with the same
+# diagnostics, as the interpreter (in_struct_interp() and
+# out_struct_interp()), using the helpers that it uses.
+#
+# Usage: perl packet_codec.pl packet.c >packet_codec.c
+#
+# Copyright (C) 2026 Openswan Project
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; either version 2 of the License, or (at your
+# option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+
+use strict;
+use warnings;
+
+my %numeric = map { $_ => 1 }
+    qw(ft_nat ft_len ft_lv ft_enum ft_loose_enum ft_af_enum
+       ft_af_loose_enum ft_set ft_np ft_np_in);
+my %ctype = (1 => 'u_int8_t', 2 => 'u_int16_t', 4 => 'u_int32_t');
+
+my $file = shift or die "usage: $0 packet.c\n";
+open(my $fh, '<:raw', $file) or die "$0: cannot open $file: $!\n";
+my $src = do { local $/; <$fh> };
+close($fh);
+
+$src =~ s{/\*.*?\*/}{ }gs;
+$src =~ s/^\s*#.*$//mg;	# and the PACKET_CODEC() definition with them
+
+my %lists;
+while ($src =~ /static\s+field_desc\s+(\w+)\s*\[\s*\]\s*=\s*\{(.*?)\}\s*;/gs) {
+    my ($name, $body) = ($1, $2);
+    my @fields;
+
+    while ($body =~ /\{\s*(ft_\w+)\s*,\s*([^,]+?)\s*,\s*(NULL|"[^"]*")\s*,\s*([^}]*?)\s*\}/g) {
+	my ($type, $size, $name) = ($1, $2, $3);
+
+	$name =~ s/^"(.*)"$/$1/;
+	push @fields, { type => $type, size => $size, name => $name };
+    }
+    die "$0: $name does not end with ft_end\n"
+	unless @fields && $fields[-1]{type} eq 'ft_end';
+    $lists{$name} = \@fields;
+}
+
+my @wanted;
+my %seen;
+while ($src =~ /PACKET_CODEC\s*\(\s*(\w+)\s*\)/g) {
+    push @wanted, $1 unless $seen{$1}++;
+}
+
+# an offset is a number of bytes plus some symbolic sizes (COOKIE_SIZE)
+sub offset_str {
+    my ($bytes, $syms) = @_;
+    my @terms;
+
+    for my $s (sort keys %$syms) {
+	push @terms, $syms->{$s} == 1 ? $s : "$syms->{$s} * $s";
+    }
+    push @terms, $bytes if $bytes != 0 || !@terms;
+    return join(' + ', @terms);
+}
+
+sub field_size {
+    my ($list, $f) = @_;
+    my $size = $f->{size};
+
+    return $1 / 8 if $size =~ m{^(\d+)\s*/\s*BITS_PER_BYTE$} && $1 % 8 == 0;
+    return $size if $size =~ /^\d+$/;
+    die "$0: $list: size \"$size\" of a $f->{type} field is not a constant\n"
+	unless $f->{type} eq 'ft_raw' && $size =~ /^[A-Z_][A-Z0-9_]*$/;
+    return undef;	# symbolic: left to the C compiler
+}
+
+# walk a field list, handing each field its index, byte size and offset
+sub layout {
+    my ($list) = @_;
+    my @out;
+    my ($bytes, %syms) = (0);
+    my $lenfields = 0;
+
+    my $fields = $lists{$list} or die "$0: no field list $list\n";
+    for my $k (0 .. $#$fields) {
+	my $f = $fields->[$k];
+	my $n = field_size($list, $f);
+
+	push @out, { %$f, index => $k, bytes => $n
+		     , off => offset_str($bytes, \%syms)
+		     , offbytes => $bytes, offsyms => {%syms} };
+	last if $f->{type} eq 'ft_end';
+	die "$0: $list: $f->{type} field of $f->{size} bytes\n"
+	    if $numeric{$f->{type}} && !$ctype{$n};
+	$lenfields++ if $f->{type} eq 'ft_len' || $f->{type} eq 'ft_lv';
+	if (defined $n) {
+	    $bytes += $n;
+	} else {
+	    $syms{$f->{size}}++;
+	}
+    }
+    die "$0: $list: more than one length field\n" if $lenfields > 1;
+    return @out;
+}
+
+sub at {
+    my ($f, $k) = @_;
+
+    return offset_str($f->{offbytes} + $k, $f->{offsyms});
+}
+
+sub fp {
+    my ($f) = @_;
+
+    return "&sd->fields[$f->{index}]";
+}
+
+sub load_net {
+    my ($f) = @_;
+    my $n = $f->{bytes};
+
+    return "n = cur[" . at($f, 0) . "];" if $n == 1;
+    return "n = cur[" . at($f, 0) . "] << 8 | cur[" . at($f, 1) . "];"
+	if $n == 2;
+    return "n = (u_int32_t)cur[" . at($f, 0) . "] << 24 | cur[" . at($f, 1)
+	. "] << 16\n\t| cur[" . at($f, 2) . "] << 8 | cur[" . at($f, 3) . "];";
+}
+
+sub store_net {
+    my ($f) = @_;
+    my @s;
+
+    for my $k (0 .. $f->{bytes} - 1) {
+	my $shift = 8 * ($f->{bytes} - 1 - $k);
+
+	push @s, "cur[" . at($f, $k) . "] = "
+	    . ($shift ? "n >> $shift" : "n") . ";";
+    }
+    return join("\n    ", @s);
+}
+
+# the checks a numeric field makes, shared by in and out
+sub value_checks {
+    my ($f, $dir, $immediate) = @_;
+    my $t = $f->{type};
+    my @c;
+
+    if ($t eq 'ft_af_enum' || $t eq 'ft_af_loose_enum') {
+	push @c, "if ((n & ISAKMP_ATTR_AF_MASK) == ISAKMP_ATTR_AF_TV)\n"
+	    . "\timmediate = TRUE;";
+    }
+    if ($t eq 'ft_enum' || $t eq 'ft_af_enum') {
+	push @c, "ugh = enum_check(" . fp($f) . ", sd, n);";
+    } elsif ($t eq 'ft_set') {
+	push @c, "ugh = set_check(" . fp($f) . ", sd, n);";
+    } elsif ($dir eq 'in' && $t eq 'ft_len') {
+	push @c, "ugh = in_len_check(" . fp($f) . ", sd, ins, n, &roof);";
+    } elsif ($dir eq 'in' && $t eq 'ft_lv') {
+	push @c, "ugh = in_len_check(" . fp($f) . ", sd, ins"
+	    . ($immediate ? ", immediate? sd->size : n + sd->size"
+			  : ", n + sd->size") . ", &roof);";
+    } elsif ($dir eq 'out' && ($t eq 'ft_len' || $t eq 'ft_lv')) {
+	my $rec = "obj.lenfld = cur + $f->{off};\n"
+	    . "    obj.lenfld_desc = " . fp($f) . ";";
+	if ($t eq 'ft_lv' && $immediate) {
+	    $rec =~ s/\n    /\n\t/g;
+	    $rec = "if (!immediate)\n    {\n\t$rec\n    }";
+	}
+	push @c, $rec;
+    }
+    return @c;
+}
+
+sub checks_ugh {
+    my (@c) = @_;
+
+    return scalar grep { /^ugh = / } @c;
+}
+
+sub emit_in {
+    my ($list, @fields) = @_;
+    my ($immediate, $ugh, $numeric) = (0, 0, 0);
+    my @body;
+    my $total;
+
+    for my $f (@fields) {
+	my $t = $f->{type};
+	my $name = $f->{name} eq 'NULL' ? $t : $f->{name};
+
+	if ($t eq 'ft_end') {
+	    $total = $f->{off};
+	    push @body, "return in_struct_done(struct_ptr, sd, ins, obj_pbs"
+		. ", cur + $total, roof);";
+	    last;
+	}
+	if ($t eq 'ft_mbz' || $t eq 'ft_zig') {
+	    for my $k (0 .. $f->{bytes} - 1) {
+		my $b = at($f, $k);
+		my $byte = at($f, $k + 1);
+
+		push @body, $t eq 'ft_mbz'
+		    ? "if (cur[$b] != 0)\n\treturn in_struct_failed(mbz_diag(sd, $byte));\n"
+		      . "    outp[$b] = '\\0';"
+		    : "if (cur[$b] != 0)\n\tzig_log(sd, $byte);\n"
+		      . "    outp[$b] = '\\0';";
+	    }
+	} elsif ($t eq 'ft_raw') {
+	    push @body, "memcpy(outp + $f->{off}, cur + $f->{off}, "
+		. (defined $f->{bytes} ? $f->{bytes} : $f->{size}) . ");"
+		. "\t/* $name */";
+	} else {
+	    my @c = value_checks($f, 'in', $immediate);
+
+	    $numeric = 1;
+	    push @body, load_net($f) . "\t/* $name */",
+		@c,
+		"*($ctype{$f->{bytes}} *)(outp + $f->{off}) = n;";
+	    if (checks_ugh(@c)) {
+		$ugh = 1;
+		push @body, "if (ugh != NULL)\n\treturn in_struct_failed(ugh);";
+	    }
+	    $immediate = 1 if $t =~ /^ft_af_/;
+	}
+    }
+
+    print "static bool\n";
+    print "in_$list(void *struct_ptr, struct_desc *sd\n";
+    print "\t, pb_stream *ins, pb_stream *obj_pbs)\n";
+    print "{\n";
+    print "    u_int8_t *cur = ins->cur;\n";
+    print "    u_int8_t *outp = struct_ptr;\n";
+    print "    u_int8_t *roof;\n";
+    print "    bool immediate = FALSE;\n" if $immediate;
+    print "    u_int32_t n;\n" if $numeric;
+    print "    err_t ugh;\n" if $ugh;
+    print "\n";
+    print "    if (ins->roof - cur < (ptrdiff_t)sd->size)\n";
+    print "\treturn in_struct_failed(in_room_diag(sd, ins));\n";
+    print "    passert(sd->size == $total);\n";
+    print "    roof = cur + sd->size;\n";
+    print "\n";
+    print "    $_\n" for @body;
+    print "}\n\n";
+}
+
+sub emit_out {
+    my ($list, @fields) = @_;
+    my ($immediate, $ugh, $numeric) = (0, 0, 0);
+    my @body;
+    my $total;
+
+    for my $f (@fields) {
+	my $t = $f->{type};
+	my $name = $f->{name} eq 'NULL' ? $t : $f->{name};
+
+	if ($t eq 'ft_end') {
+	    $total = $f->{off};
+	    push @body, "return out_struct_done(sd, outs, obj_pbs, &obj"
+		. ", cur + $total);";
+	    last;
+	}
+	push @body, "outs->next_payload_pointer = cur + $f->{off};"
+	    if $t eq 'ft_np';
+	push @body, "obj.next_payload_pointer = cur + $f->{off};"
+	    if $t eq 'ft_np_in';
+	if ($t eq 'ft_mbz' || $t eq 'ft_zig') {
+	    push @body, map { "cur[" . at($f, $_) . "] = '\\0';" }
+		0 .. $f->{bytes} - 1;
+	} elsif ($t eq 'ft_raw') {
+	    push @body, "memcpy(cur + $f->{off}, inp + $f->{off}, "
+		. (defined $f->{bytes} ? $f->{bytes} : $f->{size}) . ");"
+		. "\t/* $name */";
+	} else {
+	    my @c = value_checks($f, 'out', $immediate);
+
+	    $numeric = 1;
+	    push @body, "n = *(const $ctype{$f->{bytes}} *)(inp + $f->{off});"
+		. "\t/* $name */",
+		@c,
+		store_net($f);
+	    if (checks_ugh(@c)) {
+		$ugh = 1;
+		push @body, "if (ugh != NULL)\n\treturn out_struct_failed(ugh);";
+	    }
+	    $immediate = 1 if $t =~ /^ft_af_/;
+	}
+    }
+
+    print "static bool\n";
+    print "out_$list(const void *struct_ptr, struct_desc *sd\n";
+    print "\t, pb_stream *outs, pb_stream *obj_pbs)\n";
+    print "{\n";
+    print "    const u_int8_t *inp = struct_ptr;\n";
+    print "    u_int8_t *cur = outs->cur;\n";
+    print "    pb_stream obj;\n";
+    print "    bool immediate = FALSE;\n" if $immediate;
+    print "    u_int32_t n;\n" if $numeric;
+    print "    err_t ugh;\n" if $ugh;
+    print "\n";
+    print "    DBG(DBG_EMITTING\n";
+    print "\t, DBG_prefix_print_struct(outs, \"emit \", struct_ptr, sd, obj_pbs==NULL));\n";
+    print "\n";
+    print "    if (outs->roof - cur < (ptrdiff_t)sd->size)\n";
+    print "\treturn out_struct_failed(out_room_diag(sd));\n";
+    print "    passert(sd->size == $total);\n";
+    print "    obj.lenfld = NULL;\n";
+    print "    obj.lenfld_desc = NULL;\n";
+    print "    obj.next_payload_pointer = NULL;\n";
+    print "\n";
+    print "    $_\n" for @body;
+    print "}\n\n";
+}
+
+print <<'EOF';
+/* in_struct() and out_struct() compiled from the field tables of packet.c
+ *
+ * DO NOT EDIT: this file is generated from packet.c by packet_codec.pl.
+ * It is included by packet.c, and the Makefile remakes it whenever
+ * packet.c changes.
+ */
+
+EOF
+
+for my $list (@wanted) {
+    my @fields = layout($list);
+
+    print "/* $list */\n\n";
+    emit_in($list, @fields);
+    emit_out($list, @fields);
+}
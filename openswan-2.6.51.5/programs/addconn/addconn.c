@@ -20,6 +20,7 @@
 #include <net/if.h>
 /* #include <linux/types.h> */ /* new */
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <limits.h>
 #include <fcntl.h>
 #include <string.h>
@@ -60,6 +61,7 @@ int warningsarefatal = 0;
 static const char *usage_string = ""
     "Usage: addconn [--config file] \n"
     "               [--addall] [--listroute] [--liststart]\n"
+    "               [--workers n] [--nobatch] [--reload]\n"
     "               [--rootdir dir] \n"
     "               [--ctlbase socketfile] \n"
     "               [--configsetup] \n"
@@ -88,6 +90,9 @@ static struct option const longopts[] =
 	{"verbose",             		no_argument, 		NULL, 'D'},
 	{"warningsfatal",       		no_argument, 		NULL, 'W'},
 	{"addall",              		no_argument, 		NULL, 'a'},
+	{"workers",             		required_argument, 	NULL, 'w'},
+	{"nobatch",             		no_argument, 		NULL, 'B'},
+	{"reload",              		no_argument, 		NULL, 'L'},
 	{"listroute",           		no_argument, 		NULL, 'r'},
 	{"liststart",           		no_argument, 		NULL, 's'},
 	{"varprefix",           		required_argument, 	NULL, 'P'},/**/
@@ -100,6 +105,32 @@ static struct option const longopts[] =
 	{0, 0, 0, 0}
 };
 
+/* most processes --addall will load ipsec.conf with */
+#define ADDCONN_MAX_WORKERS	32
+
+/* --defaultroute and --defaultroutenexthop, for each cfg we load */
+static ip_address defaultroute_addr, defaultnexthop_addr;
+
+/* --addall: add the conns marked as auto=add or better */
+static int add_auto_conn(struct starter_config *cfg, struct starter_conn *conn)
+{
+    if (conn->desired_state == STARTUP_ADD
+	|| conn->desired_state == STARTUP_START
+	|| conn->desired_state == STARTUP_ROUTE) {
+	if(verbose) printf(" %s", conn->name);
+	cfg->dr = defaultroute_addr;
+	cfg->dnh = defaultnexthop_addr;
+	return starter_whack_add_conn(cfg, conn);
+    }
+    return 0;
+}
+
+static long msec_since(const struct timeval *tv0, const struct timeval *tv1)
+{
+    return (tv1->tv_sec - tv0->tv_sec) * 1000L
+	+ (tv1->tv_usec - tv0->tv_usec) / 1000L;
+}
+
 
 
 int
@@ -111,6 +142,9 @@ main(int argc, char *argv[])
     int typeexport = 0;
     int checkconfig = 0;
     int listroute=0, liststart=0;
+    int batch = 1;
+    int reload = 0;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
     struct starter_config *cfg = NULL;
     err_t err = NULL;
     char *confdir = NULL;
@@ -150,6 +184,19 @@ main(int argc, char *argv[])
 	    all=1;
 	    break;
 
+	case 'w':/*workers*/
+	    workers = strtol(optarg, NULL, 10);
+	    break;
+
+	case 'B':/*nobatch*/
+	    batch=0;
+	    break;
+
+	case 'L':/*reload*/
+	    reload=1;
+	    all=1;
+	    break;
+
 	case 'D':
 	    verbose++;
 	    break;
@@ -268,22 +315,10 @@ main(int argc, char *argv[])
 	/* but not if we have no use for them... might cause delays too! */
 	resolvip=FALSE;
     }
-    cfg = confread_load(configfile, &err, resolvip, ctlbase,typeexport);
-
-    if(cfg == NULL) {
-	fprintf(stderr, "can not load config '%s': %s\n",
-		configfile, err);
-	exit(3);
-    }
-    else if(checkconfig) {
-	confread_free(cfg);
-	exit(0);
-    }
-
     if(defaultroute) {
 	err_t e;
 	char b[ADDRTOT_BUF];
-	e = ttoaddr(defaultroute, strlen(defaultroute), AF_INET, &cfg->dr);
+	e = ttoaddr(defaultroute, strlen(defaultroute), AF_INET, &defaultroute_addr);
 	if(e) {
 	    printf("ignoring invalid defaultroute: %s\n", e);
 	    defaultroute = NULL;
@@ -291,7 +326,7 @@ main(int argc, char *argv[])
 	} else
 
 	if(verbose) {
-	    addrtot(&cfg->dr, 0, b, sizeof(b));
+	    addrtot(&defaultroute_addr, 0, b, sizeof(b));
 	    printf("default route is: %s\n", b);
 	}
     }
@@ -299,7 +334,7 @@ main(int argc, char *argv[])
     if(defaultnexthop) {
 	err_t e;
 	char b[ADDRTOT_BUF];
-	e = ttoaddr(defaultnexthop, strlen(defaultnexthop), AF_INET, &cfg->dnh);
+	e = ttoaddr(defaultnexthop, strlen(defaultnexthop), AF_INET, &defaultnexthop_addr);
 	if(e) {
 	    printf("ignoring invalid defaultnexthop: %s\n", e);
 	    defaultnexthop = NULL;
@@ -307,11 +342,76 @@ main(int argc, char *argv[])
 	} else
 
 	if(verbose) {
-	    addrtot(&cfg->dnh, 0, b, sizeof(b));
+	    addrtot(&defaultnexthop_addr, 0, b, sizeof(b));
 	    printf("default nexthop is: %s\n", b);
 	}
     }
 
+    if(workers < 1) {
+	workers = 1;
+    }
+    if(workers > ADDCONN_MAX_WORKERS) {
+	workers = ADDCONN_MAX_WORKERS;
+    }
+
+    if(reload && !batch) {
+	fprintf(stderr, "--reload needs pluto to see all of the conns in one batch\n");
+	exit(10);
+    }
+
+    if(all && batch && !checkconfig && !typeexport) {
+	/*
+	 * conns are added as they are loaded, by several workers at
+	 * once, and all of them go to pluto in a single whack batch.
+	 * For a reload, pluto only changes what differs from the batch.
+	 */
+	struct timeval tv0, tv1, tv2;
+	unsigned int count;
+
+	if(verbose) {
+	    printf("loading all conns:");
+	}
+	gettimeofday(&tv0, NULL);
+	cfg = confread_load_batch(configfile, &err, resolvip, ctlbase,
+				  workers, add_auto_conn);
+	if(cfg == NULL) {
+	    fprintf(stderr, "can not load config '%s': %s\n",
+		    configfile, err);
+	    exit(3);
+	}
+	if(verbose) printf("\n");
+
+	count = cfg->whack_batch->count;
+	if(reload) {
+	    cfg->whack_batch->flags |= WHACK_BATCH_RELOAD;
+	}
+	gettimeofday(&tv1, NULL);
+	exit_status = starter_whack_batch_send(cfg);
+	gettimeofday(&tv2, NULL);
+
+	starter_log(LOG_LEVEL_INFO,
+		    "addconn: %u whack messages loaded by %ld workers in %ld ms, added by pluto in %ld ms",
+		    count, workers, msec_since(&tv0, &tv1), msec_since(&tv1, &tv2));
+
+	confread_free(cfg);
+	exit(exit_status);
+    }
+
+    cfg = confread_load(configfile, &err, resolvip, ctlbase,typeexport);
+
+    if(cfg == NULL) {
+	fprintf(stderr, "can not load config '%s': %s\n",
+		configfile, err);
+	exit(3);
+    }
+    else if(checkconfig) {
+	confread_free(cfg);
+	exit(0);
+    }
+
+    cfg->dr = defaultroute_addr;
+    cfg->dnh = defaultnexthop_addr;
+
     if(all)
     {
 	if(verbose) {
@@ -322,12 +422,7 @@ main(int argc, char *argv[])
 	    conn != NULL;
 	    conn = conn->link.tqe_next)
 	{
-	    if (conn->desired_state == STARTUP_ADD
-		|| conn->desired_state == STARTUP_START
-		|| conn->desired_state == STARTUP_ROUTE) {
-		if(verbose) printf(" %s", conn->name);
-		starter_whack_add_conn(cfg, conn);
-	    }
+	    add_auto_conn(cfg, conn);
 	}
 	if(verbose) printf("\n");
     } else if(listroute) {
@@ -73,6 +73,7 @@ stf_status build_ke(struct pluto_crypto_req_cont *cn
 /*ʼ*/
     pcr_init(r, pcr_build_kenonce, importance);
     r->pcr_d.kn.oakley_group   = group->group;
+    r->pcr_d.kn.single_use     = st->st_ikev2;
 
     cn->pcrc_serialno = st->st_serialno;
 	/*ܲ*/
@@ -18,8 +18,10 @@
  */
 
 #include <string.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -82,37 +84,220 @@ struct connection *connections = NULL;
 
 struct connection *unoriented_connections = NULL;
 
+/* Connections are hashed by name, for con_by_name(), and by each word
+ * of their alias, for foreach_connection_by_alias().  The name table
+ * doubles as connections are added; its first size is static, so that
+ * a few connections need no allocation.  Instances share their template's
+ * name, so a chain is kept in the order of the connections list.
+ */
+#define CONN_NAME_BUCKETS	64	/* initial size, power of 2 */
+#define CONN_ALIAS_BUCKETS	1024	/* power of 2 */
+
+struct conn_alias {
+    struct conn_alias *next;
+    struct connection *c;
+    const char *word;	/* points into c->connalias */
+    size_t len;
+};
+
+static struct connection *conn_names_static[CONN_NAME_BUCKETS];
+static struct connection **conn_names = conn_names_static;
+static unsigned int conn_name_buckets = CONN_NAME_BUCKETS;
+static unsigned int conn_count = 0;
+static struct conn_alias *conn_aliases[CONN_ALIAS_BUCKETS];
+
+static unsigned int
+conn_name_hash(const char *nm, size_t len, bool fold)
+{
+    unsigned int h = 5381;
+
+    while (len-- > 0)
+    {
+	unsigned char ch = *nm++;
+
+	h = h * 33 + (fold ? tolower(ch) : ch);
+    }
+    return h;
+}
+
+static struct connection **
+conn_name_bucket(const char *nm)
+{
+    return &conn_names[conn_name_hash(nm, strlen(nm), FALSE)
+		       & (conn_name_buckets - 1)];
+}
+
+static void
+conn_names_resize(unsigned int newsize)
+{
+    struct connection **old = conn_names;
+    unsigned int i, oldsize = conn_name_buckets;
+
+    conn_names = alloc_bytes(newsize * sizeof(*conn_names)
+			     , "connection name table");
+    conn_name_buckets = newsize;
+
+    /* keep the order of each chain: it matters between instances */
+    for (i = 0; i < oldsize; i++)
+    {
+	struct connection *c, *next;
+
+	for (c = old[i]; c != NULL; c = next)
+	{
+	    struct connection **pp = conn_name_bucket(c->name);
+
+	    next = c->name_next;
+	    while (*pp != NULL)
+		pp = &(*pp)->name_next;
+	    c->name_next = NULL;
+	    *pp = c;
+	}
+    }
+    if (old != conn_names_static)
+	pfree(old);
+}
+
+/* calls f for each word of c's alias */
+static void
+conn_alias_words(struct connection *c
+		 , void (*f)(struct connection *c, const char *word, size_t len))
+{
+    const char *s = c->connalias;
+
+    if (s == NULL)
+	return;
+
+    while (*s != '\0')
+    {
+	size_t len = strcspn(s, " \t");
+
+	if (len > 0)
+	    (*f)(c, s, len);
+	s += len;
+	s += strspn(s, " \t");
+    }
+}
+
+static void
+conn_alias_add(struct connection *c, const char *word, size_t len)
+{
+    struct conn_alias **head = &conn_aliases[conn_name_hash(word, len, TRUE)
+					     & (CONN_ALIAS_BUCKETS - 1)];
+    struct conn_alias *a;
+
+    for (a = *head; a != NULL; a = a->next)
+	if (a->c == c && a->len == len && strncasecmp(a->word, word, len) == 0)
+	    return;	/* said twice */
+
+    a = alloc_thing(struct conn_alias, "connection alias entry");
+    a->c = c;
+    a->word = word;
+    a->len = len;
+    a->next = *head;
+    *head = a;
+}
+
+static void
+conn_alias_remove(struct connection *c, const char *word, size_t len)
+{
+    struct conn_alias *a, **pp;
+
+    for (pp = &conn_aliases[conn_name_hash(word, len, TRUE)
+			    & (CONN_ALIAS_BUCKETS - 1)]
+	; (a = *pp) != NULL; pp = &a->next)
+    {
+	if (a->c == c && a->word == word)
+	{
+	    *pp = a->next;
+	    pfree(a);
+	    return;
+	}
+    }
+}
+
+/* put c on the front of the connections list, and in the indexes */
+static void
+connection_link(struct connection *c)
+{
+    struct connection **head;
+
+    c->ac_next = connections;
+    if (connections != NULL)
+	connections->ac_prevp = &c->ac_next;
+    c->ac_prevp = &connections;
+    connections = c;
+
+    if (++conn_count > 2 * conn_name_buckets)
+	conn_names_resize(2 * conn_name_buckets);
+    head = conn_name_bucket(c->name);
+    c->name_next = *head;
+    *head = c;
+
+    conn_alias_words(c, conn_alias_add);
+}
+
+static void
+connection_unlink(struct connection *c)
+{
+    struct connection **pp;
+
+    *c->ac_prevp = c->ac_next;
+    if (c->ac_next != NULL)
+	c->ac_next->ac_prevp = c->ac_prevp;
+
+    for (pp = conn_name_bucket(c->name); *pp != c; pp = &(*pp)->name_next)
+	passert(*pp != NULL);
+    *pp = c->name_next;
+
+    /* the last one out goes back to the static table */
+    if (--conn_count == 0 && conn_names != conn_names_static)
+    {
+	pfree(conn_names);
+	conn_names = conn_names_static;
+	conn_name_buckets = CONN_NAME_BUCKETS;
+    }
+
+    conn_alias_words(c, conn_alias_remove);
+}
+
 /* find a connection by name.
  * If strict, don't accept a CK_INSTANCE.
- * Move the winner (if any) to the front.
+ * Move the winner (if any) to the front, both of the list and of its
+ * hash chain, so that the two stay in the same order.
  * If none is found, and strict, a diagnostic is logged to whack.
  */
 struct connection *
 con_by_name(const char *nm, bool strict)
 {
-    struct connection *p, *prev;
+    struct connection *p = NULL, **pp, **head;
 
-    for (prev = NULL, p = connections; ; prev = p, p = p->ac_next)
+    head = conn_name_bucket(nm);
+    for (pp = head; (p = *pp) != NULL; pp = &p->name_next)
     {
-	if (p == NULL)
-	{
-	    if (strict)
-		whack_log(RC_UNKNOWN_NAME
-		    , "no connection named \"%s\"", nm);
-	    break;
-	}
 	if (streq(p->name, nm)
 	&& (!strict || p->kind != CK_INSTANCE))
 	{
-	    if (prev != NULL)
+	    *pp = p->name_next;	/* remove p from chain */
+	    p->name_next = *head;	/* and stick it on front */
+	    *head = p;
+
+	    if (p != connections)
 	    {
-		prev->ac_next = p->ac_next;	/* remove p from list */
+		*p->ac_prevp = p->ac_next;	/* remove p from list */
+		if (p->ac_next != NULL)
+		    p->ac_next->ac_prevp = p->ac_prevp;
 		p->ac_next = connections;	/* and stick it on front */
+		connections->ac_prevp = &p->ac_next;
+		p->ac_prevp = &connections;
 		connections = p;
 	    }
 	    break;
 	}
     }
+
+    if (p == NULL && strict)
+	whack_log(RC_UNKNOWN_NAME
+	    , "no connection named \"%s\"", nm);
     return p;
 }
 
@@ -238,6 +423,10 @@ delete_connection(struct connection *c, bool relations)
 
     set_cur_connection(c);
 
+    /* the limiter may have taken its limits from c */
+    if (c->ratelimit_new != 0 || c->ratelimit_existing != 0)
+	connection_ratelimit_generation++;
+
     /* Must be careful to avoid circularity:
      * we mark c as going away so it won't get deleted recursively.
      */
@@ -269,7 +458,8 @@ delete_connection(struct connection *c, bool relations)
     perpeer_logfree(c);
 
     /* find and delete c from connections list */
-    list_rm(struct connection, ac_next, c, connections);
+    connection_unlink(c);
+    route_index_remove(c);
     cur_connection = old_cur_connection;
 
     /* find and delete c from the host pair list */
@@ -281,6 +471,7 @@ delete_connection(struct connection *c, bool relations)
     set_debugging(old_cur_debugging);
 #endif
     pfreeany(c->name);
+    pfreeany(c->connalias);
 #ifdef XAUTH
     pfreeany(c->cisco_dns_info);
     pfreeany(c->cisco_domain_info);
@@ -314,17 +505,38 @@ int foreach_connection_by_alias(const char *alias
 				 , int (*f)(struct connection *c, void *arg)
 				 , void *arg)
 {
-    struct connection *p, *pnext;
+    size_t len = strlen(alias);
+    struct conn_alias *a
+	, **head = &conn_aliases[conn_name_hash(alias, len, TRUE)
+				 & (CONN_ALIAS_BUCKETS - 1)];
+    struct connection **matches;
+    unsigned int n = 0, i;
     int count = 0;
 
-    for (p = connections; p!=NULL; p = pnext)
-    {
-	pnext = p->ac_next;
+    for (a = *head; a != NULL; a = a->next)
+	if (a->len == len && strncasecmp(a->word, alias, len) == 0)
+	    n++;
+    if (n == 0)
+	return 0;
 
-	if (osw_alias_cmp(alias, p->connalias)) {
-	    count += (*f)(p, arg);
-	}
+    /* f may delete connections, so collect them first */
+    matches = alloc_bytes(n * sizeof(*matches), "alias matches");
+    n = 0;
+    for (a = *head; a != NULL; a = a->next)
+	if (a->len == len && strncasecmp(a->word, alias, len) == 0)
+	    matches[n++] = a->c;
+
+    for (i = 0; i < n; i++)
+    {
+	/* skip any that went away under an earlier call */
+	for (a = *head; a != NULL; a = a->next)
+	    if (a->c == matches[i] && a->len == len
+		&& strncasecmp(a->word, alias, len) == 0)
+		break;
+	if (a != NULL)
+	    count += (*f)(matches[i], arg);
     }
+    pfree(matches);
     return count;
 }
 
@@ -901,7 +1113,47 @@ gen_reqid(void)
     return 0; /* never reached, here to make compiler happy */
 }
 
-void
+unsigned long connection_ratelimit_generation = 0;
+
+/* lifetimes, DPD and rate limits: what a reload may change under live SAs */
+static void
+set_connection_timers(struct connection *c, const struct whack_message *wm)
+{
+	c->sa_ike_life_seconds = wm->sa_ike_life_seconds;
+	c->sa_ipsec_life_seconds = wm->sa_ipsec_life_seconds;
+	c->sa_rekey_margin = wm->sa_rekey_margin;
+	c->sa_rekey_fuzz = wm->sa_rekey_fuzz;
+	c->sa_keying_tries = wm->sa_keying_tries;
+
+	if (c->sa_rekey_margin >= c->sa_ipsec_life_seconds) {
+		time_t new_rkm;
+
+		new_rkm = c->sa_ipsec_life_seconds / 2;
+
+		openswan_log("conn: %s, rekeymargin (%lus) > salifetime (%lus); "
+				"reducing rekeymargin to %lu seconds", c->name,
+				c->sa_rekey_margin, c->sa_ipsec_life_seconds,
+				new_rkm);
+
+		c->sa_rekey_margin = new_rkm;
+	}
+
+	/* RFC 3706 DPD */
+        c->dpd_delay = wm->dpd_delay;
+        c->dpd_timeout = wm->dpd_timeout;
+        c->dpd_action = wm->dpd_action;
+
+	if (c->ratelimit_new != wm->ratelimit_new
+	    || c->ratelimit_existing != wm->ratelimit_existing)
+	{
+	    c->ratelimit_new = wm->ratelimit_new;
+	    c->ratelimit_existing = wm->ratelimit_existing;
+	    connection_ratelimit_generation++;
+	}
+}
+
+/* FALSE if the connection could not be added, and was not */
+bool
 add_connection(const struct whack_message *wm)
 {
     struct alg_info_ike *alg_info_ike;
@@ -937,13 +1189,13 @@ add_connection(const struct whack_message *wm)
 	    loglog(RC_NOALGO
 		   , "got 0 transforms for ike=\"%s\""
 		   , wm->ike);
-	    return;
+	    return FALSE;
 	}
 
 	loglog(RC_NOALGO
 	       , "esp string error: %s"
 	       , ugh? ugh : "Unknown");
-	return;
+	return FALSE;
     }
     else if ((wm->ike == NULL || alg_info_ike != NULL)
 	     && check_connection_end(&wm->right, &wm->left, wm)
@@ -992,13 +1244,13 @@ add_connection(const struct whack_message *wm)
 		    && (c->policy & POLICY_ENCRYPT)) {
 		    loglog(RC_NOALGO, "Can only do AH, or ESP, not AH+ESP\n");
 		    pfree(c);
-		    return;
+		    return FALSE;
 		}
 		if( !(c->policy & POLICY_AUTHENTICATE)
 		    && !(c->policy & POLICY_ENCRYPT)) {
 		    loglog(RC_NOALGO, "Must do at AH or ESP, not neither.\n");
 		    pfree(c);
-		    return;
+		    return FALSE;
 		}
 
 		if(c->policy & POLICY_ENCRYPT) {
@@ -1022,14 +1274,14 @@ add_connection(const struct whack_message *wm)
 					, "got 0 transforms for esp=\"%s\""
 					, wm->esp);
 				pfree(c);
-				return;
+				return FALSE;
 			}
 		} else {
 			loglog(RC_NOALGO
 				, "esp string error: %s"
 				, ugh? ugh : "Unknown");
 			pfree(c);
-			return;
+			return FALSE;
 		}
 	}
 #endif
@@ -1052,40 +1304,18 @@ add_connection(const struct whack_message *wm)
 			   , "got 0 transforms for ike=\"%s\""
 			   , wm->ike);
 		    pfree(c);
-		    return;
+		    return FALSE;
 		}
 	    } else {
 		loglog(RC_NOALGO
 		       , "ike string error: %s"
 		       , ugh? ugh : "Unknown");
 		pfree(c);
-		return;
+		return FALSE;
 	    }
 	}
 #endif
-	c->sa_ike_life_seconds = wm->sa_ike_life_seconds;
-	c->sa_ipsec_life_seconds = wm->sa_ipsec_life_seconds;
-	c->sa_rekey_margin = wm->sa_rekey_margin;
-	c->sa_rekey_fuzz = wm->sa_rekey_fuzz;
-	c->sa_keying_tries = wm->sa_keying_tries;
-
-	if (c->sa_rekey_margin >= c->sa_ipsec_life_seconds) {
-		time_t new_rkm;
-
-		new_rkm = c->sa_ipsec_life_seconds / 2;
-
-		openswan_log("conn: %s, rekeymargin (%lus) > salifetime (%lus); "
-				"reducing rekeymargin to %lu seconds", c->name,
-				c->sa_rekey_margin, c->sa_ipsec_life_seconds,
-				new_rkm);
-
-		c->sa_rekey_margin = new_rkm;
-	}
-
-	/* RFC 3706 DPD */
-        c->dpd_delay = wm->dpd_delay;
-        c->dpd_timeout = wm->dpd_timeout;
-        c->dpd_action = wm->dpd_action;
+	set_connection_timers(c, wm);
 
         /* Cisco interop: remote peer type */
         c->remotepeertype=wm->remotepeertype;
@@ -1168,8 +1398,6 @@ add_connection(const struct whack_message *wm)
 
 	/* set internal fields */
 	c->instance_serial = 0;
-	c->ac_next = connections;
-	connections = c;
 	c->interface = NULL;
 	c->spd.routing = RT_UNROUTED;
 	c->newest_isakmp_sa = SOS_NOBODY;
@@ -1236,6 +1464,7 @@ add_connection(const struct whack_message *wm)
 	}
 
 	unshare_connection_strings(c);
+	connection_link(c);	/* after unsharing: the alias index points into c */
 
 	(void)orient(c, pluto_port500);
 	connect_to_IPhost_pair(c);
@@ -1311,10 +1540,136 @@ add_connection(const struct whack_message *wm)
 		, (unsigned long) c->sa_keying_tries
 		, prettypolicy(c->policy));
 	);
+	return TRUE;
     } else {
 	loglog(RC_FATAL, "attempt to load incomplete connection");
     }
+    return FALSE;
+}
+
+/*
+ * Reloading ipsec.conf.  A connection added by a whack batch remembers
+ * two digests of the message that defined it: one of all of it, and
+ * one without the timers that set_connection_timers() can change under
+ * live SAs.  A reload only touches the connections whose digests
+ * differ, and reload_end() deletes those that it did not mention.
+ */
+static unsigned long reload_generation;
+
+/* the connection defined by name: not one of its instances */
+static struct connection *
+config_con_by_name(const char *name)
+{
+    struct connection *c;
+
+    for (c = *conn_name_bucket(name); c != NULL; c = c->name_next)
+    {
+	if (streq(c->name, name)
+	    && c->kind != CK_INSTANCE && c->kind != CK_GOING_AWAY)
+	    return c;
+    }
+    return NULL;
+}
 
+void
+reload_begin(void)
+{
+    reload_generation++;
+}
+
+/* remember what whack message defined the connection name */
+void
+note_config_connection(const char *name, u_int64_t digest, u_int64_t sa_digest)
+{
+    struct connection *c = config_con_by_name(name);
+
+    if (c != NULL)
+    {
+	c->config_digest = digest;
+	c->config_sa_digest = sa_digest;
+	c->config_generation = reload_generation;
+    }
+}
+
+enum reload_change
+reload_connection(const struct whack_message *wm
+		  , u_int64_t digest, u_int64_t sa_digest)
+{
+    struct connection *c = config_con_by_name(wm->name);
+    struct connection *d;
+    enum reload_change what;
+
+    if (c != NULL && c->config_digest == digest)
+    {
+	what = RELOAD_SAME;
+    }
+    else if (c != NULL && c->config_digest != 0
+	     && c->config_sa_digest == sa_digest)
+    {
+	/* the instances carry the timers too: their SAs stay up */
+	for (d = *conn_name_bucket(wm->name); d != NULL; d = d->name_next)
+	{
+	    if (streq(d->name, wm->name))
+		set_connection_timers(d, wm);
+	}
+	c->config_digest = digest;
+	what = RELOAD_UPDATED;
+    }
+    else
+    {
+	what = RELOAD_ADDED;
+	if (c != NULL)
+	{
+	    delete_connections_by_name(wm->name, FALSE);
+	    what = RELOAD_REPLACED;
+	}
+	if (!add_connection(wm))
+	    return RELOAD_FAILED;
+
+	c = config_con_by_name(wm->name);
+	passert(c != NULL);
+	c->config_digest = digest;
+	c->config_sa_digest = sa_digest;
+    }
+    c->config_generation = reload_generation;
+    return what;
+}
+
+/* delete the connections from ipsec.conf that this reload left out */
+unsigned int
+reload_end(void)
+{
+    struct connection *c;
+    char **names;
+    unsigned int i, n = 0;
+
+    for (c = connections; c != NULL; c = c->ac_next)
+    {
+	if (c->config_digest != 0 && c->config_generation != reload_generation
+	    && c->kind != CK_INSTANCE && c->kind != CK_GOING_AWAY)
+	    n++;
+    }
+    if (n == 0)
+	return 0;
+
+    /* deleting one may delete others, so collect their names first */
+    names = alloc_bytes(n * sizeof(*names), "reload removals");
+    i = 0;
+    for (c = connections; c != NULL; c = c->ac_next)
+    {
+	if (c->config_digest != 0 && c->config_generation != reload_generation
+	    && c->kind != CK_INSTANCE && c->kind != CK_GOING_AWAY)
+	    names[i++] = clone_str(c->name, "reload removal");
+    }
+
+    for (i = 0; i < n; i++)
+    {
+	openswan_log("reload: \"%s\" removed", names[i]);
+	delete_connections_by_name(names[i], FALSE);
+	pfree(names[i]);
+    }
+    pfree(names);
+    return n;
 }
 
 /* Derive a template connection from a group connection and target.
@@ -1347,6 +1702,7 @@ add_group_instance(struct connection *group, const ip_subnet *target)
 	t = clone_thing(*group, "group instance");
 	t->name = namebuf;
 	unshare_connection_strings(t);
+	t->config_digest = 0;	/* goes with the group, not ipsec.conf */
 	name = clone_str(t->name, "group instance name");
 	t->spd.that.client = *target;
 	t->policy &= ~(POLICY_GROUP | POLICY_GROUTED);
@@ -1358,6 +1714,9 @@ add_group_instance(struct connection *group, const ip_subnet *target)
 	t->log_file = NULL;
 	t->log_file_err = FALSE;
 
+	/* the group's states are not the instance's */
+	LIST_INIT(&t->states);
+
 	t->spd.reqid = gen_reqid();
 
 	if (t->spd.that.virt) {
@@ -1366,8 +1725,7 @@ add_group_instance(struct connection *group, const ip_subnet *target)
 	}
 
 	/* add to connections list */
-	t->ac_next = connections;
-	connections = t;
+	connection_link(t);
 
 	/* same host_pair as parent: stick after parent on list */
 	group->IPhp_next = t;
@@ -1443,11 +1801,11 @@ instantiate(struct connection *c, const ip_address *him
     d->spd.reqid = gen_reqid();
 
     /* set internal fields */
-    d->ac_next = connections;
-    connections = d;
+    connection_link(d);
     d->spd.routing = RT_UNROUTED;
     d->newest_isakmp_sa = SOS_NOBODY;
     d->newest_ipsec_sa = SOS_NOBODY;
+    LIST_INIT(&d->states);
     d->spd.eroute_owner = SOS_NOBODY;
 
     /* reset log file info */
@@ -1633,14 +1991,20 @@ oppo_instantiate(struct connection *c
      * If there was another instance eclipsing, we'd be using it.
      */
     if (c->spd.routing == RT_ROUTED_ECLIPSED)
+    {
 	d->spd.routing = RT_ROUTED_PROSPECTIVE;
+	route_index_update(d);
+    }
 
     /* Remember if the template is routed:
      * if so, this instance applies for initiation
      * even if it is created for responding.
      */
     if (routed(c->spd.routing))
+    {
 	d->instance_initiation_ok = TRUE;
+	route_index_update(d);
+    }
 
     DBG(DBG_CONTROL,
 	char topo[CONN_BUF_LEN];
@@ -1727,6 +2091,288 @@ fmt_conn_instance(const struct connection *c, char buf[CONN_INST_BUF])
     return buf;
 }
 
+/* Index of routed connections by client pair, for
+ * find_connection_for_clients().
+ *
+ * A two level prefix trie: this.client is looked up in the first
+ * level, and each of its nodes has a second level trie of that.client.
+ * An acquire walks both levels along the bits of the packet's
+ * addresses, so it only meets connections whose clients contain them.
+ * route_index_update() and route_index_remove() maintain it.
+ */
+#define CLIENT_INDEX_BITS	12
+
+struct client_trie {
+    unsigned char key[16];	/* address bytes, first len bits count */
+    unsigned int len;
+    struct client_trie *child[2];
+    struct client_trie *peers;	/* first level: that.client trie */
+    struct client_entry *entries;	/* second level */
+};
+
+struct client_entry {
+    struct client_entry *next;	/* same node */
+    struct client_entry **prevp;
+    struct client_entry *conn_next;	/* same connection */
+    struct connection *c;
+    struct client_trie *ours;	/* first level node */
+    ip_subnet this_client;
+    ip_subnet that_client;
+};
+
+static struct client_trie *client_trie_root[2];	/* IPv4, IPv6 */
+static struct client_entry *client_index_conns[1 << CLIENT_INDEX_BITS];
+static unsigned int client_entry_count = 0;
+static unsigned int client_trie_nodes = 0;
+
+static inline unsigned int
+client_trie_bit(const unsigned char *key, unsigned int i)
+{
+    return (key[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/* number of leading bits, at most max, that a and b share */
+static unsigned int
+client_trie_common(const unsigned char *a, const unsigned char *b
+		   , unsigned int max)
+{
+    unsigned int i = 0;
+
+    while (i + 8 <= max && a[i / 8] == b[i / 8])
+	i += 8;
+    while (i < max && client_trie_bit(a, i) == client_trie_bit(b, i))
+	i++;
+    return i;
+}
+
+static struct client_trie *
+client_trie_node(const unsigned char *key, unsigned int len)
+{
+    struct client_trie *n = alloc_thing(struct client_trie, "client trie node");
+
+    memcpy(n->key, key, (len + 7) / 8);
+    n->len = len;
+    client_trie_nodes++;
+    return n;
+}
+
+/* find or make the node for key/len below *pp */
+static struct client_trie *
+client_trie_insert(struct client_trie **pp, const unsigned char *key
+		   , unsigned int len)
+{
+    for (;;)
+    {
+	struct client_trie *n = *pp, *m;
+	unsigned int common;
+
+	if (n == NULL)
+	    return *pp = client_trie_node(key, len);
+
+	common = client_trie_common(key, n->key, len < n->len ? len : n->len);
+	if (common == n->len)
+	{
+	    if (len == n->len)
+		return n;
+	    pp = &n->child[client_trie_bit(key, n->len)];
+	    continue;
+	}
+
+	/* split: n and key part ways after common bits */
+	m = client_trie_node(key, common);
+	m->child[client_trie_bit(n->key, common)] = n;
+	*pp = m;
+	if (common == len)
+	    return m;
+	return m->child[client_trie_bit(key, common)] = client_trie_node(key, len);
+    }
+}
+
+/* drop the empty nodes on the path to key/len; returns the new subtree */
+static struct client_trie *
+client_trie_prune(struct client_trie *n, const unsigned char *key
+		  , unsigned int len)
+{
+    struct client_trie *child;
+
+    if (n == NULL)
+	return NULL;
+
+    if (n->len < len && client_trie_common(key, n->key, n->len) == n->len)
+    {
+	unsigned int b = client_trie_bit(key, n->len);
+
+	n->child[b] = client_trie_prune(n->child[b], key, len);
+    }
+
+    if (n->peers != NULL || n->entries != NULL
+	|| (n->child[0] != NULL && n->child[1] != NULL))
+	return n;
+
+    child = n->child[0] != NULL ? n->child[0] : n->child[1];
+    pfree(n);
+    client_trie_nodes--;
+    return child;
+}
+
+/* the node after n on the path of a (of bits bits), if it covers a */
+static struct client_trie *
+client_trie_step(struct client_trie *n, const unsigned char *a
+		 , unsigned int bits)
+{
+    if (n == NULL || n->len >= bits)
+	return NULL;
+    n = n->child[client_trie_bit(a, n->len)];
+    if (n != NULL && client_trie_common(a, n->key, n->len) != n->len)
+	return NULL;
+    return n;
+}
+
+static struct client_trie *
+client_trie_start(struct client_trie *root, const unsigned char *a)
+{
+    if (root != NULL && client_trie_common(a, root->key, root->len) != root->len)
+	return NULL;
+    return root;
+}
+
+static struct client_entry **
+client_index_conn_head(const struct connection *c)
+{
+    /* Fibonacci hashing of the pointer */
+    unsigned int h = (unsigned int)(uintptr_t)c * 2654435761U;
+
+    return &client_index_conns[h >> (32 - CLIENT_INDEX_BITS)];
+}
+
+static void
+client_index_remove(struct connection *c)
+{
+    struct client_entry *e, **pp;
+
+    for (pp = client_index_conn_head(c); (e = *pp) != NULL; )
+    {
+	unsigned char *ob, *pb;
+	struct client_trie **root;
+
+	if (e->c != c)
+	{
+	    pp = &e->conn_next;
+	    continue;
+	}
+	*e->prevp = e->next;
+	if (e->next != NULL)
+	    e->next->prevp = e->prevp;
+	*pp = e->conn_next;
+
+	(void) addrbytesptr(&e->this_client.addr, &ob);
+	(void) addrbytesptr(&e->that_client.addr, &pb);
+	e->ours->peers = client_trie_prune(e->ours->peers, pb
+					   , e->that_client.maskbits);
+	root = &client_trie_root[subnettypeof(&e->this_client) == AF_INET6];
+	*root = client_trie_prune(*root, ob, e->this_client.maskbits);
+
+	pfree(e);
+	client_entry_count--;
+    }
+}
+
+static void
+client_index_add(struct connection *c)
+{
+    struct client_entry **head = client_index_conn_head(c);
+    struct spd_route *sr;
+
+    for (sr = &c->spd; sr != NULL; sr = sr->next)
+    {
+	struct client_entry *e;
+	struct client_trie *ours, *theirs;
+	unsigned char *ob, *pb;
+
+	for (e = *head; e != NULL; e = e->conn_next)
+	    if (e->c == c
+		&& samesubnet(&e->this_client, &sr->this.client)
+		&& samesubnet(&e->that_client, &sr->that.client))
+		break;
+	if (e != NULL)
+	    continue;	/* another spd_route of c is already there */
+
+	(void) addrbytesptr(&sr->this.client.addr, &ob);
+	(void) addrbytesptr(&sr->that.client.addr, &pb);
+	ours = client_trie_insert(
+	    &client_trie_root[subnettypeof(&sr->this.client) == AF_INET6]
+	    , ob, sr->this.client.maskbits);
+	theirs = client_trie_insert(&ours->peers, pb, sr->that.client.maskbits);
+
+	e = alloc_thing(struct client_entry, "client index entry");
+	e->c = c;
+	e->ours = ours;
+	e->this_client = sr->this.client;
+	e->that_client = sr->that.client;
+	e->next = theirs->entries;
+	if (e->next != NULL)
+	    e->next->prevp = &e->next;
+	e->prevp = &theirs->entries;
+	theirs->entries = e;
+	e->conn_next = *head;
+	*head = e;
+	client_entry_count++;
+    }
+}
+
+/* walks the connections whose client tries contain a pair of addresses */
+struct client_index_iter {
+    unsigned char *ob, *pb;
+    unsigned int obits, pbits;
+    struct client_trie *ours, *theirs;
+    struct client_entry *e;
+};
+
+static struct connection *
+client_index_next(struct client_index_iter *it)
+{
+    for (;;)
+    {
+	if (it->e != NULL)
+	{
+	    struct connection *c = it->e->c;
+
+	    it->e = it->e->next;
+	    return c;
+	}
+
+	it->theirs = client_trie_step(it->theirs, it->pb, it->pbits);
+	while (it->theirs == NULL)
+	{
+	    it->ours = client_trie_step(it->ours, it->ob, it->obits);
+	    if (it->ours == NULL)
+		return NULL;
+	    it->theirs = client_trie_start(it->ours->peers, it->pb);
+	}
+	it->e = it->theirs->entries;
+    }
+}
+
+static struct connection *
+client_index_first(struct client_index_iter *it
+		   , const ip_address *our_client
+		   , const ip_address *peer_client)
+{
+    it->obits = 8 * addrbytesptr(our_client, &it->ob);
+    it->pbits = 8 * addrbytesptr(peer_client, &it->pb);
+    it->ours = client_trie_start(client_trie_root[addrtypeof(our_client) == AF_INET6]
+				 , it->ob);
+    it->theirs = NULL;
+    it->e = NULL;
+    if (it->ours != NULL)
+    {
+	it->theirs = client_trie_start(it->ours->peers, it->pb);
+	if (it->theirs != NULL)
+	    it->e = it->theirs->entries;
+    }
+    return client_index_next(it);
+}
+
 /* Find an existing connection for a trapped outbound packet.
  * This is attempted before we bother with gateway discovery.
  *   + this connection is routed or instance_of_routed_template
@@ -1748,7 +2394,8 @@ find_connection_for_clients(struct spd_route **srp,
 			    const ip_address *peer_client,
 			    int transport_proto)
 {
-    struct connection *c = connections, *best = NULL;
+    struct connection *c, *best = NULL;
+    struct client_index_iter it;
     policy_prio_t best_prio = BOTTOM_PRIO;
     struct spd_route *sr;
     struct spd_route *best_sr;
@@ -1769,8 +2416,9 @@ find_connection_for_clients(struct spd_route **srp,
 		"looking for policy for connection: %s:%d/%d -> %s:%d/%d"
 		, ocb, transport_proto, our_port, pcb, transport_proto, peer_port));
 
-
-    for (c = connections; c != NULL; c = c->ac_next)
+    /* only connections whose clients could contain ours and the peer's */
+    for (c = client_index_first(&it, our_client, peer_client); c != NULL
+	; c = client_index_next(&it))
     {
 	if (c->kind == CK_GROUP)
 	    continue;
@@ -1973,6 +2621,145 @@ build_outgoing_opportunistic_connection(struct gw_info *gw
 			      , our_client, peer_client);
 }
 
+/* Index of routed connections by peer client, for route_owner().
+ *
+ * Each connection that has been routed is entered once under every
+ * (that.client, that.protocol, that.port) of its spd_routes, so that
+ * route_owner() only has to look at connections that could share a
+ * route instead of at all of them.  Entries name the connection, not
+ * the spd_route: the spd_route chain can be rebuilt under us (XAUTH
+ * split tunnelling), so route_owner() re-checks every spd_route of a
+ * candidate.  An entry left over from before a connection's clients
+ * changed costs a wasted comparison and nothing more.
+ *
+ * route_index_update() and route_index_remove() keep the client trie
+ * of find_connection_for_clients() up to date as well.
+ *
+ * Whoever routes a connection, allows it to initiate on demand, or
+ * changes the clients of one that may already be routed, must call
+ * route_index_update() on it.
+ */
+#define ROUTE_INDEX_BUCKETS	4096	/* power of 2 */
+
+struct route_index_entry {
+    struct route_index_entry *next;	/* same bucket */
+    struct route_index_entry **prevp;
+    struct route_index_entry *conn_next;	/* same connection */
+    struct connection *c;
+    unsigned int bucket;
+};
+
+static struct route_index_entry *route_index[ROUTE_INDEX_BUCKETS];
+static struct route_index_entry *route_index_conns[ROUTE_INDEX_BUCKETS];
+static unsigned int route_index_count = 0;
+
+static unsigned int
+route_index_mix(unsigned int h)
+{
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (ROUTE_INDEX_BUCKETS - 1);
+}
+
+static unsigned int
+route_index_bucket(const struct spd_route *sr)
+{
+    unsigned char *b;
+    size_t n = addrbytesptr(&sr->that.client.addr, &b);
+    unsigned int h = sr->that.client.maskbits;
+
+    while (n-- > 0)
+	h = h * 31 + *b++;
+    h = h * 31 + sr->that.protocol;
+    h = h * 31 + sr->that.port;
+    return route_index_mix(h);
+}
+
+static struct route_index_entry **
+route_index_conn_head(const struct connection *c)
+{
+    return &route_index_conns[route_index_mix((unsigned int)(uintptr_t)c)];
+}
+
+void
+route_index_remove(struct connection *c)
+{
+    struct route_index_entry *e, **pp;
+
+    for (pp = route_index_conn_head(c); (e = *pp) != NULL; )
+    {
+	if (e->c != c)
+	{
+	    pp = &e->conn_next;
+	    continue;
+	}
+	*e->prevp = e->next;
+	if (e->next != NULL)
+	    e->next->prevp = e->prevp;
+	*pp = e->conn_next;
+	pfree(e);
+	route_index_count--;
+    }
+    client_index_remove(c);
+}
+
+void
+route_index_update(struct connection *c)
+{
+    struct route_index_entry **head = route_index_conn_head(c);
+    struct spd_route *sr;
+
+    route_index_remove(c);
+    for (sr = &c->spd; sr != NULL; sr = sr->next)
+    {
+	unsigned int bucket = route_index_bucket(sr);
+	struct route_index_entry *e;
+
+	for (e = *head; e != NULL; e = e->conn_next)
+	    if (e->c == c && e->bucket == bucket)
+		break;
+	if (e != NULL)
+	    continue;	/* another spd_route of c is already there */
+
+	e = alloc_thing(struct route_index_entry, "route index entry");
+	e->c = c;
+	e->bucket = bucket;
+	e->next = route_index[bucket];
+	if (e->next != NULL)
+	    e->next->prevp = &e->next;
+	e->prevp = &route_index[bucket];
+	route_index[bucket] = e;
+	e->conn_next = *head;
+	*head = e;
+	route_index_count++;
+    }
+    client_index_add(c);
+}
+
+void
+show_route_index_status(void)
+{
+    unsigned int i, used = 0, longest = 0;
+
+    for (i = 0; i < ROUTE_INDEX_BUCKETS; i++)
+    {
+	const struct route_index_entry *e;
+	unsigned int chain = 0;
+
+	for (e = route_index[i]; e != NULL; e = e->next)
+	    chain++;
+	if (chain > 0)
+	    used++;
+	if (chain > longest)
+	    longest = chain;
+    }
+    whack_log(RC_COMMENT, "stats route index: entries=%u buckets=%u/%u longest=%u"
+	      , route_index_count, used, ROUTE_INDEX_BUCKETS, longest);
+    whack_log(RC_COMMENT, "stats client trie: entries=%u nodes=%u"
+	      , client_entry_count, client_trie_nodes);
+}
+
 /* Find the connection to connection c's peer's client with the
  * largest value of .routing.  All other things being equal,
  * preference is given to c.  If none is routed, return NULL.
@@ -2004,23 +2791,26 @@ route_owner(struct connection *c
     best_routing = cur_spd->routing;
     best_erouting = best_routing;
 
-    for (d = connections; d != NULL; d = d->ac_next)
+    for (src = &c->spd; src; src=src->next)
     {
+	struct route_index_entry *e;
+
+	for (e = route_index[route_index_bucket(src)]; e != NULL; e = e->next)
+	{
+	    d = e->c;
 
 #ifdef KLIPS_MAST
-	/* in mast mode we must also delete the iptables rule */
-	if (kern_interface == USE_MASTKLIPS)
-	    if (compatible_overlapping_connections(c, d))
-		continue;
+	    /* in mast mode we must also delete the iptables rule */
+	    if (kern_interface == USE_MASTKLIPS)
+		if (compatible_overlapping_connections(c, d))
+		    continue;
 #endif
 
-	for (srd = &d->spd; srd; srd = srd->next)
-	{
-	    if (srd->routing == RT_UNROUTED)
-		continue;
-
-	    for (src = &c->spd; src; src=src->next)
+	    for (srd = &d->spd; srd; srd = srd->next)
 	    {
+		if (srd->routing == RT_UNROUTED)
+		    continue;
+
 		if (src==srd)
 		    continue;
 
@@ -3306,6 +4096,15 @@ show_one_connection(struct connection *c, logfunc logger)
 		  , (unsigned long)c->dpd_timeout);
     }
 
+    if(c->ratelimit_new > 0 || c->ratelimit_existing > 0) {
+	logger(RC_COMMENT
+		  , "\"%s\"%s:   ratelimit: new:%lu/s; existing:%lu/s;  "
+		  , c->name
+		  , instance
+		  , (unsigned long)c->ratelimit_new
+		  , (unsigned long)c->ratelimit_existing);
+    }
+
     if(c->extra_debugging) {
 	logger(RC_COMMENT, "\"%s\"%s:   debug: %s"
 		  , c->name
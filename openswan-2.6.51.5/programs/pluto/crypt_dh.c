@@ -75,6 +75,24 @@ static PK11SymKey *pk11_extract_derive_wrapper_osw(PK11SymKey *base, CK_EXTRACT_
 
     return PK11_Derive_osw(base, CKM_EXTRACT_KEY_FROM_KEY, &param, target, operation, keySize);
 }
+
+/* copy out len bytes of base from bit bs on: keying material that is
+ * not used as a key, like the salt of an AEAD cipher
+ */
+static void nss_extract_salt(PK11SymKey *base, CK_EXTRACT_PARAMS bs
+		, u_int8_t *out, size_t len)
+{
+    PK11SymKey *k = pk11_extract_derive_wrapper_osw(base, bs
+		, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, len);
+    SECItem *keydata;
+
+    passert(k != NULL);
+    passert(PK11_ExtractKeyValue(k) == SECSuccess);
+    keydata = PK11_GetKeyData(k);
+    passert(keydata != NULL && keydata->len == len);
+    memcpy(out, keydata->data, len);
+    PK11_FreeSymKey(k);
+}
 /*
 static CK_MECHANISM_TYPE nss_hmac_mech(const struct hash_desc *hasher)
 {
@@ -99,6 +117,7 @@ CK_MECHANISM_TYPE mechanism=0x80000000;
     switch(encrypter->common.algo_id){
     case OAKLEY_3DES_CBC:   mechanism = CKM_DES3_CBC; break;
     case OAKLEY_AES_CBC:  mechanism = CKM_AES_CBC; break;
+    case OAKLEY_AES_GCM_C:  mechanism = CKM_AES_GCM; break;
     default: loglog(RC_LOG_SERIOUS,"NSS: Unsupported encryption mechanism"); break; /*should not reach here*/
     }
 return mechanism;
@@ -1312,7 +1331,10 @@ calc_skeyseed_v2(struct pcr_skeyid_q *skq
 	/* SK_p needs PRF hasher*2 key bits */
 	/* SK_e needs keysize*2 key bits */
 	/* SK_a needs hash's key bits size */
+	/* an AEAD cipher has no SK_a, and its SK_e ends in salt (RFC5282) */
 	const struct hash_desc *integ_hasher = (struct hash_desc *)ike_alg_ikev2_find(IKE_ALG_INTEG, skq->integ_hash, 0);
+	const struct encrypt_desc *aead = skq->encrypter != NULL
+	    && ike_alg_enc_aead(skq->encrypter) ? skq->encrypter : NULL;
 #ifdef HAVE_LIBNSS
        int skd_bytes = hasher->hash_key_size;
        int skp_bytes = hasher->hash_key_size;
@@ -1320,8 +1342,14 @@ calc_skeyseed_v2(struct pcr_skeyid_q *skq
        int skd_bytes = vpss.prf_hasher->hash_key_size;
        int skp_bytes = vpss.prf_hasher->hash_key_size;
 #endif
-	int ska_bytes = integ_hasher->hash_key_size;
-	int ske_bytes = keysize;
+	int ska_bytes = aead ? 0 : integ_hasher->hash_key_size;
+	int salt_bytes = aead ? aead->salt_size : 0;
+	int ske_bytes = keysize + salt_bytes;
+#ifdef HAVE_LIBNSS
+	u_int8_t salt_ei[8], salt_er[8];
+
+	passert(salt_bytes <= (int)sizeof(salt_ei));
+#endif
 
 	vpss.counter[0]=0x01;
 	vpss.t.len = 0;
@@ -1467,26 +1495,32 @@ calc_skeyseed_v2(struct pcr_skeyid_q *skq
 	SK_d_k = pk11_extract_derive_wrapper_osw(finalkey, bs, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, skd_bytes);
 
 
-	bs= skd_bytes*BITS_PER_BYTE;
-	SK_ai_k = pk11_extract_derive_wrapper_osw(finalkey, bs, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, ska_bytes);
-
+	SK_ai_k = SK_ar_k = NULL;
+	if (ska_bytes != 0) {
+	    bs= skd_bytes*BITS_PER_BYTE;
+	    SK_ai_k = pk11_extract_derive_wrapper_osw(finalkey, bs, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, ska_bytes);
 
-	bs= (skd_bytes + ska_bytes)*BITS_PER_BYTE;
-	SK_ar_k = pk11_extract_derive_wrapper_osw(finalkey, bs, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, ska_bytes);
+	    bs= (skd_bytes + ska_bytes)*BITS_PER_BYTE;
+	    SK_ar_k = pk11_extract_derive_wrapper_osw(finalkey, bs, CKM_CONCATENATE_BASE_AND_DATA, CKA_DERIVE, ska_bytes);
+	}
 
 
 	bs= (skd_bytes + (2*ska_bytes))*BITS_PER_BYTE;
 	param1.data =(unsigned char*)&bs;
 	param1.len = sizeof(bs);
 	SK_ei_k = PK11_DeriveWithFlags(finalkey, CKM_EXTRACT_KEY_FROM_KEY, &param1
-		, nss_encryption_mech(encrypter), CKA_FLAGS_ONLY, ske_bytes, CKF_ENCRYPT|CKF_DECRYPT);
+		, nss_encryption_mech(encrypter), CKA_FLAGS_ONLY, keysize, CKF_ENCRYPT|CKF_DECRYPT);
+	if (salt_bytes != 0)
+	    nss_extract_salt(finalkey, bs + keysize*BITS_PER_BYTE, salt_ei, salt_bytes);
 
 
 	bs= (skd_bytes + (2*ska_bytes) + ske_bytes)*BITS_PER_BYTE;
 	param1.data =(unsigned char*)&bs;
 	param1.len = sizeof(bs);
 	SK_er_k = PK11_DeriveWithFlags(finalkey, CKM_EXTRACT_KEY_FROM_KEY, &param1
-		, nss_encryption_mech(encrypter), CKA_FLAGS_ONLY, ske_bytes, CKF_ENCRYPT|CKF_DECRYPT);
+		, nss_encryption_mech(encrypter), CKA_FLAGS_ONLY, keysize, CKF_ENCRYPT|CKF_DECRYPT);
+	if (salt_bytes != 0)
+	    nss_extract_salt(finalkey, bs + keysize*BITS_PER_BYTE, salt_er, salt_bytes);
 
 
 	bs= (skd_bytes + (2*ska_bytes) + (2*ske_bytes))*BITS_PER_BYTE;
@@ -1507,24 +1541,28 @@ calc_skeyseed_v2(struct pcr_skeyid_q *skq
 	memcpy(SK_d->ptr, &SK_d_k, SK_d->len);
 
 
-	SK_ai->len = sizeof(PK11SymKey *);
-	SK_ai->ptr = alloc_bytes(SK_ai->len, "SK_ai");
-	memcpy(SK_ai->ptr, &SK_ai_k, SK_ai->len);
+	if (ska_bytes != 0) {
+	    SK_ai->len = sizeof(PK11SymKey *);
+	    SK_ai->ptr = alloc_bytes(SK_ai->len, "SK_ai");
+	    memcpy(SK_ai->ptr, &SK_ai_k, SK_ai->len);
 
-
-	SK_ar->len = sizeof(PK11SymKey *);
-	SK_ar->ptr = alloc_bytes(SK_ar->len, "SK_ar");
-	memcpy(SK_ar->ptr, &SK_ar_k, SK_ar->len);
+	    SK_ar->len = sizeof(PK11SymKey *);
+	    SK_ar->ptr = alloc_bytes(SK_ar->len, "SK_ar");
+	    memcpy(SK_ar->ptr, &SK_ar_k, SK_ar->len);
+	}
 
 
-	SK_ei->len = sizeof(PK11SymKey *);
+	/* the AES key, then the salt */
+	SK_ei->len = sizeof(PK11SymKey *) + salt_bytes;
 	SK_ei->ptr = alloc_bytes(SK_ei->len, "SK_ei");
-	memcpy(SK_ei->ptr, &SK_ei_k, SK_ei->len);
+	memcpy(SK_ei->ptr, &SK_ei_k, sizeof(PK11SymKey *));
+	memcpy(SK_ei->ptr + sizeof(PK11SymKey *), salt_ei, salt_bytes);
 
 
-	SK_er->len = sizeof(PK11SymKey *);
+	SK_er->len = sizeof(PK11SymKey *) + salt_bytes;
 	SK_er->ptr = alloc_bytes(SK_er->len, "SK_er");
-	memcpy(SK_er->ptr, &SK_er_k, SK_er->len);
+	memcpy(SK_er->ptr, &SK_er_k, sizeof(PK11SymKey *));
+	memcpy(SK_er->ptr + sizeof(PK11SymKey *), salt_er, salt_bytes);
 
 
 	SK_pi->len = sizeof(PK11SymKey *);
@@ -1543,8 +1581,10 @@ calc_skeyseed_v2(struct pcr_skeyid_q *skq
 #else
 	/* SKEYSEED_T1 */
 	v2genbytes(SK_d,  skd_bytes, "SK_d", &vpss);
-	v2genbytes(SK_ai, ska_bytes, "SK_ai", &vpss);
-	v2genbytes(SK_ar, ska_bytes, "SK_ar", &vpss);
+	if (ska_bytes != 0) {
+	    v2genbytes(SK_ai, ska_bytes, "SK_ai", &vpss);
+	    v2genbytes(SK_ar, ska_bytes, "SK_ar", &vpss);
+	}
 	v2genbytes(SK_ei, ske_bytes, "SK_ei", &vpss);
 	v2genbytes(SK_er, ske_bytes, "SK_er", &vpss);
 	v2genbytes(SK_pi, skp_bytes, "SK_ei", &vpss);
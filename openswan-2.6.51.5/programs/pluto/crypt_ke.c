@@ -50,6 +50,7 @@
 #include "oswlog.h"
 #include "log.h"
 #include "timer.h"
+#include "oswtime.h"
 
 #include "oswcrypto.h"
 
@@ -59,8 +60,9 @@
 # include <pk11pub.h>
 # include <keyhi.h>
 # include "oswconf.h"
+# include <pthread.h>
 
-void calc_ke(struct pluto_crypto_req *r)
+void compute_ke(struct pcr_kenonce *kn)
 {
     chunk_t  prime;
     chunk_t  base;
@@ -68,7 +70,6 @@ void calc_ke(struct pluto_crypto_req *r)
     PK11SlotInfo *slot = NULL;
     SECKEYPrivateKey *privk;
     SECKEYPublicKey   *pubk;
-    struct pcr_kenonce *kn = &r->pcr_d.kn;
     const struct oakley_group_desc *group;
 
     group = lookup_group(kn->oakley_group);
@@ -160,12 +161,11 @@ void calc_nonce(struct pluto_crypto_req *r)
 	       , DEFAULT_NONCE_SIZE));
 }
 #else
-void calc_ke(struct pluto_crypto_req *r)
+void compute_ke(struct pcr_kenonce *kn)
 {
     MP_INT mp_g;
     MP_INT secret;
     chunk_t gi;
-    struct pcr_kenonce *kn = &r->pcr_d.kn;
     const struct oakley_group_desc *group;
 
     group = lookup_group(kn->oakley_group);
@@ -218,6 +218,287 @@ void calc_nonce(struct pluto_crypto_req *r)
 }
 #endif
 
+/*
+ * Pool of precomputed DH key pairs.
+ *
+ * Making a DH key pair costs a modular exponentiation, which used to be
+ * on the path of every KE payload we built.  Instead, the helpers make
+ * key pairs while they have nothing else to do, and calc_ke() takes a
+ * ready one when it can.
+ *
+ * A group gets a pool the first time somebody asks for it.  Once it drops
+ * below the low watermark, idle helpers fill it back up to the high one.
+ * Each key pair is used once, unless --dhpool-reuse gives them a lifetime;
+ * even then, KEs for IKEv2 (single_use) always get a key of their own.
+ *
+ * With NSS the helpers are threads sharing one pool.  Without it, every
+ * helper process has its own, and the main process only sees the answers.
+ */
+#define KE_POOL_GROUPS	16
+
+int ke_pool_size = 8;		/* high watermark; 0 disables the pool */
+int ke_pool_reuse = 0;		/* seconds a key pair may be reused */
+
+struct ke_pool_entry {
+    time_t             made;
+    struct pcr_kenonce kn;	/* as left by compute_ke() */
+};
+
+struct ke_pool {
+    bool          wanted;	/* somebody asked for this group */
+    bool          refilling;	/* fell below low watermark */
+    unsigned int  count;
+    unsigned long generated;
+    unsigned long expired;
+    struct ke_pool_entry entries[KE_POOL_MAX];	/* a stack */
+};
+
+/* where the helpers keep their key pairs */
+static struct ke_pool ke_pools[KE_POOL_GROUPS];
+
+/* what the main process saw come back */
+static struct {
+    unsigned long hits;
+    unsigned long misses;
+} ke_pool_seen[KE_POOL_GROUPS];
+
+#ifdef HAVE_LIBNSS
+static pthread_mutex_t ke_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define ke_pool_lock()		pthread_mutex_lock(&ke_pool_mutex)
+# define ke_pool_unlock()	pthread_mutex_unlock(&ke_pool_mutex)
+#else
+# define ke_pool_lock()		do { } while (0)
+# define ke_pool_unlock()	do { } while (0)
+#endif
+
+static int ke_pool_low(void)
+{
+    int low = ke_pool_size / 4;
+
+    return low > 0 ? low : 1;
+}
+
+static struct ke_pool *ke_pool_for(u_int16_t groupnum)
+{
+    const struct oakley_group_desc *group = lookup_group(groupnum);
+    unsigned int i;
+
+    if (group == NULL || ke_pool_size <= 0)
+	return NULL;
+
+    i = group - oakley_group;
+    return i < KE_POOL_GROUPS ? &ke_pools[i] : NULL;
+}
+
+static void ke_pool_discard(struct ke_pool_entry *e)
+{
+#ifdef HAVE_LIBNSS
+    SECKEYPrivateKey *privk;
+    SECKEYPublicKey *pubk;
+
+    memcpy(&privk, wire_chunk_ptr(&e->kn, &e->kn.secret), sizeof(privk));
+    memcpy(&pubk, wire_chunk_ptr(&e->kn, &e->kn.pubk), sizeof(pubk));
+    SECKEY_DestroyPrivateKey(privk);
+    SECKEY_DestroyPublicKey(pubk);
+#endif
+    memset(&e->kn, 0, sizeof(e->kn));
+}
+
+/*
+ * give the caller its own copy of a key pair that stays in the pool.
+ */
+static void ke_pool_share(struct pcr_kenonce *kn)
+{
+#ifdef HAVE_LIBNSS
+    SECKEYPrivateKey *privk;
+    SECKEYPublicKey *pubk;
+
+    memcpy(&privk, wire_chunk_ptr(kn, &kn->secret), sizeof(privk));
+    memcpy(&pubk, wire_chunk_ptr(kn, &kn->pubk), sizeof(pubk));
+    privk = SECKEY_CopyPrivateKey(privk);
+    pubk = SECKEY_CopyPublicKey(pubk);
+    memcpy(wire_chunk_ptr(kn, &kn->secret), &privk, sizeof(privk));
+    memcpy(wire_chunk_ptr(kn, &kn->pubk), &pubk, sizeof(pubk));
+#else
+    (void)kn;
+#endif
+}
+
+/*
+ * fill in the KE part of kn from the pool, if there is a key pair ready.
+ * Runs in the helpers, and must be called before anything else is put
+ * into kn's space.
+ */
+bool ke_pool_take(struct pcr_kenonce *kn)
+{
+    struct ke_pool *p = ke_pool_for(kn->oakley_group);
+    u_int16_t groupnum = kn->oakley_group;
+    bool single_use = kn->single_use;
+    bool got = FALSE;
+
+    if (p == NULL)
+	return FALSE;
+
+    passert(kn->thespace.start == 0);
+
+    ke_pool_lock();
+    p->wanted = TRUE;
+
+    while (p->count > 0 && !got) {
+	struct ke_pool_entry *e = &p->entries[p->count - 1];
+	bool keep = !single_use && ke_pool_reuse > 0;
+
+	if (ke_pool_reuse > 0 && now() - e->made > ke_pool_reuse) {
+	    /* too old to hand out again */
+	    ke_pool_discard(e);
+	    p->count--;
+	    p->expired++;
+	    continue;
+	}
+
+	*kn = e->kn;
+	if (keep) {
+	    ke_pool_share(kn);
+	} else {
+	    memset(&e->kn, 0, sizeof(e->kn));
+	    p->count--;
+	}
+	got = TRUE;
+    }
+
+    if (p->count < (unsigned)ke_pool_low())
+	p->refilling = TRUE;
+    ke_pool_unlock();
+
+    kn->oakley_group = groupnum;
+    kn->single_use = single_use;
+    kn->pooled = got;
+
+    if (got) {
+	DBG(DBG_CRYPT, DBG_log("using pooled DH key pair for %s"
+			       , enum_show(&oakley_group_names, groupnum)));
+    }
+    return got;
+}
+
+/*
+ * make one key pair for a pool that wants it.
+ * Returns FALSE when there is nothing left to do.
+ */
+bool ke_pool_refill(void)
+{
+    struct ke_pool_entry fresh;
+    struct ke_pool *p = NULL;
+    unsigned int i;
+
+    if (ke_pool_size <= 0)
+	return FALSE;
+
+    ke_pool_lock();
+    for (i = 0; i < KE_POOL_GROUPS && i < oakley_group_size; i++) {
+	if (ke_pools[i].wanted && ke_pools[i].refilling) {
+	    p = &ke_pools[i];
+	    break;
+	}
+    }
+    ke_pool_unlock();
+
+    if (p == NULL)
+	return FALSE;
+
+    /* the expensive part happens without the lock */
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.kn.thespace.start = 0;
+    fresh.kn.thespace.len   = sizeof(fresh.kn.space);
+    fresh.kn.oakley_group   = oakley_group[i].group;
+    compute_ke(&fresh.kn);
+
+    ke_pool_lock();
+    fresh.made = now();
+    if (p->count < (unsigned)ke_pool_size && p->count < KE_POOL_MAX) {
+	p->entries[p->count++] = fresh;
+	p->generated++;
+	fresh.kn.secret.len = 0;
+    }
+    if (p->count >= (unsigned)ke_pool_size || p->count >= KE_POOL_MAX)
+	p->refilling = FALSE;
+    ke_pool_unlock();
+
+    if (fresh.kn.secret.len != 0) {
+	/* another helper filled it up first */
+	ke_pool_discard(&fresh);
+    }
+    return TRUE;
+}
+
+/*
+ * account for a KE answer coming back to the main process.
+ */
+void ke_pool_note(struct pluto_crypto_req *r)
+{
+    const struct oakley_group_desc *group;
+    unsigned int i;
+
+    if (r->pcr_type != pcr_build_kenonce)
+	return;
+
+    group = lookup_group(r->pcr_d.kn.oakley_group);
+    if (group == NULL)
+	return;
+
+    i = group - oakley_group;
+    if (i >= KE_POOL_GROUPS)
+	return;
+
+    if (r->pcr_d.kn.pooled)
+	ke_pool_seen[i].hits++;
+    else
+	ke_pool_seen[i].misses++;
+}
+
+void show_ke_pool_status(void)
+{
+    unsigned int i;
+
+    if (ke_pool_size <= 0)
+	return;
+
+    for (i = 0; i < KE_POOL_GROUPS && i < oakley_group_size; i++) {
+	if (ke_pool_seen[i].hits + ke_pool_seen[i].misses == 0)
+	    continue;
+
+#ifdef HAVE_LIBNSS
+	ke_pool_lock();
+	whack_log(RC_COMMENT, "stats dh pool: group=%s hits=%lu misses=%lu"
+		  " level=%u low=%d high=%d generated=%lu expired=%lu"
+		  , enum_show(&oakley_group_names, oakley_group[i].group)
+		  , ke_pool_seen[i].hits, ke_pool_seen[i].misses
+		  , ke_pools[i].count, ke_pool_low(), ke_pool_size
+		  , ke_pools[i].generated, ke_pools[i].expired);
+	ke_pool_unlock();
+#else
+	/* the pools themselves live in the helper processes */
+	whack_log(RC_COMMENT, "stats dh pool: group=%s hits=%lu misses=%lu"
+		  " low=%d high=%d"
+		  , enum_show(&oakley_group_names, oakley_group[i].group)
+		  , ke_pool_seen[i].hits, ke_pool_seen[i].misses
+		  , ke_pool_low(), ke_pool_size);
+#endif
+    }
+}
+
+/*
+ * make the KE, or better, take one the helpers made earlier.
+ */
+void calc_ke(struct pluto_crypto_req *r)
+{
+    struct pcr_kenonce *kn = &r->pcr_d.kn;
+
+    if(!ke_pool_take(kn)) {
+	compute_ke(kn);
+    }
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -95,10 +95,9 @@ stf_status start_dh_secretiv(struct pluto_crypto_req_cont *cn
     pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->secret, st->st_sec_chunk);
 
 /*˺ӦNonceKEϢȫspace*/
-#ifdef HAVE_LIBNSS
     /*copying required encryption algo*/
-    /*dhq->encrypt_algo = st->st_oakley.encrypt;*/
     dhq->encrypter = st->st_oakley.encrypter;
+#ifdef HAVE_LIBNSS
     DBG(DBG_CRYPT, DBG_log("Copying DH pub key pointer to be sent to a thread helper"));
     pluto_crypto_copychunk(&dhq->thespace, dhq->space , &dhq->pubk, st->pubk);
 #endif
@@ -163,6 +162,10 @@ void finish_dh_secretiv(struct state *st,
 /*֤ԿϢǷҪ*/
     ikev2_validate_key_lengths(st);
 
+    /* schedule SK_e and SK_a now, rather than for each message */
+    free_sk_keys(st);
+    (void) ikev2_sk_keys(st);
+
     st->hidden_variables.st_skeyid_calculated = TRUE;
 }
 
@@ -298,10 +301,9 @@ stf_status start_dh_v2(struct pluto_crypto_req_cont *cn
     pluto_crypto_copychunk(&dhq->thespace, dhq->space
 			   , &dhq->secret, st->st_sec_chunk);
 
-#ifdef HAVE_LIBNSS
     /*copying required encryption algo*/
-    /*dhq->encrypt_algo = st->st_oakley.encrypter->common.algo_v2id;*/
     dhq->encrypter = st->st_oakley.encrypter;
+#ifdef HAVE_LIBNSS
     DBG(DBG_CRYPT, DBG_log("Copying DH pub key pointer to be sent to a thread helper"));
     pluto_crypto_copychunk(&dhq->thespace, dhq->space
                           , &dhq->pubk, st->pubk);
@@ -95,6 +95,9 @@ static struct encrypt_desc crypto_encrypter_des =
 
 #ifdef USE_3DES
 static void do_3des(u_int8_t *buf, size_t buf_len, u_int8_t *key, size_t key_size, u_int8_t *iv, bool enc);
+static void *des3_key_new(const u_int8_t *key, size_t key_size);
+static void des3_key_crypt(void *sched, u_int8_t *buf, size_t buf_len, u_int8_t *iv, bool enc);
+static void des3_key_free(void *sched);
 static struct encrypt_desc crypto_encrypter_3des =
 {
     common: {name: "oakley_3des_cbc",
@@ -109,6 +112,9 @@ static struct encrypt_desc crypto_encrypter_3des =
     keyminlen: 	DES_CBC_BLOCK_SIZE * 3 * BITS_PER_BYTE,
     keymaxlen: 	DES_CBC_BLOCK_SIZE * 3 * BITS_PER_BYTE,
     do_crypt: 	do_3des,
+    key_new: 	des3_key_new,
+    key_crypt: 	des3_key_crypt,
+    key_free: 	des3_key_free,
 };
 #endif
 
@@ -345,6 +351,41 @@ do_3des(u_int8_t *buf, size_t buf_len
                          (des_cblock *)iv, enc);
 }
 
+/* the same, with the three key schedules computed once per SA */
+static void *
+des3_key_new(const u_int8_t *key, size_t key_size)
+{
+    des_key_schedule *ks = alloc_bytes(sizeof(des_key_schedule) * 3
+				       , "3des key schedule");
+    des_cblock k[3];	/* des_set_key() wants it writable */
+
+    passert(key_size==(DES_CBC_BLOCK_SIZE * 3));
+
+    memcpy(k, key, sizeof(k));
+    (void) oswcrypto.des_set_key(&k[0], ks[0]);
+    (void) oswcrypto.des_set_key(&k[1], ks[1]);
+    (void) oswcrypto.des_set_key(&k[2], ks[2]);
+    memset(k, 0, sizeof(k));
+    return ks;
+}
+
+static void
+des3_key_crypt(void *sched, u_int8_t *buf, size_t buf_len, u_int8_t *iv, bool enc)
+{
+    des_key_schedule *ks = sched;
+
+    oswcrypto.des_ede3_cbc_encrypt((des_cblock *)buf, (des_cblock *)buf, buf_len,
+                         ks[0], ks[1], ks[2],
+                         (des_cblock *)iv, enc);
+}
+
+static void
+des3_key_free(void *sched)
+{
+    memset(sched, 0, sizeof(des_key_schedule) * 3);
+    pfree(sched);
+}
+
 /* hash and prf routines */
 /*==========================================================
  *
@@ -361,6 +402,115 @@ struct encrypt_desc *crypto_get_encrypter(int alg)
 	return (struct encrypt_desc *) ike_alg_find(IKE_ALG_ENCRYPT, alg, 0);
 }
 
+/* Per-SA cipher keys
+ *
+ * A crypt_key holds a key together with whatever the cipher could
+ * compute from it in advance (its key_new() hook), so that a message
+ * costs only the encryption itself.  The key is copied: under NSS that
+ * is the PK11SymKey pointer, which the key_new() hook references.
+ */
+struct crypt_key *
+crypt_key_new(const struct encrypt_desc *e, chunk_t key)
+{
+    struct crypt_key *k = alloc_thing(struct crypt_key, "crypt key");
+
+    k->e = e;
+    clonetochunk(k->key, key.ptr, key.len, "crypt key value");
+    if (e->key_new != NULL)
+	k->sched = e->key_new(k->key.ptr, k->key.len);
+    return k;
+}
+
+/* is k (still) the key for e and key? */
+bool
+crypt_key_matches(const struct crypt_key *k
+		  , const struct encrypt_desc *e, chunk_t key)
+{
+    return k != NULL && k->e == e && k->key.len == key.len
+	&& memcmp(k->key.ptr, key.ptr, key.len) == 0;
+}
+
+void
+crypt_key_crypt(struct crypt_key *k, u_int8_t *buf, size_t size
+		, u_int8_t *iv, bool enc)
+{
+    if (k->sched != NULL)
+	k->e->key_crypt(k->sched, buf, size, iv, enc);
+    else
+	k->e->do_crypt(buf, size, k->key.ptr, k->key.len, iv, enc);
+}
+
+/* AEAD ciphers: encrypt and seal, or check and decrypt, in one pass */
+bool
+crypt_key_aead(struct crypt_key *k, u_int8_t *buf, size_t size
+	       , const u_int8_t *iv, const u_int8_t *aad, size_t aad_size
+	       , u_int8_t *tag, bool enc)
+{
+    passert(k->sched != NULL && ike_alg_enc_aead(k->e));
+    return k->e->key_aead(k->sched, buf, size, iv, aad, aad_size, tag, enc);
+}
+
+void
+crypt_key_free(struct crypt_key **kp)
+{
+    struct crypt_key *k = *kp;
+
+    if (k == NULL)
+	return;
+    if (k->sched != NULL)
+	k->e->key_free(k->sched);
+    memset(k->key.ptr, 0, k->key.len);
+    freeanychunk(k->key);
+    pfree(k);
+    *kp = NULL;
+}
+
+/* IKEv2 SK_e and SK_a of a parent SA, set up once it has them.
+ * Returns NULL if it has not (yet).  An AEAD cipher has no SK_a.
+ */
+struct sk_keys *
+ikev2_sk_keys(struct state *st)
+{
+    const struct encrypt_desc *e = st->st_oakley.encrypter;
+    const struct hash_desc *h = st->st_oakley.integ_hasher;
+    struct sk_keys *sk = st->st_sk_keys;
+
+    if (sk != NULL)
+	return sk;
+    if (e == NULL
+	|| st->st_skey_ei.ptr == NULL || st->st_skey_er.ptr == NULL)
+	return NULL;
+    if (!ike_alg_enc_aead(e)
+	&& (h == NULL
+	    || st->st_skey_ai.ptr == NULL || st->st_skey_ar.ptr == NULL))
+	return NULL;
+
+    sk = alloc_thing(struct sk_keys, "IKEv2 SK keys");
+    sk->ei = crypt_key_new(e, st->st_skey_ei);
+    sk->er = crypt_key_new(e, st->st_skey_er);
+    if (!ike_alg_enc_aead(e)) {
+	sk->ai = hmac_key_new(h, st->st_skey_ai);
+	sk->ar = hmac_key_new(h, st->st_skey_ar);
+    }
+    st->st_sk_keys = sk;
+    return sk;
+}
+
+void
+free_sk_keys(struct state *st)
+{
+    struct sk_keys *sk = st->st_sk_keys;
+
+    if (sk == NULL)
+	return;
+    crypt_key_free(&sk->ei);
+    crypt_key_free(&sk->er);
+    hmac_key_free(&sk->ai);
+    hmac_key_free(&sk->ar);
+    pfree(sk);
+    st->st_sk_keys = NULL;
+}
+
 void
 crypto_cbc_encrypt(const struct encrypt_desc *e, bool enc
 		   , u_int8_t *buf, size_t size, struct state *st)
@@ -375,13 +525,13 @@ crypto_cbc_encrypt(const struct encrypt_desc *e, bool enc
 		  , st->st_enc_key.len, st->st_new_iv, enc));
 #endif
 
-    e->do_crypt(buf, size, st->st_enc_key.ptr
-		, st->st_enc_key.len, st->st_new_iv, enc);
+    /* schedule st_enc_key on first use, and again if it changes */
+    if (!crypt_key_matches(st->st_enc_ctx, e, st->st_enc_key)) {
+	crypt_key_free(&st->st_enc_ctx);
+	st->st_enc_ctx = crypt_key_new(e, st->st_enc_key);
+    }
 
-    /*
-      e->set_key(&ctx, st->st_enc_key.ptr, st->st_enc_key.len);
-      e->cbc_crypt(&ctx, buf, size, st->st_new_iv, enc);
-    */
+    crypt_key_crypt(st->st_enc_ctx, buf, size, st->st_new_iv, enc);
 }
 
 /*
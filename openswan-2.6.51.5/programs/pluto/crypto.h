@@ -71,6 +71,21 @@ struct encrypt_desc *crypto_get_encrypter(int alg);
 struct hash_desc *crypto_get_hasher(oakley_hash_t alg);
 void crypto_cbc_encrypt(const struct encrypt_desc *e, bool enc, u_int8_t *buf, size_t size, struct state *st);
 
+/* a cipher key, scheduled once for all the messages of an SA */
+struct crypt_key {
+    const struct encrypt_desc *e;
+    chunk_t key;		/* copy, for e->do_crypt() */
+    void *sched;		/* e->key_new()'s, if e has one */
+};
+
+extern struct crypt_key *crypt_key_new(const struct encrypt_desc *e, chunk_t key);
+extern bool crypt_key_matches(const struct crypt_key *k, const struct encrypt_desc *e, chunk_t key);
+extern void crypt_key_crypt(struct crypt_key *k, u_int8_t *buf, size_t size, u_int8_t *iv, bool enc);
+extern bool crypt_key_aead(struct crypt_key *k, u_int8_t *buf, size_t size
+			   , const u_int8_t *iv, const u_int8_t *aad, size_t aad_size
+			   , u_int8_t *tag, bool enc);
+extern void crypt_key_free(struct crypt_key **kp);
+
 #define update_iv(st)	passert(st->st_new_iv_len <= sizeof(st->st_iv)); memcpy((st)->st_iv, (st)->st_new_iv \
     , (st)->st_iv_len = (st)->st_new_iv_len)
 
@@ -141,8 +156,28 @@ extern void hmac_final(u_char *output, struct hmac_ctx *ctx);
 	(ch).ptr = alloc_bytes((ch).len, name); \
 	hmac_final((ch).ptr, (ctx)); \
     }
+
+/* an HMAC key with its pads already worked out, for all the messages
+ * of an SA: hmac_init_key() then replaces hmac_init().
+ */
+struct hmac_key {
+    struct hmac_ctx ctx;	/* keyed, with nothing hashed */
+};
+
+extern struct hmac_key *hmac_key_new(const struct hash_desc *h, chunk_t key);
+extern void hmac_init_key(struct hmac_ctx *ctx, const struct hmac_key *k);
+extern void hmac_key_free(struct hmac_key **kp);
 #endif
 
+/* IKEv2 SK_e and SK_a, kept by the parent SA */
+struct sk_keys {
+    struct crypt_key *ei, *er;
+    struct hmac_key  *ai, *ar;	/* NULL with an AEAD cipher */
+};
+
+extern struct sk_keys *ikev2_sk_keys(struct state *st);
+extern void free_sk_keys(struct state *st);
+
 #ifdef HAVE_LIBNSS
 extern CK_MECHANISM_TYPE nss_key_derivation_mech(const struct hash_desc *hasher);
 extern void nss_symkey_log(PK11SymKey *key, const char *msg);
@@ -17,6 +17,9 @@
  * (all the code that used to be here is now in ikev1.c)
  */
 
+#ifdef HAVE_RECVMMSG
+# define _GNU_SOURCE	/* for recvmmsg(2) */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -30,6 +33,10 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#ifdef HAVE_RECVMMSG
+#  include <sys/uio.h>	/* struct iovec */
+#endif
+
 #if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
 #  include <asm/types.h>	/* for __u8, __u32 */
 #  include <linux/errqueue.h>
@@ -76,14 +83,47 @@
 #include "dpd.h"
 #endif
 #include "udpfromto.h"
+#include "ratelimit.h"
 #include "tpm/tpm.h"
 
 /* This file does basic header checking and demux of
  * incoming packets.
  */
 
+/* one datagram as it came off the socket, before read_packet digests it */
+union comm_sockaddr {
+    struct sockaddr sa;
+    struct sockaddr_in sa_in4;
+    struct sockaddr_in6 sa_in6;
+};
+
+struct comm_packet {
+    u_int8_t *slab;		/* MD_SLAB_SIZE buffer holding the datagram */
+    int len;			/* -1 if the read failed */
+    int err;			/* errno of the failed read */
+    union comm_sockaddr from;
+    socklen_t from_len;
+};
+
+#ifdef HAVE_RECVMMSG
+# define COMM_RECV_MAX	COMM_RECV_BATCH
+#else
+# define COMM_RECV_MAX	1
+#endif
+
+/* receive counters, reported by show_comm_status() */
+static struct {
+    unsigned long batches;	/* reads that returned datagrams */
+    unsigned long packets;	/* datagrams returned */
+    unsigned long full;		/* reads that filled all COMM_RECV_MAX slots */
+    unsigned int largest;	/* most datagrams returned by one read */
+    unsigned long kernel_drops;	/* SO_RXQ_OVFL: socket queue overflows */
+} comm_stats;
+
 /* forward declarations */
-static bool read_packet(struct msg_digest *md);
+static int recv_packets(struct iface_port *ifp
+			, struct comm_packet *pkts, int max);
+static bool read_packet(struct msg_digest *md, const struct comm_packet *pkt);
 
 /* Reply messages are built in this buffer.
  * Only one state transition function can be using it at a time
@@ -193,13 +233,19 @@ process_packet(struct msg_digest **mdp)
  * process_packet sets md to NULL to prevent the msg_digest being freed.
  * Someone else must ensure that msg_digest is freed eventually.
  *
- * read_packet is broken out to minimize the lifetime of the
- * enormous input packet buffer, an auto.
+ * recv_packets reads up to COMM_RECV_MAX datagrams at once, each into
+ * its own slab; read_packet copies each into the msg_digest, and the
+ * slab goes back to the pool at once.  A peer over its rate limit (see
+ * ratelimit.c) is turned away here, before any state lookup or crypto.
+ * Returns the number of datagrams read: 0 once the socket is empty.
  */
-void
-comm_handle(const struct iface_port *ifp)
+int
+comm_handle(struct iface_port *ifp)
 {
     static struct msg_digest *md;
+    struct comm_packet pkts[COMM_RECV_MAX];
+    int n, i;
+    bool ok;
 
 #if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
     /* Even though select(2) says that there is a message,
@@ -213,25 +259,209 @@ comm_handle(const struct iface_port *ifp)
      * just return on failure.
      */
     if (!check_msg_errqueue(ifp, POLLIN))
-	return;	/* no normal message to read */
+	return 0;	/* no normal message to read */
 #endif /* defined(IP_RECVERR) && defined(MSG_ERRQUEUE) */
 
-    md = alloc_md();
-    md->iface = ifp;
-
 #ifdef DEBUG_WITH_PAUSE
     pause();
 #endif
-    if (read_packet(md))
-	process_packet(&md);
+    n = recv_packets(ifp, pkts, COMM_RECV_MAX);
+
+    for (i = 0; i < n; i++)
+    {
+	md = alloc_md();
+	md->iface = ifp;
+
+	ok = read_packet(md, &pkts[i]);
+	release_md_slab(pkts[i].slab);
+	if (ok && ratelimit_admit(ifp, &md->sender, md->sender_port
+				  , md->packet_pbs.start
+				  , pbs_room(&md->packet_pbs)))
+	    process_packet(&md);
+
+	if (md != NULL)
+	    release_md(md);
+
+	cur_state = NULL;
+	reset_cur_connection();
+	cur_from = NULL;
+    }
+    return n;
+}
+
+static void
+comm_note_batch(int n, int max)
+{
+    comm_stats.batches++;
+    comm_stats.packets += n;
+    if (n == max)
+	comm_stats.full++;
+    if ((unsigned)n > comm_stats.largest)
+	comm_stats.largest = n;
+}
+
+void
+show_comm_status(void)
+{
+    unsigned long avg = comm_stats.batches == 0 ? 0
+	: comm_stats.packets * 100 / comm_stats.batches;
+
+    whack_log(RC_COMMENT, "stats ike receive: batches=%lu packets=%lu"
+	      " avg=%lu.%02lu largest=%u full=%lu (of %d) kernel_drops=%lu"
+	      , comm_stats.batches, comm_stats.packets
+	      , avg / 100, avg % 100
+	      , comm_stats.largest, comm_stats.full, COMM_RECV_MAX
+	      , comm_stats.kernel_drops);
+}
+
+#ifdef HAVE_RECVMMSG
 
-    if (md != NULL)
-	release_md(md);
+#ifdef SO_RXQ_OVFL
+/* SO_RXQ_OVFL hands us the socket's running count of datagrams
+ * dropped because its receive queue was full.
+ */
+static void
+recv_note_drops(struct iface_port *ifp, struct msghdr *msg)
+{
+    struct cmsghdr *cm;
+
+    for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm))
+    {
+	u_int32_t dropped;
+
+	if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SO_RXQ_OVFL)
+	    continue;
 
-    cur_state = NULL;
-    reset_cur_connection();
-    cur_from = NULL;
+	memcpy(&dropped, CMSG_DATA(cm), sizeof(dropped));
+	if (dropped != ifp->rx_dropped)
+	{
+	    u_int32_t delta = dropped - ifp->rx_dropped;
+
+	    DBG(DBG_CONTROL
+		, DBG_log("kernel dropped %u IKE packets on %s:%u"
+			  , (unsigned)delta, ifp->ip_dev->id_rname, ifp->port));
+	    comm_stats.kernel_drops += delta;
+	    ifp->rx_dropped = dropped;
+	}
+    }
 }
+#endif
+
+/* read up to max datagrams with one recvmmsg(2).
+ * A failed read is returned as a single packet with len == -1
+ * so that read_packet reports it as it always has; an empty
+ * socket returns nothing.
+ */
+static int
+recv_packets(struct iface_port *ifp, struct comm_packet *pkts, int max)
+{
+    struct mmsghdr msgs[COMM_RECV_BATCH];
+    struct iovec iov[COMM_RECV_BATCH];
+#ifdef SO_RXQ_OVFL
+    union {
+	struct cmsghdr align;
+	char buf[CMSG_SPACE(sizeof(u_int32_t))];
+    } ctl[COMM_RECV_BATCH];
+#endif
+    int i, n;
+
+    passert(max <= COMM_RECV_BATCH);
+    zero(&msgs);
+
+    for (i = 0; i < max; i++)
+    {
+	pkts[i].slab = alloc_md_slab();
+	zero(&pkts[i].from);
+	iov[i].iov_base = pkts[i].slab;
+	iov[i].iov_len = MD_SLAB_SIZE;
+	msgs[i].msg_hdr.msg_name = &pkts[i].from;
+	msgs[i].msg_hdr.msg_namelen = sizeof(pkts[i].from);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef SO_RXQ_OVFL
+	msgs[i].msg_hdr.msg_control = &ctl[i];
+	msgs[i].msg_hdr.msg_controllen = sizeof(ctl[i]);
+#endif
+    }
+
+    n = recvmmsg(ifp->fd, msgs, max, MSG_DONTWAIT, NULL);
+    if (n == -1)
+    {
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	    n = 0;
+	}
+	else
+	{
+	    pkts[0].len = -1;
+	    pkts[0].err = errno;
+	    pkts[0].from_len = msgs[0].msg_hdr.msg_namelen;
+	    n = 1;
+	}
+    }
+    else
+    {
+	for (i = 0; i < n; i++)
+	{
+	    pkts[i].len = msgs[i].msg_len;
+	    pkts[i].err = 0;
+	    pkts[i].from_len = msgs[i].msg_hdr.msg_namelen;
+#ifdef SO_RXQ_OVFL
+	    recv_note_drops(ifp, &msgs[i].msg_hdr);
+#endif
+	}
+	if (n > 0)
+	    comm_note_batch(n, max);
+    }
+
+    for (i = n; i < max; i++)
+	release_md_slab(pkts[i].slab);
+
+    return n;
+}
+
+#else /* !HAVE_RECVMMSG */
+
+/* read one datagram; nothing if the socket is empty */
+static int
+recv_packets(struct iface_port *ifp, struct comm_packet *pkts, int max UNUSED)
+{
+    struct comm_packet *pkt = &pkts[0];
+#if defined(HAVE_UDPFROMTO)
+    union comm_sockaddr to;
+    socklen_t to_len = sizeof(to);
+#endif
+
+    pkt->slab = alloc_md_slab();
+    zero(&pkt->from);
+    pkt->from_len = sizeof(pkt->from);
+
+#if defined(HAVE_UDPFROMTO)
+    pkt->len = recvfromto(ifp->fd, pkt->slab
+			  , MD_SLAB_SIZE, /*flags*/0
+			  , &pkt->from.sa, &pkt->from_len
+			  , &to.sa, &to_len);
+#else
+    pkt->len = recvfrom(ifp->fd, pkt->slab
+			, MD_SLAB_SIZE, /*flags*/0
+			, &pkt->from.sa, &pkt->from_len);
+#endif
+    /* we do not do anything with *to* addresses yet... we will */
+
+    pkt->err = pkt->len == -1 ? errno : 0;
+    if (pkt->len != -1)
+	comm_note_batch(1, 1);
+    else if (pkt->err == EAGAIN || pkt->err == EWOULDBLOCK)
+    {
+	/* the socket is non-blocking, and empty */
+	release_md_slab(pkt->slab);
+	return 0;
+    }
+
+    return 1;
+}
+
+#endif /* !HAVE_RECVMMSG */
 
 bool natt_skip_nonesp(const struct iface_port *ifp
                       , const ip_address *cur_from
@@ -260,71 +490,39 @@ bool natt_skip_nonesp(const struct iface_port *ifp
     return TRUE;
 }
 
-/* read the message.
- * Since we don't know its size, we read it into
- * an overly large buffer and then copy it to a
- * new, properly sized buffer.
+/* digest a datagram read by recv_packets.
+ * The datagram is copied out of its slab, which the caller releases.
  */
 static bool
-read_packet(struct msg_digest *md)
+read_packet(struct msg_digest *md, const struct comm_packet *pkt)
 {
     const struct iface_port *ifp = md->iface;
-    int packet_len;
-    /* ??? this buffer seems *way* too big */
-    u_int8_t bigbuffer[MAX_INPUT_UDP_SIZE];
-    u_int8_t *_buffer = bigbuffer;
-
-    union
-    {
-	struct sockaddr sa;
-	struct sockaddr_in sa_in4;
-	struct sockaddr_in6 sa_in6;
-    } from
-#if defined(HAVE_UDPFROMTO)
-	  ,to
-#endif
-	  ;
-    socklen_t from_len = sizeof(from);
-#if defined(HAVE_UDPFROMTO)
-    socklen_t to_len   = sizeof(to);
-#endif
+    int packet_len = pkt->len;
+    u_int8_t *_buffer = pkt->slab;
+    socklen_t from_len = pkt->from_len;
     err_t from_ugh = NULL;
     static const char undisclosed[] = "unknown source";
 
     happy(anyaddr(addrtypeof(&ifp->ip_addr), &md->sender));
-    zero(&from.sa);
-
-#if defined(HAVE_UDPFROMTO)
-    packet_len = recvfromto(ifp->fd, bigbuffer
-			    , sizeof(bigbuffer), /*flags*/0
-			    , &from.sa, &from_len
-			    , &to.sa, &to_len);
-#else
-    packet_len = recvfrom(ifp->fd, bigbuffer
-			  , sizeof(bigbuffer), /*flags*/0
-			  , &from.sa, &from_len);
-#endif
-
-    /* we do not do anything with *to* addresses yet... we will */
 
     /* First: digest the from address.
      * We presume that nothing here disturbs errno.
      */
     if (packet_len == -1
-    && from_len == sizeof(from)
-    && all_zero((const void *)&from.sa, sizeof(from)))
+    && from_len == sizeof(pkt->from)
+    && all_zero((const void *)&pkt->from.sa, sizeof(pkt->from)))
     {
 	/* "from" is untouched -- not set by recvfrom */
 	from_ugh = undisclosed;
     }
     else if (from_len
-    < (int) (offsetof(struct sockaddr, sa_family) + sizeof(from.sa.sa_family)))
+    < (int) (offsetof(struct sockaddr, sa_family) + sizeof(pkt->from.sa.sa_family)))
     {
 	from_ugh = "truncated";
     }
     else
     {
-	const struct af_info *afi = aftoinfo(from.sa.sa_family);
+	const struct af_info *afi = aftoinfo(pkt->from.sa.sa_family);
 
 	if (afi == NULL)
 	{
@@ -336,21 +534,21 @@ read_packet(struct msg_digest *md)
 	}
 	else
 	{
-	    switch (from.sa.sa_family)
+	    switch (pkt->from.sa.sa_family)
 	    {
 	    case AF_INET:
-		from_ugh = initaddr((void *) &from.sa_in4.sin_addr
-				    , sizeof(from.sa_in4.sin_addr)
+		from_ugh = initaddr((const void *) &pkt->from.sa_in4.sin_addr
+				    , sizeof(pkt->from.sa_in4.sin_addr)
 				    , AF_INET, &md->sender);
-		setportof(from.sa_in4.sin_port, &md->sender);
-		md->sender_port = ntohs(from.sa_in4.sin_port);
+		setportof(pkt->from.sa_in4.sin_port, &md->sender);
+		md->sender_port = ntohs(pkt->from.sa_in4.sin_port);
 		break;
 	    case AF_INET6:
-		from_ugh = initaddr((void *) &from.sa_in6.sin6_addr
-				    , sizeof(from.sa_in6.sin6_addr)
+		from_ugh = initaddr((const void *) &pkt->from.sa_in6.sin6_addr
+				    , sizeof(pkt->from.sa_in6.sin6_addr)
 				    , AF_INET6, &md->sender);
-		setportof(from.sa_in6.sin6_port, &md->sender);
-		md->sender_port = ntohs(from.sa_in6.sin6_port);
+		setportof(pkt->from.sa_in6.sin6_port, &md->sender);
+		md->sender_port = ntohs(pkt->from.sa_in6.sin6_port);
 		break;
 	    }
 	}
@@ -359,6 +557,7 @@ read_packet(struct msg_digest *md)
     /* now we report any actual I/O error */
     if (packet_len == -1)
     {
+	errno = pkt->err;	/* for log_errno */
 	if (from_ugh == undisclosed
 	&& errno == ECONNREFUSED)
 	{
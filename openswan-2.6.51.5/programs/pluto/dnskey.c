@@ -543,7 +543,8 @@ static field_desc qr_header_fields[] = {
 static struct_desc qr_header_desc = {
     "Query Response Header",
     qr_header_fields,
-    sizeof(struct qr_header)
+    sizeof(struct qr_header),
+    NULL, NULL
 };
 
 /* Messages for codes in RCODE (see RFC 1035 4.1.1) */
@@ -681,7 +682,8 @@ static field_desc qs_fixed_fields[] = {
 static struct_desc qs_fixed_desc = {
     "Question Section entry fixed part",
     qs_fixed_fields,
-    sizeof(struct qs_fixed)
+    sizeof(struct qs_fixed),
+    NULL, NULL
 };
 
 /* 4.1.3. Resource record format:
@@ -727,7 +729,8 @@ static struct_desc rr_fixed_desc = {
     "Resource Record fixed part",
     rr_fixed_fields,
     /* note: following is tricky: avoids padding problems */
-    offsetof(struct rr_fixed, rdlength) + sizeof(u_int16_t)
+    offsetof(struct rr_fixed, rdlength) + sizeof(u_int16_t),
+    NULL, NULL
 };
 
 /* RFC 1035 3.3.14: TXT RRs have text in the RDATA field.
@@ -764,7 +767,8 @@ static field_desc key_rdata_fields[] = {
 static struct_desc key_rdata_desc = {
     "KEY RR RData fixed part",
     key_rdata_fields,
-    sizeof(struct key_rdata)
+    sizeof(struct key_rdata),
+    NULL, NULL
 };
 
 /* RFC 2535 4.1 SIG RDATA format:
@@ -814,7 +818,8 @@ static field_desc sig_rdata_fields[] = {
 static struct_desc sig_rdata_desc = {
     "SIG RR RData fixed part",
     sig_rdata_fields,
-    sizeof(struct sig_rdata)
+    sizeof(struct sig_rdata),
+    NULL, NULL
 };
 
 /* handle a KEY Resource Record. */
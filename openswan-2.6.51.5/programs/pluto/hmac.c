@@ -218,6 +218,65 @@ hmac_final(u_char *output, struct hmac_ctx *ctx)
 #endif
 }
 
+/* HMAC keys for the life of an SA
+ *
+ * hmac_init() works the key into the pads every time.  An hmac_key keeps
+ * the result, a keyed context with nothing hashed, to be copied for each
+ * message.  Under NSS that is a digest context that has taken ikey, and
+ * the copy is a PK11_CloneContext(); ikey and okey are referenced again
+ * for each copy because hmac_final() frees them.
+ */
+struct hmac_key *
+hmac_key_new(const struct hash_desc *h, chunk_t key)
+{
+    struct hmac_key *k = alloc_thing(struct hmac_key, "hmac key");
+
+    hmac_init(&k->ctx, h, key.ptr, key.len);
+    return k;
+}
+
+void
+hmac_init_key(struct hmac_ctx *ctx, const struct hmac_key *k)
+{
+    *ctx = k->ctx;
+#ifdef HAVE_LIBNSS
+    ctx->ikey = PK11_ReferenceSymKey(k->ctx.ikey);
+    ctx->okey = PK11_ReferenceSymKey(k->ctx.okey);
+
+    ctx->ctx_nss = PK11_CloneContext(k->ctx.ctx_nss);
+    if (ctx->ctx_nss == NULL) {
+	/* token can't save digest state: start over from ikey */
+	SECStatus status;
+
+	ctx->ctx_nss = PK11_CreateDigestContext(nss_hash_oid(ctx->h));
+	PR_ASSERT(ctx->ctx_nss!=NULL);
+
+	status=PK11_DigestBegin(ctx->ctx_nss);
+	PR_ASSERT(status==SECSuccess);
+
+	status=PK11_DigestKey(ctx->ctx_nss, ctx->ikey);
+	PR_ASSERT(status==SECSuccess);
+    }
+#endif
+}
+
+void
+hmac_key_free(struct hmac_key **kp)
+{
+    struct hmac_key *k = *kp;
+
+    if (k == NULL)
+	return;
+#ifdef HAVE_LIBNSS
+    PK11_DestroyContext(k->ctx.ctx_nss, PR_TRUE);
+    PK11_FreeSymKey(k->ctx.ikey);
+    PK11_FreeSymKey(k->ctx.okey);
+#endif
+    memset(k, 0, sizeof(*k));
+    pfree(k);
+    *kp = NULL;
+}
+
 #ifdef HAVE_LIBNSS
 static SECOidTag nss_hash_oid(const struct hash_desc *hasher)
 {
@@ -104,6 +104,171 @@
 struct IPhost_pair *IPhost_pairs = NULL;
 struct IDhost_pair *IDhost_pairs = NULL;
 
+/* IP host pairs are also hashed on (me, him) for find_host_pair().
+ * Pairs whose him is %any have a table of their own, hashed on me
+ * alone.  Ports are still compared along the chain, since a pair's
+ * port need not be specific.  Both tables double together, from a
+ * static first size.
+ */
+#define IPHP_BUCKETS	64	/* initial size, power of 2 */
+
+static struct IPhost_pair *IPhp_table_static[IPHP_BUCKETS];
+static struct IPhost_pair *IPhp_any_table_static[IPHP_BUCKETS];
+static struct IPhost_pair **IPhp_table = IPhp_table_static;
+static struct IPhost_pair **IPhp_any_table = IPhp_any_table_static;
+static unsigned int IPhp_buckets = IPHP_BUCKETS;
+static unsigned int IPhp_count = 0;
+
+static unsigned int
+IPhp_hash(const ip_address *me, const ip_address *him)
+{
+    unsigned char *b;
+    size_t n = addrbytesptr(me, &b);
+    unsigned int h = 0;
+
+    while (n-- > 0)
+	h = h * 31 + *b++;
+    if (him != NULL)
+    {
+	n = addrbytesptr(him, &b);
+	while (n-- > 0)
+	    h = h * 31 + *b++;
+    }
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (IPhp_buckets - 1);
+}
+
+static struct IPhost_pair **
+IPhp_bucket(const struct IPhost_pair *hp)
+{
+    return hp->him.host_type == KH_ANY
+	? &IPhp_any_table[IPhp_hash(&hp->me.addr, NULL)]
+	: &IPhp_table[IPhp_hash(&hp->me.addr, &hp->him.addr)];
+}
+
+static void
+IPhp_unhash(struct IPhost_pair *hp)
+{
+    struct IPhost_pair **pp;
+
+    for (pp = IPhp_bucket(hp); *pp != hp; pp = &(*pp)->hash_next)
+	passert(*pp != NULL);
+    *pp = hp->hash_next;
+}
+
+static void
+IPhp_resize(unsigned int newsize)
+{
+    struct IPhost_pair **old[2] = { IPhp_table, IPhp_any_table };
+    unsigned int i, t, oldsize = IPhp_buckets;
+
+    IPhp_table = alloc_bytes(newsize * sizeof(*IPhp_table), "host pair table");
+    IPhp_any_table = alloc_bytes(newsize * sizeof(*IPhp_any_table)
+				 , "host pair %any table");
+    IPhp_buckets = newsize;
+
+    /* keep the order of each chain: the first match wins */
+    for (t = 0; t < 2; t++)
+    {
+	for (i = 0; i < oldsize; i++)
+	{
+	    struct IPhost_pair *hp, *next;
+
+	    for (hp = old[t][i]; hp != NULL; hp = next)
+	    {
+		struct IPhost_pair **pp = IPhp_bucket(hp);
+
+		next = hp->hash_next;
+		while (*pp != NULL)
+		    pp = &(*pp)->hash_next;
+		hp->hash_next = NULL;
+		*pp = hp;
+	    }
+	}
+	if (old[t] != IPhp_table_static && old[t] != IPhp_any_table_static)
+	    pfree(old[t]);
+    }
+}
+
+/* put a new host pair on the front of the list, and in the hash */
+static void
+IPhp_link(struct IPhost_pair *hp)
+{
+    struct IPhost_pair **head;
+
+    hp->next = IPhost_pairs;
+    if (IPhost_pairs != NULL)
+	IPhost_pairs->prevp = &hp->next;
+    hp->prevp = &IPhost_pairs;
+    IPhost_pairs = hp;
+
+    if (++IPhp_count > 2 * IPhp_buckets)
+	IPhp_resize(2 * IPhp_buckets);
+    head = IPhp_bucket(hp);
+    hp->hash_next = *head;
+    *head = hp;
+}
+
+/* move a host pair to the front of the list */
+static void
+IPhp_to_front(struct IPhost_pair *hp)
+{
+    if (IPhost_pairs == hp)
+	return;
+
+    *hp->prevp = hp->next;	/* remove hp from list */
+    if (hp->next != NULL)
+	hp->next->prevp = hp->prevp;
+
+    hp->next = IPhost_pairs;	/* and stick it on front */
+    IPhost_pairs->prevp = &hp->next;
+    hp->prevp = &IPhost_pairs;
+    IPhost_pairs = hp;
+}
+
+/* TRUE if a is ahead of b on the list */
+static bool
+IPhp_ahead(const struct IPhost_pair *a, const struct IPhost_pair *b)
+{
+    const struct IPhost_pair *p;
+
+    for (p = IPhost_pairs; p != NULL; p = p->next)
+    {
+	if (p == a)
+	    return TRUE;
+	if (p == b)
+	    return FALSE;
+    }
+    return FALSE;
+}
+
+/* does hp belong to our address me?  An unset me stands for the pairs
+ * that have no address of their own yet.
+ */
+static bool
+IPhp_me_matches(const struct IPhost_pair *hp, const ip_address *me)
+{
+    if (addrtypeof(me) == 0)
+	return addrtypeof(&hp->me.addr) == 0;
+    return sameaddr(&hp->me.addr, me);
+}
+
+/* the peer of a host pair moved (IKEv1 redirect) */
+void
+set_IPhost_pair_him(struct IPhost_pair *hp, const ip_address *him)
+{
+    struct IPhost_pair **head;
+
+    IPhp_unhash(hp);
+    hp->him.addr = *him;
+    head = IPhp_bucket(hp);
+    hp->hash_next = *head;
+    *head = hp;
+    IPhp_to_front(hp);
+}
+
 /*
  * the pending list is a set of related connections which
  * depend upon this conn to be activated before they can
@@ -141,6 +306,8 @@ same_peer_ids(const struct connection *c, const struct connection *d
  * It also moves the relevant pair description to the beginning of the list, so that it can be
  * found faster next time.
  *
+ * The hash chains are kept in list order, so the first match on a
+ * chain is the one a walk of the whole list would have found first.
  */
 struct IPhost_pair *
 find_host_pair(bool exact
@@ -150,10 +317,13 @@ find_host_pair(bool exact
 	       , const ip_address *hisaddr
 	       , u_int16_t hisport)
 {
-    struct IPhost_pair *p, *prev;
+    struct IPhost_pair *p, **pp;
     struct IPhost_pair *bestpair = NULL;
-    struct IPhost_pair *bestpair_prev = NULL;
-    unsigned int bestpair_prio = 0;
+    struct IPhost_pair **bestpair_pp = NULL;
+    struct IPhost_pair **bestpair_head = NULL;
+    bool tight = FALSE;	/* not just a %any match */
+    static const ip_address unset_addr;	/* all zero: no family */
+    const ip_address *me;
 
     /*
      * look for a host-pair that has the right set of ports/address,
@@ -179,68 +349,138 @@ find_host_pair(bool exact
                 , hisaddr ? (addrtot(hisaddr, 0, b2, sizeof(b2)), b2) : "<none>"
                 , hisport, exact ? "exact-match" : "any-match"));
 
-    for (prev = NULL, p = IPhost_pairs; p != NULL; prev = p, p = p->next)
-    {
-	DBG(DBG_CONTROLMORE,
-	    char b1[ADDRTOT_BUF];
-	    char b2[ADDRTOT_BUF];
-            char himtypebuf[KEYWORD_NAME_BUFLEN];
-	    DBG_log("find_host_pair: comparing to me=%s:%d %s him=%s:%d\n"
-                    , (addrtot(&p->me.addr, 0, b1, sizeof(b1)), b1)
-                    , p->me.host_port
-                    , keyword_name(&kw_host_list, p->him.host_type, himtypebuf)
-                    , (addrtot(&p->him.addr, 0, b2, sizeof(b2)), b2)
-                    , p->him.host_port));
-
+    /* not wrapped in do { } while(0): that would swallow the continue */
 #if 0
         /* enable to get way too verbose debug of this function */
-#define FAIL_TO_MATCH_IF(cond) do if(cond) { DBG_log("     failed to match " #cond ); continue; } while(0)
+#define FAIL_TO_MATCH_IF(cond) if(cond) { DBG_log("     failed to match " #cond ); continue; }
 #else
-#define FAIL_TO_MATCH_IF(cond) do if(cond) { continue; } while(0)
+#define FAIL_TO_MATCH_IF(cond) if(cond) { continue; }
 #endif
 
-        /* kick out if it does not match: easier to understand than positive/convuluted logic */
-	FAIL_TO_MATCH_IF(!sameaddr(&p->me.addr, myaddr));
-        FAIL_TO_MATCH_IF(p->me.host_port_specific && p->me.host_port != myport);
+    if(myaddr == NULL) {
+        /*
+         * an unoriented connection has no address of its own to hash
+         * on, and any pair of ours will do: walk the whole list.
+         */
+        for (p = IPhost_pairs; p != NULL; p = p->next)
+        {
+            if(p->him.host_type == KH_ANY) {
+                if(histype == KH_ANY) {
+                    bestpair = p;
+                    tight = TRUE;
+                    break;
+                }
+                if(!exact && bestpair == NULL)
+                    bestpair = p;
+                continue;
+            }
+            if(histype != KH_ANY && hisaddr != NULL
+               && sameaddr(&p->him.addr, hisaddr)) {
+                bestpair = p;
+                tight = TRUE;
+                break;
+            }
+        }
+        if(bestpair != NULL) {
+            bestpair_head = IPhp_bucket(bestpair);
+            for (bestpair_pp = bestpair_head; *bestpair_pp != bestpair
+                 ; bestpair_pp = &(*bestpair_pp)->hash_next)
+                ;
+        }
+    }
 
-        if(histype == KH_ANY && p->him.host_type == KH_ANY) {
-            /* no bestpair_prio, it's an exact match */
-            bestpair = p;
-            bestpair_prev = prev;
-            break;
+    /*
+     * a pair made before its own address was known (an unresolved
+     * %defaultroute) is hashed as unset, and will do for any address
+     * of ours when nothing matches that address itself.
+     */
+    me = myaddr;
+    while(me != NULL) {
+        if(histype == KH_ANY) {
+            /* %any to %any: no bestpair_prio, it's an exact match */
+            struct IPhost_pair **head = &IPhp_any_table[IPhp_hash(me, NULL)];
+
+            for (pp = head; (p = *pp) != NULL; pp = &p->hash_next)
+            {
+                /* kick out if it does not match: easier to understand than positive/convuluted logic */
+                FAIL_TO_MATCH_IF(!IPhp_me_matches(p, me));
+                FAIL_TO_MATCH_IF(p->me.host_port_specific && p->me.host_port != myport);
+                bestpair = p;
+                bestpair_pp = pp;
+                bestpair_head = head;
+                tight = TRUE;
+                break;
+            }
+        }
+
+        if(hisaddr != NULL && (exact || histype != KH_ANY)) {
+            /* a pair for him exactly: highest match */
+            struct IPhost_pair **head = &IPhp_table[IPhp_hash(me, hisaddr)];
+
+            for (pp = head; (p = *pp) != NULL; pp = &p->hash_next)
+            {
+                FAIL_TO_MATCH_IF(!IPhp_me_matches(p, me));
+                FAIL_TO_MATCH_IF(p->me.host_port_specific && p->me.host_port != myport);
+                /* if hisport is specific, then it must match */
+                FAIL_TO_MATCH_IF(p->him.host_port_specific && p->him.host_port != hisport);
+                FAIL_TO_MATCH_IF(!sameaddr(&p->him.addr, hisaddr));
+
+                /* an exact %any to %any match may be ahead of it */
+                if (bestpair == NULL || IPhp_ahead(p, bestpair)) {
+                    bestpair = p;
+                    bestpair_pp = pp;
+                    bestpair_head = head;
+                    tight = TRUE;
+                }
+                break;
+            }
         }
 
-        /* if hisport is specific, then it must match */
-        FAIL_TO_MATCH_IF(p->him.host_port_specific && p->him.host_port != hisport);
+        if(bestpair == NULL && !exact && histype != KH_ANY) {
+            /* matched against %any, and did not have a tighter match */
+            struct IPhost_pair **head = &IPhp_any_table[IPhp_hash(me, NULL)];
 
-        if(exact == TRUE) {
-            /* when matching exactly, we ignore KH_ANY entries.  If an %any match
-             * was desired, then it would be caught above */
-            if(p->him.host_type == KH_ANY) continue;
-            if(sameaddr(&p->him.addr, hisaddr)) {
+            for (pp = head; (p = *pp) != NULL; pp = &p->hash_next)
+            {
+                FAIL_TO_MATCH_IF(!IPhp_me_matches(p, me));
+                FAIL_TO_MATCH_IF(p->me.host_port_specific && p->me.host_port != myport);
+                FAIL_TO_MATCH_IF(p->him.host_port_specific && p->him.host_port != hisport);
                 bestpair = p;
-                bestpair_prev = prev;
+                bestpair_pp = pp;
+                bestpair_head = head;
                 break;
             }
-        } else if(p->him.host_type == KH_ANY && bestpair_prio < 1) {
-            /* matched against %any, and did not have a tighter match */
-            bestpair = p;
-            bestpair_prev = prev;
-            bestpair_prio = 1;
-        } else if(histype != KH_ANY && sameaddr(&p->him.addr, hisaddr) && bestpair_prio < 2) {
-            bestpair = p;
-            bestpair_prev = prev;
-            bestpair_prio = 2;
-            /* highest match, so break */
-            break;
         }
-        /* not a good match, continue loop */
+
+        if(bestpair != NULL || addrtypeof(me) == 0)
+            break;
+        me = &unset_addr;
     }
 
-    if (bestpair_prev != NULL) {
-        bestpair_prev->next = bestpair->next;	/* remove p from list */
-        bestpair->next = IPhost_pairs;	/* and stick it on front */
-        IPhost_pairs = bestpair;
+    /* the pairs a search of the whole list would have looked at */
+    DBG(DBG_CONTROLMORE,
+	for (p = IPhost_pairs; p != NULL; p = p->next)
+	{
+	    char b1[ADDRTOT_BUF];
+	    char b2[ADDRTOT_BUF];
+            char himtypebuf[KEYWORD_NAME_BUFLEN];
+	    DBG_log("find_host_pair: comparing to me=%s:%d %s him=%s:%d\n"
+                    , (addrtot(&p->me.addr, 0, b1, sizeof(b1)), b1)
+                    , p->me.host_port
+                    , keyword_name(&kw_host_list, p->him.host_type, himtypebuf)
+                    , (addrtot(&p->him.addr, 0, b2, sizeof(b2)), b2)
+                    , p->him.host_port);
+	    if (p == bestpair && tight)
+		break;
+	});
+
+    if (bestpair != NULL) {
+        if (bestpair_pp != bestpair_head) {
+            *bestpair_pp = bestpair->hash_next;	/* remove p from chain */
+            bestpair->hash_next = *bestpair_head;	/* and stick it on front */
+            *bestpair_head = bestpair;
+        }
+        IPhp_to_front(bestpair);
     }
     DBG(DBG_CONTROLMORE,
         DBG_log("find_host_pair: concluded with %s", bestpair && bestpair->connections ? bestpair->connections->name : "<none>"));
@@ -253,8 +493,20 @@ find_host_pair(bool exact
 void remove_IPhost_pair(struct IPhost_pair *hp)
 {
     if(hp != NULL && hp->connections == NULL) {
-        list_rm(struct IPhost_pair, next, hp, IPhost_pairs);
+        *hp->prevp = hp->next;
+        if (hp->next != NULL)
+            hp->next->prevp = hp->prevp;
+        IPhp_unhash(hp);
         pfree(hp);
+
+        /* the last one out goes back to the static tables */
+        if (--IPhp_count == 0 && IPhp_table != IPhp_table_static) {
+            pfree(IPhp_table);
+            pfree(IPhp_any_table);
+            IPhp_table = IPhp_table_static;
+            IPhp_any_table = IPhp_any_table_static;
+            IPhp_buckets = IPHP_BUCKETS;
+        }
     }
 }
 
@@ -376,8 +628,7 @@ connect_to_IPhost_pair(struct connection *c)
 #endif
 	    hp->connections = NULL;
 	    hp->pending = NULL;
-	    hp->next = IPhost_pairs;
-	    IPhost_pairs = hp;
+	    IPhp_link(hp);
 	}
 	c->IPhost_pair = hp;
 	c->IPhp_next = hp->connections;
@@ -15,6 +15,8 @@ struct IPhost_pair {
     struct connection *connections;	/* connections with this pair */
     struct pending *pending;	/* awaiting Keying Channel */
     struct IPhost_pair *next;
+    struct IPhost_pair **prevp;	/* what points at us on IPhost_pairs */
+    struct IPhost_pair *hash_next;	/* find_host_pair() hash chain */
 };
 extern struct IPhost_pair *IPhost_pairs;
 
@@ -60,6 +62,7 @@ extern struct IDhost_pair *find_ID_host_pair(const struct id me
     }
 
 extern void remove_IPhost_pair(struct IPhost_pair *hp);
+extern void set_IPhost_pair_him(struct IPhost_pair *hp, const ip_address *him);
 extern void remove_IDhost_pair(struct IDhost_pair *hp);
 extern void clear_host_pairs(struct connection *c);
 extern void clear_IPhost_pair(struct connection *c);
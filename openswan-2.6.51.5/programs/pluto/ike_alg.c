@@ -82,6 +82,10 @@ bool ike_alg_enc_ok(int ealg, unsigned key_len,
 		/* failure: encrypt algo must be present */
 		snprintf(ugh_buf, ugh_buf_len, "encrypt algo not found");
 		ret = FALSE;
+	} else if (enc_desc->do_crypt == NULL) {
+		/* failure: AEAD (and placeholder) ciphers are IKEv2 only */
+		snprintf(ugh_buf, ugh_buf_len, "encrypt algo not usable with IKEv1");
+		ret = FALSE;
 	} else if ((key_len) && ((key_len < enc_desc->keyminlen) ||
 			 (key_len > enc_desc->keymaxlen))) {
 		/* failure: if key_len specified, it must be in range */
@@ -206,6 +210,12 @@ ike_alg_add(struct ike_alg* a, bool quiet)
 		return_on(ret,-EEXIST);
 	}
 	if (ret==0) {
+		if (a->algo_type == IKE_ALG_ENCRYPT) {
+			struct encrypt_desc *e = (struct encrypt_desc *)a;
+
+			if (e->iv_size == 0)
+				e->iv_size = e->enc_blocksize;
+		}
 		a->algo_next=ike_alg_base[a->algo_type];
 		ike_alg_base[a->algo_type]=a;
 	}
@@ -283,7 +293,7 @@ ike_alg_register_enc(struct encrypt_desc *enc_desc)
 	}
 #endif
 
-	/* XXX struct algo_aes_ccm_8 up to algo_aes_gcm_16, where
+	/* XXX struct algo_aes_ccm_8 up to algo_aes_gcm_12, where
 	 * "commin.algo_id" is not defined need this officename fallback.
 	 * These are defined in kernel_netlink.c and need to move to
 	 * the proper place - even if klips does not support these
@@ -17,8 +17,7 @@ struct encrypt_desc {
     struct ike_alg common;
     size_t   enc_ctxsize;
     size_t   enc_blocksize;
-/* Is this always true?  usually with CBC methods. Maybe not with others */
-#define iv_size enc_blocksize
+    size_t   iv_size;		/* 0: the same as enc_blocksize (CBC) */
     unsigned keydeflen;
     unsigned keymaxlen;
     unsigned keyminlen;
@@ -28,8 +27,41 @@ struct encrypt_desc {
 		     , size_t key_size
 		     , u_int8_t *iv
 		     , bool enc);
+    /*
+     * Optional: schedule a key once for the life of an SA, then
+     * encrypt in place with it (see crypt_key_new() in crypto.c).
+     * Ciphers without them get do_crypt() for every message.
+     */
+    void *(*key_new)(const u_int8_t *key, size_t key_size);
+    void (*key_crypt)(void *sched
+		      , u_int8_t *dat
+		      , size_t datasize
+		      , u_int8_t *iv
+		      , bool enc);
+    void (*key_free)(void *sched);
+
+    /*
+     * AEAD ciphers (RFC 5282) protect an IKEv2 SK payload in one pass,
+     * without an INTEG transform.  Their key is followed by salt_size
+     * bytes of salt, and a message ends in an aead_tag_size byte ICV.
+     * They have key_new/key_free, key_aead() in place of key_crypt(),
+     * and no do_crypt(), which keeps them out of IKEv1.  key_aead()
+     * returns FALSE if a message fails to authenticate.
+     */
+    size_t   salt_size;
+    size_t   aead_tag_size;
+    bool (*key_aead)(void *sched
+		     , u_int8_t *dat
+		     , size_t datasize
+		     , const u_int8_t *iv
+		     , const u_int8_t *aad
+		     , size_t aad_size
+		     , u_int8_t *tag
+		     , bool enc);
 };
 
+#define ike_alg_enc_aead(e)	((e)->key_aead != NULL)
+
 typedef void (*hash_update_t)(void *, const u_char *, size_t) ;
 
 struct hash_desc {
@@ -27,6 +27,32 @@
 #define  AES_KEY_DEF_LEN	128
 #define  AES_KEY_MAX_LEN	256
 
+#ifndef HAVE_LIBNSS
+static void
+aes_cbc_crypt(aes_context *aes_ctx, u_int8_t *buf, size_t buf_len, u_int8_t *iv, bool enc)
+{
+    char iv_bak[AES_CBC_BLOCK_SIZE];
+    char *new_iv = NULL;	/* logic will avoid copy to NULL */
+
+    /*
+     *	my AES cbc does not touch passed IV (optimization for
+     *	ESP handling), so I must "emulate" des-like IV
+     *	crunching
+     */
+    if (!enc)
+	    memcpy(new_iv=iv_bak,
+			    (char*) buf + buf_len-AES_CBC_BLOCK_SIZE,
+			    AES_CBC_BLOCK_SIZE);
+
+    AES_cbc_encrypt(aes_ctx, buf, buf, buf_len, iv, enc);
+
+    if (enc)
+	    new_iv = (char*) buf + buf_len-AES_CBC_BLOCK_SIZE;
+
+    memcpy(iv, new_iv, AES_CBC_BLOCK_SIZE);
+}
+#endif
+
 static void
 do_aes(u_int8_t *buf, size_t buf_len, u_int8_t *key, size_t key_size, u_int8_t *iv, bool enc)
 {
@@ -34,7 +60,6 @@ do_aes(u_int8_t *buf, size_t buf_len, u_int8_t *key, size_t key_size, u_int8_t *
 #ifdef HAVE_LIBNSS
     u_int8_t iv_bak[AES_CBC_BLOCK_SIZE];
     u_int8_t *new_iv = NULL;        /* logic will avoid copy to NULL */
-    u_int8_t *tmp_buf;
 
     CK_MECHANISM_TYPE  ciphermech;
     SECItem              ivitem;
@@ -65,7 +90,6 @@ do_aes(u_int8_t *buf, size_t buf_len, u_int8_t *key, size_t key_size, u_int8_t *
    }
 
    outlen = 0;
-   tmp_buf= PR_Malloc((PRUint32)buf_len);
 
     if (!enc){
     memcpy(new_iv=iv_bak,(char*) buf + buf_len-AES_CBC_BLOCK_SIZE,AES_CBC_BLOCK_SIZE);
@@ -76,20 +100,18 @@ do_aes(u_int8_t *buf, size_t buf_len, u_int8_t *key, size_t key_size, u_int8_t *
         loglog(RC_LOG_SERIOUS, "do_aes: PKCS11 context creation failure (err %d)\n", PR_GetError());
         abort();
     }
-    rv = PK11_CipherOp(enccontext, tmp_buf, &outlen, buf_len, buf, buf_len);
+    rv = PK11_CipherOp(enccontext, buf, &outlen, buf_len, buf, buf_len);
     if (rv != SECSuccess) {
         loglog(RC_LOG_SERIOUS, "do_aes: PKCS11 operation failure (err %d)\n", PR_GetError());
         abort();
     }
     PK11_DestroyContext(enccontext, PR_TRUE);
-    memcpy(buf,tmp_buf,buf_len);
 
     if(enc){
     new_iv = (u_int8_t*) buf + buf_len-AES_CBC_BLOCK_SIZE;
     }
 
     memcpy(iv, new_iv, AES_CBC_BLOCK_SIZE);
-    PR_Free(tmp_buf);
 
 if (secparam)
     SECITEM_FreeItem(secparam, PR_TRUE);
@@ -97,31 +119,140 @@ DBG(DBG_CRYPT, DBG_log("NSS do_aes: exit"));
 
 #else
     aes_context aes_ctx;
-    char iv_bak[AES_CBC_BLOCK_SIZE];
-    char *new_iv = NULL;	/* logic will avoid copy to NULL */
 
     aes_set_key(&aes_ctx, key, key_size, 0);
+    aes_cbc_crypt(&aes_ctx, buf, buf_len, iv, enc);
+#endif
+
+}
+
+/*
+ * Per-SA keys: the key is scheduled once, by aes_key_new(), and
+ * every message is then encrypted in place with it.
+ */
+#ifdef HAVE_LIBNSS
+struct aes_key {
+    PK11SymKey  *symkey;
+    PK11Context *ctx[2];		/* [enc], created on first use */
+    u_int8_t     chain[2][AES_CBC_BLOCK_SIZE];	/* ctx[enc]'s CBC state */
+};
+
+static void *
+aes_key_new(const u_int8_t *key, size_t key_size)
+{
+    struct aes_key *k = alloc_thing(struct aes_key, "aes key");
+
+    passert(key_size == sizeof(k->symkey));
+    memcpy(&k->symkey, key, key_size);
+    if (k->symkey == NULL) {
+	loglog(RC_LOG_SERIOUS, "aes_key_new: NSS derived enc key in NULL\n");
+	abort();
+    }
+    k->symkey = PK11_ReferenceSymKey(k->symkey);
+    return k;
+}
+
+static void
+aes_key_crypt(void *sched, u_int8_t *buf, size_t buf_len, u_int8_t *iv, bool enc)
+{
+    struct aes_key *k = sched;
+    u_int8_t *chain = k->chain[enc ? 1 : 0];
+    PK11Context **ctx = &k->ctx[enc ? 1 : 0];
+    u_int8_t new_iv[AES_CBC_BLOCK_SIZE];
+    SECStatus rv;
+    int outlen = 0;
+    int i;
+
+    passert(buf_len >= AES_CBC_BLOCK_SIZE && buf_len % AES_CBC_BLOCK_SIZE == 0);
+
+    if (*ctx == NULL) {
+	SECItem ivitem;
+	SECItem *secparam;
+
+	ivitem.type = siBuffer;
+	ivitem.data = chain;
+	ivitem.len = AES_CBC_BLOCK_SIZE;
+	secparam = PK11_ParamFromIV(CKM_AES_CBC, &ivitem);
+	if (secparam == NULL) {
+	    loglog(RC_LOG_SERIOUS, "aes_key_crypt: Failure to set up PKCS11 param (err %d)\n", PR_GetError());
+	    abort();
+	}
+	*ctx = PK11_CreateContextBySymKey(CKM_AES_CBC
+					  , enc ? CKA_ENCRYPT : CKA_DECRYPT
+					  , k->symkey, secparam);
+	SECITEM_FreeItem(secparam, PR_TRUE);
+	if (*ctx == NULL) {
+	    loglog(RC_LOG_SERIOUS, "aes_key_crypt: PKCS11 context creation failure (err %d)\n", PR_GetError());
+	    abort();
+	}
+    }
 
     /*
-     *	my AES cbc does not touch passed IV (optimization for
-     *	ESP handling), so I must "emulate" des-like IV
-     *	crunching
+     * NSS offers no way to give a context a new IV, so the context
+     * carries on from the last block of its previous message (chain).
+     * Folding iv ^ chain into the first block makes that come out the
+     * same as CBC from iv: before encrypting, or after decrypting.
      */
-    if (!enc)
-	    memcpy(new_iv=iv_bak,
-			    (char*) buf + buf_len-AES_CBC_BLOCK_SIZE,
-			    AES_CBC_BLOCK_SIZE);
+    if (enc) {
+	for (i = 0; i < AES_CBC_BLOCK_SIZE; i++)
+	    buf[i] ^= iv[i] ^ chain[i];
+    } else {
+	memcpy(new_iv, buf + buf_len - AES_CBC_BLOCK_SIZE, AES_CBC_BLOCK_SIZE);
+    }
 
-    AES_cbc_encrypt(&aes_ctx, buf, buf, buf_len, iv, enc);
+    rv = PK11_CipherOp(*ctx, buf, &outlen, buf_len, buf, buf_len);
+    if (rv != SECSuccess) {
+	loglog(RC_LOG_SERIOUS, "aes_key_crypt: PKCS11 operation failure (err %d)\n", PR_GetError());
+	abort();
+    }
 
-    if (enc)
-	    new_iv = (char*) buf + buf_len-AES_CBC_BLOCK_SIZE;
+    if (enc) {
+	memcpy(new_iv, buf + buf_len - AES_CBC_BLOCK_SIZE, AES_CBC_BLOCK_SIZE);
+    } else {
+	for (i = 0; i < AES_CBC_BLOCK_SIZE; i++)
+	    buf[i] ^= iv[i] ^ chain[i];
+    }
 
+    memcpy(chain, new_iv, AES_CBC_BLOCK_SIZE);
     memcpy(iv, new_iv, AES_CBC_BLOCK_SIZE);
-#endif
+}
+
+static void
+aes_key_free(void *sched)
+{
+    struct aes_key *k = sched;
+
+    if (k->ctx[0] != NULL)
+	PK11_DestroyContext(k->ctx[0], PR_TRUE);
+    if (k->ctx[1] != NULL)
+	PK11_DestroyContext(k->ctx[1], PR_TRUE);
+    PK11_FreeSymKey(k->symkey);
+    pfree(k);
+}
+#else
+static void *
+aes_key_new(const u_int8_t *key, size_t key_size)
+{
+    aes_context *aes_ctx = alloc_thing(aes_context, "aes key schedule");
+
+    aes_set_key(aes_ctx, key, key_size, 0);
+    return aes_ctx;
+}
 
+static void
+aes_key_crypt(void *sched, u_int8_t *buf, size_t buf_len, u_int8_t *iv, bool enc)
+{
+    aes_cbc_crypt(sched, buf, buf_len, iv, enc);
 }
 
+static void
+aes_key_free(void *sched)
+{
+    memset(sched, 0, sizeof(aes_context));
+    pfree(sched);
+}
+#endif
+
 struct encrypt_desc algo_aes =
 {
 	common: {
@@ -137,12 +268,320 @@ struct encrypt_desc algo_aes =
 	keydeflen: 	AES_KEY_DEF_LEN,
 	keymaxlen: 	AES_KEY_MAX_LEN,
 	do_crypt: 	do_aes,
+	key_new: 	aes_key_new,
+	key_crypt: 	aes_key_crypt,
+	key_free: 	aes_key_free,
+};
+/*
+ * AES-GCM with a 16 octet ICV, for IKEv2 SK payloads (RFC 5282).
+ * The key is the AES key followed by a 4 byte salt, and the nonce is
+ * that salt followed by the 8 byte IV carried in the message.  Under
+ * NSS the AES key is the PK11SymKey pointer, as for CBC.
+ */
+#define AES_GCM_SALT_SIZE	4
+#define AES_GCM_IV_SIZE		8
+#define AES_GCM_TAG_SIZE	16
+
+#ifdef HAVE_LIBNSS
+struct aes_gcm_key {
+    PK11SymKey *symkey;
+    u_int8_t    salt[AES_GCM_SALT_SIZE];
+};
+
+static void *
+aes_gcm_key_new(const u_int8_t *key, size_t key_size)
+{
+    struct aes_gcm_key *k = alloc_thing(struct aes_gcm_key, "aes gcm key");
+
+    passert(key_size == sizeof(k->symkey) + AES_GCM_SALT_SIZE);
+    memcpy(&k->symkey, key, sizeof(k->symkey));
+    if (k->symkey == NULL) {
+	loglog(RC_LOG_SERIOUS, "aes_gcm_key_new: NSS derived enc key in NULL\n");
+	abort();
+    }
+    k->symkey = PK11_ReferenceSymKey(k->symkey);
+    memcpy(k->salt, key + sizeof(k->symkey), AES_GCM_SALT_SIZE);
+    return k;
+}
+
+/* the tag follows the text in a message, so NSS can take both at once */
+static bool
+aes_gcm_key_aead(void *sched, u_int8_t *buf, size_t buf_len
+		 , const u_int8_t *iv, const u_int8_t *aad, size_t aad_len
+		 , u_int8_t *tag, bool enc)
+{
+    struct aes_gcm_key *k = sched;
+    u_int8_t nonce[AES_GCM_SALT_SIZE + AES_GCM_IV_SIZE];
+    CK_GCM_PARAMS gcm;
+    SECItem param;
+    SECStatus rv;
+    unsigned int outlen = 0;
+
+    passert(tag == buf + buf_len);
+
+    memcpy(nonce, k->salt, AES_GCM_SALT_SIZE);
+    memcpy(nonce + AES_GCM_SALT_SIZE, iv, AES_GCM_IV_SIZE);
+
+    memset(&gcm, 0, sizeof(gcm));
+    gcm.pIv = nonce;
+    gcm.ulIvLen = sizeof(nonce);
+#if defined(CRYPTOKI_VERSION_MAJOR) && CRYPTOKI_VERSION_MAJOR >= 3 && !defined(NSS_PKCS11_2_0_COMPAT)
+    gcm.ulIvBits = sizeof(nonce) * BITS_PER_BYTE;	/* PKCS#11 v3 layout */
+#endif
+    gcm.pAAD = (u_int8_t *)aad;
+    gcm.ulAADLen = aad_len;
+    gcm.ulTagBits = AES_GCM_TAG_SIZE * BITS_PER_BYTE;
+
+    param.type = siBuffer;
+    param.data = (unsigned char *)&gcm;
+    param.len = sizeof(gcm);
+
+    if (enc) {
+	rv = PK11_Encrypt(k->symkey, CKM_AES_GCM, &param, buf, &outlen
+			  , buf_len + AES_GCM_TAG_SIZE, buf, buf_len);
+	if (rv != SECSuccess || outlen != buf_len + AES_GCM_TAG_SIZE) {
+	    loglog(RC_LOG_SERIOUS, "aes_gcm_key_aead: PKCS11 operation failure (err %d)\n", PR_GetError());
+	    abort();
+	}
+	return TRUE;
+    }
+
+    rv = PK11_Decrypt(k->symkey, CKM_AES_GCM, &param, buf, &outlen
+		      , buf_len + AES_GCM_TAG_SIZE, buf, buf_len + AES_GCM_TAG_SIZE);
+    if (rv != SECSuccess) {
+	DBG(DBG_CRYPT, DBG_log("aes_gcm_key_aead: ICV check failed (err %d)", PR_GetError()));
+	return FALSE;
+    }
+    passert(outlen == buf_len);
+    return TRUE;
+}
+
+static void
+aes_gcm_key_free(void *sched)
+{
+    struct aes_gcm_key *k = sched;
+
+    PK11_FreeSymKey(k->symkey);
+    memset(k, 0, sizeof(*k));
+    pfree(k);
+}
+#else
+/*
+ * GHASH uses Shoup's 4-bit tables: the multiples of H by every 4 bit
+ * value are computed once per key, and a block then costs 32 lookups.
+ */
+struct aes_gcm_key {
+    aes_context aes;
+    u_int8_t    salt[AES_GCM_SALT_SIZE];
+    u_int64_t   hl[16], hh[16];
 };
+
+static const u_int64_t gcm_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0,
+};
+
+static u_int64_t
+gcm_get64(const u_int8_t *b)
+{
+    u_int64_t v = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+	v = (v << 8) | b[i];
+    return v;
+}
+
+static void
+gcm_put64(u_int8_t *b, u_int64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+	b[i] = v & 0xff;
+	v >>= 8;
+    }
+}
+
+/* x = x * H in GF(2^128) */
+static void
+gcm_mult(const struct aes_gcm_key *k, u_int8_t x[AES_CBC_BLOCK_SIZE])
+{
+    u_int64_t zh, zl;
+    unsigned lo, hi, rem;
+    int i;
+
+    lo = x[15] & 0xf;
+    zh = k->hh[lo];
+    zl = k->hl[lo];
+
+    for (i = 15; i >= 0; i--) {
+	lo = x[i] & 0xf;
+	hi = x[i] >> 4;
+
+	if (i != 15) {
+	    rem = zl & 0xf;
+	    zl = (zh << 60) | (zl >> 4);
+	    zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+	    zh ^= k->hh[lo];
+	    zl ^= k->hl[lo];
+	}
+	rem = zl & 0xf;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+	zh ^= k->hh[hi];
+	zl ^= k->hl[hi];
+    }
+    gcm_put64(x, zh);
+    gcm_put64(x + 8, zl);
+}
+
+static void
+gcm_ghash(const struct aes_gcm_key *k, u_int8_t y[AES_CBC_BLOCK_SIZE]
+	  , const u_int8_t *dat, size_t len)
+{
+    size_t i;
+
+    while (len > 0) {
+	size_t n = len < AES_CBC_BLOCK_SIZE ? len : AES_CBC_BLOCK_SIZE;
+
+	for (i = 0; i < n; i++)
+	    y[i] ^= dat[i];
+	gcm_mult(k, y);
+	dat += n;
+	len -= n;
+    }
+}
+
+static void *
+aes_gcm_key_new(const u_int8_t *key, size_t key_size)
+{
+    struct aes_gcm_key *k = alloc_thing(struct aes_gcm_key, "aes gcm key");
+    u_int8_t h[AES_CBC_BLOCK_SIZE];
+    u_int64_t vh, vl;
+    int i, j;
+
+    passert(key_size > AES_GCM_SALT_SIZE);
+    key_size -= AES_GCM_SALT_SIZE;
+    aes_set_key(&k->aes, key, key_size, 0);
+    memcpy(k->salt, key + key_size, AES_GCM_SALT_SIZE);
+
+    memset(h, 0, sizeof(h));
+    aes_encrypt(&k->aes, h, h);
+    vh = gcm_get64(h);
+    vl = gcm_get64(h + 8);
+
+    k->hl[8] = vl;
+    k->hh[8] = vh;
+    k->hl[0] = k->hh[0] = 0;
+    for (i = 4; i > 0; i >>= 1) {
+	u_int32_t t = (vl & 1) * 0xe1000000U;
+
+	vl = (vh << 63) | (vl >> 1);
+	vh = (vh >> 1) ^ ((u_int64_t)t << 32);
+	k->hl[i] = vl;
+	k->hh[i] = vh;
+    }
+    for (i = 2; i <= 8; i *= 2) {
+	for (j = 1; j < i; j++) {
+	    k->hh[i + j] = k->hh[i] ^ k->hh[j];
+	    k->hl[i + j] = k->hl[i] ^ k->hl[j];
+	}
+    }
+    memset(h, 0, sizeof(h));
+    return k;
+}
+
+static bool
+aes_gcm_key_aead(void *sched, u_int8_t *buf, size_t buf_len
+		 , const u_int8_t *iv, const u_int8_t *aad, size_t aad_len
+		 , u_int8_t *tag, bool enc)
+{
+    struct aes_gcm_key *k = sched;
+    u_int8_t ctr[AES_CBC_BLOCK_SIZE], ks[AES_CBC_BLOCK_SIZE];
+    u_int8_t y[AES_CBC_BLOCK_SIZE], t[AES_CBC_BLOCK_SIZE];
+    u_int8_t diff = 0;
+    size_t off, i;
+
+    memset(y, 0, sizeof(y));
+    gcm_ghash(k, y, aad, aad_len);
+    if (!enc)
+	gcm_ghash(k, y, buf, buf_len);
+
+    /* J0 = salt | iv | 1, the text starts at counter 2 */
+    memcpy(ctr, k->salt, AES_GCM_SALT_SIZE);
+    memcpy(ctr + AES_GCM_SALT_SIZE, iv, AES_GCM_IV_SIZE);
+    ctr[12] = ctr[13] = ctr[14] = 0;
+    ctr[15] = 1;
+    aes_encrypt(&k->aes, ctr, t);
+
+    for (off = 0; off < buf_len; off += AES_CBC_BLOCK_SIZE) {
+	size_t n = buf_len - off < AES_CBC_BLOCK_SIZE
+	    ? buf_len - off : AES_CBC_BLOCK_SIZE;
+
+	for (i = 15; i >= 12 && ++ctr[i] == 0; i--)
+	    ;
+	aes_encrypt(&k->aes, ctr, ks);
+	for (i = 0; i < n; i++)
+	    buf[off + i] ^= ks[i];
+    }
+
+    if (enc)
+	gcm_ghash(k, y, buf, buf_len);
+
+    gcm_put64(ks, (u_int64_t)aad_len * BITS_PER_BYTE);
+    gcm_put64(ks + 8, (u_int64_t)buf_len * BITS_PER_BYTE);
+    gcm_ghash(k, y, ks, sizeof(ks));
+
+    for (i = 0; i < AES_GCM_TAG_SIZE; i++)
+	t[i] ^= y[i];
+
+    if (enc) {
+	memcpy(tag, t, AES_GCM_TAG_SIZE);
+	return TRUE;
+    }
+    for (i = 0; i < AES_GCM_TAG_SIZE; i++)
+	diff |= t[i] ^ tag[i];
+    return diff == 0;
+}
+
+static void
+aes_gcm_key_free(void *sched)
+{
+    memset(sched, 0, sizeof(struct aes_gcm_key));
+    pfree(sched);
+}
+#endif
+
+struct encrypt_desc algo_aes_gcm_16 =
+{
+	common: {
+	  name: "aes_gcm_16",
+	  officname: "aes_gcm_16",
+	  algo_type: 	IKE_ALG_ENCRYPT,
+	  algo_id:   	OAKLEY_AES_GCM_C,
+	  algo_v2id:    IKEv2_ENCR_AES_GCM_16,
+	  algo_next: 	NULL, },
+	enc_ctxsize: 	sizeof(aes_context),
+	enc_blocksize: 	1,		/* no padding but the pad length */
+	iv_size: 	AES_GCM_IV_SIZE,
+	keyminlen: 	AES_KEY_MIN_LEN,
+	keydeflen: 	AES_KEY_DEF_LEN,
+	keymaxlen: 	AES_KEY_MAX_LEN,
+	key_new: 	aes_gcm_key_new,
+	key_free: 	aes_gcm_key_free,
+	salt_size: 	AES_GCM_SALT_SIZE,
+	aead_tag_size: 	AES_GCM_TAG_SIZE,
+	key_aead: 	aes_gcm_key_aead,
+};
+
 int ike_alg_aes_init(void);
 int
 ike_alg_aes_init(void)
 {
 	int ret = ike_alg_register_enc(&algo_aes);
+	if (ret == 0)
+		ret = ike_alg_register_enc(&algo_aes_gcm_16);
 	return ret;
 }
 /*
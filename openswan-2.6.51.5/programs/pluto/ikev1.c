@@ -792,7 +792,8 @@ informational(struct msg_digest *md)
                     }
                    );
 
-		tmp_c->IPhost_pair->him.addr = tmp_c->spd.that.host_addr;
+		set_IPhost_pair_him(tmp_c->IPhost_pair, &tmp_c->spd.that.host_addr);
+		route_index_update(tmp_c);
 
 		/*Initiating connection to the redirected peer*/
 		initiate_connection(tmp_name, tmp_whack_sock, 0, pcim_demand_crypto);
@@ -2269,6 +2270,11 @@ complete_v1_state_transition(struct msg_digest **mdp, stf_status result)
 		}
 	    }
 
+#ifdef NAT_TRAVERSAL
+	    /* an SA behind a NAT goes on the keepalive wheel */
+	    nat_traversal_ka_track(st);
+#endif
+
 
 #ifdef XAUTH
 	    /* Special case for XAUTH server */
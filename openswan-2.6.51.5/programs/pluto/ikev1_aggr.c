@@ -638,9 +638,6 @@ aggr_inR1_outI2(struct msg_digest *md)
     if (st->hidden_variables.st_nat_traversal) {
 	nat_traversal_show_result(st->hidden_variables.st_nat_traversal, md->sender_port);
     }
-    if (st->hidden_variables.st_nat_traversal & NAT_T_WITH_KA) {
-	nat_traversal_new_ka_event();
-    }
 #endif
 
     /* set up second calculation */
@@ -877,9 +874,6 @@ aggr_inI2_tail(struct msg_digest *md
     if (st->hidden_variables.st_nat_traversal) {
 	nat_traversal_show_result(st->hidden_variables.st_nat_traversal, md->sender_port);
     }
-    if (st->hidden_variables.st_nat_traversal & NAT_T_WITH_KA) {
-	nat_traversal_new_ka_event();
-    }
 #endif
 
     /* Reconstruct the peer ID so the peer hash can be authenticated */
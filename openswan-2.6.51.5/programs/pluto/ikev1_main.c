@@ -1201,10 +1201,6 @@ main_inI2_outR2(struct msg_digest *md)
        nat_traversal_show_result(st->hidden_variables.st_nat_traversal
 				 , md->sender_port);
     }
-    if (st->hidden_variables.st_nat_traversal & NAT_T_WITH_KA) {
-       DBG(DBG_NATT, DBG_log(" NAT_T_WITH_KA detected"));
-       nat_traversal_new_ka_event();/*NAT-Tı¼*/
-    }
 #endif
 
     {
@@ -1574,9 +1570,6 @@ main_inR2_outI3_continue(struct msg_digest *md
       nat_traversal_show_result(st->hidden_variables.st_nat_traversal
 				, md->sender_port);
     }
-    if (st->hidden_variables.st_nat_traversal & NAT_T_WITH_KA) {
-      nat_traversal_new_ka_event();
-    }
 #endif
 
     /*************** build output packet HDR*;IDii;HASH/SIG_I ***************/
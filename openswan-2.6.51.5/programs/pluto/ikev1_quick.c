@@ -804,7 +804,7 @@ quick_outI1(int whack_sock
     char p2alg[256];
 
     st->st_whack_sock = whack_sock;
-    st->st_connection = c;/*ԿÿһcɶӦstateṹһphase1,һphase2.״̬ʱҪرע*/
+    set_state_connection(st, c);/*ԿÿһcɶӦstateṹһphase1,һphase2.״̬ʱҪرע*/
     passert(c != NULL);
 
     if(st->st_calculating) {
@@ -1976,7 +1976,7 @@ quick_inI1_outR1_authtail(struct verify_oppo_bundle *b
 	{
 	    struct connection *t = st->st_connection;
 
-	    st->st_connection = c;
+	    set_state_connection(st, c);
 	    set_cur_connection(c);
 	    connection_discard(t);
 	}
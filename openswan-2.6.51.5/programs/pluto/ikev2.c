@@ -1045,6 +1045,9 @@ send_v2_notification_from_md(struct msg_digest *md UNUSED,
 
     send_v2_notification(&st, xchg, ntf_type,
 			 md->hdr.isa_icookie, md->hdr.isa_rcookie, data);
+
+    /* send_packet() has its own copy; nothing else frees the dummy's */
+    freeanychunk(st.st_tpacket);
 }
 
 void ikev2_update_counters(struct msg_digest *md)
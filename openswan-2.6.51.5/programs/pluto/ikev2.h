@@ -298,6 +298,14 @@ extern stf_status ikev2_decrypt_msg(struct msg_digest *md
 
 extern bool force_busy;  /* config option to emulate responder under DOS */
 
+/* half-open IKE SAs at which cookies are demanded: of all, of one prefix */
+#define IKEV2_COOKIE_THRESHOLD		10000
+#define IKEV2_COOKIE_PREFIX_THRESHOLD	500
+extern unsigned long ikev2_cookie_threshold;
+extern unsigned long ikev2_cookie_prefix_threshold;
+extern void ikev2_rotate_dcookie_secret(void);
+extern void show_ikev2_dcookie_status(void);
+
 /* allocate a transmit slot */
 extern stf_status allocate_msgid_from_parent(struct state *pst, msgid_t *newid_p);
 
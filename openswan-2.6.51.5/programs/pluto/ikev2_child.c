@@ -571,36 +571,40 @@ int ikev2_evaluate_connection_fit(struct connection *d
 	er = &sr->this;
     }
 
+    /*
+     * a %any end has no client of its own: fill in a new end with the
+     * actual client info from the state.  This must happen whether or
+     * not we are debugging.
+     */
+    if(!ei->has_client && ei->host_type == KH_ANY) {
+        fei = *ei;
+        ei  = &fei;
+        addrtosubnet(&st->st_remoteaddr, &fei.client);
+    }
+    if(!er->has_client && er->host_type == KH_ANY) {
+        fer = *er;
+        er  = &fer;
+        addrtosubnet(&st->st_remoteaddr, &fer.client);
+    }
+
     DBG(DBG_CONTROLMORE,
     {
 	char ei3[SUBNETTOT_BUF];
 	char er3[SUBNETTOT_BUF];
         if(ei->has_client) {
             subnettot(&ei->client,  0, ei3, sizeof(ei3));
+        } else if(ei == &fei) {
+            strcpy(ei3, "<self>");
         } else {
             strcpy(ei3, "<noclient>");
-
-            /* here, fill in new end with actual client info from the state */
-            if(ei->host_type == KH_ANY) {
-                fei = *ei;
-                ei  = &fei;
-                strcpy(ei3, "<self>");
-                addrtosubnet(&st->st_remoteaddr, &fei.client);
-            }
         }
 
         if(er->has_client) {
             subnettot(&er->client,  0, er3, sizeof(er3));
+        } else if(er == &fer) {
+            strcpy(er3, "<self>");
         } else {
             strcpy(er3, "<noclient");
-
-            /* here, fill in new end with actual client info from the state */
-            if(er->host_type == KH_ANY) {
-                fer = *er;
-                er  = &fer;
-                strcpy(er3, "<self>");
-                addrtosubnet(&st->st_remoteaddr, &fer.client);
-            }
         }
 	DBG_log("  ikev2_evaluate_connection_fit evaluating our "
 		"I=%s:%s:%d/%d R=%s:%d/%d %s to their:"
@@ -849,7 +853,7 @@ stf_status ikev2_child_sa_respond(struct msg_digest *md
             openswan_log("switched from \"%s\" to \"%s\"%s", c->name, b->name
                          , fmt_connection_inst_name(b, instance, sizeof(instance)));
 
-	    pst->st_connection = b;	/* kill reference to c */
+	    set_state_connection(pst, b);	/* kill reference to c */
 
 	    /* this ensures we don't move cur_connection from NULL to
 	     * something, requiring a reset_cur_connection() */
@@ -882,7 +886,7 @@ stf_status ikev2_child_sa_respond(struct msg_digest *md
     }
 
     /* note that st1 starts == st, but a child SA creation can change that */
-    st1->st_connection = c;
+    set_state_connection(st1, c);
     md->st = st1;
 
     /* start of SA out */
@@ -69,8 +69,7 @@ static void ikev2_parent_outI1_continue(struct pluto_crypto_req_cont *pcrc
 static stf_status ikev2_parent_outI1_tail(struct pluto_crypto_req_cont *pcrc
                                           , struct pluto_crypto_req *r);
 
-static bool ikev2_get_dcookie(u_char *dcookie, chunk_t st_ni
-	,ip_address *addr, u_int8_t *spiI);
+static stf_status ikev2_check_dcookie(struct msg_digest *md, bool *checked);
 
 static stf_status ikev2_parent_outI1_common(struct msg_digest *md
                                             , struct state *st);
@@ -228,6 +227,11 @@ unsigned char *ikev2_authloc(struct msg_digest *md
     }
 
     b12 = e_pbs->cur;
+    if(ike_alg_enc_aead(pst->st_oakley.encrypter)) {
+        if(!out_zero(pst->st_oakley.encrypter->aead_tag_size, e_pbs, "length of ICV"))
+            return NULL;
+        return b12;
+    }
     if(!out_zero(pst->st_oakley.integ_hasher->hash_integ_len, e_pbs, "length of truncated HMAC"))
         return NULL;
 
@@ -245,7 +249,9 @@ stf_status ikev2_encrypt_msg(struct msg_digest *md,
 {
     struct state *st = md->st;
     struct state *pst = st;
-    chunk_t *cipherkey, *authkey;
+    struct sk_keys *sk;
+    struct crypt_key *cipherkey;
+    struct hmac_key *authkey;
 
     /* IKEv2 crypto state is in parent */
     if(st->st_clonedfrom != 0) {
@@ -261,17 +267,41 @@ stf_status ikev2_encrypt_msg(struct msg_digest *md,
     if(init == INITIATOR) {
         DBG(DBG_CONTROLMORE, DBG_log("encrypting as INITIATOR, parent SA #%lu",
 				     pst->st_serialno));
-        cipherkey = &pst->st_skey_ei;
-        authkey   = &pst->st_skey_ai;
     } else {
         DBG(DBG_CONTROLMORE, DBG_log("encrypting as RESPONDER, parent SA #%lu",
 				     pst->st_serialno));
-        cipherkey = &pst->st_skey_er;
-        authkey   = &pst->st_skey_ar;
     }
 
     ikev2_validate_key_lengths(st);
 
+    sk = ikev2_sk_keys(pst);
+    if(sk == NULL) {
+       loglog(RC_CRYPTOFAILED, "ikev2 encrypt internal error: parent SA #%lu has no keys. Please report.", pst->st_serialno);
+       return STF_FAIL;
+    }
+    cipherkey = init == INITIATOR ? sk->ei : sk->er;
+    authkey   = init == INITIATOR ? sk->ai : sk->ar;
+
+    /*
+     * AEAD: one pass encrypts from encstart to authloc, and puts the
+     * ICV at authloc.  What precedes the IV is the associated data.
+     */
+    if(ike_alg_enc_aead(pst->st_oakley.encrypter)) {
+        unsigned int cipherlen = authloc - encstart;
+
+        DBG(DBG_CRYPT,
+            DBG_dump("data before encryption:", encstart, cipherlen));
+
+        crypt_key_aead(cipherkey, encstart, cipherlen, iv
+                       , authstart, iv - authstart, authloc, TRUE);
+
+        DBG(DBG_CRYPT,
+            DBG_dump("data after encryption:", encstart, cipherlen);
+            DBG_dump("out calculated ICV:", authloc
+                     , pst->st_oakley.encrypter->aead_tag_size));
+        return STF_OK;
+    }
+
     /* encrypt the block */
     {
         size_t  blocksize = pst->st_oakley.encrypter->enc_blocksize;
@@ -284,11 +314,7 @@ stf_status ikev2_encrypt_msg(struct msg_digest *md,
         memcpy(savediv, iv, blocksize);
 
         /* now, encrypt */
-        (pst->st_oakley.encrypter->do_crypt)(encstart,
-                                            cipherlen,
-                                            cipherkey->ptr,
-                                            cipherkey->len,
-                                            savediv, TRUE);
+        crypt_key_crypt(cipherkey, encstart, cipherlen, savediv, TRUE);
 
         DBG(DBG_CRYPT,
             DBG_dump("data after encryption:", encstart, cipherlen));
@@ -297,7 +323,7 @@ stf_status ikev2_encrypt_msg(struct msg_digest *md,
     /* okay, authenticate from beginning of IV */
     {
         struct hmac_ctx ctx;
-        hmac_init_chunk(&ctx, pst->st_oakley.integ_hasher, *authkey);
+        hmac_init_key(&ctx, authkey);
         hmac_update(&ctx, authstart, authloc-authstart);
         hmac_final(authloc, &ctx);
 
@@ -318,8 +344,12 @@ stf_status ikev2_decrypt_msg(struct msg_digest *md
     pb_stream     *e_pbs;
     unsigned int   np;
     unsigned char *iv;
-    chunk_t       *cipherkey, *authkey;
+    struct sk_keys   *sk;
+    struct crypt_key *cipherkey;
+    struct hmac_key  *authkey;
     unsigned char *authstart;
+    unsigned char *encstart;
+    bool           aead;
     struct state *pst = st;
 
     /* IKEv2 crypto state is in parent */
@@ -329,44 +359,72 @@ stf_status ikev2_decrypt_msg(struct msg_digest *md
 
     if(init == INITIATOR) {
         DBG(DBG_CONTROLMORE, DBG_log("decrypting as INITIATOR, using RESPONDER keys"));
-        cipherkey = &pst->st_skey_er;
-        authkey   = &pst->st_skey_ar;
     } else {
         DBG(DBG_CONTROLMORE, DBG_log("decrypting as RESPONDER, using INITIATOR keys"));
-        cipherkey = &pst->st_skey_ei;
-        authkey   = &pst->st_skey_ai;
     }
 
     ikev2_validate_key_lengths(st);
 
+    sk = ikev2_sk_keys(pst);
+    if(sk == NULL) {
+        openswan_log("no keys to decrypt with on parent SA #%lu", pst->st_serialno);
+        return STF_FAIL;
+    }
+    cipherkey = init == INITIATOR ? sk->er : sk->ei;
+    authkey   = init == INITIATOR ? sk->ar : sk->ai;
+
     e_pbs = &md->chain[ISAKMP_NEXT_v2E]->pbs;
     np    = md->chain[ISAKMP_NEXT_v2E]->payload.generic.isag_np;
 
     authstart=md->packet_pbs.start;
     iv     = e_pbs->cur;
-    encend = e_pbs->roof - pst->st_oakley.integ_hasher->hash_integ_len;
 
-    /* start by checking authenticator */
-    {
-        unsigned char  *b12 = alloca(pst->st_oakley.integ_hasher->hash_digest_len);
-        struct hmac_ctx ctx;
+    aead   = ike_alg_enc_aead(pst->st_oakley.encrypter);
+    encstart = iv + pst->st_oakley.encrypter->iv_size;
 
-        hmac_init_chunk(&ctx, pst->st_oakley.integ_hasher, *authkey);
-        hmac_update(&ctx, authstart, encend-authstart);
-        hmac_final(b12, &ctx);
+    if(aead) {
+        /* check the ICV and decrypt in one pass */
+        size_t tagsize = pst->st_oakley.encrypter->aead_tag_size;
 
-        DBG(DBG_PARSING,
-            DBG_dump("data being hmac:", authstart, encend-authstart);
-            DBG_dump("R2 calculated auth:", b12, pst->st_oakley.integ_hasher->hash_integ_len);
-            DBG_dump("R2  provided  auth:", encend, pst->st_oakley.integ_hasher->hash_integ_len);
-            );
+        if(e_pbs->roof - encstart < (ptrdiff_t)(tagsize + 1)) {
+            openswan_log("encrypted payload too short for its ICV");
+            return STF_FAIL;
+        }
+        encend = e_pbs->roof - tagsize;
+
+        DBG(DBG_CRYPT,
+            DBG_dump("data before decryption:", encstart, encend - encstart));
 
-        /* compare first 96 bits == 12 bytes */
-        /* It is not always 96 bytes, it depends upon which integ algo is used*/
-        if(memcmp(b12, encend, pst->st_oakley.integ_hasher->hash_integ_len)!=0) {
+        if(!crypt_key_aead(cipherkey, encstart, encend - encstart, iv
+                           , authstart, iv - authstart, encend, FALSE)) {
             openswan_log("R2 failed to match authenticator");
             return STF_FAIL;
         }
+    } else {
+        encend = e_pbs->roof - pst->st_oakley.integ_hasher->hash_integ_len;
+
+        /* start by checking authenticator */
+        {
+            unsigned char  *b12 = alloca(pst->st_oakley.integ_hasher->hash_digest_len);
+            struct hmac_ctx ctx;
+
+            hmac_init_key(&ctx, authkey);
+            hmac_update(&ctx, authstart, encend-authstart);
+            hmac_final(b12, &ctx);
+
+            DBG(DBG_PARSING,
+                DBG_dump("data being hmac:", authstart, encend-authstart);
+                DBG_dump("R2 calculated auth:", b12, pst->st_oakley.integ_hasher->hash_integ_len);
+                DBG_dump("R2  provided  auth:", encend, pst->st_oakley.integ_hasher->hash_integ_len);
+                );
+
+            /* compare first 96 bits == 12 bytes */
+            /* It is not always 96 bytes, it depends upon which integ algo is used*/
+            if(memcmp(b12, encend, pst->st_oakley.integ_hasher->hash_integ_len)!=0) {
+                openswan_log("R2 failed to match authenticator");
+                return STF_FAIL;
+            }
+        }
     }
 
     DBG(DBG_PARSING, DBG_log("authenticator matched, np=%u", np));
@@ -394,31 +452,26 @@ stf_status ikev2_decrypt_msg(struct msg_digest *md
                          , b1, st->st_remoteport
                          , b2, md->sender_port);
             st->st_remoteport = md->sender_port;
-            st->st_remoteaddr = md->sender;
+            set_state_remoteaddr(st, &md->sender);
         }
     }
 
-    /* decrypt */
+    /* decrypt, unless the AEAD cipher has already */
     {
-        size_t         blocksize = pst->st_oakley.encrypter->enc_blocksize;
-        unsigned char *encstart  = iv + blocksize;
         unsigned int   enclen    = encend - encstart;
         unsigned int   padlen;
 
-        DBG(DBG_CRYPT,
-            DBG_dump("data before decryption:", encstart, enclen));
+        if(!aead) {
+            DBG(DBG_CRYPT,
+                DBG_dump("data before decryption:", encstart, enclen));
 
-        /* now, decrypt */
-        (pst->st_oakley.encrypter->do_crypt)(encstart,
-                                             enclen,
-                                             cipherkey->ptr,
-                                             cipherkey->len,
-                                             iv, FALSE);
+            /* now, decrypt */
+            crypt_key_crypt(cipherkey, encstart, enclen, iv, FALSE);
+        }
 
         padlen = encstart[enclen-1];
-        encend = encend - padlen+1;
 
-        if(encend < encstart) {
+        if(padlen+1 > enclen) {
             openswan_log("invalid pad length: %u", padlen);
             return STF_FAIL;
         }
@@ -510,17 +563,44 @@ ikev2_update_nat_ports(struct state *st)
 }
 
 /*
- * Cookie = <VersionIDofSecret> | Hash(Ni | IPi | SPIi | <secret>)
- * where <secret> is a randomly generated secret known only to the
- * in OSW implementation <VersionIDofSecret> is not used.
+ * Anti-DoS cookies, RFC 7296 section 2.6.
+ *
+ * Every initiator has to return a cookie while the number of half-open
+ * IKE SAs is at or above ikev2_cookie_threshold, until it drops below
+ * three quarters of that again.  So does any source prefix that has
+ * ikev2_cookie_prefix_threshold half-open SAs of its own.  With
+ * --force_busy, every initiator always has to.  A threshold of 0 turns
+ * that check off.
+ *
+ *   Cookie = <VersionIDofSecret> | Hash(Ni | IPi | SPIi | <secret>)
+ *
+ * The version is one byte and the hash is SHA1.  The secret changes
+ * along with the IKEv1 secret_of_the_day.  The previous secret is still
+ * accepted, so a cookie handed out just before the change still works.
+ * Checking a cookie needs nothing but the request, so no struct state
+ * is made until the initiator has proven that it can receive packets
+ * at its address.
  */
-
-/*
-*	NiIPSPIԼʱֵɵַ(COOKIE)
-*  ʱڴΪ̶ֵ!!!!
-*/
-static bool ikev2_get_dcookie(u_char *dcookie,  chunk_t st_ni
-                              ,ip_address *addr, u_int8_t *spiI)
+#define IKEV2_DCOOKIE_SIZE	(1 + SHA1_DIGEST_SIZE)
+
+unsigned long ikev2_cookie_threshold = IKEV2_COOKIE_THRESHOLD;
+unsigned long ikev2_cookie_prefix_threshold = IKEV2_COOKIE_PREFIX_THRESHOLD;
+
+static u_int8_t ikev2_secret_version;
+static u_char   ikev2_old_secret[SHA1_DIGEST_SIZE];
+
+static struct {
+    bool          busy;		/* demanding cookies from everyone */
+    unsigned long busy_times;	/* how often that started */
+    unsigned long sent;		/* COOKIE notifies sent */
+    unsigned long valid;	/* requests that returned a good one */
+    unsigned long invalid;	/* ... a wrong or stale one */
+    unsigned long rotations;	/* secret changes */
+} dcookie_stats;
+
+static void ikev2_get_dcookie(u_char *dcookie, chunk_t ni
+                              , const ip_address *addr, const u_int8_t *spiI
+                              , u_int8_t version, const u_char *secret)
 {
     size_t addr_length;
     SHA1_CTX        ctx_sha1;
@@ -530,30 +610,148 @@ static bool ikev2_get_dcookie(u_char *dcookie,  chunk_t st_ni
 
     addr_length = addrbytesof(addr, addr_buff, sizeof(addr_buff));
     SHA1Init(&ctx_sha1);
-    SHA1Update(&ctx_sha1, st_ni.ptr, st_ni.len);
+    SHA1Update(&ctx_sha1, ni.ptr, ni.len);
     SHA1Update(&ctx_sha1, addr_buff, addr_length);
-    SHA1Update(&ctx_sha1, spiI, sizeof(*spiI));
-    SHA1Update(&ctx_sha1, ikev2_secret_of_the_day
-               , SHA1_DIGEST_SIZE);
-    SHA1Final(dcookie, &ctx_sha1);
-    DBG(DBG_PRIVATE
-        ,DBG_log("ikev2 secret_of_the_day used %s, length %d"
-                 , ikev2_secret_of_the_day
-                 , SHA1_DIGEST_SIZE););
+    SHA1Update(&ctx_sha1, spiI, COOKIE_SIZE);
+    SHA1Update(&ctx_sha1, secret, SHA1_DIGEST_SIZE);
+    dcookie[0] = version;
+    SHA1Final(dcookie + 1, &ctx_sha1);
 
     DBG(DBG_CRYPT
-        ,DBG_dump("computed dcookie: HASH(Ni | IPi | SPIi | <secret>)"
-                  , dcookie, SHA1_DIGEST_SIZE));
-#if 0
-    ikev2_secrets_recycle++;
-    if(ikev2_secrets_recycle >= 32768) {
-        /* handed out too many cookies, cycle secrets */
-        ikev2_secrets_recycle = 0;
-        /* can we call init_secrets() without adding an EVENT? */
-        init_secrets();
+        ,DBG_dump("computed dcookie: Version | HASH(Ni | IPi | SPIi | <secret>)"
+                  , dcookie, IKEV2_DCOOKIE_SIZE));
+}
+
+/* called with the IKEv1 secret_of_the_day, from init_secret() */
+void ikev2_rotate_dcookie_secret(void)
+{
+    memcpy(ikev2_old_secret, ikev2_secret_of_the_day, SHA1_DIGEST_SIZE);
+    get_rnd_bytes(ikev2_secret_of_the_day, SHA1_DIGEST_SIZE);
+    ikev2_secret_version++;
+    dcookie_stats.rotations++;
+}
+
+static bool ikev2_cookies_wanted(const ip_address *src)
+{
+    unsigned long half_open = half_open_count();
+    unsigned long off = ikev2_cookie_threshold - ikev2_cookie_threshold / 4;
+
+    if (force_busy)
+        return TRUE;
+
+    if (ikev2_cookie_threshold != 0) {
+        if (!dcookie_stats.busy && half_open >= ikev2_cookie_threshold) {
+            dcookie_stats.busy = TRUE;
+            dcookie_stats.busy_times++;
+            openswan_log("%lu half-open IKE SAs: demanding cookies from all initiators"
+                         , half_open);
+        } else if (dcookie_stats.busy && half_open < off) {
+            dcookie_stats.busy = FALSE;
+            openswan_log("%lu half-open IKE SAs: no longer demanding cookies"
+                         , half_open);
+        }
+        if (dcookie_stats.busy)
+            return TRUE;
     }
-#endif
-    return TRUE;
+
+    return ikev2_cookie_prefix_threshold != 0
+        && half_open_prefix_busy(src, ikev2_cookie_prefix_threshold
+                                 , ikev2_cookie_prefix_threshold
+                                 - ikev2_cookie_prefix_threshold / 4);
+}
+
+/*
+ * An IKE_SA_INIT request for a new IKE SA.  If cookies are wanted from
+ * its sender, check the one it returned, or send it one.  STF_OK means
+ * carry on (*checked tells whether a cookie was verified); STF_IGNORE
+ * means the request was answered with a COOKIE and is finished with.
+ */
+static stf_status ikev2_check_dcookie(struct msg_digest *md, bool *checked)
+{
+    struct payload_digest *p;
+    const pb_stream *ni_pbs;
+    u_char dcookie[IKEV2_DCOOKIE_SIZE];
+    chunk_t ni, dc;
+
+    *checked = FALSE;
+    if (!ikev2_cookies_wanted(&md->sender))
+        return STF_OK;
+
+    if (md->chain[ISAKMP_NEXT_v2Ni] == NULL) {
+        DBG(DBG_CONTROLMORE, DBG_log("busy mode on. I1 without Ni dropped"));
+        return STF_IGNORE;
+    }
+    ni_pbs = &md->chain[ISAKMP_NEXT_v2Ni]->pbs;
+    setchunk(ni, ni_pbs->cur, pbs_left(ni_pbs));
+
+    /* RFC 7296 wants the COOKIE first, but look at every notify */
+    for (p = md->chain[ISAKMP_NEXT_v2N]; p != NULL; p = p->next)
+        if (p->payload.v2n.isan_type == v2N_COOKIE)
+            break;
+
+    if (p != NULL) {
+        const pb_stream *dc_pbs = &p->pbs;
+        u_int8_t spisize = p->payload.v2n.isan_spisize;
+        const u_char *secret = NULL;
+
+        DBG(DBG_CONTROLMORE
+            , DBG_log("received a DOS cookie in I1 verify it"));
+
+        if (pbs_left(dc_pbs) == (size_t)spisize + IKEV2_DCOOKIE_SIZE) {
+            const u_char *blob = dc_pbs->cur + spisize;
+
+            DBG(DBG_CONTROLMORE
+                , DBG_dump("dcookie received in I1 Packet"
+                           , blob, IKEV2_DCOOKIE_SIZE));
+
+            if (blob[0] == ikev2_secret_version)
+                secret = ikev2_secret_of_the_day;
+            else if (dcookie_stats.rotations > 1
+                     && blob[0] == (u_int8_t)(ikev2_secret_version - 1))
+                secret = ikev2_old_secret;
+
+            if (secret != NULL) {
+                ikev2_get_dcookie(dcookie, ni, &md->sender
+                                  , md->hdr.isa_icookie, blob[0], secret);
+                if (memcmp(blob, dcookie, IKEV2_DCOOKIE_SIZE) == 0) {
+                    DBG(DBG_CONTROLMORE
+                        , DBG_log("dcookie received match with computed one"));
+                    dcookie_stats.valid++;
+                    *checked = TRUE;
+                    return STF_OK;
+                }
+            }
+        }
+        dcookie_stats.invalid++;
+        DBG(DBG_CONTROLMORE
+            , DBG_log("mismatch in DOS v2N_COOKIE, send a new one"));
+    } else {
+        /* we are under DOS attack I1 contains no DOS COOKIE */
+        DBG(DBG_CONTROLMORE
+            , DBG_log("busy mode on. received I1 without a valid dcookie");
+            DBG_log("send a dcookie, and keep no state"));
+    }
+
+    ikev2_get_dcookie(dcookie, ni, &md->sender, md->hdr.isa_icookie
+                      , ikev2_secret_version, ikev2_secret_of_the_day);
+    setchunk(dc, dcookie, IKEV2_DCOOKIE_SIZE);
+    send_v2_notification_from_md(md, ISAKMP_v2_SA_INIT, v2N_COOKIE, &dc);
+    dcookie_stats.sent++;
+    return STF_IGNORE;
+}
+
+void show_ikev2_dcookie_status(void)
+{
+    whack_log(RC_COMMENT, "stats ikev2 cookies: %s half-open=%lu"
+              " threshold=%lu prefix-threshold=%lu prefixes=%u"
+              " sent=%lu valid=%lu invalid=%lu busy-times=%lu rotations=%lu"
+              , force_busy ? "forced"
+                : dcookie_stats.busy ? "on" : "off"
+              , half_open_count()
+              , ikev2_cookie_threshold, ikev2_cookie_prefix_threshold
+              , half_open_prefix_count()
+              , dcookie_stats.sent, dcookie_stats.valid, dcookie_stats.invalid
+              , dcookie_stats.busy_times, dcookie_stats.rotations);
 }
 
 /* details moved to seperate files for readability */
@@ -416,7 +416,7 @@ ikev2_parent_inR1outI2_tail(struct pluto_crypto_req_cont *pcrc
         if(c0) {
             chunk_t child_spi, notify_data;
             unsigned int next_payload = ISAKMP_NEXT_NONE;
-            st->st_connection = c0;
+            set_state_connection(st, c0);
 
             if( !(st->st_connection->policy & POLICY_TUNNEL) ) {
                 next_payload = ISAKMP_NEXT_v2N;
@@ -45,10 +45,25 @@ stf_status ikev2parent_inI1outR1(struct msg_digest *md)
     struct state *st = md->st;
     lset_t policy = POLICY_IKEV2_ALLOW;
     lset_t policy_hint = LEMPTY;
+    bool dcookie_checked = FALSE;
+    struct connection *c;
+
+    /*
+     * check, as a responder, whether we want a cookie from this
+     * initiator first: until it has returned one, we keep no state,
+     * and spend no time looking for a connection
+     */
+    if(!st) {
+        stf_status e = ikev2_check_dcookie(md, &dcookie_checked);
+
+        if(e != STF_OK)
+            return e;
+    }
+
 	/*
 	*	Э̵ַͶ˿
 	*/
-    struct connection *c = find_host_connection(ANY_MATCH, &md->iface->ip_addr
+    c = find_host_connection(ANY_MATCH, &md->iface->ip_addr
                                                 , md->iface->port
                                                 , KH_IPADDR
                                                 , &md->sender
@@ -87,78 +102,20 @@ stf_status ikev2parent_inI1outR1(struct msg_digest *md)
 	 st->st_ikev2      = TRUE;
         st->st_localaddr  = md->iface->ip_addr;
         st->st_localport  = md->iface->port;
-        st->st_remoteaddr = md->sender;
+        set_state_remoteaddr(st, &md->sender);
         st->st_remoteport = md->sender_port;
         st->st_ike_maj    = md->maj;
         st->st_ike_min    = md->min;
 	change_state(st, STATE_PARENT_R1);
+	state_half_open(st);
 
         md->st = st;
         md->from_state = STATE_IKEv2_BASE;
         md->transition_state = st;
     }
 
-    /* check,as a responder, are we under dos attack or not
-     * if yes go to 6 message exchange mode. it is a config option for now.
-     * TBD set force_busy dynamically
-     * Paul: Can we check for STF_TOOMUCHCRYPTO ?
-     */
-    if(force_busy == TRUE)/*ط!!!!!!!!*/
-        {
-            u_char dcookie[SHA1_DIGEST_SIZE];
-            chunk_t dc;
-			/*cookie challengecookieֵ*/
-            ikev2_get_dcookie( dcookie, st->st_ni, &md->sender, st->st_icookie);
-            dc.ptr = dcookie;
-            dc.len = SHA1_DIGEST_SIZE;/*20bytes*/
-
-            /* check if I1 packet contian KE and a v2N payload with type COOKIE */
-			/*ĸʽ??? : HDR + NOTIF + KE*/
-            if ( md->chain[ISAKMP_NEXT_v2KE] &&   md->chain[ISAKMP_NEXT_v2N] &&
-                 (md->chain[ISAKMP_NEXT_v2N]->payload.v2n.isan_type == v2N_COOKIE))
-                {/*ԷЭ̱аcookie*/
-                /*
-         *	ISAKMP_NEXT_v2N  : IKEv2 ֪ͨغ
-         * ISAKMP_NEXT_v2Ni : Nonceغ
-         * ISAKMP_NEXT_v2Nr : նNonceغ
-         */
-                    u_int8_t spisize;
-                    const pb_stream *dc_pbs;
-                    chunk_t blob;
-                    DBG(DBG_CONTROLMORE
-                        , DBG_log("received a DOS cookie in I1 verify it"));
-					
-                    /* we received dcookie we send earlier verify it */
-                    spisize = md->chain[ISAKMP_NEXT_v2N]->payload.v2n.isan_spisize;
-                    dc_pbs = &md->chain[ISAKMP_NEXT_v2N]->pbs;
-                    blob.ptr = dc_pbs->cur + spisize;
-                    blob.len = pbs_left(dc_pbs) - spisize;
-                    DBG(DBG_CONTROLMORE
-                        ,DBG_dump_chunk("dcookie received in I1 Packet", blob);
-                        DBG_dump("dcookie computed", dcookie, SHA1_DIGEST_SIZE));
-
-			/*յcookieͱ˷͵cookieǷһ!!!*/
-                    if(memcmp(blob.ptr, dcookie, SHA1_DIGEST_SIZE)!=0) {
-                        openswan_log("mismatch in DOS v2N_COOKIE,send a new one");
-                        SEND_V2_NOTIFICATION_DATA(md, st, v2N_COOKIE, &dc);
-                        return STF_FAIL + v2N_INVALID_IKE_SPI;
-                    }
-                    DBG(DBG_CONTROLMORE
-                        ,DBG_log("dcookie received match with computed one"));
-                 }
-            else/*յıвCOOKIEغɣҪcookie challenge*/
-                {/*COOKIE challenge֪ͨغɷ*/
-                    /* we are under DOS attack I1 contains no DOS COOKIE */
-                    DBG(DBG_CONTROLMORE
-                        ,DBG_log("busy mode on. receieved I1 without a valid dcookie");
-                        DBG_log("send a dcookie and forget this state"));
-                    SEND_V2_NOTIFICATION_DATA(md, st, v2N_COOKIE, &dc);
-                    return STF_FAIL;
-                }
-        }
-    else {
+    if(!dcookie_checked) {
         DBG(DBG_CONTROLMORE ,DBG_log("will not send/process a dcookie"));
-
     }
 
     /*
@@ -288,6 +288,7 @@ ikev2_parent_inI2outR2_tail(struct pluto_crypto_req_cont *pcrc
      * the IPsec SA, and to provide for it's eventual rekeying
      */
     change_state(st, STATE_PARENT_R2);
+    state_half_open_done(st);
     c->newest_isakmp_sa = st->st_serialno;
     md->pst = st;
 
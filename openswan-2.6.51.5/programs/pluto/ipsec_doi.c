@@ -756,7 +756,7 @@ decode_peer_id(struct msg_digest *md, bool initiator, bool aggrmode)
 	{
             openswan_log("switched from \"%s\" to \"%s\"", c->name, r->name);
 
-	    st->st_connection = r;	/* kill reference to c */
+	    set_state_connection(st, r);	/* kill reference to c */
 
 	    /* this ensures we don't move cur_connection from NULL to
 	     * something, requiring a reset_cur_connection() */
@@ -780,7 +780,7 @@ void initialize_new_state(struct state *st
 {
     struct spd_route *sr;
 
-    st->st_connection = c;
+    set_state_connection(st, c);
 
     set_state_ike_endpoints(st, c);
 
@@ -950,9 +950,13 @@ void fmt_isakmp_sa_established(struct state *st, char *sadetails, int sad_len)
     if(st->st_ikev2) {
 	authname="IKEv2";
 	integstr=" integ=";
+	if (st->st_oakley.integ_hasher == NULL) {
+	    integname = "none";		/* AEAD cipher */
+	} else {
 	snprintf(integname_tmp, sizeof(integname_tmp), "%s_%zu", st->st_oakley.integ_hasher->common.officname
 		, st->st_oakley.integ_hasher->hash_integ_len*BITS_PER_BYTE);
 	integname=(const char*)integname_tmp;
+	}
     } else {
 	authname = enum_show(&oakley_auth_names, st->st_oakley.auth);
 	integstr="";
@@ -982,7 +986,8 @@ void __ikev2_validate_key_lengths(struct state *st, const char *fn, int ln)
     /* test the encryption key length */
     enc_name = st->st_oakley.encrypter
 	? st->st_oakley.encrypter->common.officname : "?",
-    expected_enc_key_bytes = st->st_oakley.enckeylen / 8;
+    expected_enc_key_bytes = st->st_oakley.enckeylen / 8
+	+ (st->st_oakley.encrypter ? st->st_oakley.encrypter->salt_size : 0);
 
     if (expected_enc_key_bytes != st->st_skey_ei.len) {
         DBG_log("WARNING: %s:%u: encryptor '%s' expects keylen %ld/%d, SA #%ld INITIATOR keylen is %ld",
@@ -105,13 +105,58 @@ const struct pfkey_proto_info null_proto_info[2] = {
         }
 };
 
-static struct bare_shunt *bare_shunts = NULL;
+/* Bare shunts are hashed on (ours, his, transport_proto, ports).
+ * The table never grows: callers keep pointers into the chains
+ * (see bare_shunt_ptr), so it must not be rehashed under them.
+ */
+#define BARE_SHUNT_BUCKETS	4096	/* power of 2 */
+
+static struct bare_shunt *bare_shunts[BARE_SHUNT_BUCKETS];
+static unsigned int bare_shunt_count = 0;
 #ifdef IPSEC_CONNECTION_LIMIT
 static int num_ipsec_eroute = 0;
 #endif
 
 static void free_bare_shunt(struct bare_shunt **pp);
 
+/* mix a subnet, including its port, into a hash */
+static unsigned int
+subnet_hash(const ip_subnet *s, unsigned int h)
+{
+    unsigned char *b;
+    size_t n = addrbytesptr(&s->addr, &b);
+
+    while (n-- > 0)
+	h = h * 31 + *b++;
+    h = h * 31 + s->maskbits;
+    h = h * 31 + portof(&s->addr);
+    return h;
+}
+
+static struct bare_shunt **
+bare_shunt_bucket(const ip_subnet *ours, const ip_subnet *his
+		  , int transport_proto)
+{
+    unsigned int h = subnet_hash(his, subnet_hash(ours, transport_proto));
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return &bare_shunts[h & (BARE_SHUNT_BUCKETS - 1)];
+}
+
+static void
+add_bare_shunt(struct bare_shunt *bs)
+{
+    struct bare_shunt **head = bare_shunt_bucket(&bs->ours, &bs->his
+						 , bs->transport_proto);
+
+    bs->next = *head;
+    *head = bs;
+    bare_shunt_count++;
+    DBG_bare_shunt("add", bs);
+}
+
 #ifdef DEBUG
 void
 DBG_bare_shunt_log(const char *op, const struct bare_shunt *bs)
@@ -165,9 +210,7 @@ record_and_initiate_opportunistic(const ip_subnet *ours
         bs->count = 0;
         bs->last_activity = now();
 
-        bs->next = bare_shunts;
-        bare_shunts = bs;
-        DBG_bare_shunt("add", bs);
+        add_bare_shunt(bs);
     }
 
     /* actually initiate opportunism / ondemand */
@@ -183,7 +226,8 @@ record_and_initiate_opportunistic(const ip_subnet *ours
 			/* if we didn't do any ondemand stuff the shunt is not needed */
 			struct bare_shunt **bspp = bare_shunt_ptr(ours,his,transport_proto);
 			if (bspp) {
-				passert(*bspp == bare_shunts);
+				passert(*bspp == *bare_shunt_bucket(ours, his
+								    , transport_proto));
 				free_bare_shunt(bspp);
 			}
 		}
@@ -561,6 +605,30 @@ do_command(struct connection *c, const struct spd_route *sr
     return TRUE;
 }
 
+/*
+ * A command that updown_invoke() queued has finished.  Run inline, a
+ * failed "up" or "route" would have kept the IPsec SA from being
+ * installed.  By now it is installed, so it is expired instead.
+ */
+void
+do_command_done(struct state *st, const char *verb, bool success)
+{
+    if (success || st == NULL)
+	return;
+
+    if (!streq(verb, "up") && !streq(verb, "route"))
+	return;
+
+    if (!IS_IPSEC_SA_ESTABLISHED(st->st_state) && !IS_CHILD_SA_ESTABLISHED(st))
+	return;
+
+    loglog(RC_LOG_SERIOUS, "%s command failed for an installed IPsec SA"
+	   ", expiring it", verb);
+    delete_event(st);
+    delete_dpd_event(st);
+    event_schedule(EVENT_SA_EXPIRE, 0, st);
+}
+
 
 /* Check that we can route (and eroute).  Diagnose if we cannot. */
 
@@ -697,6 +765,7 @@ could_route(struct connection *c, struct spd_route *dsr)
              */
             outside->spd.eroute_owner = SOS_NOBODY;
             outside->spd.routing = RT_UNROUTED_KEYED;
+            route_index_update(outside);
 
             /* set the priority of the new eroute owner to be higher
              * than that of the current eroute owner
@@ -864,7 +933,8 @@ bare_shunt_ptr(const ip_subnet *ours, const ip_subnet *his, int transport_proto)
 {
     struct bare_shunt *p, **pp;
 
-    for (pp = &bare_shunts; (p = *pp) != NULL; pp = &p->next)
+    for (pp = bare_shunt_bucket(ours, his, transport_proto)
+	; (p = *pp) != NULL; pp = &p->next)
     {
         if (samesubnet(ours, &p->ours)
         && samesubnet(his, &p->his)
@@ -891,6 +961,7 @@ free_bare_shunt(struct bare_shunt **pp)
         struct bare_shunt *p = *pp;
 
         *pp = p->next;
+        bare_shunt_count--;
         DBG_bare_shunt("delete", p);
         pfree(p->why);
         pfree(p);
@@ -901,27 +972,42 @@ void
 show_shunt_status(void)
 {
     struct bare_shunt *bs;
+    unsigned int i, used = 0, longest = 0;
 
-    for (bs = bare_shunts; bs != NULL; bs = bs->next)
+    for (i = 0; i < BARE_SHUNT_BUCKETS; i++)
     {
-        /* Print interesting fields.  Ignore count and last_active. */
+        unsigned int chain = 0;
+
+        for (bs = bare_shunts[i]; bs != NULL; bs = bs->next)
+        {
+            /* Print interesting fields.  Ignore count and last_active. */
 
-        int ourport = ntohs(portof(&bs->ours.addr));
-        int hisport = ntohs(portof(&bs->his.addr));
-        char ourst[SUBNETTOT_BUF];
-        char hist[SUBNETTOT_BUF];
-        char sat[SATOT_BUF];
-        char prio[POLICY_PRIO_BUF];
+            int ourport = ntohs(portof(&bs->ours.addr));
+            int hisport = ntohs(portof(&bs->his.addr));
+            char ourst[SUBNETTOT_BUF];
+            char hist[SUBNETTOT_BUF];
+            char sat[SATOT_BUF];
+            char prio[POLICY_PRIO_BUF];
 
-        subnettot(&(bs)->ours, 0, ourst, sizeof(ourst));
-        subnettot(&(bs)->his, 0, hist, sizeof(hist));
-        satot(&(bs)->said, 0, sat, sizeof(sat));
-        fmt_policy_prio(bs->policy_prio, prio);
+            subnettot(&(bs)->ours, 0, ourst, sizeof(ourst));
+            subnettot(&(bs)->his, 0, hist, sizeof(hist));
+            satot(&(bs)->said, 0, sat, sizeof(sat));
+            fmt_policy_prio(bs->policy_prio, prio);
 
-        whack_log(RC_COMMENT, "%s:%d -%d-> %s:%d => %s %s    %s"
-            , ourst, ourport, bs->transport_proto, hist, hisport, sat
-            , prio, bs->why);
+            whack_log(RC_COMMENT, "%s:%d -%d-> %s:%d => %s %s    %s"
+                , ourst, ourport, bs->transport_proto, hist, hisport, sat
+                , prio, bs->why);
+            chain++;
+        }
+        if (chain > 0)
+            used++;
+        if (chain > longest)
+            longest = chain;
     }
+
+    whack_log(RC_COMMENT, "stats bare shunts: shunts=%u buckets=%u/%u longest=%u"
+        , bare_shunt_count, used, BARE_SHUNT_BUCKETS, longest);
+    show_route_index_status();
 }
 
 /* Setup an IPsec route entry.
@@ -999,8 +1085,10 @@ clear_narrow_holds(
     int transport_proto)
 {
     struct bare_shunt *p, **pp;
+    unsigned int i;
 
-    for (pp = &bare_shunts; (p = *pp) != NULL; )
+    for (i = 0; i < BARE_SHUNT_BUCKETS; i++)
+    for (pp = &bare_shunts[i]; (p = *pp) != NULL; )
     {
 	ip_subnet po, ph;
 
@@ -1029,8 +1117,8 @@ clear_narrow_holds(
 		    , FALSE, transport_proto
 		    , "removing clashing narrow holds");
 
-	    /* restart from beginning as we just removed and entry */
-	    pp = &bare_shunts;
+	    /* restart the chain as we just removed an entry */
+	    pp = &bare_shunts[i];
 	    continue;
 	}
 	pp = &p->next;
@@ -1101,9 +1189,7 @@ replace_bare_shunt(const ip_address *src, const ip_address *dst
                                 bs->said.dst = *null_host;
                                 bs->count = 0;
                                 bs->last_activity = now();
-                                bs->next = bare_shunts;
-                                bare_shunts = bs;
-                                DBG_bare_shunt("add", bs);
+                                add_bare_shunt(bs);
                             }
                     }
                 shunt_spi = SPI_HOLD;
@@ -1229,7 +1315,7 @@ bool eroute_connection(struct state *st
 /* assign a bare hold to a connection */
 
 bool
-assign_hold(struct connection *c USED_BY_DEBUG
+assign_hold(struct connection *c
             , struct spd_route *sr
             , int transport_proto
             , const ip_address *src, const ip_address *dst)
@@ -1311,6 +1397,7 @@ assign_hold(struct connection *c USED_BY_DEBUG
             return FALSE;
     }
     sr->routing = rn;
+    route_index_update(c);
     return TRUE;
 }
 
@@ -2411,9 +2498,50 @@ void show_kernel_interface()
     if(kernel_ops) {
 	whack_log(RC_COMMENT, "using kernel interface: %s"
 		  , kernel_ops->kern_name);
+	if (kernel_ops->show_status)
+	    kernel_ops->show_status();
     }
 }
 
+/*
+ * How old the SA traffic counters that DPD and the status listing use
+ * may get, if the kernel interface can fetch them all at once;
+ * 0 asks after each SA separately, every time.
+ */
+int sa_poll_interval = 5;
+
+void
+free_kernel(void)
+{
+    if (kernel_ops != NULL && kernel_ops->free != NULL)
+	kernel_ops->free();
+}
+
+/*
+ * Requests made to the kernel between kernel_batch_begin() and
+ * kernel_batch_end() may be sent together, if the kernel interface can
+ * do that; until then add_sa, del_sa and raw_eroute report success.
+ * Batches nest: the outermost end sends them, or any end that says it
+ * has to wait for the answers.  kernel_batch_end() is FALSE if one of the
+ * requests made since the matching begin failed (as far as it knows,
+ * if it did not wait).
+ */
+unsigned long
+kernel_batch_begin(void)
+{
+    if (kernel_ops == NULL || kernel_ops->batch_begin == NULL)
+	return 0;
+    return kernel_ops->batch_begin();
+}
+
+bool
+kernel_batch_end(unsigned long mark, bool wait)
+{
+    if (kernel_ops == NULL || kernel_ops->batch_end == NULL)
+	return TRUE;
+    return kernel_ops->batch_end(mark, wait);
+}
+
 /*
  * see if the attached connection refers to an older state.
  * if it does, then initiate this state with the appropriate outgoing
@@ -2461,6 +2589,8 @@ install_inbound_ipsec_sa(struct state *parent_st, struct state *st)
 {
     struct connection *const c = st->st_connection;
     struct spd_route   desired_sr;
+    unsigned long batch;
+    bool ok = TRUE;
 
     /* If our peer has a fixed-address client, check if we already
      * have a route for that client that conflicts.  We will take this
@@ -2546,6 +2676,9 @@ install_inbound_ipsec_sa(struct state *parent_st, struct state *st)
      * we now have to set up the outgoing SA first, so that
      * we can refer to it in the incoming SA.
      */
+    /* the SAs for both directions go to the kernel together */
+    batch = kernel_batch_begin();
+
     if(st->st_refhim == IPSEC_SAREF_NULL && !st->st_outbound_done) {
 
 #ifdef HAVE_LABELED_IPSEC
@@ -2554,6 +2687,7 @@ install_inbound_ipsec_sa(struct state *parent_st, struct state *st)
             DBG(DBG_CONTROL, DBG_log("installing outgoing SA now as refhim=%u", st->st_refhim));
             if(!setup_half_ipsec_sa(parent_st, st, &desired_sr, FALSE)) {
                 DBG_log("failed to install outgoing SA: %u", st->st_refhim);
+                (void) kernel_batch_end(batch, TRUE);
                 return FALSE;
             }
 #ifdef HAVE_LABELED_IPSEC
@@ -2574,15 +2708,22 @@ install_inbound_ipsec_sa(struct state *parent_st, struct state *st)
     if(!st->st_connection->loopback)
 #endif
         {
-            return setup_half_ipsec_sa(parent_st, st, &desired_sr, TRUE);
+            ok = setup_half_ipsec_sa(parent_st, st, &desired_sr, TRUE);
         }
 
 #ifdef HAVE_LABELED_IPSEC
     else {
         DBG(DBG_CONTROL, DBG_log("in case of loopback, the state that initiated this quick mode exchange will install incoming SAs, so skipping this"));
-	return TRUE;
     }
 #endif
+
+    if (!kernel_batch_end(batch, TRUE) && ok) {
+	loglog(RC_LOG_SERIOUS, "state #%lu: kernel refused part of the IPsec SA", st->st_serialno);
+	st->st_outbound_done = FALSE;
+	delete_ipsec_sa(st, FALSE);
+	ok = FALSE;
+    }
+    return ok;
 }
 
 /* Install a route and then a prospective shunt eroute or an SA group eroute.
@@ -2787,6 +2928,8 @@ route_and_eroute(struct connection *c USED_BY_KLIPS
             }
         }
 
+        route_index_update(c);
+
         if (st == NULL)
         {
             passert(sr->eroute_owner == SOS_NOBODY);
@@ -2904,6 +3047,7 @@ install_ipsec_sa(struct state *parent_st
     struct spd_route *orig_sr;
     struct spd_route *sr;
     enum routability rb;
+    unsigned long batch;
 
     DBG(DBG_CONTROL, DBG_log("state #%ld: install_ipsec_sa() for %s"
                              , st->st_serialno
@@ -2938,6 +3082,9 @@ install_ipsec_sa(struct state *parent_st
         return FALSE;
     }
 
+    /* the SAs for both directions go to the kernel together */
+    batch = kernel_batch_begin();
+
     /* setup outgoing SA if we haven't already */
     if(!st->st_outbound_done
 #ifdef HAVE_LABELED_IPSEC
@@ -2946,6 +3093,7 @@ install_ipsec_sa(struct state *parent_st
        ) {
 	if(!setup_half_ipsec_sa(parent_st, st, sr, FALSE)) {
             loglog(RC_LOG_SERIOUS, "state #%lu: failed to setup outgoing SA", st->st_serialno);
+	    (void) kernel_batch_end(batch, TRUE);
 	    return FALSE;
 	}
 	DBG(DBG_KLIPS, DBG_log("state #%lu: set up outgoing SA, ref=%u/%u", st->st_serialno, st->st_ref, st->st_refhim));
@@ -2957,11 +3105,19 @@ install_ipsec_sa(struct state *parent_st
     if(st->st_ref == IPSEC_SAREF_NULL && inbound_also) {
 	if(!setup_half_ipsec_sa(parent_st, st, sr, TRUE)) {
             loglog(RC_LOG_SERIOUS, "state #%lu: failed to setup incoming SA", st->st_serialno);
+	    (void) kernel_batch_end(batch, TRUE);
 	    return FALSE;
 	}
 	DBG(DBG_KLIPS, DBG_log("state #%lu: set up incoming SA, ref=%u/%u", st->st_serialno, st->st_ref, st->st_refhim));
     }
 
+    if (!kernel_batch_end(batch, TRUE)) {
+	loglog(RC_LOG_SERIOUS, "state #%lu: kernel refused part of the IPsec SA", st->st_serialno);
+	st->st_outbound_done = FALSE;
+	delete_ipsec_sa(st, FALSE);
+	return FALSE;
+    }
+
     if(rb == route_unnecessary) {
 	return TRUE;
     }
@@ -3012,6 +3168,7 @@ install_ipsec_sa(struct state *parent_st
 	sr = st->st_connection->spd.next;
 	st->st_connection->spd.eroute_owner = sr->eroute_owner;
 	st->st_connection->spd.routing = sr->routing;
+	route_index_update(st->st_connection);
 
 	if(!st->st_connection->newest_ipsec_sa) {
 		if(!do_command(st->st_connection, &st->st_connection->spd, "updateresolvconf", st)) {
@@ -3031,6 +3188,7 @@ void
 delete_ipsec_sa(struct state *st USED_BY_KLIPS, bool inbound_only USED_BY_KLIPS)
 {
     struct connection *c = st->st_connection;
+    unsigned long batch;
     switch (kern_interface) {
     case USE_MASTKLIPS:
     case USE_KLIPS:
@@ -3088,6 +3246,12 @@ delete_ipsec_sa(struct state *st USED_BY_KLIPS, bool inbound_only USED_BY_KLIPS)
 #endif
 		}
 	    }
+	}
+
+	/* nobody is waiting for the answer, so these can be coalesced */
+	batch = kernel_batch_begin();
+	if (!inbound_only)
+	{
 #ifdef HAVE_LABELED_IPSEC
 	    if(!st->st_connection->loopback) {
 #endif
@@ -3103,6 +3267,7 @@ delete_ipsec_sa(struct state *st USED_BY_KLIPS, bool inbound_only USED_BY_KLIPS)
 #ifdef HAVE_LABELED_IPSEC
         }
 #endif
+	(void) kernel_batch_end(batch, FALSE);
 
 	if (st->st_connection->remotepeertype == CISCO && st->st_serialno == st->st_connection->newest_ipsec_sa) {
 		if(!do_command(st->st_connection, &st->st_connection->spd, "restoreresolvconf", st)) {
@@ -193,6 +193,11 @@ struct kernel_ops {
     void (*process_ifaces)(struct raw_iface *rifaces);
     bool (*exceptsocket)(int socketfd, int family);
 
+    /* optional: coalesce requests to the kernel, see kernel_batch_begin() */
+    unsigned long (*batch_begin)(void);
+    bool (*batch_end)(unsigned long mark, bool wait);
+    void (*show_status)(void);
+    void (*free)(void);
 };
 
 extern int create_socket(struct raw_iface *ifp, const char *v_name, int port);
@@ -226,6 +231,9 @@ extern const char *kernel_command_verb_suffix(struct state *st
 /* many bits reach in to use this, but maybe shouldn't */
 extern bool do_command(struct connection *c, const struct spd_route *sr, const char *verb, struct state *st);
 
+/* the result of a command that was queued by updown_invoke() */
+extern void do_command_done(struct state *st, const char *verb, bool success);
+
 #if defined(linux)
 extern bool do_command_linux(struct connection *c, const struct spd_route *sr
 			     , const char *verb, struct state *st);
@@ -401,6 +409,12 @@ extern bool kernel_overlap_supported(void);
 extern const char *kernel_if_name(void);
 extern void show_kernel_interface(void);
 
+extern int sa_poll_interval;	/* --sa-poll-interval: seconds */
+extern void free_kernel(void);
+
+extern unsigned long kernel_batch_begin(void);
+extern bool kernel_batch_end(unsigned long mark, bool wait);
+
 extern void saref_init(void);
 
 
@@ -41,6 +41,7 @@
 #include "pluto/connections.h"
 #include "state.h"
 #include "kernel.h"
+#include "updown.h"
 #include "kernel_pfkey.h"
 #include "timer.h"
 #include "log.h"
@@ -441,7 +442,7 @@ mast_do_command(struct connection *c, const struct spd_route *sr
 	return FALSE;
     }
 
-    return invoke_command(verb, verb_suffix, cmd);
+    return updown_invoke(sr, verb, verb_suffix, st, cmd);
 }
 
 static bool
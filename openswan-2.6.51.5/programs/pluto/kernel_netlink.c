@@ -36,6 +36,8 @@
 #include <stdint.h>
 #include <linux/pfkeyv2.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <net/if.h>
 
 #include "kameipsec.h"
 #include <rtnetlink.h>
@@ -48,6 +50,7 @@
 #include "sysdep.h"
 #include "socketwrapper.h"
 #include "constants.h"
+#include "oswtime.h"
 #include "defs.h"
 #include "id.h"
 #include "state.h"
@@ -63,6 +66,7 @@
 #include "kernel_alg.h"
 #include "klips-crypto/aes_cbc.h"
 #include "ike_alg.h"
+#include "updown.h"
 
 /* required for Linux 2.6.26 kernel and later */
 #ifndef XFRM_STATE_AF_UNSPEC
@@ -423,6 +427,264 @@ static void init_netlink(void)
 #endif /* HAVE_AEAD */
 }
 
+/*
+ * Batching of XFRM requests.
+ *
+ * Between netlink_batch_begin() and netlink_batch_end(), requests that
+ * only want an acknowledgement (new/update/delete of SAs and policies)
+ * are appended to netlink_batch_buf and go to the kernel in a single
+ * write.  The kernel processes them in order and acknowledges each one;
+ * the acknowledgements are matched back to the request, and to the state
+ * that was current when it was queued, by sequence number.  Anything
+ * that wants a real answer (GETSPI, GETSA) flushes the batch first.
+ */
+#define NETLINK_BATCH_MAX	64
+#define NETLINK_BATCH_BYTES	32768
+
+struct netlink_batch_req {
+    uint32_t     seq;
+    uint16_t     type;
+    bool         enoent_ok;
+    bool         acked;
+    so_serial_t  serialno;	/* cur_state when queued */
+    const char  *description;	/* always a literal */
+    char         text_said[SATOT_BUF + 64];
+};
+
+static uint32_t netlink_seq;
+static int netlink_batch_depth = 0;
+static uint32_t netlink_batch_failed_seq = 0;	/* the last one that failed */
+
+static struct netlink_batch_req netlink_batch_reqs[NETLINK_BATCH_MAX];
+static int netlink_batch_count = 0;
+static union {
+    struct nlmsghdr n;	/* for alignment */
+    char buf[NETLINK_BATCH_BYTES];
+} netlink_batch_buf;
+static size_t netlink_batch_len = 0;
+
+static struct {
+    unsigned long batches;
+    unsigned long requests;
+    unsigned long failed;
+    int           largest;
+} netlink_batch_stats;
+
+/* log an error against the state the request was made for */
+static void
+netlink_batch_error(const struct netlink_batch_req *req, int error)
+{
+    struct state *old = cur_state;
+    struct state *st = req->serialno == SOS_NOBODY
+	? NULL : state_with_serialno(req->serialno);
+
+    if (st != NULL)
+	cur_state = st;
+    loglog(RC_LOG_SERIOUS
+	, "ERROR: netlink %s response for %s %s included errno %d: %s"
+	, sparse_val_show(xfrm_type_names, req->type)
+	, req->description, req->text_said
+	, error, strerror(error));
+    cur_state = old;
+}
+
+static void
+netlink_batch_ack(uint32_t seq, int error)
+{
+    struct netlink_batch_req *req;
+    uint32_t first;
+
+    if (netlink_batch_count == 0)
+	return;
+
+    first = netlink_batch_reqs[0].seq;
+    if (seq - first >= (uint32_t)netlink_batch_count)
+    {
+	DBG(DBG_NETKEY,
+	    DBG_log("netlink: ignoring acknowledgement of %u outside batch %u..%u"
+		    , seq, first, first + netlink_batch_count - 1));
+	return;
+    }
+
+    req = &netlink_batch_reqs[seq - first];
+    if (req->acked)
+	return;
+    req->acked = TRUE;
+
+    if (error == 0 || (error == ENOENT && req->enoent_ok))
+	return;
+
+    netlink_batch_error(req, error);
+    netlink_batch_failed_seq = seq;
+    netlink_batch_stats.failed++;
+}
+
+/* send everything queued in one write and collect the acknowledgements */
+static void
+netlink_batch_flush(void)
+{
+    int outstanding = netlink_batch_count;
+    ssize_t r;
+    int i;
+
+    if (netlink_batch_count == 0)
+	return;
+
+    netlink_batch_stats.batches++;
+    if (netlink_batch_stats.largest < netlink_batch_count)
+	netlink_batch_stats.largest = netlink_batch_count;
+
+    DBG(DBG_NETKEY,
+	DBG_log("netlink: sending batch of %d requests (%lu bytes)"
+		, netlink_batch_count, (unsigned long)netlink_batch_len));
+
+    do {
+	r = write(netlinkfd, netlink_batch_buf.buf, netlink_batch_len);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0 || (size_t)r != netlink_batch_len)
+    {
+	if (r < 0)
+	{
+	    log_errno((e, "netlink write() of a batch of %d requests failed"
+		       , netlink_batch_count));
+	}
+	else
+	{
+	    loglog(RC_LOG_SERIOUS
+		, "ERROR: netlink write() of a batch of %d requests truncated:"
+		  " %ld instead of %lu"
+		, netlink_batch_count, (long)r
+		, (unsigned long)netlink_batch_len);
+	}
+	outstanding = 0;
+    }
+
+    while (outstanding > 0)
+    {
+	union {
+	    struct nlmsghdr n;
+	    char buf[8192];
+	} rsp;
+	struct sockaddr_nl addr;
+	socklen_t alen = sizeof(addr);
+	struct nlmsghdr *n;
+	size_t left;
+
+	r = recvfrom(netlinkfd, rsp.buf, sizeof(rsp.buf), 0
+	    , (struct sockaddr *)&addr, &alen);
+	if (r < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    log_errno((e, "netlink recvfrom() of acknowledgements for a batch"
+		       " of %d requests failed", netlink_batch_count));
+	    break;
+	}
+	if (addr.nl_pid != 0)
+	{
+	    /* not for us: ignore */
+	    continue;
+	}
+
+	left = r;
+	for (n = &rsp.n; NLMSG_OK(n, left); n = NLMSG_NEXT(n, left))
+	{
+	    int error = 0;
+
+	    if (n->nlmsg_type == NLMSG_ERROR
+		&& n->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+	    {
+		error = -((struct nlmsgerr *)NLMSG_DATA(n))->error;
+	    }
+	    else if (n->nlmsg_type != NLMSG_ERROR)
+	    {
+		DBG(DBG_NETKEY,
+		    DBG_log("netlink: ignoring %s message in batch"
+			    , sparse_val_show(xfrm_type_names, n->nlmsg_type)));
+		continue;
+	    }
+	    netlink_batch_ack(n->nlmsg_seq, error);
+	}
+
+	outstanding = 0;
+	for (i = 0; i < netlink_batch_count; i++)
+	    if (!netlink_batch_reqs[i].acked)
+		outstanding++;
+    }
+
+    /* whatever never got an answer counts as a failure */
+    for (i = 0; i < netlink_batch_count; i++)
+    {
+	if (!netlink_batch_reqs[i].acked)
+	{
+	    netlink_batch_failed_seq = netlink_batch_reqs[i].seq;
+	    netlink_batch_stats.failed++;
+	}
+    }
+
+    netlink_batch_count = 0;
+    netlink_batch_len = 0;
+}
+
+static bool
+netlink_batch_queue(struct nlmsghdr *hdr, bool enoent_ok
+		    , const char *description, const char *text_said)
+{
+    struct netlink_batch_req *req;
+    size_t len = NLMSG_ALIGN(hdr->nlmsg_len);
+
+    if (len > sizeof(netlink_batch_buf.buf))
+    {
+	loglog(RC_LOG_SERIOUS
+	    , "ERROR: netlink %s message for %s %s too big to send: %lu"
+	    , sparse_val_show(xfrm_type_names, hdr->nlmsg_type)
+	    , description, text_said, (unsigned long)len);
+	return FALSE;
+    }
+    if (netlink_batch_count == NETLINK_BATCH_MAX
+	|| netlink_batch_len + len > sizeof(netlink_batch_buf.buf))
+    {
+	netlink_batch_flush();
+    }
+
+    hdr->nlmsg_flags |= NLM_F_ACK;
+    hdr->nlmsg_seq = ++netlink_seq;
+    memcpy(netlink_batch_buf.buf + netlink_batch_len, hdr, hdr->nlmsg_len);
+    netlink_batch_len += len;
+
+    req = &netlink_batch_reqs[netlink_batch_count++];
+    req->seq = hdr->nlmsg_seq;
+    req->type = hdr->nlmsg_type;
+    req->enoent_ok = enoent_ok;
+    req->acked = FALSE;
+    req->serialno = cur_state == NULL ? SOS_NOBODY : cur_state->st_serialno;
+    req->description = description;
+    strncpy(req->text_said, text_said, sizeof(req->text_said) - 1);
+    req->text_said[sizeof(req->text_said) - 1] = '\0';
+
+    netlink_batch_stats.requests++;
+    return TRUE;	/* as far as we know */
+}
+
+/* the mark is the first sequence number that belongs to the caller */
+static unsigned long
+netlink_batch_begin(void)
+{
+    netlink_batch_depth++;
+    return netlink_seq + 1;
+}
+
+/* FALSE if one of the requests made since the mark failed */
+static bool
+netlink_batch_end(unsigned long mark, bool wait)
+{
+    passert(netlink_batch_depth > 0);
+    if (--netlink_batch_depth == 0 || wait)
+	netlink_batch_flush();
+    return (int32_t)(netlink_batch_failed_seq - (uint32_t)mark) < 0;
+}
+
+
 /** send_netlink_msg
  *
  * @param hdr - Data to be sent.
@@ -445,14 +707,22 @@ send_netlink_msg(struct nlmsghdr *hdr, struct nlmsghdr *rbuf, size_t rbuf_len
     size_t len;
     ssize_t r;
     struct sockaddr_nl addr;
-    static uint32_t seq;
+    uint32_t seq;
 
     if (kern_interface == NO_KERNEL)
     {
 	return TRUE;
     }
 
-    hdr->nlmsg_seq = ++seq;
+    if (rbuf == NULL && netlink_batch_depth > 0)
+    {
+	return netlink_batch_queue(hdr, FALSE, description, text_said);
+    }
+
+    /* whatever is batched has to reach the kernel before this does */
+    netlink_batch_flush();
+
+    hdr->nlmsg_seq = seq = ++netlink_seq;
     len = hdr->nlmsg_len;
     do {
 	r = write(netlinkfd, hdr, len);
@@ -588,6 +858,11 @@ netlink_policy(struct nlmsghdr *hdr, bool enoent_ok, const char *text_said)
     } rsp;
     int error;
 
+    if (netlink_batch_depth > 0 && kern_interface != NO_KERNEL)
+    {
+	return netlink_batch_queue(hdr, enoent_ok, "policy", text_said);
+    }
+
     rsp.n.nlmsg_type = NLMSG_ERROR;
     if (!send_netlink_msg(hdr, &rsp.n, sizeof(rsp), "policy", text_said))
     {
@@ -1372,20 +1647,6 @@ struct encrypt_desc algo_aes_gcm_12 =
 	keymaxlen: 	AES_KEY_MAX_LEN + 3,
 };
 
-struct encrypt_desc algo_aes_gcm_16 =
-{
-	common: {
-	  name: "aes_gcm_16",
-	  officname: "aes_gcm_16",
-	  algo_type: 	IKE_ALG_ENCRYPT,
-	  algo_v2id:    IKEv2_ENCR_AES_GCM_16,
-	  algo_next: 	NULL, },
-	enc_blocksize: 	AES_CBC_BLOCK_SIZE,
-	keyminlen: 	AES_KEY_MIN_LEN + 3,
-	keydeflen: 	AES_KEY_DEF_LEN + 3,
-	keymaxlen: 	AES_KEY_MAX_LEN + 3,
-};
-
 static void
 linux_pfkey_add_aead(void)
 {
@@ -1431,7 +1692,7 @@ linux_pfkey_add_aead(void)
 	ike_alg_register_enc(&algo_aes_ccm_16);
 	ike_alg_register_enc(&algo_aes_gcm_8);
 	ike_alg_register_enc(&algo_aes_gcm_12);
-	ike_alg_register_enc(&algo_aes_gcm_16);
+	/* algo_aes_gcm_16 is a real IKE cipher, see ike_alg_aes.c */
 }
 
 static void
@@ -2397,6 +2658,249 @@ add_entry:
     }
 }
 
+/*
+ * Cache of the kernel's SA counters.
+ *
+ * Asking for one SA at a time does not scale: with tens of thousands of
+ * SAs, a status listing or a round of DPD idle checks turns into as many
+ * GETSA round trips.  Instead, every sa_poll_interval seconds (at most,
+ * and only when somebody asks) we dump the whole SAD with one
+ * NLM_F_DUMP request and remember the counters, keyed the way the kernel
+ * keys SAs: SPI, destination and protocol.  An SA that is newer than the
+ * last dump is still asked for on its own.
+ */
+struct sa_counters {
+    struct sa_counters *next;
+    ipsec_spi_t     spi;
+    u_int8_t        proto;
+    u_int16_t       family;
+    xfrm_address_t  daddr;
+    u_int64_t       bytes;
+    u_int64_t       use_time;
+    unsigned long   generation;	/* of the dump that last saw it */
+};
+
+#define SA_COUNTERS_MIN_BUCKETS	256
+
+static struct sa_counters **sa_counters_table = NULL;
+static unsigned int sa_counters_buckets = 0;
+static unsigned int sa_counters_count = 0;
+static unsigned long sa_counters_generation = 0;
+static time_t sa_counters_refreshed = 0;
+
+static struct {
+    unsigned long dumps;
+    unsigned long hits;
+    unsigned long misses;
+} sa_counters_stats;
+
+static unsigned int
+sa_counters_hash(ipsec_spi_t spi, u_int8_t proto, const xfrm_address_t *daddr)
+{
+    const u_int32_t *w = (const u_int32_t *)daddr;
+    u_int32_t h = spi ^ (proto << 24);
+
+    h ^= w[0] ^ w[1] ^ w[2] ^ w[3];
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (sa_counters_buckets - 1);
+}
+
+static struct sa_counters **
+sa_counters_find(ipsec_spi_t spi, u_int8_t proto, u_int16_t family
+		 , const xfrm_address_t *daddr)
+{
+    struct sa_counters **pp;
+
+    if (sa_counters_table == NULL)
+	return NULL;
+
+    for (pp = &sa_counters_table[sa_counters_hash(spi, proto, daddr)]
+	; *pp != NULL; pp = &(*pp)->next)
+    {
+	struct sa_counters *sc = *pp;
+
+	if (sc->spi == spi && sc->proto == proto && sc->family == family
+	    && memcmp(&sc->daddr, daddr, sizeof(sc->daddr)) == 0)
+	    return pp;
+    }
+    return pp;	/* where it would go */
+}
+
+/* double the table once it gets crowded; buckets is a power of two */
+static void
+sa_counters_grow(void)
+{
+    struct sa_counters **old = sa_counters_table;
+    unsigned int old_buckets = sa_counters_buckets;
+    unsigned int i;
+
+    if (sa_counters_table != NULL && sa_counters_count < 2 * sa_counters_buckets)
+	return;
+
+    sa_counters_buckets = old_buckets == 0
+	? SA_COUNTERS_MIN_BUCKETS : old_buckets * 2;
+    sa_counters_table = alloc_bytes(sa_counters_buckets * sizeof(*old)
+				    , "SA counter table");
+
+    for (i = 0; i < old_buckets; i++)
+    {
+	while (old[i] != NULL)
+	{
+	    struct sa_counters *sc = old[i];
+	    unsigned int h = sa_counters_hash(sc->spi, sc->proto, &sc->daddr);
+
+	    old[i] = sc->next;
+	    sc->next = sa_counters_table[h];
+	    sa_counters_table[h] = sc;
+	}
+    }
+    pfreeany(old);
+}
+
+static void
+sa_counters_note(const struct xfrm_usersa_info *info)
+{
+    struct sa_counters **pp;
+    struct sa_counters *sc;
+
+    sa_counters_grow();
+    pp = sa_counters_find(info->id.spi, info->id.proto, info->family
+			  , &info->id.daddr);
+    sc = *pp;
+    if (sc == NULL)
+    {
+	sc = alloc_thing(struct sa_counters, "SA counters");
+	sc->spi = info->id.spi;
+	sc->proto = info->id.proto;
+	sc->family = info->family;
+	sc->daddr = info->id.daddr;
+	*pp = sc;
+	sa_counters_count++;
+    }
+    sc->bytes = info->curlft.bytes;
+    sc->use_time = info->curlft.use_time;
+    sc->generation = sa_counters_generation;
+}
+
+/* forget the SAs the last dump did not mention */
+static void
+sa_counters_sweep(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < sa_counters_buckets; i++)
+    {
+	struct sa_counters **pp = &sa_counters_table[i];
+
+	while (*pp != NULL)
+	{
+	    struct sa_counters *sc = *pp;
+
+	    if (sc->generation == sa_counters_generation)
+	    {
+		pp = &sc->next;
+		continue;
+	    }
+	    *pp = sc->next;
+	    pfree(sc);
+	    sa_counters_count--;
+	}
+    }
+}
+
+/* dump the SAD into the cache; FALSE if the dump did not complete */
+static bool
+sa_counters_refresh(void)
+{
+    struct {
+	struct nlmsghdr n;
+	struct xfrm_usersa_info info;
+    } req;
+    uint32_t seq;
+    ssize_t r;
+    bool done = FALSE;
+
+    /* whatever is batched has to reach the kernel before this does */
+    netlink_batch_flush();
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.n.nlmsg_type = XFRM_MSG_GETSA;
+    req.n.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(req.info)));
+    req.n.nlmsg_seq = seq = ++netlink_seq;
+
+    do {
+	r = write(netlinkfd, &req, req.n.nlmsg_len);
+    } while (r < 0 && errno == EINTR);
+    if (r != (ssize_t)req.n.nlmsg_len)
+    {
+	log_errno((e, "netlink write() of SA dump request failed"));
+	return FALSE;
+    }
+
+    sa_counters_generation++;
+    sa_counters_stats.dumps++;
+
+    while (!done)
+    {
+	union {
+	    struct nlmsghdr n;
+	    char buf[65536];
+	} rsp;
+	struct sockaddr_nl addr;
+	socklen_t alen = sizeof(addr);
+	struct nlmsghdr *n;
+	size_t left;
+
+	r = recvfrom(netlinkfd, rsp.buf, sizeof(rsp.buf), 0
+	    , (struct sockaddr *)&addr, &alen);
+	if (r < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    log_errno((e, "netlink recvfrom() of SA dump failed"));
+	    return FALSE;
+	}
+	if (addr.nl_pid != 0)
+	    continue;	/* not for us */
+
+	left = r;
+	for (n = &rsp.n; NLMSG_OK(n, left); n = NLMSG_NEXT(n, left))
+	{
+	    if (n->nlmsg_seq != seq)
+		continue;
+
+	    if (n->nlmsg_type == NLMSG_DONE)
+	    {
+		done = TRUE;
+		break;
+	    }
+	    if (n->nlmsg_type == NLMSG_ERROR)
+	    {
+		const struct nlmsgerr *err = NLMSG_DATA(n);
+
+		loglog(RC_LOG_SERIOUS
+		    , "ERROR: netlink SA dump failed with errno %d: %s"
+		    , -err->error, strerror(-err->error));
+		return FALSE;
+	    }
+	    if (n->nlmsg_type == XFRM_MSG_NEWSA
+		&& n->nlmsg_len >= NLMSG_LENGTH(sizeof(struct xfrm_usersa_info)))
+	    {
+		sa_counters_note(NLMSG_DATA(n));
+	    }
+	}
+    }
+
+    sa_counters_sweep();
+    sa_counters_refreshed = now();
+    DBG(DBG_NETKEY,
+	DBG_log("netlink: SA dump found %u SAs", sa_counters_count));
+    return TRUE;
+}
+
 /* netlink_get_sa - Get SA information from the kernel
  *
  * @param sa Kernel SA to be queried
@@ -2426,6 +2930,28 @@ netlink_get_sa(const struct kernel_sa *sa, u_int *bytes)
     req.id.family = sa->src->u.v4.sin_family;
     req.id.proto = sa->proto;
 
+    if (sa_poll_interval > 0 && kern_interface != NO_KERNEL)
+    {
+	struct sa_counters **pp;
+
+	if (sa_counters_table == NULL
+	    || now() - sa_counters_refreshed >= sa_poll_interval)
+	{
+	    (void) sa_counters_refresh();
+	}
+
+	pp = sa_counters_find(req.id.spi, req.id.proto, req.id.family
+			      , &req.id.daddr);
+	if (pp != NULL && *pp != NULL)
+	{
+	    sa_counters_stats.hits++;
+	    *bytes = (u_int) (*pp)->bytes;
+	    return TRUE;
+	}
+	/* newer than the dump: ask after it alone */
+	sa_counters_stats.misses++;
+    }
+
     req.n.nlmsg_len = NLMSG_ALIGN(NLMSG_LENGTH(sizeof(req.id)));
     rsp.n.nlmsg_type = XFRM_MSG_NEWSA;
 
@@ -2436,6 +2962,358 @@ netlink_get_sa(const struct kernel_sa *sa, u_int *bytes)
     return TRUE;
 }
 
+static void
+netlink_free(void)
+{
+    sa_counters_generation++;
+    sa_counters_sweep();
+    pfreeany(sa_counters_table);
+    sa_counters_table = NULL;
+    sa_counters_buckets = 0;
+}
+
+static void
+netlink_show_status(void)
+{
+    whack_log(RC_COMMENT, "stats netlink: batches=%lu requests=%lu"
+	      " largest=%d failed=%lu"
+	      , netlink_batch_stats.batches, netlink_batch_stats.requests
+	      , netlink_batch_stats.largest, netlink_batch_stats.failed);
+    whack_log(RC_COMMENT, "stats netlink SA counters: interval=%d sas=%u"
+	      " dumps=%lu hits=%lu misses=%lu"
+	      , sa_poll_interval, sa_counters_count, sa_counters_stats.dumps
+	      , sa_counters_stats.hits, sa_counters_stats.misses);
+}
+
+/*
+ * --updown-builtin: what the stock _updown.netkey does for the common
+ * verbs, done over rtnetlink instead of by forking a shell.
+ *
+ * It is only used for connections that leave updown= at the default,
+ * and not at all if there is a pluto_updown defaults file, whose
+ * settings only the script can see.  Anything the script would do that
+ * is not repeated here (IPv6, Cisco peers with a source IP, resolv.conf
+ * and NetworkManager verbs) still goes to the script.
+ */
+static int netlink_route_fd = NULL_FD;
+
+static void
+rtnl_addattr(struct nlmsghdr *n, size_t maxlen, int type
+	     , const void *data, size_t alen)
+{
+    struct rtattr *rta = (struct rtattr *)((char *)n + NLMSG_ALIGN(n->nlmsg_len));
+    size_t len = RTA_LENGTH(alen);
+
+    passert(NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len) <= maxlen);
+    rta->rta_type = type;
+    rta->rta_len = len;
+    memcpy(RTA_DATA(rta), data, alen);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len);
+}
+
+/* send one rtnetlink request; rbuf, if any, gets the answer */
+static bool
+rtnl_talk(struct nlmsghdr *hdr, struct nlmsghdr *rbuf, size_t rbuf_len
+	  , int ignore_errno, const char *description)
+{
+    struct {
+	struct nlmsghdr n;
+	union {
+	    struct nlmsgerr e;
+	    char data[1024];
+	} u;
+    } rsp;
+    static uint32_t seq;
+    ssize_t r;
+
+    if (kern_interface == NO_KERNEL)
+	return TRUE;
+
+    if (netlink_route_fd == NULL_FD)
+    {
+	netlink_route_fd = safe_socket(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE);
+	if (netlink_route_fd < 0)
+	{
+	    log_errno((e, "socket() for rtnetlink failed"));
+	    netlink_route_fd = NULL_FD;
+	    return FALSE;
+	}
+	(void) fcntl(netlink_route_fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    hdr->nlmsg_seq = ++seq;
+    hdr->nlmsg_flags |= NLM_F_REQUEST | (rbuf == NULL ? NLM_F_ACK : 0);
+    do {
+	r = write(netlink_route_fd, hdr, hdr->nlmsg_len);
+    } while (r < 0 && errno == EINTR);
+    if (r != (ssize_t)hdr->nlmsg_len)
+    {
+	log_errno((e, "rtnetlink write() for %s failed", description));
+	return FALSE;
+    }
+
+    for (;;)
+    {
+	r = recv(netlink_route_fd, &rsp, sizeof(rsp), 0);
+	if (r < 0 && errno == EINTR)
+	    continue;
+	if (r < (ssize_t)sizeof(rsp.n))
+	{
+	    log_errno((e, "rtnetlink recv() for %s failed", description));
+	    return FALSE;
+	}
+	if (rsp.n.nlmsg_seq == seq)
+	    break;
+    }
+
+    if (rsp.n.nlmsg_type == NLMSG_ERROR)
+    {
+	int err = -rsp.u.e.error;
+
+	if (err == 0 || err == ignore_errno)
+	    return TRUE;
+	loglog(RC_LOG_SERIOUS, "rtnetlink %s failed: %s"
+	       , description, strerror(err));
+	return FALSE;
+    }
+    if (rbuf != NULL)
+    {
+	if ((size_t)r > rbuf_len)
+	    r = rbuf_len;
+	memcpy(rbuf, &rsp, r);
+    }
+    return TRUE;
+}
+
+/* "ip -o route get ADDR | grep -q ^local" */
+static bool
+netkey_builtin_is_local(const ip_address *addr)
+{
+    struct {
+	struct nlmsghdr n;
+	struct rtmsg r;
+	char data[64];
+    } req;
+    struct {
+	struct nlmsghdr n;
+	struct rtmsg r;
+	char data[1024];
+    } rsp;
+
+    zero(&req);
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(req.r));
+    req.n.nlmsg_type = RTM_GETROUTE;
+    req.r.rtm_family = AF_INET;
+    req.r.rtm_dst_len = 32;
+    rtnl_addattr(&req.n, sizeof(req), RTA_DST
+		 , &addr->u.v4.sin_addr, sizeof(addr->u.v4.sin_addr));
+
+    zero(&rsp);
+    return rtnl_talk(&req.n, &rsp.n, sizeof(rsp), 0, "route get")
+	&& rsp.n.nlmsg_type == RTM_NEWROUTE
+	&& rsp.r.rtm_type == RTN_LOCAL;
+}
+
+static unsigned
+netkey_builtin_ifindex(const struct connection *c)
+{
+    char name[IFNAMSIZ];
+    char *colon;
+
+    strncpy(name, c->interface->ip_dev->id_vname, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    colon = strchr(name, ':');	/* ${PLUTO_INTERFACE%:*} */
+    if (colon != NULL)
+	*colon = '\0';
+    return if_nametoindex(name);
+}
+
+/* addsource: put the source IP on the interface if it is not local */
+static bool
+netkey_builtin_addsource(const struct connection *c, const struct spd_route *sr)
+{
+    struct {
+	struct nlmsghdr n;
+	struct ifaddrmsg a;
+	char data[64];
+    } req;
+
+    if (netkey_builtin_is_local(&sr->this.host_srcip))
+	return TRUE;
+
+    zero(&req);
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(req.a));
+    req.n.nlmsg_type = RTM_NEWADDR;
+    req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+    req.a.ifa_family = AF_INET;
+    req.a.ifa_prefixlen = 32;
+    req.a.ifa_scope = RT_SCOPE_UNIVERSE;
+    req.a.ifa_index = netkey_builtin_ifindex(c);
+    rtnl_addattr(&req.n, sizeof(req), IFA_LOCAL
+		 , &sr->this.host_srcip.u.v4.sin_addr, 4);
+    rtnl_addattr(&req.n, sizeof(req), IFA_ADDRESS
+		 , &sr->this.host_srcip.u.v4.sin_addr, 4);
+
+    /* the script ignores "File exists" too */
+    return rtnl_talk(&req.n, NULL, 0, EEXIST, "addsource");
+}
+
+/* doroute replace|del, for one destination */
+static bool
+netkey_builtin_doroute(const struct connection *c, const struct spd_route *sr
+		       , bool add, const struct in_addr *dst, int dst_len)
+{
+    struct {
+	struct nlmsghdr n;
+	struct rtmsg r;
+	char data[256];
+    } req;
+    bool via = c->tunnel_addr_family == c->end_addr_family
+	&& addrbytesptr(&sr->this.host_nexthop, NULL)
+	&& !isanyaddr(&sr->this.host_nexthop);
+
+    zero(&req);
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(req.r));
+    req.n.nlmsg_type = add ? RTM_NEWROUTE : RTM_DELROUTE;
+    req.n.nlmsg_flags = add ? NLM_F_CREATE | NLM_F_REPLACE : 0;
+    req.r.rtm_family = AF_INET;
+    req.r.rtm_table = RT_TABLE_MAIN;
+    req.r.rtm_dst_len = dst_len;
+    if (add)
+    {
+	req.r.rtm_protocol = RTPROT_BOOT;
+	req.r.rtm_scope = via ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+	req.r.rtm_type = RTN_UNICAST;
+    }
+    else
+    {
+	req.r.rtm_scope = RT_SCOPE_NOWHERE;
+    }
+
+    rtnl_addattr(&req.n, sizeof(req), RTA_DST, dst, sizeof(*dst));
+    if (via)
+    {
+	rtnl_addattr(&req.n, sizeof(req), RTA_GATEWAY
+		     , &sr->this.host_nexthop.u.v4.sin_addr, 4);
+    }
+    else
+    {
+	u_int32_t oif = netkey_builtin_ifindex(c);
+
+	rtnl_addattr(&req.n, sizeof(req), RTA_OIF, &oif, sizeof(oif));
+    }
+    if (c->metric)
+    {
+	u_int32_t metric = c->metric;
+
+	rtnl_addattr(&req.n, sizeof(req), RTA_PRIORITY, &metric, sizeof(metric));
+    }
+    if (c->connmtu)
+    {
+	struct {
+	    struct rtattr rta;
+	    u_int32_t mtu;
+	} metrics;
+
+	metrics.rta.rta_type = RTAX_MTU;
+	metrics.rta.rta_len = RTA_LENGTH(sizeof(metrics.mtu));
+	metrics.mtu = c->connmtu;
+	rtnl_addattr(&req.n, sizeof(req), RTA_METRICS, &metrics, sizeof(metrics));
+    }
+    if (add)
+    {
+	rtnl_addattr(&req.n, sizeof(req), RTA_PREFSRC
+		     , &sr->this.host_srcip.u.v4.sin_addr, 4);
+    }
+
+    return rtnl_talk(&req.n, NULL, 0, 0, add ? "route replace" : "route del");
+}
+
+/* uproute/downroute; there is no route cache to flush any more */
+static bool
+netkey_builtin_route(const struct connection *c, const struct spd_route *sr
+		     , bool add)
+{
+    ip_address net;
+    struct in_addr dst;
+
+    if (add && !netkey_builtin_addsource(c, sr))
+	return FALSE;
+
+    networkof(&sr->that.client, &net);
+    dst = net.u.v4.sin_addr;
+
+    if (sr->that.client.maskbits == 0)
+    {
+	/* eclipse the default route without replacing it */
+	bool ok = netkey_builtin_doroute(c, sr, add, &dst, 1);
+
+	dst.s_addr = htonl(0x80000000);
+	return netkey_builtin_doroute(c, sr, add, &dst, 1) && ok;
+    }
+    return netkey_builtin_doroute(c, sr, add, &dst, sr->that.client.maskbits);
+}
+
+/* TRUE if the verb was handled here, with *success saying how it went */
+static bool
+netkey_builtin_updown(const struct connection *c, const struct spd_route *sr
+		      , const char *verb, const char *verb_suffix
+		      , bool *success)
+{
+    static int defaults_file = -1;
+    bool srcip;
+
+    if (sr->this.updown != NULL && !streq(sr->this.updown, DEFAULT_UPDOWN))
+	return FALSE;
+
+    if (defaults_file < 0)
+    {
+	struct stat sb;
+
+	defaults_file = stat("/etc/sysconfig/pluto_updown", &sb) == 0
+	    || stat("/etc/default/pluto_updown", &sb) == 0;
+	if (defaults_file)
+	    openswan_log("a pluto_updown defaults file exists"
+			 ", so --updown-builtin always runs the script");
+    }
+    if (defaults_file)
+	return FALSE;
+
+    /* the script does nothing for the IPv6 verbs */
+    if (strstr(verb_suffix, "-v6") != NULL)
+	return FALSE;
+    if (c->end_addr_family != AF_INET || c->tunnel_addr_family != AF_INET)
+	return FALSE;
+
+    srcip = addrbytesptr(&sr->this.host_srcip, NULL) != 0
+	&& !isanyaddr(&sr->this.host_srcip);
+
+#ifdef XAUTH
+    /* addsource/delsource are different for these */
+    if (srcip && c->remotepeertype == CISCO)
+	return FALSE;
+#endif
+
+    if (!streq(verb, "prepare") && !streq(verb, "up") && !streq(verb, "down")
+	&& !streq(verb, "route") && !streq(verb, "unroute"))
+	return FALSE;
+
+    /* anything still queued for this peer goes first */
+    updown_flush(sr);
+
+    /* prepare, up and down do nothing unless you have your own script.
+     * Without a source IP the script only routes with --route yes.
+     */
+    *success = TRUE;
+    if (srcip && (streq(verb, "route") || streq(verb, "unroute")))
+	*success = netkey_builtin_route(c, sr, streq(verb, "route"));
+
+    DBG(DBG_CONTROL, DBG_log("builtin %s%s: %s"
+			     , verb, verb_suffix, *success ? "done" : "failed"));
+    updown_note_builtin();
+    return TRUE;
+}
+
 static bool
 netkey_do_command(struct connection *c, const struct spd_route *sr
                   , const char *verb, const char *verb_suffix
@@ -2444,6 +3322,14 @@ netkey_do_command(struct connection *c, const struct spd_route *sr
     char cmd[2048];     /* arbitrary limit on shell command length */
     char common_shell_out_str[2048];
 
+    if (updown_builtin)
+    {
+	bool success;
+
+	if (netkey_builtin_updown(c, sr, verb, verb_suffix, &success))
+	    return success;
+    }
+
     if(fmt_common_shell_out(common_shell_out_str, sizeof(common_shell_out_str), c, sr, st)==-1) {
 	loglog(RC_LOG_SERIOUS, "%s%s command too long!", verb, verb_suffix);
 	return FALSE;
@@ -2462,7 +3348,7 @@ netkey_do_command(struct connection *c, const struct spd_route *sr
 	return FALSE;
     }
 
-    return invoke_command(verb, verb_suffix, cmd);
+    return updown_invoke(sr, verb, verb_suffix, st, cmd);
 }
 
 const struct kernel_ops netkey_kernel_ops = {
@@ -2497,6 +3383,10 @@ const struct kernel_ops netkey_kernel_ops = {
     remove_orphaned_holds: pfkey_remove_orphaned_holds,
     overlap_supported: FALSE,
     sha2_truncbug_support: TRUE,
+    batch_begin: netlink_batch_begin,
+    batch_end: netlink_batch_end,
+    show_status: netlink_show_status,
+    free: netlink_free,
 };
 #endif /* linux && NETKEY_SUPPORT */
 
@@ -53,10 +53,19 @@
 #include "kernel.h"	/* needs connections.h */
 #include "whack.h"	/* needs connections.h */
 #include "timer.h"
+#include "packet.h"
+#include "demux.h"	/* needs packet.h */
 #include "kernel_alg.h"
 #include "ike_alg.h"
 #include "plutoalg.h"
+#include "pluto_crypt.h"
+#include "updown.h"
+#include "ikev2.h"
+#include "ratelimit.h"
 #include "pluto/virtual.h" /* for show_virtual_private */
+#ifdef NAT_TRAVERSAL
+#include "nat_traversal.h"
+#endif
 
 #ifndef NO_DB_OPS_STATS
 #define NO_DB_CONTEXT
@@ -830,6 +839,15 @@ show_status(void)
 {
     show_kernel_interface();
     show_ifaces_status();
+    show_comm_status();
+    show_ratelimit_status();
+    show_send_queue_status();
+    show_ke_pool_status();
+    show_updown_status();
+#ifdef NAT_TRAVERSAL
+    show_nat_traversal_ka_status();
+#endif
+    show_ikev2_dcookie_status();
     show_secrets_status();
     show_myid_status();
     show_debug_status();
@@ -850,6 +868,7 @@ show_status(void)
 #endif
     show_connections_status(whack_log);
     whack_log(RC_COMMENT, BLANK_FORMAT);	/* spacer */
+    show_state_table_status();
     show_states_status();
 #ifdef KLIPS
     whack_log(RC_COMMENT, BLANK_FORMAT);	/* spacer */
@@ -62,10 +62,39 @@
 
 static struct msg_digest *md_pool = NULL;
 
+/* receive slabs: comm_handle reads each datagram into one of these,
+ * and read_packet copies it out at its own size.
+ */
+static u_int8_t *md_slab_pool[MD_SLAB_POOL_MAX];
+static unsigned int md_slab_pooled = 0;
+
+u_int8_t *
+alloc_md_slab(void)
+{
+    if (md_slab_pooled > 0)
+	return md_slab_pool[--md_slab_pooled];
+
+    return alloc_bytes(MD_SLAB_SIZE, "msg_digest packet slab");
+}
+
+void
+release_md_slab(u_int8_t *slab)
+{
+    if (slab == NULL)
+	return;
+    if (md_slab_pooled < MD_SLAB_POOL_MAX)
+	md_slab_pool[md_slab_pooled++] = slab;
+    else
+	pfree(slab);
+}
+
 /* free_md_pool is only used to avoid leak reports */
 void
 free_md_pool(void)
 {
+    while (md_slab_pooled > 0)
+	pfree(md_slab_pool[--md_slab_pooled]);
+
 
     for (;;)
     {
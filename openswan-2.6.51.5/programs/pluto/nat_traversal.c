@@ -720,13 +720,128 @@ int nat_traversal_espinudp_socket (int sk, const char *fam, u_int32_t type)
 	return -1;
 }
 
-void nat_traversal_new_ka_event (void)
+/*
+ * NAT-T keepalives.
+ *
+ * The states that need keepalives are kept, by serial number, on a
+ * wheel of NAT_KA_SLOTS slots.  EVENT_NAT_T_KEEPALIVE fires once per
+ * slot, NAT_KA_SLOTS times per keep alive period, and only sends the
+ * keepalives of that slot.  Each state goes into the emptiest slot, so
+ * the sending is spread evenly over the period.  The keepalives go out
+ * through send_packet(), so one tick's worth leaves in a sendmmsg() per
+ * interface when the main loop flushes the send queues.
+ *
+ * A state stays on the wheel until it is deleted, or until a newer SA
+ * of its connection needs keepalives instead.  Both are noticed when
+ * the state's slot comes round.
+ */
+#define NAT_KA_SLOTS	32
+
+struct nat_ka_slot {
+	so_serial_t  *serials;
+	unsigned int  count;
+	unsigned int  size;
+};
+
+static struct nat_ka_slot nat_ka_wheel[NAT_KA_SLOTS];
+static unsigned int nat_ka_next;	/* slot the next tick sends */
+static unsigned int nat_ka_tracked;	/* states on the wheel */
+static unsigned long nat_ka_sent;
+static unsigned long nat_ka_ticks;
+
+/* established, NAT-T detected, and we are NATed (or forced to) */
+static bool nat_traversal_ka_wanted (const struct state *st)
+{
+	u_int32_t nt = st->hidden_variables.st_nat_traversal;
+
+	return (IS_ISAKMP_SA_ESTABLISHED(st->st_state)
+		|| st->st_state == STATE_QUICK_R2
+		|| st->st_state == STATE_QUICK_I2)
+	    && (nt & NAT_T_WITH_KA)
+	    && (nt & NAT_T_DETECTED)
+	    && ((nt & LELEM(NAT_TRAVERSAL_NAT_BHND_ME)) || _force_ka);
+}
+
+/**
+ * FALSE once a newer SA of the same kind on the connection takes over
+ * the keepalives: we only send them for the newest.
+ */
+static bool nat_traversal_ka_newest (const struct state *st)
+{
+	const struct connection *c = st->st_connection;
+	bool isakmp = IS_ISAKMP_SA_ESTABLISHED(st->st_state);
+	so_serial_t newest;
+	struct state *st_newest;
+
+	if (c == NULL)
+		return FALSE;
+
+	newest = isakmp ? c->newest_isakmp_sa : c->newest_ipsec_sa;
+	if (newest == st->st_serialno)
+		return TRUE;
+
+	/*
+	 * newest_isakmp_sa and newest_ipsec_sa only ever name an SA of
+	 * their own kind, so there is no need to check the kind of
+	 * st_newest again (gcc 12 gets that comparison wrong at -O1 and
+	 * up, and keeps the old SA on the wheel).
+	 */
+	st_newest = state_with_serialno(newest);
+	return st_newest == NULL || !nat_traversal_ka_wanted(st_newest);
+}
+
+static void nat_traversal_ka_schedule (void)
 {
-	if (_ka_evt) return;  /* Event already schedule */
-	event_schedule(EVENT_NAT_T_KEEPALIVE, _kap, NULL);
+	if (_ka_evt || nat_ka_tracked == 0)
+		return;
+	event_schedule_ms(EVENT_NAT_T_KEEPALIVE
+			  , _kap * 1000UL / NAT_KA_SLOTS, NULL);
 	_ka_evt = 1;
 }
 
+void nat_traversal_ka_track (struct state *st)
+{
+	struct nat_ka_slot *slot;
+	unsigned int best, i;
+
+	if (!nat_traversal_enabled || st->st_nat_ka
+	    || !nat_traversal_ka_wanted(st))
+		return;
+
+	/* the emptiest slot, the soonest one if there is a tie */
+	best = nat_ka_next;
+	for (i = 1; i < NAT_KA_SLOTS; i++) {
+		unsigned int s = (nat_ka_next + i) % NAT_KA_SLOTS;
+
+		if (nat_ka_wheel[s].count < nat_ka_wheel[best].count)
+			best = s;
+	}
+
+	slot = &nat_ka_wheel[best];
+	if (slot->count == slot->size) {
+		unsigned int size = slot->size ? slot->size * 2 : 8;
+		so_serial_t *serials = alloc_bytes(size * sizeof(so_serial_t)
+						   , "NAT-T keepalive slot");
+
+		if (slot->serials != NULL) {
+			memcpy(serials, slot->serials
+			       , slot->count * sizeof(so_serial_t));
+			pfree(slot->serials);
+		}
+		slot->serials = serials;
+		slot->size = size;
+	}
+	slot->serials[slot->count++] = st->st_serialno;
+	st->st_nat_ka = TRUE;
+	nat_ka_tracked++;
+
+	DBG(DBG_NATT,
+	    DBG_log("NAT-T keepalives for #%lu in slot %u of %u (%u states)"
+		    , st->st_serialno, best, NAT_KA_SLOTS, nat_ka_tracked));
+
+	nat_traversal_ka_schedule();
+}
+
 static void nat_traversal_send_ka (struct state *st)
 {
 	static unsigned char ka_payload = 0xff;
@@ -742,7 +857,7 @@ static void nat_traversal_send_ka (struct state *st)
 	/** save state chunk */
 	setchunk(sav, st->st_tpacket.ptr, st->st_tpacket.len);
 
-	/** send keep alive */
+	/** send keep alive; send_packet() queues a copy */
 	setchunk(st->st_tpacket, &ka_payload, 1);
 	send_packet(st, "NAT-T Keep Alive", FALSE);
 
@@ -751,95 +866,75 @@ static void nat_traversal_send_ka (struct state *st)
 }
 
 /**
- * Find ISAKMP States with NAT-T and send keep-alive
+ * Send the keep-alives of the next slot, dropping the states that no
+ * longer need them
  */
-static void nat_traversal_ka_event_state (struct state *st, void *data)
+void nat_traversal_ka_event (void)
 {
-	unsigned int *_kap_st = (unsigned int *)data;
-	const struct connection *c = st->st_connection;
-	if (!c) return;
-	if ( IS_ISAKMP_SA_ESTABLISHED(st->st_state)
-	     &&	(st->hidden_variables.st_nat_traversal & NAT_T_DETECTED)
-	     &&	((st->hidden_variables.st_nat_traversal & LELEM(NAT_TRAVERSAL_NAT_BHND_ME))
-		 || (_force_ka)))
-	{
-	    /**
-	     * - ISAKMP established
-	     * - NAT-Traversal detected
-	     * - NAT-KeepAlive needed (we are NATed)
-	     */
-	    if (c->newest_isakmp_sa != st->st_serialno) {
-		/**
-		 * if newest is also valid, ignore this one, we will only use
-		 * newest.
-		 */
-		struct state *st_newest;
-		st_newest = state_with_serialno(c->newest_isakmp_sa);
-		if ((st_newest)
-		    && IS_ISAKMP_SA_ESTABLISHED(st->st_state)
-		    && (st_newest->hidden_variables.st_nat_traversal & NAT_T_DETECTED)
-		    && ((st_newest->hidden_variables.st_nat_traversal & LELEM(NAT_TRAVERSAL_NAT_BHND_ME))
-			|| (_force_ka)))
-		{
-		    return;
+	struct nat_ka_slot *slot = &nat_ka_wheel[nat_ka_next];
+	unsigned int i = 0, sent = 0;
+
+	_ka_evt = 0;  /* ready to be reschedule */
+	nat_ka_next = (nat_ka_next + 1) % NAT_KA_SLOTS;
+	nat_ka_ticks++;
+
+	while (i < slot->count) {
+		struct state *st = state_with_serialno(slot->serials[i]);
+
+		if (st == NULL || !nat_traversal_ka_wanted(st)
+		    || !nat_traversal_ka_newest(st)) {
+			if (st != NULL)
+				st->st_nat_ka = FALSE;
+			slot->serials[i] = slot->serials[--slot->count];
+			nat_ka_tracked--;
+			continue;
 		}
-	    }
-	    set_cur_state(st);
-	    nat_traversal_send_ka(st);
-	    reset_cur_state();
-	    (*_kap_st)++;
+
+		set_cur_state(st);
+		nat_traversal_send_ka(st);
+		reset_cur_state();
+		sent++;
+		i++;
 	}
+	nat_ka_sent += sent;
 
-	if ( ((st->st_state == STATE_QUICK_R2)
-	      || (st->st_state == STATE_QUICK_I2))
-	     &&	(st->hidden_variables.st_nat_traversal & NAT_T_DETECTED)
-	     &&	((st->hidden_variables.st_nat_traversal & LELEM(NAT_TRAVERSAL_NAT_BHND_ME))
-		 || (_force_ka)))
-	{
-	    /**
-	     * - IPSEC SA established
-	     * - NAT-Traversal detected
-	     * - NAT-KeepAlive needed (we are NATed)
-	     */
-	    if (c->newest_ipsec_sa != st->st_serialno) {
-		/**
-		 * if newest is also valid, ignore this one, we will only use
-		 * newest.
-		 */
-		struct state *st_newest;
-		st_newest = state_with_serialno(c->newest_ipsec_sa);
-		if ((st_newest)
-		    && ((st_newest->st_state==STATE_QUICK_R2)
-			|| (st_newest->st_state == STATE_QUICK_I2))
-		    && (st_newest->hidden_variables.st_nat_traversal & NAT_T_DETECTED)
-		    && ((st_newest->hidden_variables.st_nat_traversal & LELEM(NAT_TRAVERSAL_NAT_BHND_ME))
-			|| (_force_ka)))
-		{
-		    return;
-		}
-	    }
-	    set_cur_state(st);
-	    nat_traversal_send_ka(st);
-	    reset_cur_state();
-	    (*_kap_st)++;
+	if (slot->count == 0 && slot->serials != NULL) {
+		pfree(slot->serials);
+		slot->serials = NULL;
+		slot->size = 0;
 	}
 
+	DBG(DBG_NATT,
+	    if (sent != 0)
+		DBG_log("ka_event: sent %u NAT-KA, %u states need them"
+			, sent, nat_ka_tracked));
+
+	/**
+	 * If there are still states who needs Keep-Alive, schedule new event
+	 */
+	nat_traversal_ka_schedule();
 }
 
-void nat_traversal_ka_event (void)
+void free_nat_traversal_ka (void)
 {
-	unsigned int _kap_st = 0;
+	unsigned int i;
 
-	_ka_evt = 0;  /* ready to be reschedule */
-
-	for_each_state((void *)nat_traversal_ka_event_state, &_kap_st);
-
-	if (_kap_st) {
-	    /**
-	     * If there are still states who needs Keep-Alive, schedule new event
-	     */
-	    nat_traversal_new_ka_event();
+	for (i = 0; i < NAT_KA_SLOTS; i++) {
+		pfreeany(nat_ka_wheel[i].serials);
+		nat_ka_wheel[i].serials = NULL;
+		nat_ka_wheel[i].count = nat_ka_wheel[i].size = 0;
 	}
+	nat_ka_tracked = 0;
+}
+
+void show_nat_traversal_ka_status (void)
+{
+	if (!nat_traversal_enabled)
+		return;
+	whack_log(RC_COMMENT, "stats nat-t keepalive: states=%u slots=%u"
+		  " tick=%lums sent=%lu ticks=%lu"
+		  , nat_ka_tracked, NAT_KA_SLOTS
+		  , _kap * 1000UL / NAT_KA_SLOTS, nat_ka_sent, nat_ka_ticks);
 }
 
 struct _new_mapp_nfo {
@@ -881,7 +976,7 @@ static void nat_traversal_find_new_mapp_state (struct state *st, void *data)
     }
 
     /* update it */
-    st->st_remoteaddr = nfo->addr;
+    set_state_remoteaddr(st, &nfo->addr);
     st->st_remoteport = nfo->port;
     st->hidden_variables.st_natd = nfo->addr;
 
@@ -69,20 +69,22 @@
 #include "oswcrypto.h"
 #include "osw_select.h"
 
+#ifndef HAVE_LIBNSS
+# include <poll.h>
+#endif
+
+/*
+ * With NSS, the helpers are threads in pluto itself: see
+ * pluto_crypt_pool.c.  Without it they are child processes,
+ * and requests and answers go through a socketpair.
+ */
+#ifndef HAVE_LIBNSS
 TAILQ_HEAD(req_queue, pluto_crypto_req_cont);
 
 struct pluto_crypto_worker {
     int   pcw_helpernum;
-#ifdef HAVE_LIBNSS
-    /* pthread_t pcw_pid; */
-   long int pcw_pid;
-#else
     pid_t pcw_pid;
-#endif
     int   pcw_pipe;
-#ifdef HAVE_LIBNSS
-    int   pcw_helper_pipe;
-#endif
     int   pcw_work;         /* how many items outstanding */
     int   pcw_maxbasicwork; /* how many basic things can be queued */
     int   pcw_maxcritwork;  /* how many critical things can be queued */
@@ -99,10 +101,6 @@ static void cleanup_crypto_helper(struct pluto_crypto_worker *w, int status);
 static void handle_helper_comm(struct pluto_crypto_worker *w);
 extern void free_preshared_secrets(void);
 
-#ifdef HAVE_LIBNSS
-static void *pluto_helper_thread(void *w);
-#endif
-
 /* may be NULL if we are to do all the work ourselves */
 struct pluto_crypto_worker *pc_workers = NULL;
 int pc_workers_cnt = 0;
@@ -111,6 +109,7 @@ pcr_req_id pcw_id;
 
 /* local in child */
 int pc_helper_num=-1;
+#endif /* !HAVE_LIBNSS */
 
 #ifdef HAVE_LIBNSS
 void pluto_do_crypto_op(struct pluto_crypto_req *r, int helpernum)
@@ -183,7 +182,6 @@ static void catchusr1(int signo UNUSED)
 {
     return;
 }
-#endif
 
 #ifdef DEBUG
 static void
@@ -208,79 +206,23 @@ helper_passert_fail(const char *pred_str
 }
 #endif
 
-#ifdef HAVE_LIBNSS
-void pluto_crypto_helper(int fd, int helpernum)
+/*
+ * while no request is waiting, top up the DH key pair pool.
+ */
+static void helper_idle(int fd)
 {
-    FILE *in  = fdopen(fd, "rb");
-    FILE *out = fdopen(fd, "wb");
-    long reqbuf[PCR_REQ_SIZE/sizeof(long)];
-    struct pluto_crypto_req *r;
-
-    /* OS X does not have pthread_setschedprio */
-#if !(defined(macintosh) || (defined(__MACH__) && defined(__APPLE__)))
-    int status=pthread_setschedprio(pthread_self(), 10);
-    DBG(DBG_CONTROL, DBG_log("status value returned by setting the priority of this thread (id=%d) %d",helpernum,status));
-#endif
+    struct pollfd pfd;
 
-    DBG(DBG_CONTROL, DBG_log("helper %d waiting on fd: %d"
-			     , helpernum, fileno(in)));
-
-    memset(reqbuf, 0, sizeof(reqbuf));
-    while(fread((char*)reqbuf, sizeof(r->pcr_len), 1, in) == 1) {
-	int restlen;
-	int actnum;
-	unsigned char *reqrest = ((unsigned char *)reqbuf)+sizeof(r->pcr_len);
-
-	r = (struct pluto_crypto_req *)reqbuf;
-	restlen = r->pcr_len-sizeof(r->pcr_len);
-
-	passert(restlen < (signed)PCR_REQ_SIZE);
-	passert(restlen > 0);
-
-	actnum = fread(reqrest, 1, restlen, in);
-	/* okay, got a basic size, read the rest of it */
-
-	DBG(DBG_CONTROL, DBG_log("helper %d read %d+4/%d bytes fd: %d"
-				 , helpernum, actnum, (int)r->pcr_len, fileno(in)));
-
-	if(actnum != restlen) {
-	    /* faulty read. die, parent will restart us */
-
-	    loglog(RC_LOG_SERIOUS, "cryptographic helper(%d) fread(%d)=%d failed: %s\n",
-		   (int)pthread_self(), restlen, actnum, strerror(errno));
-
-	   loglog(RC_LOG_SERIOUS, "pluto_crypto_helper: helper (%d) is error exiting\n",helpernum);
-	    goto error;
-	}
-
-	pluto_do_crypto_op(r,helpernum);
-
-	actnum = fwrite((unsigned char *)r, r->pcr_len, 1, out);
-	fflush(out);
-
-	if(actnum != 1) {
-	    loglog(RC_LOG_SERIOUS, "failed to write answer: %d", actnum);
-	    goto error;
+    do {
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if(poll(&pfd, 1, 0) != 0) {
+	    break;
 	}
-	memset(reqbuf, 0, sizeof(reqbuf));
-    }
-
-    if(!feof(in)) {
-	loglog(RC_LOG_SERIOUS, "helper %d got error: %s", helpernum, strerror(ferror(in)));
-        goto error;
-    }
-
-    /* probably normal EOF */
-    loglog(RC_LOG_SERIOUS, "pluto_crypto_helper: helper (%d) is exiting (eof, normal)\n",helpernum);
-
-error:
-    fclose(in);
-    fclose(out);
-    /*pthread_exit();*/
+    } while(ke_pool_refill());
 }
 
-#else /* non-LIBNSS */
-
 void pluto_crypto_helper(int fd, int helpernum)
 {
     FILE *in  = fdopen(fd, "rb");
@@ -295,10 +237,14 @@ void pluto_crypto_helper(int fd, int helpernum)
     /* make us lower priority that average */
     setpriority(PRIO_PROCESS, 0, 10);
 
+    /* helper_idle() needs to know whether a request is waiting */
+    setvbuf(in, NULL, _IONBF, 0);
+
     DBG(DBG_CONTROL, DBG_log("helper %d waiting on fd: %d"
 			     , helpernum, fileno(in)));
 
     memset(reqbuf, 0, sizeof(reqbuf));
+    helper_idle(fd);
     while(fread((char*)reqbuf, sizeof(r->pcr_len), 1, in) == 1) {
 	int restlen;
 	int actnum;
@@ -343,6 +289,7 @@ void pluto_crypto_helper(int fd, int helpernum)
 	    exit(2);
 	}
 	memset(reqbuf, 0, sizeof(reqbuf));
+	helper_idle(fd);
     }
 
     if(!feof(in)) {
@@ -355,7 +302,6 @@ void pluto_crypto_helper(int fd, int helpernum)
     loglog(RC_LOG_SERIOUS, "pluto_crypto_helper: helper [nonnss] (%d) is exiting normally\n",helpernum);
     exit(0);
 }
-#endif
 
 
 /* send the request, make sure it all goes down. */
@@ -415,11 +361,8 @@ err_t send_crypto_helper_request(struct pluto_crypto_req *r
 	reset_cur_state();
 
 /*nonceֵ*/
-#ifdef HAVE_LIBNSS
-	pluto_do_crypto_op(r,pc_helper_num);
-#else
 	pluto_do_crypto_op(r);
-#endif
+	ke_pool_note(r);
 	/* call the continuation */
 	(*cn->pcrc_func)(cn, r, NULL);//1 /*ִкmain_inR1_outI2_continue*/
 
@@ -752,11 +695,7 @@ void handle_helper_comm(struct pluto_crypto_worker *w)
 	       , (unsigned long)w->pcw_pid, (unsigned long)r->pcr_len
                , (unsigned long)sizeof(reqbuf));
     killit:
-#ifdef HAVE_LIBNSS
-	pthread_cancel((pthread_t)w->pcw_pid);
-#else
 	kill(w->pcw_pid, SIGTERM);
-#endif
 	w->pcw_dead = TRUE;
 	return;
     }
@@ -823,6 +762,7 @@ void handle_helper_comm(struct pluto_crypto_worker *w)
 
     /* call the continuation */
     cn->pcrc_pcr = r;
+    ke_pool_note(r);
     reset_cur_state();
     (*cn->pcrc_func)(cn, r, NULL);
 
@@ -837,9 +777,7 @@ void handle_helper_comm(struct pluto_crypto_worker *w)
 static void init_crypto_helper(struct pluto_crypto_worker *w, int n)
 {
     int fds[2];
-#ifndef HAVE_LIBNSS
     int errno2;
-#endif
 
     /* reset this */
     w->pcw_pid = -1;
@@ -852,9 +790,6 @@ static void init_crypto_helper(struct pluto_crypto_worker *w, int n)
 
     w->pcw_helpernum = n;
     w->pcw_pipe = fds[0];
-#ifdef HAVE_LIBNSS
-    w->pcw_helper_pipe = fds[1];
-#endif
     w->pcw_maxbasicwork  = 2;
     w->pcw_maxcritwork   = 4;
     w->pcw_work     = 0;
@@ -878,32 +813,14 @@ static void init_crypto_helper(struct pluto_crypto_worker *w, int n)
     }
 
     /* flush various descriptors so that they don't get written twice */
-#ifndef HAVE_LIBNSS
     fflush(stdout);
     fflush(stderr);
     close_log();
     close_peerlog();
-#endif
 
     /* set local so that child inheirits it */
     pc_helper_num = n;
 
-#ifdef HAVE_LIBNSS
-    int thread_status;
-
-    thread_status = pthread_create((pthread_t*)&w->pcw_pid, NULL, pluto_helper_thread, (void*)w);
-    if(thread_status!=0) {
-	loglog(RC_LOG_SERIOUS, "failed to start child, error = %d" , thread_status);
-	w->pcw_pid= -1;
-	close(fds[1]);
-	close(fds[0]);
-	w->pcw_dead   = TRUE;
-	return;
-    }
-    else{
-	openswan_log("started helper (thread) pid=%ld (fd:%d)", w->pcw_pid,  w->pcw_pipe);
-    }
-#else
     w->pcw_pid = fork();
     errno2 = errno;
     if(w->pcw_pid == 0) {
@@ -977,18 +894,7 @@ static void init_crypto_helper(struct pluto_crypto_worker *w, int n)
 
     /* close client side of socket pair in parent */
     close(fds[1]);
-#endif
-}
-
-#ifdef HAVE_LIBNSS
-void *
-pluto_helper_thread(void *w) {
-    struct pluto_crypto_worker *helper;
-    helper=(struct pluto_crypto_worker *)w;
-    pluto_crypto_helper(helper->pcw_helper_pipe, helper->pcw_helpernum);
-    return NULL;
 }
-#endif
 
 /*
  * clean up after a crypto helper
@@ -1106,6 +1012,7 @@ int pluto_crypto_helper_ready(osw_fd_set *readfds)
 
     return ndes;
 }
+#endif /* !HAVE_LIBNSS */
 
 /*
  * Local Variables:
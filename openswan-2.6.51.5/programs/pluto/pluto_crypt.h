@@ -48,6 +48,7 @@ struct pcr_kenonce {
 
   /* inputs */
   u_int16_t oakley_group;
+  bool      single_use;  /* never share the key pair (IKEv2) */
 
   /* outputs */
   wire_chunk_t secret;
@@ -56,6 +57,7 @@ struct pcr_kenonce {
 #ifdef HAVE_LIBNSS
   wire_chunk_t pubk;
 #endif
+  bool      pooled;      /* key pair came from the DH pool */
 };
 
 #define DHCALC_SIZE 2560
@@ -78,9 +80,8 @@ struct pcr_skeyid_q {
   wire_chunk_t icookie;
   wire_chunk_t rcookie;
   wire_chunk_t secret;
-#ifdef HAVE_LIBNSS
-  /* u_int16_t encrypt_algo; */
   const struct encrypt_desc *encrypter;
+#ifdef HAVE_LIBNSS
   wire_chunk_t   pubk;
 #endif
 };
@@ -180,8 +181,8 @@ extern int  pluto_crypto_helper_ready(osw_fd_set *readfds);
 extern void pluto_do_crypto_op(struct pluto_crypto_req *r, int helpernum);
 #else
 extern void pluto_do_crypto_op(struct pluto_crypto_req *r);
-#endif
 extern void pluto_crypto_helper(int fd, int helpernum);
+#endif
 extern void pluto_crypto_allocchunk(wire_chunk_t *space
 				    , wire_chunk_t *new
 				    , size_t howbig);
@@ -196,12 +197,22 @@ extern stf_status build_ke(struct pluto_crypto_req_cont *cn
 			   , const struct oakley_group_desc *group
 			   , enum crypto_importance importance);
 extern void calc_ke(struct pluto_crypto_req *r);
+extern void compute_ke(struct pcr_kenonce *kn);
 
 extern stf_status build_nonce(struct pluto_crypto_req_cont *cn
 			      , struct state *st
 			      , enum crypto_importance importance);
 extern void calc_nonce(struct pluto_crypto_req *r);
 
+/* DH key pair pool, in crypt_ke.c */
+#define KE_POOL_MAX 16
+extern int ke_pool_size;
+extern int ke_pool_reuse;
+extern bool ke_pool_take(struct pcr_kenonce *kn);
+extern bool ke_pool_refill(void);
+extern void ke_pool_note(struct pluto_crypto_req *r);
+extern void show_ke_pool_status(void);
+
 extern void compute_dh_shared(struct state *st, const chunk_t g
 			      , const struct oakley_group_desc *group);
 
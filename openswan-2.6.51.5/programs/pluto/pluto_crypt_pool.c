@@ -0,0 +1,637 @@
+/*
+ * Cryptographic helper threads.
+ * Copyright (C) 2004-2007 Michael C. Richardson <mcr@xelerance.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * With NSS, the helpers are threads inside pluto.  A request is copied
+ * once into a job, and from then on only the pointer to it moves: onto
+ * one of the per-importance request rings, through a helper, onto the
+ * completion ring, and back to the main loop, which is woken through a
+ * single eventfd.  Any idle helper takes the most important queued job,
+ * so a helper stuck on a slow modp8192 operation holds up nobody else.
+ *
+ * The rings are bounded lock-free MPMC queues (one sequence number per
+ * cell).  Only the main thread allocates and frees jobs and
+ * continuations, as the leak detective is not thread safe.
+ */
+
+#ifdef HAVE_LIBNSS
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef linux
+# include <sys/eventfd.h>
+#endif
+
+#include <openswan.h>
+#include <openswan/ipsec_policy.h>
+
+#include "sysdep.h"
+#include "constants.h"
+#include "defs.h"
+#include "packet.h"
+#include "demux.h"
+#include "oswlog.h"
+#include "log.h"
+#include "state.h"
+#include "pluto_crypt.h"
+
+#include "oswcrypto.h"
+#include "osw_select.h"
+
+/* how many jobs each helper may have queued, as for the old pipes */
+#define CRYPTO_POOL_BASICWORK	2
+#define CRYPTO_POOL_CRITWORK	4
+
+/* request rings, most important first */
+enum crypto_class {
+    CRYPTO_CLASS_CRITICAL = 0,	/* pcim_local_crypto and up */
+    CRYPTO_CLASS_ONGOING,	/* pcim_ongoing_crypto */
+    CRYPTO_CLASS_BACKGROUND,	/* new peers, strangers */
+    CRYPTO_CLASS_ROOF
+};
+
+struct crypto_job {
+    struct pluto_crypto_req_cont *cj_cont;
+    bool                          cj_cancelled;	/* its state was deleted */
+    enum crypto_class             cj_class;
+    int                           cj_helper;	/* who did it */
+    struct pluto_crypto_req       cj_req;
+};
+
+struct crypto_ring_cell {
+    unsigned long      seq;
+    struct crypto_job *job;
+};
+
+struct crypto_ring {
+    unsigned long            mask;
+    struct crypto_ring_cell *cells;
+    /* keep the two ends on separate cache lines */
+    unsigned long            head __attribute__((aligned(64)));
+    unsigned long            tail __attribute__((aligned(64)));
+};
+
+TAILQ_HEAD(req_queue, pluto_crypto_req_cont);
+
+static struct crypto_ring crypto_requests[CRYPTO_CLASS_ROOF];
+static struct crypto_ring crypto_completions;
+static sem_t crypto_pending;		/* jobs on crypto_requests[] */
+static int crypto_wakeup_fd = -1;	/* read end, or the eventfd */
+static int crypto_wakeup_wfd = -1;	/* write end, or the eventfd */
+
+static pthread_t *crypto_threads = NULL;
+static int crypto_threads_cnt = 0;
+
+/* main thread only */
+static struct req_queue active;		/* continuations with a job out */
+static struct req_queue backlog;	/* demand crypto waiting for room */
+static int backlogqueue_len = 0;
+static int outstanding = 0;		/* jobs handed to the helpers */
+static pcr_req_id pcw_id;
+
+static void crypto_ring_init(struct crypto_ring *q, unsigned long room)
+{
+    unsigned long size = 2;
+    unsigned long i;
+
+    while (size < room)
+	size <<= 1;
+
+    q->mask = size - 1;
+    q->cells = alloc_bytes(sizeof(*q->cells) * size, "crypto ring");
+    for (i = 0; i < size; i++)
+	q->cells[i].seq = i;
+    q->head = 0;
+    q->tail = 0;
+}
+
+static bool crypto_ring_push(struct crypto_ring *q, struct crypto_job *job)
+{
+    struct crypto_ring_cell *cell;
+    unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+	long diff;
+
+	cell = &q->cells[pos & q->mask];
+	diff = (long)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (long)pos;
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, TRUE
+					    , __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		break;
+	} else if (diff < 0) {
+	    return FALSE;	/* full */
+	} else {
+	    pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	}
+    }
+
+    cell->job = job;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+static struct crypto_job *crypto_ring_pop(struct crypto_ring *q)
+{
+    struct crypto_ring_cell *cell;
+    struct crypto_job *job;
+    unsigned long pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    for (;;) {
+	long diff;
+
+	cell = &q->cells[pos & q->mask];
+	diff = (long)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (long)(pos + 1);
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, TRUE
+					    , __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		break;
+	} else if (diff < 0) {
+	    return NULL;	/* empty */
+	} else {
+	    pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+    }
+
+    job = cell->job;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return job;
+}
+
+static enum crypto_class crypto_class_of(enum crypto_importance pcim)
+{
+    if (pcim >= pcim_local_crypto)
+	return CRYPTO_CLASS_CRITICAL;
+    if (pcim == pcim_ongoing_crypto)
+	return CRYPTO_CLASS_ONGOING;
+    return CRYPTO_CLASS_BACKGROUND;
+}
+
+/* tell the main loop that there is something on crypto_completions */
+static void crypto_wakeup(int helpernum)
+{
+    u_int64_t one = 1;
+
+    if (write(crypto_wakeup_wfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+	loglog(RC_LOG_SERIOUS, "helper %d failed to wake pluto: %s"
+	       , helpernum, strerror(errno));
+    }
+}
+
+static void *pluto_crypto_thread(void *arg)
+{
+    int helpernum = (int)(long)arg;
+
+    /* make us lower priority than average; on Linux this is per thread */
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    DBG(DBG_CONTROL, DBG_log("helper %d started", helpernum));
+
+    for (;;) {
+	struct crypto_job *job = NULL;
+	int i;
+
+	/* nothing to do?  top up the DH key pair pool meanwhile */
+	while (sem_trywait(&crypto_pending) != 0) {
+	    if (!ke_pool_refill()) {
+		while (sem_wait(&crypto_pending) != 0)
+		    ;	/* EINTR */
+		break;
+	    }
+	}
+
+	/*
+	 * the semaphore was posted after the push, so there is a job
+	 * for us; another helper may have taken the one we looked at
+	 * first, but then it will have left us the one it was after.
+	 */
+	while (job == NULL) {
+	    for (i = 0; i < CRYPTO_CLASS_ROOF && job == NULL; i++)
+		job = crypto_ring_pop(&crypto_requests[i]);
+	}
+
+	job->cj_helper = helpernum;
+	pluto_do_crypto_op(&job->cj_req, helpernum);
+
+	/*
+	 * completions never outnumber the jobs admitted, for which the
+	 * ring is sized; but should it ever be full, wait for the main
+	 * loop to drain it rather than lose a finished job.
+	 */
+	while (!crypto_ring_push(&crypto_completions, job)) {
+	    crypto_wakeup(helpernum);
+	    usleep(1000);
+	}
+	crypto_wakeup(helpernum);
+    }
+    return NULL;
+}
+
+static void crypto_save_reply(struct pluto_crypto_req_cont *cn)
+{
+    cn->pcrc_reply_stream = reply_stream;
+    cn->pcrc_reply_buffer = NULL;
+    if (pbs_offset(&reply_stream)) {
+	cn->pcrc_reply_buffer = clone_bytes(reply_stream.start
+		, pbs_offset(&reply_stream), "saved reply buffer");
+    }
+}
+
+static void crypto_forget_reply(struct pluto_crypto_req_cont *cn)
+{
+    if (pbs_offset(&cn->pcrc_reply_stream))
+	pfree(cn->pcrc_reply_buffer);
+    cn->pcrc_reply_buffer = NULL;
+}
+
+/* queue a job for the helpers; called from the main thread only */
+static void crypto_submit(struct crypto_job *job)
+{
+    struct pluto_crypto_req_cont *cn = job->cj_cont;
+
+    DBG(DBG_CONTROL
+	, DBG_log("queueing %s op on seq: %u (class=%d, outstanding=%d)"
+		  , enum_show(&pluto_cryptoop_names, job->cj_req.pcr_type)
+		  , job->cj_req.pcr_id, job->cj_class, outstanding + 1));
+
+    cn->pcrc_pcr = &job->cj_req;
+    TAILQ_INSERT_TAIL(&active, cn, pcrc_list);
+    outstanding++;
+
+    /* the rings are sized for every job we admit */
+    passert(crypto_ring_push(&crypto_requests[job->cj_class], job));
+    sem_post(&crypto_pending);
+}
+
+static struct crypto_job *crypto_new_job(struct pluto_crypto_req *r
+					 , struct pluto_crypto_req_cont *cn)
+{
+    struct crypto_job *job = alloc_thing(struct crypto_job, "crypto job");
+
+    memcpy(&job->cj_req, r, sizeof(job->cj_req));
+    job->cj_cont = cn;
+    job->cj_cancelled = FALSE;
+    job->cj_class = crypto_class_of(r->pcr_pcim);
+    job->cj_helper = -1;
+    return job;
+}
+
+/*
+ * this function is called with a request to do some cryptographic operations
+ * along with a continuation structure, which will be used to deal with
+ * the response.
+ *
+ * This may fail if the helpers already have too much to do, in which
+ * case an error is returned.
+ */
+err_t send_crypto_helper_request(struct pluto_crypto_req *r
+				 , struct pluto_crypto_req_cont *cn
+				 , bool *toomuch)
+{
+    int room;
+
+    /* do it all ourselves? */
+    if(crypto_threads_cnt == 0) {
+	reset_cur_state();
+
+	pluto_do_crypto_op(r, -1);
+	ke_pool_note(r);
+	/* call the continuation */
+	(*cn->pcrc_func)(cn, r, NULL);
+
+	/* indicate that we did everything ourselves */
+	*toomuch = TRUE;
+
+	pfree(cn);
+	return NULL;
+    }
+
+    /* set up the id */
+    r->pcr_id = pcw_id++;
+    cn->pcrc_id = r->pcr_id;
+
+    room = crypto_threads_cnt * (r->pcr_pcim > pcim_ongoing_crypto
+				 ? CRYPTO_POOL_CRITWORK : CRYPTO_POOL_BASICWORK);
+
+    if(outstanding >= room && r->pcr_pcim >= pcim_demand_crypto) {
+	/* it is very important. Put it all on a queue for later */
+	cn->pcrc_pcr = &crypto_new_job(r, cn)->cj_req;
+	crypto_save_reply(cn);
+	TAILQ_INSERT_TAIL(&backlog, cn, pcrc_list);
+
+	backlogqueue_len++;
+	DBG(DBG_CONTROL
+	    , DBG_log("critical demand crypto operation queued on backlog as %d'th item, id: q#%u"
+		      , backlogqueue_len, r->pcr_id));
+	*toomuch = FALSE;
+	return NULL;
+    }
+
+    if(outstanding >= room) {
+	DBG(DBG_CONTROL
+	    , DBG_log("failed to find any available worker (import=%s)"
+		      , enum_name(&pluto_cryptoimportance_names,r->pcr_pcim)));
+
+	*toomuch = TRUE;
+	return "failed to find any available worker";
+    }
+
+    crypto_save_reply(cn);
+    crypto_submit(crypto_new_job(r, cn));
+
+    *toomuch = FALSE;
+    return NULL;
+}
+
+/*
+ * move backlog items to the helpers while there is room for them.
+ */
+static void crypto_send_backlog(void)
+{
+    while(backlogqueue_len > 0
+	  && outstanding < crypto_threads_cnt * CRYPTO_POOL_CRITWORK) {
+	struct pluto_crypto_req_cont *cn = backlog.tqh_first;
+	struct crypto_job *job;
+
+	passert(cn != NULL);
+	TAILQ_REMOVE(&backlog, cn, pcrc_list);
+	backlogqueue_len--;
+
+	DBG(DBG_CONTROL
+	    , DBG_log("removing backlog item id: q#%u from queue: %d left"
+		      , cn->pcrc_id, backlogqueue_len));
+
+	job = (struct crypto_job *)((char *)cn->pcrc_pcr
+				    - offsetof(struct crypto_job, cj_req));
+	crypto_submit(job);
+    }
+}
+
+/* with threads, there are no children of ours to reap */
+bool pluto_crypt_handle_dead_child(int pid UNUSED, int status UNUSED)
+{
+    return FALSE;
+}
+
+/*
+ * look for any states attached to continuations
+ * also check the backlog
+ */
+void delete_cryptographic_continuation(struct state *st)
+{
+    struct pluto_crypto_req_cont *cn, *next;
+
+    for(cn = backlog.tqh_first; cn != NULL; cn = next) {
+	struct crypto_job *job;
+
+	next = cn->pcrc_list.tqe_next;
+	if(cn->pcrc_serialno != st->st_serialno)
+	    continue;
+
+	TAILQ_REMOVE(&backlog, cn, pcrc_list);
+	backlogqueue_len--;
+	DBG(DBG_CONTROL
+	    , DBG_log("removing deleted backlog item id: q#%u from queue: %d left"
+		      , cn->pcrc_id, backlogqueue_len));
+
+	/* never submitted, so it is still ours to free */
+	job = (struct crypto_job *)((char *)cn->pcrc_pcr
+				    - offsetof(struct crypto_job, cj_req));
+	pfree(job);
+	cn->pcrc_pcr = NULL;
+	crypto_forget_reply(cn);
+	pfree(cn);
+    }
+
+    for(cn = active.tqh_first; cn != NULL; cn = next) {
+	struct crypto_job *job;
+
+	next = cn->pcrc_list.tqe_next;
+	if(cn->pcrc_serialno != st->st_serialno)
+	    continue;
+
+	/*
+	 * a helper may be working on it right now, so neither the job
+	 * nor the continuation that points into it can go yet: mark
+	 * it cancelled, and let the completion free both.
+	 */
+	TAILQ_REMOVE(&active, cn, pcrc_list);
+	job = (struct crypto_job *)((char *)cn->pcrc_pcr
+				    - offsetof(struct crypto_job, cj_req));
+	job->cj_cancelled = TRUE;
+	crypto_forget_reply(cn);
+	DBG(DBG_CONTROL
+	    , DBG_log("cancelled q#%u: its answer will be dropped", cn->pcrc_id));
+    }
+    DBG(DBG_CRYPT, DBG_log("no suspended cryptographic state for %lu\n"
+				   , st->st_serialno));
+}
+
+/*
+ * a helper has finished with a job: hand the answer to its continuation.
+ */
+static void handle_helper_answer(struct crypto_job *job)
+{
+    struct pluto_crypto_req_cont *cn = job->cj_cont;
+    struct pluto_crypto_req *r = &job->cj_req;
+
+    outstanding--;
+
+    if(job->cj_cancelled) {
+	DBG(DBG_CONTROL, DBG_log("helper %d answered q#%u for a deleted state"
+				 , job->cj_helper, r->pcr_id));
+	if(cn->pcrc_free) {
+	    /*
+	     * use special free function which can deal with other
+	     * saved structures.
+	     */
+	    (*cn->pcrc_free)(cn, r, "state removed");
+	} else {
+	    pfree(cn);
+	}
+	pfree(job);
+	return;
+    }
+
+    DBG(DBG_CRYPT|DBG_CONTROL, DBG_log("helper %d replies to id: q#%u"
+				       , job->cj_helper, r->pcr_id));
+
+    /* unlink it */
+    TAILQ_REMOVE(&active, cn, pcrc_list);
+
+    passert(cn->pcrc_func != NULL);
+
+    DBG(DBG_CRYPT, DBG_log("calling callback function %p"
+			   ,cn->pcrc_func));
+
+    reply_stream = cn->pcrc_reply_stream;
+    if (pbs_offset(&reply_stream)) {
+	memcpy(reply_stream.start, cn->pcrc_reply_buffer
+		, pbs_offset(&reply_stream));
+	pfree(cn->pcrc_reply_buffer);
+    }
+    cn->pcrc_reply_buffer = NULL;
+
+    /* call the continuation */
+    cn->pcrc_pcr = r;
+    ke_pool_note(r);
+    reset_cur_state();
+    (*cn->pcrc_func)(cn, r, NULL);
+
+    /* now free up the continuation and the job */
+    pfree(cn);
+    pfree(job);
+}
+
+static bool crypto_wakeup_init(void)
+{
+#ifdef linux
+    crypto_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(crypto_wakeup_fd == -1) {
+	loglog(RC_LOG_SERIOUS, "could not create eventfd for helpers: %s"
+	       , strerror(errno));
+	return FALSE;
+    }
+    crypto_wakeup_wfd = crypto_wakeup_fd;
+#else
+    int fds[2];
+
+    if(pipe(fds) != 0) {
+	loglog(RC_LOG_SERIOUS, "could not create pipe for helpers: %s"
+	       , strerror(errno));
+	return FALSE;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    crypto_wakeup_fd = fds[0];
+    crypto_wakeup_wfd = fds[1];
+#endif
+    return TRUE;
+}
+
+/*
+ * initialize the helpers.
+ *
+ * nhelpers == -1 means one per CPU but one (and at least one),
+ * nhelpers == 0 means we do all the work ourselves.
+ */
+void init_crypto_helpers(int nhelpers)
+{
+    sigset_t all, old;
+    int i;
+
+    pcw_id = 1;
+    outstanding = 0;
+    backlogqueue_len = 0;
+    TAILQ_INIT(&active);
+    TAILQ_INIT(&backlog);
+
+    if(nhelpers == -1) {
+	int ncpu_online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	nhelpers = ncpu_online > 2 ? ncpu_online - 1 : 1;
+    }
+
+    if(nhelpers <= 0 || !crypto_wakeup_init()) {
+	openswan_log("no helpers will be started, all cryptographic operations will be done inline");
+	return;
+    }
+
+    for(i = 0; i < CRYPTO_CLASS_ROOF; i++)
+	crypto_ring_init(&crypto_requests[i], nhelpers * CRYPTO_POOL_CRITWORK);
+    crypto_ring_init(&crypto_completions, nhelpers * CRYPTO_POOL_CRITWORK);
+    sem_init(&crypto_pending, 0, 0);
+
+    openswan_log("starting up %d cryptographic helpers", nhelpers);
+    crypto_threads = alloc_bytes(sizeof(*crypto_threads) * nhelpers
+				 , "pluto helpers");
+
+    /* signals are for the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for(i = 0; i < nhelpers; i++) {
+	int thread_status = pthread_create(&crypto_threads[crypto_threads_cnt]
+					   , NULL, pluto_crypto_thread
+					   , (void *)(long)i);
+
+	if(thread_status != 0) {
+	    loglog(RC_LOG_SERIOUS, "failed to start helper %d, error = %d"
+		   , i, thread_status);
+	    continue;
+	}
+	crypto_threads_cnt++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if(crypto_threads_cnt == 0) {
+	openswan_log("no helpers could be started, all cryptographic operations will be done inline");
+    }
+}
+
+void pluto_crypto_helper_sockets(osw_fd_set *readfds)
+{
+    if(crypto_threads_cnt > 0) {
+	OSW_FD_SET(crypto_wakeup_fd, readfds);
+    }
+}
+
+int pluto_crypto_helper_ready(osw_fd_set *readfds)
+{
+    struct crypto_job *job;
+    int ndes = 0;
+
+    if(crypto_threads_cnt == 0 || !OSW_FD_ISSET(crypto_wakeup_fd, readfds)) {
+	return 0;
+    }
+
+    /* reset the wakeup before draining, so no completion is missed */
+    {
+	char buf[64];
+
+	while(read(crypto_wakeup_fd, buf, sizeof(buf)) > 0
+	      && crypto_wakeup_fd != crypto_wakeup_wfd)
+	    ;
+    }
+
+    while((job = crypto_ring_pop(&crypto_completions)) != NULL) {
+	handle_helper_answer(job);
+	ndes++;
+    }
+
+    /* the answers made room: send off any backlog */
+    crypto_send_backlog();
+
+    return ndes;
+}
+
+#endif /* HAVE_LIBNSS */
+
+/*
+ * Local Variables:
+ * c-basic-offset:4
+ * c-style: pluto
+ * End:
+ */
@@ -81,6 +81,9 @@
 #include "crypto.h"	/* requires sha1.h and md5.h */
 #include "vendor.h"
 #include "pluto_crypt.h"
+#include "updown.h"
+#include "ikev2.h"
+#include "ratelimit.h"
 
 #include "pluto/virtual.h"
 
@@ -175,6 +178,19 @@ usage(const char *mess)
 	    "[--ipsecdir <ipsec-dir>] "
 	    "\n\t"
 	    "[--nhelpers <number>] "
+	    "[--dhpool <number>] "
+	    "[--dhpool-reuse <seconds>] "
+	    "\n\t"
+	    "[--updown-workers <number>] "
+	    "[--updown-builtin] "
+	    "[--sa-poll-interval <seconds>] "
+	    "\n\t"
+	    "[--cookie-threshold <number>] "
+	    "[--cookie-prefix-threshold <number>] "
+	    "\n\t"
+	    "[--ratelimit-new <packets/s>] "
+	    "[--ratelimit-existing <packets/s>] "
+	    "[--ratelimit-burst <seconds>] "
 	    " \n\t"
 	    "[--secctx_attr_value <number>]  "
 #ifdef HAVE_LABELED_IPSEC
@@ -343,6 +359,7 @@ init_secret(void)
      * schedule an event for refresh.
      */
     get_rnd_bytes(secret_of_the_day, sizeof(secret_of_the_day));
+    ikev2_rotate_dcookie_secret();
     event_schedule(EVENT_REINIT_SECRET, EVENT_REINIT_SECRET_DELAY, NULL);
 }
 
@@ -455,6 +472,16 @@ main(int argc, char **argv)
 #endif
 	    { "virtual_private", required_argument, NULL, '6' },
 	    { "nhelpers", required_argument, NULL, 'j' },
+	    { "dhpool", required_argument, NULL, '8' },
+	    { "dhpool-reuse", required_argument, NULL, '9' },
+	    { "updown-workers", required_argument, NULL, 'U' },
+	    { "updown-builtin", no_argument, NULL, 'B' },
+	    { "sa-poll-interval", required_argument, NULL, 'S' },
+	    { "cookie-threshold", required_argument, NULL, 'Q' },
+	    { "cookie-prefix-threshold", required_argument, NULL, 'Z' },
+	    { "ratelimit-new", required_argument, NULL, 'E' },
+	    { "ratelimit-existing", required_argument, NULL, 'X' },
+	    { "ratelimit-burst", required_argument, NULL, 'Y' },
 
             { "built-withlibnss", no_argument, NULL, '7' },
 
@@ -552,6 +579,99 @@ main(int argc, char **argv)
             }
 	    continue;
 
+	case '8':	/* --dhpool */
+	case '9':	/* --dhpool-reuse */
+            if (optarg == NULL || !isdigit(optarg[0]))
+                usage(c == '8' ? "missing size of DH key pair pool"
+		      : "missing DH key pair reuse lifetime");
+
+            {
+                char *endptr;
+                long value = strtol(optarg, &endptr, 0);
+
+                if (*endptr != '\0' || endptr == optarg || value < 0)
+                    usage("<number> must be a positive number or 0");
+		if (c == '8')
+		    ke_pool_size = value > KE_POOL_MAX ? KE_POOL_MAX : value;
+		else
+		    ke_pool_reuse = value;
+            }
+	    continue;
+
+	case 'S':	/* --sa-poll-interval */
+            if (optarg == NULL || !isdigit(optarg[0]))
+                usage("missing SA poll interval");
+
+            {
+                char *endptr;
+                long interval = strtol(optarg, &endptr, 0);
+
+                if (*endptr != '\0' || endptr == optarg || interval < 0)
+                    usage("<seconds> must be a positive number or 0");
+		sa_poll_interval = interval;
+            }
+	    continue;
+
+	case 'U':	/* --updown-workers */
+            if (optarg == NULL || !isdigit(optarg[0]))
+                usage("missing number of updown workers");
+
+            {
+                char *endptr;
+                long count = strtol(optarg, &endptr, 0);
+
+                if (*endptr != '\0' || endptr == optarg || count < 0)
+                    usage("<number> must be a positive number or 0");
+		updown_workers = count > UPDOWN_WORKERS_MAX
+		    ? UPDOWN_WORKERS_MAX : count;
+            }
+	    continue;
+
+	case 'B':	/* --updown-builtin */
+	    updown_builtin = TRUE;
+	    continue;
+
+	case 'Q':	/* --cookie-threshold */
+	case 'Z':	/* --cookie-prefix-threshold */
+            if (optarg == NULL || !isdigit(optarg[0]))
+                usage("missing number of half-open IKE SAs");
+
+            {
+                char *endptr;
+                long count = strtol(optarg, &endptr, 0);
+
+                if (*endptr != '\0' || endptr == optarg || count < 0)
+                    usage("<number> must be a positive number or 0");
+		if (c == 'Q')
+		    ikev2_cookie_threshold = count;
+		else
+		    ikev2_cookie_prefix_threshold = count;
+            }
+	    continue;
+
+	case 'E':	/* --ratelimit-new */
+	case 'X':	/* --ratelimit-existing */
+	case 'Y':	/* --ratelimit-burst */
+            if (optarg == NULL || !isdigit(optarg[0]))
+                usage("missing rate limit");
+
+            {
+                char *endptr;
+                long count = strtol(optarg, &endptr, 0);
+
+                if (*endptr != '\0' || endptr == optarg || count < 0)
+                    usage("<number> must be a positive number or 0");
+		if (c == 'E')
+		    ratelimit_new = count;
+		else if (c == 'X')
+		    ratelimit_existing = count;
+		else if (count == 0)
+		    usage("--ratelimit-burst must be at least 1");
+		else
+		    ratelimit_burst = count;
+            }
+	    continue;
+
 	case 'w':	/* --secctx_attr_value*/
 	    if (optarg == NULL || !isdigit(optarg[0]))
 		usage("missing (positive integer) value of secctx_attr_value (needed only if using labeled ipsec)");
@@ -1149,7 +1269,15 @@ exit_pluto(int status)
     reset_globals();	/* needed because we may be called in odd state */
     free_preshared_secrets();
     free_remembered_public_keys();
-    delete_every_connection();
+    {
+	/* send the kernel all the deletes at once */
+	unsigned long batch = kernel_batch_begin();
+
+	delete_every_connection();
+	(void) kernel_batch_end(batch, FALSE);
+    }
+    updown_flush(NULL);	/* the unroutes and downs just queued */
+    free_kernel();		/* free the kernel interface's caches */
 
     /* free memory allocated by initialization routines.  Please don't
        forget to do this. */
@@ -1176,6 +1304,10 @@ exit_pluto(int status)
     free_ifaces();          /* free interface list from memory */
     stop_adns();            /* Stop async DNS process (if running) */
     free_md_pool();         /* free the md pool */
+    free_ratelimit();       /* free the per-peer rate limits */
+#ifdef NAT_TRAVERSAL
+    free_nat_traversal_ka(); /* free the keepalive wheel */
+#endif
 #ifdef HAVE_LIBNSS
     NSS_Shutdown();
 #endif
@@ -0,0 +1,437 @@
+/* per-peer admission control for incoming IKE packets
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * comm_handle() asks ratelimit_admit() about every datagram it has read,
+ * before any state lookup, parsing beyond the ISAKMP header or crypto.
+ * Each peer (an IPv4 address, or an IPv6 /64) has two token buckets:
+ * one for packets that start an SA (a zero responder cookie: Main or
+ * Aggressive Mode message 1, an IKE_SA_INIT request) and one for
+ * everything else.  A bucket fills at its rate in packets/s and holds
+ * --ratelimit-burst seconds of packets; a packet that finds it empty is
+ * dropped.
+ *
+ * The rates come from the connections between the interface and the
+ * peer that set ratelimit-new= or ratelimit-existing=, or failing that
+ * from those to %any on the interface, or else from --ratelimit-new and
+ * --ratelimit-existing.  Where several connections set one, the highest
+ * wins.  They are looked up when a peer is first seen, and again after
+ * connection_ratelimit_generation has moved on.
+ *
+ * Peers idle for RATELIMIT_IDLE_MS are forgotten.  Once RATELIMIT_PEERS
+ * are known, new peers share one bucket at the global rates, so a flood
+ * from many sources cannot grow the table without bound.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <openswan.h>
+
+#include "sysdep.h"
+#include "constants.h"
+#include "oswlog.h"
+#include "defs.h"
+#include "id.h"
+#include "pluto/connections.h"	/* needs id.h */
+#include "pluto/server.h"
+#include "hostpair.h"
+#include "state.h"
+#include "packet.h"
+#include "log.h"
+#include "timer.h"
+#include "kernel.h"	/* for pluto_port500 */
+#include "whack.h"	/* for RC_COMMENT */
+#include "ratelimit.h"
+
+unsigned int ratelimit_new = 0;
+unsigned int ratelimit_existing = 0;
+unsigned int ratelimit_burst = RATELIMIT_BURST;
+
+#define RATELIMIT_BUCKETS	1024
+#define RATELIMIT_PEERS		16384	/* most peers with buckets of their own */
+#define RATELIMIT_IDLE_MS	60000
+#define RATELIMIT_SWEEP_MS	10000
+
+/* a token is a thousandth of a packet, so rates need no division */
+#define RATELIMIT_PACKET	1000ULL
+
+enum ratelimit_kind {
+    RL_NEW,		/* would start an SA */
+    RL_EXISTING,	/* for an SA we should have */
+    RL_ROOF
+};
+
+static const char *const ratelimit_kind_name[RL_ROOF] = { "new", "existing" };
+
+struct ratelimit_peer {
+    struct ratelimit_peer *next;
+    u_char        key[COOKIE_SIZE];	/* the address, or the /64, zero padded */
+    ip_address    addr;			/* for show_ratelimit_status() */
+    bool          resolved;		/* rate[] has been looked up */
+    unsigned long generation;		/* connection_ratelimit_generation of rate[] */
+    unsigned long long last;		/* now_msec() of the last refill */
+    unsigned int  rate[RL_ROOF];	/* packets/s; 0: no limit */
+    unsigned long long tokens[RL_ROOF];
+    bool          limited[RL_ROOF];	/* has dropped since it was last full */
+    unsigned long admitted[RL_ROOF];
+    unsigned long dropped[RL_ROOF];
+};
+
+static struct ratelimit_peer *ratelimit_table[RATELIMIT_BUCKETS];
+static unsigned int ratelimit_peers;
+
+/* where peers go once the table is full */
+static struct ratelimit_peer ratelimit_overflow;
+
+static unsigned long long ratelimit_last_sweep;
+
+static struct {
+    unsigned long admitted[RL_ROOF];
+    unsigned long dropped[RL_ROOF];
+    unsigned long overflowed;		/* packets charged to ratelimit_overflow */
+    unsigned long forgotten;		/* idle peers swept */
+} ratelimit_stats;
+
+/* a zero responder cookie: the first message of an exchange */
+static enum ratelimit_kind
+ratelimit_classify(const u_int8_t *packet, size_t len)
+{
+    static const u_char zero_cookie[COOKIE_SIZE];
+
+    if (len < COOKIE_SIZE * 2)
+	return RL_NEW;	/* it will not get far, but it costs the same */
+
+    return memcmp(packet + COOKIE_SIZE, zero_cookie, COOKIE_SIZE) == 0
+	? RL_NEW : RL_EXISTING;
+}
+
+/* the highest limit of each kind set by the connections on list c */
+static bool
+ratelimit_conn_rates(struct connection *c, unsigned int rate[RL_ROOF])
+{
+    bool found = FALSE;
+
+    for (; c != NULL; c = c->IPhp_next)
+    {
+	if (c->ratelimit_new > rate[RL_NEW])
+	    rate[RL_NEW] = c->ratelimit_new;
+	if (c->ratelimit_existing > rate[RL_EXISTING])
+	    rate[RL_EXISTING] = c->ratelimit_existing;
+	found |= c->ratelimit_new != 0 || c->ratelimit_existing != 0;
+    }
+    return found;
+}
+
+static void
+ratelimit_resolve(struct ratelimit_peer *p, const struct iface_port *ifp
+		  , const ip_address *src, u_int16_t src_port)
+{
+    unsigned int rate[RL_ROOF];
+    bool found = FALSE;
+    int k;
+
+    rate[RL_NEW] = rate[RL_EXISTING] = 0;
+
+    if (ifp != NULL && connection_ratelimit_generation != 0)
+    {
+	found = ratelimit_conn_rates(find_host_pair_connections(__FUNCTION__
+	    , EXACT_MATCH, &ifp->ip_addr, ifp->port
+	    , KH_IPADDR, src, src_port), rate);
+	if (!found)
+	    found = ratelimit_conn_rates(find_host_pair_connections(__FUNCTION__
+		, ANY_MATCH, &ifp->ip_addr, ifp->port
+		, KH_ANY, NULL, pluto_port500), rate);
+    }
+    if (rate[RL_NEW] == 0)
+	rate[RL_NEW] = ratelimit_new;
+    if (rate[RL_EXISTING] == 0)
+	rate[RL_EXISTING] = ratelimit_existing;
+
+    for (k = 0; k < RL_ROOF; k++)
+    {
+	unsigned long long cap = (unsigned long long)rate[k]
+	    * ratelimit_burst * RATELIMIT_PACKET;
+
+	/* a new peer starts with a full bucket, a changed one keeps what it has */
+	if (!p->resolved || p->tokens[k] > cap || p->rate[k] == 0)
+	    p->tokens[k] = cap;
+	p->rate[k] = rate[k];
+    }
+    p->resolved = TRUE;
+    p->generation = connection_ratelimit_generation;
+
+    DBG(DBG_CONTROLMORE
+	, DBG_log("ratelimit for %s: new=%u/s existing=%u/s%s"
+		  , ip_str(src), rate[RL_NEW], rate[RL_EXISTING]
+		  , found ? " (from connection)" : ""));
+}
+
+static void
+ratelimit_key(const ip_address *src, u_char key[COOKIE_SIZE]
+	      , ip_address *addr)
+{
+    unsigned char *bytes;
+    size_t len;
+
+    *addr = *src;
+    setportof(0, addr);
+    len = addrbytesptr_write(addr, &bytes);
+
+    /* a host, or a /64 */
+    memset(key, 0, COOKIE_SIZE);
+    if (len > COOKIE_SIZE)
+    {
+	memset(bytes + COOKIE_SIZE, 0, len - COOKIE_SIZE);
+	len = COOKIE_SIZE;
+    }
+    memcpy(key, bytes, len);
+}
+
+static struct ratelimit_peer **
+ratelimit_chain(const u_char *key)
+{
+    static const u_char zero_cookie[COOKIE_SIZE];
+
+    /* the same keyed hash as the state table */
+    return &ratelimit_table[compute_icookie_rcookie_hash(key, zero_cookie)
+			    % RATELIMIT_BUCKETS];
+}
+
+static struct ratelimit_peer *
+ratelimit_lookup(const ip_address *src)
+{
+    u_char key[COOKIE_SIZE];
+    ip_address addr;
+    struct ratelimit_peer **pp;
+    struct ratelimit_peer *p;
+
+    ratelimit_key(src, key, &addr);
+    pp = ratelimit_chain(key);
+
+    for (p = *pp; p != NULL; p = p->next)
+    {
+	if (addrtypeof(&p->addr) == addrtypeof(&addr)
+	    && memcmp(p->key, key, sizeof(key)) == 0)
+	    return p;
+    }
+
+    if (ratelimit_peers >= RATELIMIT_PEERS)
+    {
+	ratelimit_stats.overflowed++;
+	return &ratelimit_overflow;
+    }
+
+    p = alloc_thing(struct ratelimit_peer, "ratelimit peer");
+    memcpy(p->key, key, sizeof(key));
+    p->addr = addr;
+    p->next = *pp;
+    *pp = p;
+    ratelimit_peers++;
+    return p;
+}
+
+/* forget the peers that have been quiet for a while */
+static void
+ratelimit_sweep(unsigned long long now)
+{
+    unsigned int i;
+
+    ratelimit_last_sweep = now;
+    for (i = 0; i < RATELIMIT_BUCKETS; i++)
+    {
+	struct ratelimit_peer **pp = &ratelimit_table[i];
+	struct ratelimit_peer *p;
+
+	while ((p = *pp) != NULL)
+	{
+	    if (now - p->last >= RATELIMIT_IDLE_MS)
+	    {
+		*pp = p->next;
+		pfree(p);
+		ratelimit_peers--;
+		ratelimit_stats.forgotten++;
+	    }
+	    else
+	    {
+		pp = &p->next;
+	    }
+	}
+    }
+}
+
+bool
+ratelimit_admit(const struct iface_port *ifp
+		, const ip_address *src, u_int16_t src_port
+		, const u_int8_t *packet, size_t len)
+{
+    enum ratelimit_kind kind;
+    struct ratelimit_peer *p;
+    unsigned long long now;
+
+    /* nothing to limit: stay out of the way */
+    if (ratelimit_new == 0 && ratelimit_existing == 0
+	&& connection_ratelimit_generation == 0)
+	return TRUE;
+
+    now = now_msec();
+    if (now - ratelimit_last_sweep >= RATELIMIT_SWEEP_MS)
+	ratelimit_sweep(now);
+
+    kind = ratelimit_classify(packet, len);
+    p = ratelimit_lookup(src);
+
+    if (!p->resolved || p->generation != connection_ratelimit_generation)
+    {
+	if (p == &ratelimit_overflow)
+	    ratelimit_resolve(p, NULL, src, src_port);
+	else
+	    ratelimit_resolve(p, ifp, src, src_port);
+	p->last = now;
+    }
+    else if (now > p->last)
+    {
+	unsigned long long elapsed = now - p->last;
+	int k;
+
+	for (k = 0; k < RL_ROOF; k++)
+	{
+	    unsigned long long cap = (unsigned long long)p->rate[k]
+		* ratelimit_burst * RATELIMIT_PACKET;
+
+	    p->tokens[k] += elapsed * p->rate[k];
+	    if (p->tokens[k] >= cap)
+	    {
+		p->tokens[k] = cap;
+
+		/* quiet for long enough to fill up again */
+		if (p->limited[k])
+		{
+		    p->limited[k] = FALSE;
+		    openswan_log("no longer rate limiting %s IKE packets from %s"
+				 , ratelimit_kind_name[k], ip_str(src));
+		}
+	    }
+	}
+	p->last = now;
+    }
+
+    if (p->rate[kind] == 0 || p->tokens[kind] >= RATELIMIT_PACKET)
+    {
+	if (p->rate[kind] != 0)
+	    p->tokens[kind] -= RATELIMIT_PACKET;
+	p->admitted[kind]++;
+	ratelimit_stats.admitted[kind]++;
+	return TRUE;
+    }
+
+    if (!p->limited[kind])
+    {
+	p->limited[kind] = TRUE;
+	openswan_log("rate limiting %s IKE packets from %s to %u/s"
+		     , ratelimit_kind_name[kind], ip_str(src), p->rate[kind]);
+    }
+    DBG(DBG_CONTROL
+	, DBG_log("dropped %s IKE packet from %s:%u: over its rate limit"
+		  , ratelimit_kind_name[kind], ip_str(src), (unsigned)src_port));
+    p->dropped[kind]++;
+    ratelimit_stats.dropped[kind]++;
+    return FALSE;
+}
+
+void
+free_ratelimit(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < RATELIMIT_BUCKETS; i++)
+    {
+	struct ratelimit_peer *p;
+
+	while ((p = ratelimit_table[i]) != NULL)
+	{
+	    ratelimit_table[i] = p->next;
+	    pfree(p);
+	}
+    }
+    ratelimit_peers = 0;
+}
+
+static unsigned long
+ratelimit_packets(const struct ratelimit_peer *p)
+{
+    return p->admitted[RL_NEW] + p->admitted[RL_EXISTING]
+	+ p->dropped[RL_NEW] + p->dropped[RL_EXISTING];
+}
+
+void
+show_ratelimit_status(void)
+{
+    const struct ratelimit_peer *top[RATELIMIT_TALKERS];
+    unsigned int ntop = 0;
+    unsigned int i, j;
+
+    if (ratelimit_new == 0 && ratelimit_existing == 0
+	&& connection_ratelimit_generation == 0)
+    {
+	whack_log(RC_COMMENT, "stats ike ratelimit: off");
+	return;
+    }
+
+    whack_log(RC_COMMENT, "stats ike ratelimit: new=%u/s existing=%u/s"
+	      " burst=%us peers=%u (max %u) overflowed=%lu forgotten=%lu"
+	      , ratelimit_new, ratelimit_existing, ratelimit_burst
+	      , ratelimit_peers, RATELIMIT_PEERS
+	      , ratelimit_stats.overflowed, ratelimit_stats.forgotten);
+    whack_log(RC_COMMENT, "stats ike ratelimit: admitted new=%lu existing=%lu;"
+	      " dropped new=%lu existing=%lu"
+	      , ratelimit_stats.admitted[RL_NEW]
+	      , ratelimit_stats.admitted[RL_EXISTING]
+	      , ratelimit_stats.dropped[RL_NEW]
+	      , ratelimit_stats.dropped[RL_EXISTING]);
+
+    /* the busiest peers, busiest first */
+    for (i = 0; i < RATELIMIT_BUCKETS; i++)
+    {
+	const struct ratelimit_peer *p;
+
+	for (p = ratelimit_table[i]; p != NULL; p = p->next)
+	{
+	    unsigned long n = ratelimit_packets(p);
+
+	    if (ntop == RATELIMIT_TALKERS
+		&& n <= ratelimit_packets(top[ntop - 1]))
+		continue;
+	    if (ntop < RATELIMIT_TALKERS)
+		ntop++;
+	    for (j = ntop - 1; j > 0 && ratelimit_packets(top[j - 1]) < n; j--)
+		top[j] = top[j - 1];
+	    top[j] = p;
+	}
+    }
+
+    for (j = 0; j < ntop; j++)
+    {
+	const struct ratelimit_peer *p = top[j];
+
+	whack_log(RC_COMMENT, "stats ike ratelimit talker: %s%s"
+		  " new=%lu/%lu (%u/s) existing=%lu/%lu (%u/s)%s"
+		  , ip_str(&p->addr)
+		  , addrtypeof(&p->addr) == AF_INET6 ? "/64" : ""
+		  , p->admitted[RL_NEW], p->dropped[RL_NEW], p->rate[RL_NEW]
+		  , p->admitted[RL_EXISTING], p->dropped[RL_EXISTING]
+		  , p->rate[RL_EXISTING]
+		  , p->limited[RL_NEW] || p->limited[RL_EXISTING]
+		  ? " limited" : "");
+    }
+}
@@ -0,0 +1,34 @@
+/* per-peer admission control for incoming IKE packets
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef _RATELIMIT_H
+#define _RATELIMIT_H
+
+struct iface_port;
+
+#define RATELIMIT_BURST		2	/* seconds of packets a peer may save up */
+#define RATELIMIT_TALKERS	10	/* peers listed by show_ratelimit_status() */
+
+extern unsigned int ratelimit_new;	/* --ratelimit-new; 0: no limit */
+extern unsigned int ratelimit_existing;	/* --ratelimit-existing; 0: no limit */
+extern unsigned int ratelimit_burst;	/* --ratelimit-burst */
+
+/* may this packet from src go any further than comm_handle()? */
+extern bool ratelimit_admit(const struct iface_port *ifp
+			    , const ip_address *src, u_int16_t src_port
+			    , const u_int8_t *packet, size_t len);
+
+extern void free_ratelimit(void);
+extern void show_ratelimit_status(void);
+
+#endif /* _RATELIMIT_H */
@@ -275,10 +275,12 @@ void whack_listen(void) {
 
 /*
  * handle a whack message.
+ * Returns FALSE if it defined a connection that could not be added.
  */
-void whack_process(int whackfd, struct whack_message msg)
+bool whack_process(int whackfd, struct whack_message msg)
 {
     const struct osw_conf_options *oco = osw_init_options();
+    bool added = TRUE;
 
     if (msg.whack_options)
     {
@@ -361,7 +363,7 @@ void whack_process(int whackfd, struct whack_message msg)
 	delete_states_by_peer(&msg.whack_crash_peer);
 
     if (msg.whack_connection)
-	add_connection(&msg);
+	added = add_connection(&msg);
 
     /* process "listen" before any operation that could require it */
     if (msg.whack_listen)
@@ -588,6 +590,237 @@ void whack_process(int whackfd, struct whack_message msg)
 done:
     whack_log_fd = NULL_FD;
     close(whackfd);
+    return added;
+}
+
+/* reads a batch of whack messages from its connection */
+struct whack_stream {
+    int fd;
+    size_t start, end;
+    unsigned char buf[2 * sizeof(struct whack_message)];
+};
+
+/* get the next len bytes of the stream; FALSE if it ended first */
+static bool
+whack_stream_get(struct whack_stream *ws, void *dst, size_t len)
+{
+    passert(len <= sizeof(ws->buf));
+
+    if (ws->end - ws->start < len)
+    {
+	memmove(ws->buf, ws->buf + ws->start, ws->end - ws->start);
+	ws->end -= ws->start;
+	ws->start = 0;
+
+	while (ws->end < len)
+	{
+	    ssize_t n = read(ws->fd, ws->buf + ws->end, sizeof(ws->buf) - ws->end);
+
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    if (n < 0)
+	    {
+		log_errno((e, "read() failed in whack batch"));
+	    }
+	    if (n <= 0)
+		return FALSE;
+	    ws->end += n;
+	}
+    }
+    memcpy(dst, ws->buf + ws->start, len);
+    ws->start += len;
+    return TRUE;
+}
+
+/* FNV-1a, over the bytes of a packed whack message */
+static u_int64_t
+whack_digest(const void *p, size_t len)
+{
+    const unsigned char *b = p;
+    u_int64_t h = 0xcbf29ce484222325ULL;
+
+    while (len-- > 0)
+    {
+	h ^= *b++;
+	h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* digests of a conn's packed message, with and without its timers.
+ * A packed message has no pointers in it, so the same conn in the same
+ * ipsec.conf packs the same way every time.
+ */
+static void
+whack_config_digests(const struct whack_message *packed, size_t len
+		     , u_int64_t *digest, u_int64_t *sa_digest)
+{
+    struct whack_message m;
+
+    memcpy(&m, packed, len);
+    *digest = whack_digest(&m, len);
+
+    /* see set_connection_timers() */
+    m.sa_ike_life_seconds = 0;
+    m.sa_ipsec_life_seconds = 0;
+    m.sa_rekey_margin = 0;
+    m.sa_rekey_fuzz = 0;
+    m.sa_keying_tries = 0;
+    m.dpd_delay = 0;
+    m.dpd_timeout = 0;
+    m.dpd_action = 0;
+    m.ratelimit_new = 0;
+    m.ratelimit_existing = 0;
+    *sa_digest = whack_digest(&m, len);
+}
+
+static const char *const reload_change_name[RELOAD_ROOF] = {
+    "unchanged", "updated", "replaced", "added", "failed"
+};
+
+/*
+ * Handle a batch of whack messages (see struct whack_batch).  The n
+ * bytes that whack_handle() has already read are in head.  Each message
+ * is processed as if it had come on its own, but with nobody listening,
+ * so whack only hears the summary, and for a reload the changeset.
+ */
+static void
+whack_handle_batch(int whackfd, const unsigned char *head, size_t n)
+{
+    struct whack_stream *ws = alloc_thing(struct whack_stream, "whack batch");
+    struct whack_batch wb;
+    unsigned long long started = now_msec();
+    unsigned int i, failed = 0, keys = 0, other = 0, removed = 0;
+    unsigned int changes[RELOAD_ROOF];
+    bool reload;
+    err_t ugh = NULL;
+
+    ws->fd = whackfd;
+    memcpy(ws->buf, head, n);
+    ws->end = n;
+
+    (void) whack_stream_get(ws, &wb, sizeof(wb));	/* already in head */
+    reload = (wb.flags & WHACK_BATCH_RELOAD) != 0;
+    memset(changes, 0, sizeof(changes));
+
+    if (reload)
+	reload_begin();
+
+    for (i = 0; i < wb.count; i++)
+    {
+	struct whack_message msg, msg_saved;
+	struct whackpacker wp;
+	u_int64_t digest, sa_digest;
+	u_int32_t len;
+	err_t bad;
+
+	if (!whack_stream_get(ws, &len, sizeof(len)))
+	{
+	    ugh = builddiag("whack batch ended after %u of %u messages"
+			    , i, wb.count);
+	    break;
+	}
+	if (len < offsetof(struct whack_message, string) || len > sizeof(msg))
+	{
+	    /* we cannot find the next message after this one */
+	    ugh = builddiag("whack batch message %u has bad length %u"
+			    , i, (unsigned)len);
+	    break;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	if (!whack_stream_get(ws, &msg, len))
+	{
+	    ugh = builddiag("whack batch ended in message %u of %u"
+			    , i, wb.count);
+	    break;
+	}
+	msg_saved = msg;
+
+	wp.msg = &msg;
+	wp.n   = len;
+	wp.cnt = 0;
+	wp.str_next = msg.string;
+	wp.str_roof = (unsigned char *)&msg + len;
+
+	if (msg.magic != WHACK_MAGIC)
+	    bad = "bad magic";
+	else
+	    bad = unpack_whack_msg(&wp);
+
+	if (bad != NULL)
+	{
+	    openswan_log("ignoring whack batch message %u: %s", i, bad);
+	    failed++;
+	    continue;
+	}
+	msg.keyval.ptr = wp.str_next;    /* grab chunk */
+
+	writewhackrecord((char *)&msg_saved, len);
+	whack_log_fd = NULL_FD;
+
+	if (msg.whack_connection)
+	{
+	    enum reload_change what;
+
+	    whack_config_digests(&msg_saved, len, &digest, &sa_digest);
+	    if (reload)
+	    {
+		what = reload_connection(&msg, digest, sa_digest);
+	    }
+	    else
+	    {
+		what = whack_process(NULL_FD, msg) ? RELOAD_ADDED : RELOAD_FAILED;
+		if (what == RELOAD_ADDED)
+		    note_config_connection(msg.name, digest, sa_digest);
+	    }
+	    changes[what]++;
+
+	    /* the changeset, such as it is */
+	    if (reload && what != RELOAD_SAME)
+	    {
+		whack_log_fd = whackfd;
+		openswan_log("reload: \"%s\" %s", msg.name, reload_change_name[what]);
+		whack_log_fd = NULL_FD;
+	    }
+	}
+	else
+	{
+	    whack_process(NULL_FD, msg);
+	    if (msg.whack_key)
+		keys++;
+	    else
+		other++;
+	}
+    }
+    pfree(ws);
+
+    whack_log_fd = whackfd;
+    if (ugh != NULL)
+	loglog(RC_BADWHACKMESSAGE, "%s", ugh);
+
+    /* a reload that was cut short must not delete what it did not reach */
+    if (reload && ugh == NULL)
+	removed = reload_end();
+
+    failed += changes[RELOAD_FAILED];
+    if (reload)
+    {
+	loglog(failed == 0 ? RC_COMMENT : RC_LOG_SERIOUS
+	       , "whack reload: %u added, %u updated, %u replaced, %u removed, %u unchanged, %u failed, in %llu ms"
+	       , changes[RELOAD_ADDED], changes[RELOAD_UPDATED]
+	       , changes[RELOAD_REPLACED], removed, changes[RELOAD_SAME]
+	       , failed, now_msec() - started);
+    }
+    else
+    {
+	loglog(failed == 0 ? RC_COMMENT : RC_LOG_SERIOUS
+	       , "whack batch: %u connections added, %u failed, %u keys, %u other, in %llu ms"
+	       , changes[RELOAD_ADDED], failed, keys, other, now_msec() - started);
+    }
+
+    whack_log_fd = NULL_FD;
+    close(whackfd);
 }
 
 /*
@@ -624,6 +857,12 @@ whack_handle(int whackctlfd)
 	return;
     }
 
+    if ((size_t)n >= sizeof(struct whack_batch) && msg.magic == WHACK_BATCH_MAGIC)
+    {
+	whack_handle_batch(whackfd, (unsigned char *)&msg, n);
+	return;
+    }
+
     whack_log_fd = whackfd;
 
     msg_saved = msg;
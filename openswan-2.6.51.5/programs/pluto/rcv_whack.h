@@ -12,6 +12,6 @@
  * for more details.
  */
 
-extern void whack_process(int whackfd, struct whack_message msg);
+extern bool whack_process(int whackfd, struct whack_message msg);
 extern void whack_handle(int kernelfd);
 extern void whack_listen(void);
@@ -19,6 +19,9 @@
  *
  */
 
+#ifdef HAVE_SENDMMSG
+# define _GNU_SOURCE	/* for sendmmsg(2) */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -37,6 +40,10 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <sys/poll.h>	/* only used for forensic poll call */
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -45,6 +52,7 @@
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <resolv.h>
+#include <sys/uio.h>	/* struct iovec */
 
 #if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
 #  include <asm/types.h>	/* for __u8, __u32 */
@@ -80,6 +88,7 @@
 #include "dnskey.h"	/* needs keys.h and adns.h */
 #include "whack.h"	/* for RC_LOG_SERIOUS */
 #include "pluto_crypt.h" /* cryptographic helper functions */
+#include "updown.h"
 #include "udpfromto.h"
 
 #include <openswan/pfkeyv2.h>
@@ -233,6 +242,9 @@ bool listening = FALSE;	/* should we pay attention to IKE messages? */
 
 struct iface_port  *interfaces = NULL;	/* public interfaces */
 
+/* bumped whenever the interfaces list is rebuilt */
+static unsigned long ifaces_generation = 0;
+
 /* Initialize the interface sockets. */
 
 static void
@@ -257,6 +269,10 @@ free_dead_iface_dev(struct iface_dev *id)
     }
 }
 
+static void send_queues_attach(void);
+static void send_queue_free(struct iface_port *ifp);
+static bool send_queue_blocked(const struct iface_port *ifp);
+
 static void
 free_dead_ifaces(void)
 {
@@ -293,6 +309,7 @@ free_dead_ifaces(void)
 		struct iface_dev *id;
 
 		*pp = p->next;	/* advance *pp */
+		send_queue_free(p);
 		close(p->fd);
 
 		id = p->ip_dev;
@@ -320,6 +337,7 @@ free_ifaces(void)
 {
     mark_ifaces_dead();
     free_dead_ifaces();
+    ifaces_generation++;
 }
 
 struct raw_iface *static_ifn=NULL;
@@ -370,6 +388,17 @@ create_socket(struct raw_iface *ifp, const char *v_name, int port)
     }
 #endif
 
+    /* Count datagrams the kernel drops on a full receive queue.
+     * Only for the statistics, so failure is not fatal.
+     */
+#if defined(HAVE_RECVMMSG) && defined(SO_RXQ_OVFL)
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL
+    , (const void *)&on, sizeof(on)) < 0)
+    {
+	log_errno((e, "setsockopt SO_RXQ_OVFL in process_raw_ifaces()"));
+    }
+#endif
+
     /* With IPv6, there is no fragmentation after
      * it leaves our interface.  PMTU discovery
      * is mandatory but doesn't work well with IKE (why?).
@@ -472,6 +501,8 @@ find_ifaces(void)
     }
 
     free_dead_ifaces();	    /* ditch remaining old entries */
+    send_queues_attach();
+    ifaces_generation++;
 
     if (interfaces == NULL)
 	loglog(RC_LOG_SERIOUS, "no public interfaces found");
@@ -536,6 +567,7 @@ reapchildren(void)
     while((child = wait3(&status, WNOHANG, &r)) > 0) {
 	/* got a child to reap */
 	if(adns_reapchild(child, status)) continue;
+	if(updown_reapchild(child, status)) continue;
        /*Threads are created instead of child processes when using LIBNSS*/
 #ifndef HAVE_LIBNSS
 	if(pluto_crypt_handle_dead_child(child, status)) continue;
@@ -549,6 +581,605 @@ reapchildren(void)
     }
 }
 
+/* things to do each time around the main loop, before waiting */
+static void
+server_housekeeping(void)
+{
+    /* free up any states not yet freed */
+    do_state_frees();
+
+    /* move part of the state table, if it is being resized */
+    state_table_rehash_step();
+
+    if (sigtermflag)
+	exit_pluto(0);
+
+    if (sighupflag)
+    {
+	/* Ignorant folks think poking any daemon with SIGHUP
+	 * is polite.  We catch it and tell them otherwise.
+	 * There is one use: unsticking a hung recvfrom.
+	 * This sticking happens sometimes -- kernel bug?
+	 */
+	sighupflag = FALSE;
+	openswan_log("Pluto ignores SIGHUP -- perhaps you want \"whack --listen\"");
+    }
+
+    if(sigchildflag) {
+	reapchildren();
+    }
+}
+
+/* we log the time when we are about to do something so that
+ * we know what time things happened, when not using syslog
+ */
+static void
+server_log_time(void)
+{
+    DBG(DBG_CONTROL, DBG_log(BLANK_FORMAT));
+
+    if(log_to_stderr_desired) {
+	time_t n;
+
+	static time_t lastn = 0;
+
+	time(&n);
+
+	if(log_did_something) {
+	    lastn=n;
+	    log_did_something=FALSE;
+	    if((n-lastn) > 60) {
+		DBG_log("time is %s (%lu)", ctime(&n), (unsigned long)n);
+	    }
+	}
+    }
+}
+
+#ifdef HAVE_EPOLL
+/*
+ * The epoll(7) main loop.
+ *
+ * Every descriptor of interest is registered once, with a note of what
+ * it is in server_fds[], which is indexed by descriptor.  Descriptors
+ * that come and go are re-registered only when they change: the
+ * interface list when find_ifaces() rebuilds it, the others when the
+ * descriptor number changes.  The timer queue drives a timerfd, so
+ * epoll_wait() only returns when there is something to do.
+ *
+ * The IKE sockets are edge-triggered.  Each wakeup reads at most
+ * IFACE_DRAIN_BUDGET packets from a socket; a socket with more waiting
+ * is put on the backlog, and the next epoll_wait() does not block
+ * until the backlog is drained.
+ */
+enum server_fd_kind {
+    SFD_NONE = 0,
+    SFD_CTL,
+    SFD_INFO,
+    SFD_ADNS_Q,
+    SFD_ADNS_A,
+    SFD_KERNEL,
+    SFD_HELPER,
+    SFD_UPDOWN,
+    SFD_IFACE,
+    SFD_TIMER,
+};
+
+struct server_fd {
+    enum server_fd_kind kind;
+    u_int32_t           events;		/* as registered */
+    struct iface_port  *ifp;		/* SFD_IFACE */
+    bool                backlog;	/* SFD_IFACE: on server_backlog[] */
+};
+
+#define IFACE_DRAIN_BUDGET	32
+#define SERVER_EPOLL_EVENTS	64
+
+static int server_epfd = NULL_FD;
+static int server_timerfd = NULL_FD;
+static struct server_fd *server_fds = NULL;	/* indexed by fd */
+static int server_fds_room = 0;
+
+static int *server_backlog = NULL;		/* IKE sockets with more to read */
+static int *server_backlog_spare = NULL;	/* the other one, while draining */
+static int server_backlog_count = 0;
+
+/* what is registered now, to notice changes */
+static int server_adns_qfd = NULL_FD;
+static int server_adns_afd = NULL_FD;
+static int server_kernel_fd = NULL_FD;
+static unsigned long server_ifaces_generation = 0;
+static bool server_listening = FALSE;
+static osw_fd_set server_helper_fds;
+static osw_fd_set server_updown_fds;
+static unsigned long server_updown_generation = 0;
+static unsigned long long server_timer_deadline = 0;	/* 0: disarmed */
+
+static struct server_fd *
+server_fd_slot(int fd)
+{
+    passert(fd >= 0);
+
+    if (fd >= server_fds_room)
+    {
+	struct server_fd *old = server_fds;
+	int *oldbl = server_backlog;
+	int room = server_fds_room == 0 ? 64 : server_fds_room;
+
+	while (room <= fd)
+	    room *= 2;
+
+	server_fds = alloc_bytes(room * sizeof(struct server_fd)
+				 , "server fd table");
+	server_backlog = alloc_bytes(room * sizeof(int)
+				     , "server backlog");
+	if (old != NULL)
+	{
+	    memcpy(server_fds, old, server_fds_room * sizeof(struct server_fd));
+	    memcpy(server_backlog, oldbl, server_backlog_count * sizeof(int));
+	    pfree(old);
+	    pfree(oldbl);
+	    pfree(server_backlog_spare);
+	}
+	server_backlog_spare = alloc_bytes(room * sizeof(int)
+					   , "server backlog");
+	server_fds_room = room;
+    }
+    return &server_fds[fd];
+}
+
+/* register fd (events != 0), change it, or drop it (events == 0) */
+static void
+server_fd_watch(int fd, enum server_fd_kind kind, u_int32_t events
+		, struct iface_port *ifp)
+{
+    struct server_fd *sfd;
+    struct epoll_event ev;
+    int op;
+
+    if (fd == NULL_FD)
+	return;
+
+    sfd = server_fd_slot(fd);
+
+    if (events == 0)
+    {
+	if (sfd->kind != SFD_NONE && sfd->events != 0)
+	    (void) epoll_ctl(server_epfd, EPOLL_CTL_DEL, fd, NULL);
+	sfd->kind = SFD_NONE;
+	sfd->events = 0;
+	sfd->ifp = NULL;
+	return;
+    }
+
+    zero(&ev);
+    ev.events = events;
+    ev.data.fd = fd;
+
+    op = sfd->kind != SFD_NONE && sfd->events != 0
+	? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(server_epfd, op, fd, &ev) == -1)
+    {
+	/* the table can be out of date about a descriptor that was
+	 * closed and reopened behind our back
+	 */
+	op = errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl(server_epfd, op, fd, &ev) == -1)
+	    exit_log_errno((e, "epoll_ctl() failed for fd %d", fd));
+    }
+    sfd->kind = kind;
+    sfd->events = events;
+    sfd->ifp = ifp;
+}
+
+/* follow a descriptor that may change or go away */
+static void
+server_fd_follow(int *registered, int fd, enum server_fd_kind kind
+		 , u_int32_t events)
+{
+    struct server_fd *sfd;
+
+    if (*registered != NULL_FD && *registered != fd)
+    {
+	if (server_fd_slot(*registered)->kind == kind)
+	    server_fd_watch(*registered, kind, 0, NULL);
+	*registered = NULL_FD;
+    }
+    if (fd == NULL_FD)
+	return;
+
+    *registered = fd;
+    sfd = server_fd_slot(fd);
+    if (sfd->events != events || (events != 0 && sfd->kind != kind))
+	server_fd_watch(fd, kind, events, NULL);
+}
+
+static void
+server_backlog_add(int fd)
+{
+    if (!server_fds[fd].backlog)
+    {
+	server_fds[fd].backlog = TRUE;
+	server_backlog[server_backlog_count++] = fd;
+    }
+}
+
+/* IKE sockets are read edge-triggered; a blocked send queue
+ * also waits for the socket to drain
+ */
+static u_int32_t
+server_iface_events(const struct iface_port *ifp)
+{
+    return EPOLLIN | EPOLLET | (send_queue_blocked(ifp) ? EPOLLOUT : 0);
+}
+
+/* bring the epoll set up to date with the interface list */
+static void
+server_sync_ifaces(void)
+{
+    struct iface_port *ifp;
+    int fd;
+
+    if (server_ifaces_generation == ifaces_generation
+	&& server_listening == listening)
+	return;
+
+    server_ifaces_generation = ifaces_generation;
+    server_listening = listening;
+
+    /* the old sockets may be gone: forget them all */
+    for (fd = 0; fd < server_fds_room; fd++)
+	if (server_fds[fd].kind == SFD_IFACE)
+	    server_fd_watch(fd, SFD_IFACE, 0, NULL);
+    for (fd = 0; fd < server_backlog_count; fd++)
+	server_fds[server_backlog[fd]].backlog = FALSE;
+    server_backlog_count = 0;
+
+    if (!listening)
+	return;
+
+    for (ifp = interfaces; ifp != NULL; ifp = ifp->next)
+    {
+	server_fd_watch(ifp->fd, SFD_IFACE, server_iface_events(ifp), ifp);
+	/* it may have had packets before we were watching */
+	server_backlog_add(ifp->fd);
+    }
+}
+
+/* after flush_send_queues(): wait for POLLOUT on blocked queues */
+static void
+server_sync_sendq(void)
+{
+    struct iface_port *ifp;
+
+    if (!listening)
+	return;
+
+    for (ifp = interfaces; ifp != NULL; ifp = ifp->next)
+    {
+	u_int32_t events = server_iface_events(ifp);
+
+	if (server_fd_slot(ifp->fd)->events != events)
+	    server_fd_watch(ifp->fd, SFD_IFACE, events, ifp);
+    }
+}
+
+static void
+server_sync_helpers(void)
+{
+    osw_fd_set now;
+    int fd;
+
+    OSW_FD_ZERO(&now);
+    pluto_crypto_helper_sockets(&now);
+    if (memcmp(&now, &server_helper_fds, sizeof(now)) == 0)
+	return;
+
+    for (fd = 0; fd < OSW_FD_SETSIZE; fd++)
+    {
+	bool was = OSW_FD_ISSET(fd, &server_helper_fds);
+	bool is = OSW_FD_ISSET(fd, &now);
+
+	if (is && !was)
+	    server_fd_watch(fd, SFD_HELPER, EPOLLIN, NULL);
+	else if (was && !is && fd < server_fds_room
+		 && server_fds[fd].kind == SFD_HELPER)
+	    server_fd_watch(fd, SFD_HELPER, 0, NULL);
+    }
+    server_helper_fds = now;
+}
+
+/* the output pipes of running updown scripts.  A pipe can be closed and
+ * its number reused before we get here, so when anything has changed
+ * they are all registered again.
+ */
+static void
+server_sync_updown(void)
+{
+    int fd;
+
+    if (server_updown_generation == updown_generation)
+	return;
+    server_updown_generation = updown_generation;
+
+    for (fd = 0; fd < server_fds_room; fd++)
+	if (server_fds[fd].kind == SFD_UPDOWN)
+	    server_fd_watch(fd, SFD_UPDOWN, 0, NULL);
+
+    OSW_FD_ZERO(&server_updown_fds);
+    updown_sockets(&server_updown_fds, NULL);
+    for (fd = 0; fd < OSW_FD_SETSIZE; fd++)
+	if (OSW_FD_ISSET(fd, &server_updown_fds))
+	    server_fd_watch(fd, SFD_UPDOWN, EPOLLIN, NULL);
+}
+
+/* arm the timerfd for the first event; FALSE if it is already due */
+static bool
+server_sync_timer(void)
+{
+    long next_time = no_retransmits ? -1 : next_event_msec();
+    unsigned long long deadline;
+    struct itimerspec its;
+
+    if (next_time == 0)
+	return FALSE;
+
+    zero(&its);
+    if (next_time < 0)
+    {
+	if (server_timer_deadline == 0)
+	    return TRUE;
+	deadline = 0;
+    }
+    else
+    {
+	deadline = now_msec() + next_time;
+	if (deadline == server_timer_deadline)
+	    return TRUE;
+	its.it_value.tv_sec = next_time / 1000;
+	its.it_value.tv_nsec = (next_time % 1000) * 1000000;
+    }
+
+    if (timerfd_settime(server_timerfd, 0, &its, NULL) == -1)
+	exit_log_errno((e, "timerfd_settime() failed in call_server()"));
+    server_timer_deadline = deadline;
+    return TRUE;
+}
+
+/* read what an edge-triggered IKE socket has, up to the budget.
+ * The socket is non-blocking: comm_handle() reads nothing once it
+ * would block, and then the socket is drained.
+ */
+static void
+server_drain_iface(int fd)
+{
+    struct iface_port *ifp = server_fds[fd].ifp;
+    unsigned long generation = ifaces_generation;
+    int budget, n;
+
+    for (budget = IFACE_DRAIN_BUDGET; budget > 0; budget -= n)
+    {
+	/* comm_handle will print DBG_CONTROL intro,
+	 * with more info than we have here.
+	 */
+	n = comm_handle(ifp);
+	passert(GLOBALS_ARE_RESET());
+	if (n == 0)
+	    return;	/* drained */
+
+	/* whack --listen may have closed this very socket */
+	if (generation != ifaces_generation)
+	    return;
+    }
+    server_backlog_add(fd);
+}
+
+static bool
+server_epoll_init(void)
+{
+    server_epfd = epoll_create(SERVER_EPOLL_EVENTS);
+    if (server_epfd == -1)
+    {
+	log_errno((e, "epoll_create() failed"));
+	server_epfd = NULL_FD;
+	return FALSE;
+    }
+    server_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (server_timerfd == -1)
+    {
+	log_errno((e, "timerfd_create() failed"));
+	close(server_epfd);
+	server_epfd = server_timerfd = NULL_FD;
+	return FALSE;
+    }
+    (void) fcntl(server_epfd, F_SETFD, FD_CLOEXEC);
+    (void) fcntl(server_timerfd, F_SETFD, FD_CLOEXEC);
+
+    OSW_FD_ZERO(&server_helper_fds);
+    server_fd_watch(server_timerfd, SFD_TIMER, EPOLLIN, NULL);
+    server_fd_watch(ctl_fd, SFD_CTL, EPOLLIN, NULL);
+#ifdef IPSECPOLICY
+    server_fd_watch(info_fd, SFD_INFO, EPOLLIN, NULL);
+#endif
+    return TRUE;
+}
+
+static void
+call_server_epoll(void)
+{
+    struct epoll_event events[SERVER_EPOLL_EVENTS];
+
+    for (;;)
+    {
+	osw_fd_set helperfds;
+	osw_fd_set updownfds;
+	bool helpers_ready = FALSE;
+	bool updown_output = FALSE;
+	unsigned long generation;
+	int timeout;
+	int ndes, i;
+
+	server_housekeeping();
+
+#ifdef KLIPS
+	if (kern_interface != NO_KERNEL)
+	{
+	    if (kernel_ops->process_queue)
+		kernel_ops->process_queue();
+	    server_fd_follow(&server_kernel_fd, *kernel_ops->async_fdp
+			     , SFD_KERNEL, EPOLLIN);
+	}
+#endif
+	server_fd_follow(&server_adns_afd, adns_afd, SFD_ADNS_A, EPOLLIN);
+	server_fd_follow(&server_adns_qfd, adns_qfd, SFD_ADNS_Q
+			 , unsent_ADNS_queries ? EPOLLOUT : 0);
+	server_sync_ifaces();
+	server_sync_helpers();
+	server_sync_updown();
+
+	/* what this pass queued goes out before we wait */
+	flush_send_queues();
+	server_sync_sendq();
+
+	/* an expired event, or a backlog, means no waiting */
+	timeout = server_sync_timer() && server_backlog_count == 0 ? -1 : 0;
+
+	ndes = epoll_wait(server_epfd, events, SERVER_EPOLL_EVENTS, timeout);
+	if (ndes == -1)
+	{
+	    if (errno != EINTR)
+		exit_log_errno((e, "epoll_wait() failed in call_server()"));
+	    continue;	/* retry if terminated by signal */
+	}
+
+	server_log_time();
+
+	/* do FD's before events are processed */
+	OSW_FD_ZERO(&helperfds);
+	OSW_FD_ZERO(&updownfds);
+	generation = ifaces_generation;
+	for (i = 0; i < ndes; i++)
+	{
+	    int fd = events[i].data.fd;
+
+	    if (fd >= server_fds_room)
+		continue;
+
+	    switch (server_fds[fd].kind)
+	    {
+	    case SFD_TIMER:
+		{
+		    u_int64_t expirations;
+
+		    /* the queue itself says what is due */
+		    if (read(fd, &expirations, sizeof(expirations)) == -1
+		    && errno != EAGAIN)
+			log_errno((e, "read() of timerfd failed in call_server()"));
+		    server_timer_deadline = 0;
+		}
+		break;
+
+	    case SFD_ADNS_Q:
+		send_unsent_ADNS_queries();
+		passert(GLOBALS_ARE_RESET());
+		break;
+
+	    case SFD_ADNS_A:
+		DBG(DBG_CONTROL,
+		    DBG_log("*received adns message"));
+		handle_adns_answer();
+		passert(GLOBALS_ARE_RESET());
+		break;
+
+#ifdef KLIPS
+	    case SFD_KERNEL:
+		DBG(DBG_CONTROL,
+		    DBG_log("*received kernel message"));
+		kernel_ops->process_msg();
+		passert(GLOBALS_ARE_RESET());
+		break;
+#endif
+
+	    case SFD_IFACE:
+		/* EPOLLOUT alone: the send queue is flushed next pass */
+		if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+		    break;
+		/* after whack --listen, the interfaces are resynced first */
+		if (!server_fds[fd].backlog && generation == ifaces_generation)
+		    server_drain_iface(fd);
+		break;
+
+	    case SFD_CTL:
+		DBG(DBG_CONTROL,
+		    DBG_log("*received whack message"));
+		whack_handle(ctl_fd);
+		passert(GLOBALS_ARE_RESET());
+		break;
+
+#ifdef IPSECPOLICY
+	    case SFD_INFO:
+		DBG(DBG_CONTROL,
+		    DBG_log("*received info message"));
+		info_handle(info_fd);
+		passert(GLOBALS_ARE_RESET());
+		break;
+#endif
+
+	    case SFD_HELPER:
+		OSW_FD_SET(fd, &helperfds);
+		helpers_ready = TRUE;
+		break;
+
+	    case SFD_UPDOWN:
+		OSW_FD_SET(fd, &updownfds);
+		updown_output = TRUE;
+		break;
+
+	    default:
+		/* gone since epoll_wait() returned */
+		break;
+	    }
+	}
+
+	/* sockets left over from last time, in the order they got there */
+	if (server_backlog_count != 0 && generation == ifaces_generation)
+	{
+	    int *backlog = server_backlog;
+	    int count = server_backlog_count;
+
+	    server_backlog = server_backlog_spare;
+	    server_backlog_spare = backlog;
+	    server_backlog_count = 0;
+	    for (i = 0; i < count; i++)
+		server_fds[backlog[i]].backlog = FALSE;
+	    for (i = 0; i < count && generation == ifaces_generation; i++)
+		if (server_fds[backlog[i]].kind == SFD_IFACE)
+		    server_drain_iface(backlog[i]);
+	}
+
+	if (updown_output)
+	{
+	    (void) updown_ready(&updownfds);
+	    passert(GLOBALS_ARE_RESET());
+	}
+
+	/* note we process helper things last on purpose */
+	if (helpers_ready)
+	{
+	    int helpers = pluto_crypto_helper_ready(&helperfds);
+	    DBG(DBG_CONTROL, DBG_log("* processed %d messages from cryptographic helpers\n", helpers));
+	}
+
+	if (next_event_msec() == 0 && !no_retransmits)
+	{
+	    /* timer event ready */
+	    DBG(DBG_CONTROL, DBG_log("*time to handle event"));
+	    handle_timer_event();
+	    passert(GLOBALS_ARE_RESET());
+	}
+    }
+}
+#endif /* HAVE_EPOLL */
+
 /* call_server listens for incoming ISAKMP packets and Whack messages,
  * and handles timer events.
  */
@@ -578,6 +1209,12 @@ call_server(void)
 	passert(r == 0);
     }
 
+#ifdef HAVE_EPOLL
+    if (server_epoll_init())
+	call_server_epoll();	/* does not return */
+    openswan_log("falling back to select() for the main loop");
+#endif
+
     for (;;)
     {
 	osw_fd_set readfds;
@@ -588,29 +1225,11 @@ call_server(void)
 
 	for (;;)
 	{
-	    long next_time = next_event();   /* time to any pending timer event */
+	    long next_time = next_event_msec();   /* msec to any pending timer event */
 	    int maxfd = ctl_fd;
 
-            /* free up any states not yet freed */
-            do_state_frees();
-
-	    if (sigtermflag)
-		exit_pluto(0);
-
-	    if (sighupflag)
-	    {
-		/* Ignorant folks think poking any daemon with SIGHUP
-		 * is polite.  We catch it and tell them otherwise.
-		 * There is one use: unsticking a hung recvfrom.
-		 * This sticking happens sometimes -- kernel bug?
-		 */
-		sighupflag = FALSE;
-		openswan_log("Pluto ignores SIGHUP -- perhaps you want \"whack --listen\"");
-	    }
-
-	    if(sigchildflag) {
-		reapchildren();
-	    }
+	    server_housekeeping();
+	    flush_send_queues();
 
 	    OSW_FD_ZERO(&readfds);
 	    OSW_FD_ZERO(&writefds);
@@ -658,11 +1277,14 @@ call_server(void)
 			maxfd = ifp->fd;
 		    passert(!OSW_FD_ISSET(ifp->fd, &readfds));
 		    OSW_FD_SET(ifp->fd, &readfds);
+		    if (send_queue_blocked(ifp))
+			OSW_FD_SET(ifp->fd, &writefds);
 		}
 	    }
 
 	    /* see if helpers need attention */
 	    pluto_crypto_helper_sockets(&readfds);
+	    updown_sockets(&readfds, &maxfd);
 
 	    if (no_retransmits || next_time < 0)
 	    {
@@ -683,8 +1305,8 @@ call_server(void)
 
 		struct timeval tm;
 
-		tm.tv_sec = next_time;
-		tm.tv_usec = 0;
+		tm.tv_sec = next_time / 1000;
+		tm.tv_usec = (next_time % 1000) * 1000;
 		ndes = osw_select(maxfd + 1, &readfds, &writefds, NULL, &tm);
 	    }
 
@@ -697,27 +1319,7 @@ call_server(void)
 	    /* retry if terminated by signal */
 	}
 
-	DBG(DBG_CONTROL, DBG_log(BLANK_FORMAT));
-
-	/*
-	 * we log the time when we are about to do something so that
-	 * we know what time things happened, when not using syslog
-	 */
-	if(log_to_stderr_desired) {
-	    time_t n;
-
-	    static time_t lastn = 0;
-
-	    time(&n);
-
-	    if(log_did_something) {
-		lastn=n;
-		log_did_something=FALSE;
-		if((n-lastn) > 60) {
-		    DBG_log("time is %s (%lu)", ctime(&n), (unsigned long)n);
-		}
-	    }
-	}
+	server_log_time();
 
 	/* figure out what is interesting */
 	/* do FD's before events are processed */
@@ -759,6 +1361,10 @@ call_server(void)
 
 	    for (ifp = interfaces; ifp != NULL; ifp = ifp->next)
 	    {
+		/* a blocked send queue is flushed next pass */
+		if (OSW_FD_ISSET(ifp->fd, &writefds))
+		    ndes--;
+
 		if (OSW_FD_ISSET(ifp->fd, &readfds))
 		{
 		    /* comm_handle will print DBG_CONTROL intro,
@@ -794,6 +1400,9 @@ call_server(void)
 	    }
 #endif
 
+	    ndes -= updown_ready(&readfds);
+	    passert(GLOBALS_ARE_RESET());
+
 	    /* note we process helper things last on purpose */
 	    {
 		int helpers = pluto_crypto_helper_ready(&readfds);
@@ -804,7 +1413,7 @@ call_server(void)
 
 	    passert(ndes == 0);
 	}
-	if (next_event() == 0 && !no_retransmits)
+	if (next_event_msec() == 0 && !no_retransmits)
 	{
 	    /* timer event ready */
 	    DBG(DBG_CONTROL, DBG_log("*time to handle event"));
@@ -1097,41 +1706,320 @@ check_msg_errqueue(const struct iface_port *ifp, short interest)
 }
 #endif /* defined(IP_RECVERR) && defined(MSG_ERRQUEUE) */
 
+/*
+ * Outbound packets.
+ *
+ * With HAVE_SENDMMSG, send_packet() does not write to the socket.  It
+ * appends the packet to the queue of its interface, and the main loop
+ * sends everything queued during one pass with a sendmmsg(2) per
+ * interface before it waits again.  A retransmit burst or a keepalive
+ * sweep then costs one system call per interface, not one per packet.
+ *
+ * The packet is copied into the queue, since st_tpacket may be replaced
+ * or freed before the queue is flushed.  The NAT-T Non-ESP marker is
+ * sent from its own iovec instead of being copied in front.
+ *
+ * When the socket buffer is full the rest of the queue waits for the
+ * socket to become writable, and new packets are added behind it.
+ * Packets that find a full queue are dropped: retransmission takes
+ * care of them, as it would of a loss on the wire.
+ *
+ * So a queued packet has not been sent yet, and send_packet() can only
+ * say that it was queued.  A send that fails when the queue is flushed
+ * is logged then, by send_queue_failed(), and counted in send_stats;
+ * like a drop, it is left to retransmission.
+ */
+static u_int32_t non_esp_marker = 0;	/* never written; iov_base is not const */
+
+#ifdef HAVE_SENDMMSG
+
+#define SEND_QUEUE_PACKETS	32
+#define SEND_QUEUE_BYTES	(64 * 1024)
+
+struct send_queue_entry {
+    ip_address	to;		/* with the port */
+    size_t	off;		/* of the packet in buf */
+    size_t	len;
+    bool	marker;		/* send the Non-ESP marker first */
+    bool	verbose;	/* log failure */
+    const char *where;		/* static string, for the log */
+};
+
+struct send_queue {
+    unsigned int head;		/* first entry not yet sent */
+    unsigned int count;
+    size_t	 used;		/* of buf */
+    bool	 blocked;	/* socket buffer full, waiting for POLLOUT */
+    struct send_queue_entry ent[SEND_QUEUE_PACKETS];
+    u_int8_t	 buf[SEND_QUEUE_BYTES];
+};
+
+static struct {
+    unsigned long calls;	/* sendmmsg() calls that sent something */
+    unsigned long packets;
+    unsigned int largest;
+    unsigned long blocked;	/* times a queue found the socket full */
+    unsigned long dropped;	/* packets that found their queue full */
+    unsigned long failed;	/* packets the kernel would not take */
+} send_stats;
+
+/* every interface gets its queue when it is found */
+static void
+send_queues_attach(void)
+{
+    struct iface_port *ifp;
+
+    for (ifp = interfaces; ifp != NULL; ifp = ifp->next)
+	if (ifp->sendq == NULL)
+	    ifp->sendq = alloc_thing(struct send_queue, "send queue");
+}
+
+static void
+send_queue_failed(const struct iface_port *ifp
+		  , struct send_queue_entry *qe, int err)
+{
+    send_stats.failed++;
+    if (!qe->verbose)
+	return;	/* do not log NAT-T Keep Alive packets */
+
+    errno = err;
+    log_errno((e, "sendmmsg on %s to %s:%u failed in %s"
+	       , ifp->ip_dev->id_rname
+	       , ip_str(&qe->to)
+	       , (unsigned)ntohs(portof(&qe->to))
+	       , qe->where));
+}
+
+static void
+send_queue_flush(const struct iface_port *ifp)
+{
+    struct send_queue *q = ifp->sendq;
+    struct mmsghdr msgs[SEND_QUEUE_PACKETS];
+    struct iovec iov[SEND_QUEUE_PACKETS][2];
+
+    if (q == NULL || q->head == q->count)
+	return;
+
+#if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
+    (void) check_msg_errqueue(ifp, POLLOUT);
+#endif /* defined(IP_RECVERR) && defined(MSG_ERRQUEUE) */
+
+    while (q->head < q->count)
+    {
+	unsigned int n = q->count - q->head;
+	unsigned int i;
+	int r;
+
+	zero(&msgs);
+	for (i = 0; i < n; i++)
+	{
+	    struct send_queue_entry *qe = &q->ent[q->head + i];
+	    struct msghdr *m = &msgs[i].msg_hdr;
+
+	    m->msg_iov = iov[i];
+	    if (qe->marker)
+	    {
+		iov[i][m->msg_iovlen].iov_base = &non_esp_marker;
+		iov[i][m->msg_iovlen].iov_len = sizeof(non_esp_marker);
+		m->msg_iovlen++;
+	    }
+	    iov[i][m->msg_iovlen].iov_base = q->buf + qe->off;
+	    iov[i][m->msg_iovlen].iov_len = qe->len;
+	    m->msg_iovlen++;
+	    m->msg_name = sockaddrof(&qe->to);
+	    m->msg_namelen = sockaddrlenof(&qe->to);
+	}
+
+	r = sendmmsg(ifp->fd, msgs, n, 0);
+	if (r == -1)
+	{
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    {
+		if (!q->blocked)
+		{
+		    DBG(DBG_CONTROL
+			, DBG_log("send queue on %s:%d blocked with %u packets"
+				  , ifp->ip_dev->id_rname, ifp->port, n));
+		    send_stats.blocked++;
+		    q->blocked = TRUE;
+		}
+		return;
+	    }
+	    /* the first one failed; the others may yet go */
+	    send_queue_failed(ifp, &q->ent[q->head], errno);
+	    q->head++;
+	    continue;
+	}
+
+	send_stats.calls++;
+	send_stats.packets += r;
+	if ((unsigned)r > send_stats.largest)
+	    send_stats.largest = r;
+	q->head += r;
+    }
+
+    q->head = q->count = 0;
+    q->used = 0;
+    q->blocked = FALSE;
+}
+
+/* queue a packet; FALSE if it had to be dropped */
+static bool
+send_queue_add(const struct iface_port *ifp, const u_int8_t *ptr, size_t len
+	       , bool marker, const ip_address *to
+	       , const char *where, bool verbose)
+{
+    struct send_queue *q = ifp->sendq;
+    struct send_queue_entry *qe;
+
+    if (q->count == SEND_QUEUE_PACKETS || q->used + len > SEND_QUEUE_BYTES)
+	send_queue_flush(ifp);
+
+    if (q->count == SEND_QUEUE_PACKETS || q->used + len > SEND_QUEUE_BYTES)
+    {
+	send_stats.dropped++;
+	if (verbose)
+	    openswan_log("send queue on %s full: dropped %lu bytes for %s to %s:%u"
+			 , ifp->ip_dev->id_rname, (unsigned long)len, where
+			 , ip_str(to), (unsigned)ntohs(portof(to)));
+	return FALSE;
+    }
+
+    qe = &q->ent[q->count++];
+    qe->to = *to;
+    qe->off = q->used;
+    qe->len = len;
+    qe->marker = marker;
+    qe->verbose = verbose;
+    qe->where = where;
+    memcpy(q->buf + q->used, ptr, len);
+    q->used += len;
+    return TRUE;
+}
+
+/* send what can be sent, and forget the rest: the socket is going */
+static void
+send_queue_free(struct iface_port *ifp)
+{
+    if (ifp->sendq == NULL)
+	return;
+    send_queue_flush(ifp);
+    pfree(ifp->sendq);
+    ifp->sendq = NULL;
+}
+
+static bool
+send_queue_blocked(const struct iface_port *ifp)
+{
+    return ifp->sendq != NULL && ifp->sendq->blocked;
+}
+
+void
+flush_send_queues(void)
+{
+    struct iface_port *ifp;
+
+    for (ifp = interfaces; ifp != NULL; ifp = ifp->next)
+	send_queue_flush(ifp);
+}
+
+void
+show_send_queue_status(void)
+{
+    unsigned long avg = send_stats.calls == 0 ? 0
+	: send_stats.packets * 100 / send_stats.calls;
+
+    whack_log(RC_COMMENT, "stats ike send: batches=%lu packets=%lu"
+	      " avg=%lu.%02lu largest=%u blocked=%lu dropped=%lu failed=%lu"
+	      , send_stats.calls, send_stats.packets
+	      , avg / 100, avg % 100, send_stats.largest
+	      , send_stats.blocked, send_stats.dropped, send_stats.failed);
+}
+
+#else /* !HAVE_SENDMMSG */
+
+static void
+send_queues_attach(void)
+{
+}
+
+static void
+send_queue_free(struct iface_port *ifp UNUSED)
+{
+}
+
+static bool
+send_queue_blocked(const struct iface_port *ifp UNUSED)
+{
+    return FALSE;
+}
+
+void
+flush_send_queues(void)
+{
+}
+
+void
+show_send_queue_status(void)
+{
+}
+
+#endif /* !HAVE_SENDMMSG */
+
+/* write one packet now, with the marker in front if asked */
+static ssize_t
+send_packet_now(const struct iface_port *ifp, u_int8_t *ptr
+		, size_t len, bool marker, ip_address *to)
+{
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    zero(&msg);
+    msg.msg_iov = iov;
+    if (marker)
+    {
+	iov[msg.msg_iovlen].iov_base = &non_esp_marker;
+	iov[msg.msg_iovlen].iov_len = sizeof(non_esp_marker);
+	msg.msg_iovlen++;
+    }
+    iov[msg.msg_iovlen].iov_base = ptr;
+    iov[msg.msg_iovlen].iov_len = len;
+    msg.msg_iovlen++;
+    msg.msg_name = sockaddrof(to);
+    msg.msg_namelen = sockaddrlenof(to);
+
+#if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
+    (void) check_msg_errqueue(ifp, POLLOUT);
+#endif /* defined(IP_RECVERR) && defined(MSG_ERRQUEUE) */
+
+    return sendmsg(ifp->fd, &msg, 0);
+}
+
 bool
 send_packet(struct state *st, const char *where, bool verbose)
 {
-    u_int8_t ike_pkt[MAX_OUTPUT_UDP_SIZE];
-    u_int8_t *ptr;
-    unsigned long len;
+    const struct iface_port *ifp = st->st_interface;
+    u_int8_t *ptr = st->st_tpacket.ptr;
+    size_t len = st->st_tpacket.len;
+    bool marker;
     ssize_t wlen;
 
-/*NATȷǷҪUDPװҪֻ轫еıƶ4ֽ(ȫ0),Ȼͼ
-*ͷЭջ,IPͷudpͷ
-*/
-    if ((st->st_interface->ike_float == TRUE) && (st->st_tpacket.len != 1)) {
-	if ((unsigned long) st->st_tpacket.len >
-	    (MAX_OUTPUT_UDP_SIZE-sizeof(u_int32_t))) {
-	    DBG_log("send_packet(): really too big");
-	    return FALSE;
-	}
-	ptr = ike_pkt;
-	/** Add Non-ESP marker **/
-	memset(ike_pkt, 0, sizeof(u_int32_t));
-	memcpy(ike_pkt + sizeof(u_int32_t), st->st_tpacket.ptr,
-	       (unsigned long)st->st_tpacket.len);
-	len = (unsigned long) st->st_tpacket.len + sizeof(u_int32_t);
-    }
-    else {
-	ptr = st->st_tpacket.ptr;
-	len = (unsigned long) st->st_tpacket.len;
+    /* Packets to port 4500 carry a Non-ESP marker (four zero bytes)
+     * in front of the IKE header, except for NAT-T keepalives.
+     */
+    marker = ifp->ike_float == TRUE && len != 1;
+    if (marker && len > MAX_OUTPUT_UDP_SIZE - sizeof(non_esp_marker))
+    {
+	DBG_log("send_packet(): really too big");
+	return FALSE;
     }
 
     DBG(DBG_CONTROL|DBG_RAW
 	, DBG_log("sending %lu bytes for %s through %s:%d to %s:%u (using #%lu)"
 		  , (unsigned long) st->st_tpacket.len
 		  , where
-		  , st->st_interface->ip_dev->id_rname
-		  , st->st_interface->port
+		  , ifp->ip_dev->id_rname
+		  , ifp->port
 		  , ip_str(&st->st_remoteaddr)
 		  , st->st_remoteport
 		  , st->st_serialno));
@@ -1140,15 +2028,19 @@ send_packet(struct state *st, const char *where, bool verbose)
 
     setportof(htons(st->st_remoteport), &st->st_remoteaddr);
 
-#if defined(IP_RECVERR) && defined(MSG_ERRQUEUE)
-    (void) check_msg_errqueue(st->st_interface, POLLOUT);
-#endif /* defined(IP_RECVERR) && defined(MSG_ERRQUEUE) */
+#ifdef HAVE_SENDMMSG
+    if (ifp->sendq != NULL && len <= SEND_QUEUE_BYTES
+#ifdef DEBUG
+	&& !DBGP(IMPAIR_JACOB_TWO_TWO)
+#endif
+	)
+	return send_queue_add(ifp, ptr, len, marker, &st->st_remoteaddr
+			      , where, verbose);
+
+    send_queue_flush(ifp);	/* keep the order */
+#endif
 
-    wlen = sendto(st->st_interface->fd
-		  , ptr
-		  , len, 0
-		  , sockaddrof(&st->st_remoteaddr)
-		  , sockaddrlenof(&st->st_remoteaddr));
+    wlen = send_packet_now(ifp, ptr, len, marker, &st->st_remoteaddr);
 
 #ifdef DEBUG
     /* XXX This is a flow change depending on debug. not good. I assume it is only useful
@@ -1161,26 +2053,22 @@ send_packet(struct state *st, const char *where, bool verbose)
 	DBG_log("JACOB 2-2: resending %lu bytes for %s through %s:%d to %s:%u:"
 		, (unsigned long) st->st_tpacket.len
 		, where
-		, st->st_interface->ip_dev->id_rname
-		, st->st_interface->port
+		, ifp->ip_dev->id_rname
+		, ifp->port
 		, ip_str(&st->st_remoteaddr)
 		, st->st_remoteport);
 
-	wlen = sendto(st->st_interface->fd
-		      , ptr
-		      , len, 0
-		      , sockaddrof(&st->st_remoteaddr)
-		      , sockaddrlenof(&st->st_remoteaddr));
+	wlen = send_packet_now(ifp, ptr, len, marker, &st->st_remoteaddr);
     }
 #endif
 
-    if (wlen != (ssize_t)len)
+    if (wlen != (ssize_t)(len + (marker ? sizeof(non_esp_marker) : 0)))
     {
         /* do not log NAT-T Keep Alive packets */
         if (!verbose)
 	    return FALSE;
 	log_errno((e, "sendto on %s to %s:%u failed in %s"
-		   , st->st_interface->ip_dev->id_rname
+		   , ifp->ip_dev->id_rname
 		   , ip_str(&st->st_remoteaddr)
 		   , st->st_remoteport
 		   , where));
@@ -282,6 +282,8 @@ enum ikev2_trans_type_encr v1tov2_encr(int oakley)
 	return IKEv2_ENCR_CAST;
     case OAKLEY_AES_CBC:
 	return IKEv2_ENCR_AES_CBC;
+    case OAKLEY_AES_GCM_C:
+	return IKEv2_ENCR_AES_GCM_16;
     case OAKLEY_TWOFISH_CBC_SSH:
     case OAKLEY_TWOFISH_CBC:
     case OAKLEY_SERPENT_CBC:
@@ -333,6 +335,25 @@ static enum ikev2_trans_type_prf v1tov2_prf(int oakley)
     }
 }
 
+/*
+ * AEAD ciphers (RFC 5282) authenticate the SK payload themselves:
+ * a proposal with one has no INTEG transform, or only INTEG NONE.
+ */
+static bool v2_encr_aead(unsigned int encr_transid)
+{
+    switch(encr_transid) {
+    case IKEv2_ENCR_AES_CCM_8:
+    case IKEv2_ENCR_AES_CCM_12:
+    case IKEv2_ENCR_AES_CCM_16:
+    case IKEv2_ENCR_AES_GCM_8:
+    case IKEv2_ENCR_AES_GCM_12:
+    case IKEv2_ENCR_AES_GCM_16:
+	return TRUE;
+    default:
+	return FALSE;
+    }
+}
+
 struct db_sa *sa_v2_convert(struct db_sa *f)
 {
     unsigned int pcc, prc, tcc, pr_cnt, pc_cnt, propnum;
@@ -453,7 +474,9 @@ struct db_sa *sa_v2_convert(struct db_sa *f)
 
 	dtfone = &dtfset[i];
 
-	if(dtfone->protoid == PROTO_ISAKMP) tr_cnt = 4;
+	if(dtfone->protoid == PROTO_ISAKMP) {
+	    tr_cnt = v2_encr_aead(dtfone->encr_transid) ? 3 : 4;
+	}
 	else tr_cnt=3;
 
 	if(dtflast != NULL) {
@@ -517,9 +540,12 @@ struct db_sa *sa_v2_convert(struct db_sa *f)
 	}
 	tr_pos++;
 
-	tr[tr_pos].transid        = dtfone->integ_transid;
-	tr[tr_pos].transform_type = IKEv2_TRANS_TYPE_INTEG;
-	tr_pos++;
+	if(dtfone->protoid != PROTO_ISAKMP
+	   || !v2_encr_aead(dtfone->encr_transid)) {
+	    tr[tr_pos].transid        = dtfone->integ_transid;
+	    tr[tr_pos].transform_type = IKEv2_TRANS_TYPE_INTEG;
+	    tr_pos++;
+	}
 
 	if(dtfone->protoid == PROTO_ISAKMP) {
 	    /* XXX Let the user set the PRF.*/
@@ -599,6 +625,16 @@ spdb_v2_match_parent(struct db_sa *sadb
 
     encr_matched=integ_matched=prf_matched=dh_matched=FALSE;
 
+    /* an AEAD cipher has its own integrity: one with an INTEG is bogus */
+    if(v2_encr_aead(encr_transform) && integ_transform != IKEv2_AUTH_NONE) {
+	DBG(DBG_CONTROLMORE
+	    , DBG_log("proposal %u failed: AEAD encr=%s with integ=%s"
+		      , propnum
+		      , enum_name(&trans_type_encr_names, encr_transform)
+		      , enum_show(&trans_type_integ_names, integ_transform)));
+	return FALSE;
+    }
+
     for(pd_cnt=0; pd_cnt < sadb->prop_disj_cnt; pd_cnt++) {
 	struct db_v2_prop_conj  *pj;
 	struct db_v2_trans      *tr;
@@ -614,6 +650,10 @@ spdb_v2_match_parent(struct db_sa *sadb
 	pj = &pd->props[0];
 	if(pj->protoid  != PROTO_ISAKMP) continue;
 
+	/* our AEAD proposals have no INTEG, so offering NONE matches */
+	if(integ_transform == IKEv2_AUTH_NONE && v2_encr_aead(encr_transform))
+	    integ_matched=TRUE;
+
 	for(tr_cnt=0; tr_cnt < pj->trans_cnt; tr_cnt++) {
 	   int keylen = -1;
 	   unsigned int attr_cnt;
@@ -721,9 +761,21 @@ ikev2_match_transform_list_parent(struct db_sa *sadb
 	return FALSE;
     }
     if(itl->integ_trans_next < 1) {
-	openswan_log("ignored proposal %u with no integrity transforms",
-		     propnum);
-	return FALSE;
+	unsigned int i;
+
+	for(i=0; i < itl->encr_trans_next; i++) {
+	    if(v2_encr_aead(itl->encr_transforms[i]))
+		break;
+	}
+	if(i == itl->encr_trans_next) {
+	    openswan_log("ignored proposal %u with no integrity transforms",
+			 propnum);
+	    return FALSE;
+	}
+	/* AEAD: no INTEG is as if INTEG NONE had been offered */
+	itl->integ_transforms[0] = IKEv2_AUTH_NONE;
+	itl->integ_keylens[0] = -1;
+	itl->integ_trans_next = 1;
     }
     if(itl->prf_trans_next < 1) {
 	openswan_log("ignored proposal %u with no prf transforms",
@@ -863,7 +915,7 @@ ikev2_emit_winning_sa(
     }
 
     if(parentSA) {
-	r_proposal.isap_numtrans = 4;
+	r_proposal.isap_numtrans = ta.integ_hasher ? 4 : 3;
     } else {
 	r_proposal.isap_numtrans = 3;
     }
@@ -891,14 +943,16 @@ ikev2_emit_winning_sa(
 		, &r_trans_pbs);
     close_output_pbs(&r_trans_pbs);
 
-    /* Transform - integrity check */
-    r_trans.isat_type= IKEv2_TRANS_TYPE_INTEG;
-    r_trans.isat_transid = ta.integ_hash;
-    r_trans.isat_np = ISAKMP_NEXT_T;
-    if(!out_struct(&r_trans, &ikev2_trans_desc
-		   , &r_proposal_pbs, &r_trans_pbs))
-	impossible();
-    close_output_pbs(&r_trans_pbs);
+    /* Transform - integrity check, but not with an AEAD cipher */
+    if(!parentSA || ta.integ_hasher) {
+	r_trans.isat_type= IKEv2_TRANS_TYPE_INTEG;
+	r_trans.isat_transid = ta.integ_hash;
+	r_trans.isat_np = ISAKMP_NEXT_T;
+	if(!out_struct(&r_trans, &ikev2_trans_desc
+		       , &r_proposal_pbs, &r_trans_pbs))
+	    impossible();
+	close_output_pbs(&r_trans_pbs);
+    }
 
     if(parentSA) {
 	/* Transform - PRF hash */
@@ -1099,8 +1153,18 @@ ikev2_parse_parent_sa_body(
 	ta.enckeylen = ta.encrypter->keydeflen;
 /*Թϣ㷨*/
     ta.integ_hash  = itl->integ_transforms[itl->integ_i];
-    ta.integ_hasher= (struct hash_desc *)ike_alg_ikev2_find(IKE_ALG_INTEG,ta.integ_hash, 0);
-    passert(ta.integ_hasher != NULL);
+    if(ike_alg_enc_aead(ta.encrypter)) {
+	if(ta.integ_hash != IKEv2_AUTH_NONE) {
+	    openswan_log("proposal %u has AEAD cipher %s with an integrity transform"
+			 , winning_prop.isap_propnum
+			 , enum_name(&trans_type_encr_names, ta.encrypt));
+	    return NO_PROPOSAL_CHOSEN;
+	}
+	ta.integ_hasher= NULL;
+    } else {
+	ta.integ_hasher= (struct hash_desc *)ike_alg_ikev2_find(IKE_ALG_INTEG,ta.integ_hash, 0);
+	passert(ta.integ_hasher != NULL);
+    }
 /*PRFϣ㷨*/
     ta.prf_hash    = itl->prf_transforms[itl->prf_i];
     ta.prf_hasher  = (struct hash_desc *)ike_alg_ikev2_find(IKE_ALG_HASH, ta.prf_hash, 0);
@@ -52,6 +52,7 @@
 #include "whack.h"
 #include "demux.h"	/* needs packet.h */
 #include "pending.h"
+#include "hostpair.h"
 #include "ipsec_doi.h"	/* needs demux.h and state.h */
 
 #include "sha1.h"
@@ -91,36 +92,121 @@
  * so that we don't allocate one in use.
  */
 
-struct msgid_list
+/*
+ * The used msgids are kept in a hash set with linear probing, at most
+ * half full.  It starts at MSGID_SET_MIN_BITS and doubles as needed:
+ * a msgid is never forgotten while the ISAKMP SA lives, or a peer could
+ * replay an old one once it had been pushed out.  That is 8 to 16
+ * bytes and a probe or two per msgid, however many Quick Mode rekeys
+ * and DPD exchanges the SA carries.
+ */
+
+static inline unsigned int
+msgid_set_home(const struct msgid_set *s, msgid_t msgid)
 {
-    msgid_t               msgid; /* network order */
-    struct msgid_list     *next;
-};
+    /* msgids from the peer need not be random, so mix them */
+    return (u_int32_t)(msgid * 2654435761U) >> (32 - s->bits);
+}
+
+static inline unsigned int
+msgid_set_capacity(const struct msgid_set *s)
+{
+    return (1U << s->bits) / 2;
+}
+
+static bool
+msgid_set_find(const struct msgid_set *s, msgid_t msgid)
+{
+    unsigned int mask = (1U << s->bits) - 1;
+    unsigned int i;
+
+    for (i = msgid_set_home(s, msgid); s->table[i] != MAINMODE_MSGID
+	     ; i = (i + 1) & mask)
+    {
+	if (s->table[i] == msgid)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+msgid_set_insert(struct msgid_set *s, msgid_t msgid)
+{
+    unsigned int mask = (1U << s->bits) - 1;
+    unsigned int i = msgid_set_home(s, msgid);
+
+    while (s->table[i] != MAINMODE_MSGID)
+	i = (i + 1) & mask;
+    s->table[i] = msgid;
+}
+
+static void
+msgid_set_alloc(struct msgid_set *s, unsigned int bits)
+{
+    s->bits = bits;
+    s->table = alloc_bytes((1U << bits) * sizeof(msgid_t), "msgid table");
+}
+
+static void
+msgid_set_grow(struct msgid_set *s)
+{
+    msgid_t *old_table = s->table;
+    unsigned int old_slots = 1U << s->bits;
+    unsigned int i;
+
+    msgid_set_alloc(s, s->bits + 1);
+    for (i = 0; i < old_slots; i++)
+    {
+	if (old_table[i] != MAINMODE_MSGID)
+	    msgid_set_insert(s, old_table[i]);
+    }
+    pfree(old_table);
+}
+
+static void
+free_msgid_set(struct msgid_set *s)
+{
+    if (s != NULL)
+    {
+	pfree(s->table);
+	pfree(s);
+    }
+}
 
 bool
 unique_msgid(struct state *isakmp_sa, msgid_t msgid)
 {
-    struct msgid_list *p;
-
     passert(msgid != MAINMODE_MSGID);
     passert(IS_ISAKMP_ENCRYPTED(isakmp_sa->st_state));
 
-    for (p = isakmp_sa->st_used_msgids; p != NULL; p = p->next)
-	if (p->msgid == msgid)
-	    return FALSE;
-
-    return TRUE;
+    return isakmp_sa->st_used_msgids == NULL
+	|| !msgid_set_find(isakmp_sa->st_used_msgids, msgid);
 }
 
 void
 reserve_msgid(struct state *isakmp_sa, msgid_t msgid)
 {
-    struct msgid_list *p;
+    struct msgid_set *s = isakmp_sa->st_used_msgids;
+
+    if (msgid == MAINMODE_MSGID)
+	return;
+
+    if (s == NULL)
+    {
+	s = alloc_thing(struct msgid_set, "msgid set");
+	msgid_set_alloc(s, MSGID_SET_MIN_BITS);
+	isakmp_sa->st_used_msgids = s;
+    }
+    else if (msgid_set_find(s, msgid))
+    {
+	return;
+    }
 
-    p = alloc_thing(struct msgid_list, "msgid");
-    p->msgid = msgid;
-    p->next = isakmp_sa->st_used_msgids;
-    isakmp_sa->st_used_msgids = p;
+    if (s->count == msgid_set_capacity(s))
+	msgid_set_grow(s);
+
+    msgid_set_insert(s, msgid);
+    s->count++;
 }
 
 msgid_t
@@ -148,32 +234,507 @@ generate_msgid(struct state *isakmp_sa)
 }
 
 
-/* state table functions */
+/* state table functions
+ *
+ * The state table is a hash table keyed by the cookie pair.  It
+ * starts out with STATE_TABLE_SIZE buckets (which must be a power of
+ * two), and doubles or halves as the number of states changes.
+ *
+ * Resizing is incremental: a resize only allocates the new bucket
+ * array, and state_table_rehash_step(), called from the main loop,
+ * moves a few old buckets at a time.  A bucket is moved as a whole, so
+ * states that share cookies (a parent and its children) are always on
+ * the same chain.  Since states only move between tables in the main
+ * loop, the walks in this file may delete and insert states freely.
+ */
 
 #ifndef STATE_TABLE_SIZE
 #define STATE_TABLE_SIZE 32
 #endif
 
+/* grow when the average chain is longer than this */
+#define STATE_TABLE_MAX_LOAD    2
+/* shrink when the average chain is shorter than 1/this */
+#define STATE_TABLE_MIN_LOAD    8
+/* old buckets moved per call to state_table_rehash_step() */
+#define STATE_TABLE_REHASH_STEP 64
+
+struct state_table {
+    struct state **buckets;
+    unsigned int   size;		/* power of two */
+};
+
+/* the minimal table is static, so small setups never allocate */
 static struct state *statetable[STATE_TABLE_SIZE];
 
+/* [0] is the live table; [1] is its replacement while rehashing */
+static struct state_table state_tables[2] = {
+    { statetable, STATE_TABLE_SIZE },
+    { NULL, 0 },
+};
+static bool state_rehashing = FALSE;
+static unsigned int state_rehash_idx;	/* [0] buckets below this have moved */
+
+static unsigned int state_count;	/* states in the table */
+static unsigned long state_table_grows;
+static unsigned long state_table_shrinks;
+
+/* key for compute_icookie_rcookie_hash(), set up by init_states() */
+static bool state_hash_keyed = FALSE;
+static u_int64_t state_hash_key[2];
+
+#define ROTL64(x, b) (u_int64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND(v0, v1, v2, v3) do { \
+	v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+	v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+	v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+	v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+    } while (0)
+
+static u_int64_t
+cookie_to_u64(const u_char *cookie)
+{
+    u_int64_t v = 0;
+    int j;
+
+    for (j = COOKIE_SIZE - 1; j >= 0; j--)
+	v = (v << 8) | cookie[j];
+    return v;
+}
+
+/*
+ * Hash a cookie pair into a state table bucket number.
+ *
+ * Once pluto has keyed the hash this is SipHash-2-4 of the two
+ * cookies, so a peer choosing its cookies cannot aim them all at one
+ * chain.  Before that (the unit tests never key it) the historic
+ * polynomial is used, which keeps recorded bucket numbers stable.
+ */
+u_int
+compute_icookie_rcookie_hash(const u_char *icookie, const u_char *rcookie)
+{
+    u_int64_t v0, v1, v2, v3, m;
+    int r;
+
+    if (!state_hash_keyed) {
+	u_int i = 0, j;
+
+	for (j = 0; j < COOKIE_SIZE; j++)
+	    i = i * 407 + icookie[j] + rcookie[j];
+	return i;
+    }
+
+    v0 = state_hash_key[0] ^ 0x736f6d6570736575ULL;
+    v1 = state_hash_key[1] ^ 0x646f72616e646f6dULL;
+    v2 = state_hash_key[0] ^ 0x6c7967656e657261ULL;
+    v3 = state_hash_key[1] ^ 0x7465646279746573ULL;
+
+    m = cookie_to_u64(icookie);
+    v3 ^= m;
+    for (r = 0; r < 2; r++)
+	SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+
+    m = cookie_to_u64(rcookie);
+    v3 ^= m;
+    for (r = 0; r < 2; r++)
+	SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+
+    m = (u_int64_t)(2 * COOKIE_SIZE) << 56;
+    v3 ^= m;
+    for (r = 0; r < 2; r++)
+	SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    for (r = 0; r < 4; r++)
+	SIPROUND(v0, v1, v2, v3);
+
+    return (u_int)(v0 ^ v1 ^ v2 ^ v3);
+}
+
+#undef SIPROUND
+#undef ROTL64
+
+/* find the chain for a hash value, in whichever table it lives now */
+static struct state **
+state_table_chain(u_int hash, unsigned *state_bucket)
+{
+    struct state_table *t = &state_tables[0];
+    u_int bucket = hash & (t->size - 1);
+
+    if (state_rehashing && bucket < state_rehash_idx) {
+	t = &state_tables[1];
+	bucket = hash & (t->size - 1);
+    }
+
+    if(state_bucket) {
+        *state_bucket = bucket;
+    }
+    return &t->buckets[bucket];
+}
+
 static struct state **
 state_hash(const u_char *icookie, const u_char *rcookie, unsigned *state_bucket)
 {
     u_int bucket;
+    struct state **p;
 
     DBG(DBG_RAW | DBG_CONTROL,
 	DBG_dump("ICOOKIE:", icookie, COOKIE_SIZE);
 	DBG_dump("RCOOKIE:", rcookie, COOKIE_SIZE));
 
-    bucket = compute_icookie_rcookie_hash(icookie, rcookie);
-    bucket %= STATE_TABLE_SIZE;
+    p = state_table_chain(compute_icookie_rcookie_hash(icookie, rcookie)
+			  , &bucket);
 
     DBG(DBG_CONTROL, DBG_log("state hash entry %d", bucket));
     if(state_bucket) {
         *state_bucket = bucket;
     }
 
-    return &statetable[bucket];
+    return p;
+}
+
+/*
+ * Walking the whole table: chains 0 .. state_walk_size()-1 cover every
+ * state exactly once, including while a rehash is in progress.
+ */
+static unsigned int
+state_walk_size(void)
+{
+    return state_tables[0].size
+	+ (state_rehashing ? state_tables[1].size : 0);
+}
+
+static struct state *
+state_walk_chain(unsigned int i)
+{
+    if (i < state_tables[0].size)
+	return state_tables[0].buckets[i];
+    return state_tables[1].buckets[i - state_tables[0].size];
+}
+
+static void
+state_table_free_buckets(struct state_table *t)
+{
+    if (t->buckets != statetable)
+	pfree(t->buckets);
+    t->buckets = NULL;
+    t->size = 0;
+}
+
+/*
+ * Start moving to a table of newsize buckets.  Nothing moves yet;
+ * state_table_rehash_step() does that.
+ */
+static void
+state_table_resize(unsigned int newsize)
+{
+    struct state_table *nt = &state_tables[1];
+
+    if (state_rehashing || newsize == state_tables[0].size)
+	return;
+
+    if (newsize == STATE_TABLE_SIZE) {
+	memset(statetable, 0, sizeof(statetable));
+	nt->buckets = statetable;
+    } else {
+	nt->buckets = alloc_bytes(newsize * sizeof(struct state *)
+				  , "state hash table");
+    }
+    nt->size = newsize;
+
+    if (newsize > state_tables[0].size)
+	state_table_grows++;
+    else
+	state_table_shrinks++;
+
+    state_rehashing = TRUE;
+    state_rehash_idx = 0;
+
+    DBG(DBG_CONTROL
+	, DBG_log("state table resizing from %u to %u buckets for %u states"
+		  , state_tables[0].size, newsize, state_count));
+}
+
+static void
+state_table_check_load(void)
+{
+    unsigned int size = state_tables[0].size;
+
+    if (state_count > size * STATE_TABLE_MAX_LOAD)
+	state_table_resize(size * 2);
+    else if (size > STATE_TABLE_SIZE
+	     && state_count < size / STATE_TABLE_MIN_LOAD)
+	state_table_resize(size / 2);
+}
+
+/*
+ * Secondary indexes.
+ *
+ * Each hashed state is also on one chain of each of three more hash
+ * tables, keyed by serial number, by parent serial number (so a parent
+ * SA finds its children even after it is gone itself) and by peer
+ * address, and on the state list of its connection.  The chains are
+ * BSD LIST_s, so a state unlinks itself without a search.
+ *
+ * The index tables have as many chains as the state table, and are
+ * rebuilt in one go when a resize of the state table completes.
+ */
+struct state_index_table {
+    struct state_list *heads;
+    unsigned int       size;		/* power of two */
+};
+
+static struct state_list state_index_initial[STATE_INDEX_ROOF][STATE_TABLE_SIZE];
+
+static struct state_index_table state_indexes[STATE_INDEX_ROOF] = {
+    { state_index_initial[STATE_INDEX_SERIAL], STATE_TABLE_SIZE },
+    { state_index_initial[STATE_INDEX_PARENT], STATE_TABLE_SIZE },
+    { state_index_initial[STATE_INDEX_PEER],   STATE_TABLE_SIZE },
+};
+
+static u_int
+state_serial_hash(so_serial_t sn)
+{
+    /* serial numbers are ours, and handed out in sequence */
+    return (u_int)sn;
+}
+
+static u_int
+state_peer_hash(const ip_address *addr)
+{
+    u_char buf[2 * COOKIE_SIZE];
+    unsigned char *bytes;
+    size_t len = addrbytesptr(addr, &bytes);
+
+    /* the peer picks its address, so use the keyed hash */
+    zero(&buf);
+    memcpy(buf, bytes, len < sizeof(buf) ? len : sizeof(buf));
+    return compute_icookie_rcookie_hash(buf, buf + COOKIE_SIZE);
+}
+
+static u_int
+state_index_hash(const struct state *st, enum state_index ix)
+{
+    switch (ix)
+    {
+    case STATE_INDEX_SERIAL:
+	return state_serial_hash(st->st_serialno);
+    case STATE_INDEX_PARENT:
+	return state_serial_hash(st->st_clonedfrom);
+    case STATE_INDEX_PEER:
+    default:
+	return state_peer_hash(&st->st_remoteaddr);
+    }
+}
+
+static struct state_list *
+state_index_chain(enum state_index ix, u_int hash)
+{
+    struct state_index_table *t = &state_indexes[ix];
+
+    return &t->heads[hash & (t->size - 1)];
+}
+
+static void
+state_index_link_one(struct state *st, enum state_index ix)
+{
+    struct state_list *head = state_index_chain(ix, state_index_hash(st, ix));
+
+    LIST_INSERT_HEAD(head, st, st_index_link[ix]);
+}
+
+static void
+state_index_unlink_one(struct state *st, enum state_index ix)
+{
+    if (st->st_index_link[ix].le_prev != NULL)
+    {
+	LIST_REMOVE(st, st_index_link[ix]);
+	st->st_index_link[ix].le_next = NULL;
+	st->st_index_link[ix].le_prev = NULL;
+    }
+}
+
+static void
+state_conn_link(struct state *st)
+{
+    if (st->st_connection != NULL)
+    {
+	LIST_INSERT_HEAD(&st->st_connection->states, st, st_conn_link);
+    }
+}
+
+static void
+state_conn_unlink(struct state *st)
+{
+    if (st->st_conn_link.le_prev != NULL)
+    {
+	LIST_REMOVE(st, st_conn_link);
+	st->st_conn_link.le_next = NULL;
+	st->st_conn_link.le_prev = NULL;
+    }
+}
+
+/*
+ * Put a state that is going into the state table on every index.
+ * Whatever is in its links is ignored: states are sometimes copied
+ * wholesale from another state.
+ */
+static void
+state_index_link(struct state *st)
+{
+    int ix;
+
+    for (ix = 0; ix < STATE_INDEX_ROOF; ix++)
+	state_index_link_one(st, ix);
+
+    st->st_conn_link.le_next = NULL;
+    st->st_conn_link.le_prev = NULL;
+    state_conn_link(st);
+}
+
+static void
+state_index_unlink(struct state *st)
+{
+    int ix;
+
+    for (ix = 0; ix < STATE_INDEX_ROOF; ix++)
+	state_index_unlink_one(st, ix);
+    state_conn_unlink(st);
+}
+
+/* move every index to newsize chains */
+static void
+state_index_resize(unsigned int newsize)
+{
+    int ix;
+
+    for (ix = 0; ix < STATE_INDEX_ROOF; ix++)
+    {
+	struct state_index_table *t = &state_indexes[ix];
+	struct state_list *old = t->heads;
+	unsigned int oldsize = t->size;
+	unsigned int i;
+
+	if (newsize == oldsize)
+	    continue;
+
+	if (newsize == STATE_TABLE_SIZE) {
+	    memset(state_index_initial[ix], 0, sizeof(state_index_initial[ix]));
+	    t->heads = state_index_initial[ix];
+	} else {
+	    t->heads = alloc_bytes(newsize * sizeof(struct state_list)
+				   , "state index table");
+	}
+	t->size = newsize;
+
+	for (i = 0; i < oldsize; i++)
+	{
+	    struct state *st;
+
+	    while ((st = old[i].lh_first) != NULL)
+	    {
+		LIST_REMOVE(st, st_index_link[ix]);
+		state_index_link_one(st, ix);
+	    }
+	}
+
+	if (old != state_index_initial[ix])
+	    pfree(old);
+    }
+}
+
+/*
+ * Move a few buckets of an in-progress resize.
+ * Only call this where no walk of the state table can be active,
+ * i.e. from the main loop.
+ */
+void
+state_table_rehash_step(void)
+{
+    struct state_table *ot = &state_tables[0];
+    struct state_table *nt = &state_tables[1];
+    unsigned int moved = 0;
+
+    if (!state_rehashing)
+	return;
+
+    while (state_rehash_idx < ot->size && moved < STATE_TABLE_REHASH_STEP)
+    {
+	struct state *st = ot->buckets[state_rehash_idx];
+
+	ot->buckets[state_rehash_idx] = NULL;
+
+	/* push each state onto the head of its new chain */
+	while (st != NULL)
+	{
+	    struct state *next = st->st_hashchain_next;
+	    struct state **p = &nt->buckets[
+		compute_icookie_rcookie_hash(st->st_icookie, st->st_rcookie)
+		& (nt->size - 1)];
+
+	    st->st_hashchain_prev = NULL;
+	    st->st_hashchain_next = *p;
+	    if (*p != NULL)
+		(*p)->st_hashchain_prev = st;
+	    *p = st;
+	    st = next;
+	}
+	state_rehash_idx++;
+	moved++;
+    }
+
+    if (state_rehash_idx == ot->size)
+    {
+	state_table_free_buckets(ot);
+	*ot = *nt;
+	nt->buckets = NULL;
+	nt->size = 0;
+	state_rehashing = FALSE;
+	state_index_resize(ot->size);
+
+	DBG(DBG_CONTROL
+	    , DBG_log("state table now has %u buckets for %u states"
+		      , ot->size, state_count));
+
+	/* the load may have moved on while we were busy */
+	state_table_check_load();
+    }
+}
+
+/*
+ * Report the shape of the state table: its load factor and how long
+ * its chains are.
+ */
+void
+show_state_table_status(void)
+{
+    unsigned int i, used = 0, longest = 0;
+    unsigned int size = state_walk_size();
+
+    for (i = 0; i < size; i++)
+    {
+	struct state *st;
+	unsigned int len = 0;
+
+	for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
+	    len++;
+	if (len != 0)
+	    used++;
+	if (len > longest)
+	    longest = len;
+    }
+
+    whack_log(RC_COMMENT, "stats state table: states=%u buckets=%u"
+	      " load=%u.%02u used=%u longest=%u grows=%lu shrinks=%lu%s"
+	      , state_count, state_tables[0].size
+	      , state_count / state_tables[0].size
+	      , (state_count * 100 / state_tables[0].size) % 100
+	      , used, longest
+	      , state_table_grows, state_table_shrinks
+	      , state_rehashing ? " (rehashing)" : "");
 }
 
 /* Get a state object.
@@ -212,16 +773,19 @@ init_states(void)
 {
     int i;
 
+    passert(state_count == 0);
     for (i = 0; i < STATE_TABLE_SIZE; i++)
 	statetable[i] = (struct state *) NULL;
+
+    /* key the cookie hash, so that bucket choice is not up to the peer */
+    get_rnd_bytes((u_char *)state_hash_key, sizeof(state_hash_key));
+    state_hash_keyed = TRUE;
 }
 
 /* Find the state object with this serial number.
  * This allows state object references that don't turn into dangerous
  * dangling pointers: reference a state by its serial number.
  * Returns NULL if there is no such state.
- * If this turns out to be a significant CPU hog, it could be
- * improved to use a hash table rather than sequential seartch.
  */
 struct state *
 state_with_serialno(so_serial_t sn)
@@ -229,12 +793,13 @@ state_with_serialno(so_serial_t sn)
     if (sn >= SOS_FIRST)
     {
 	struct state *st;
-	int i;
 
-	for (i = 0; i < STATE_TABLE_SIZE; i++)
-	    for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
-		if (st->st_serialno == sn)
-		    return st;
+	for (st = state_index_chain(STATE_INDEX_SERIAL
+				    , state_serial_hash(sn))->lh_first
+		 ; st != NULL
+		 ; st = st->st_index_link[STATE_INDEX_SERIAL].le_next)
+	    if (st->st_serialno == sn)
+		return st;
     }
     return NULL;
 }
@@ -262,6 +827,10 @@ insert_state(struct state *st)
     }
     st->st_hashchain_next = *p;
     *p = st;
+    state_index_link(st);
+
+    state_count++;
+    state_table_check_load();
 
     /* Ensure that somebody is in charge of killing this state:
      * if no event is scheduled for it, schedule one to discard the state.
@@ -303,6 +872,8 @@ rehash_state(struct state *st)
     }
 
     st->st_hashchain_next = st->st_hashchain_prev = NULL;
+    state_index_unlink(st);
+    state_count--;
 
     /* now, re-insert */
     insert_state(st);
@@ -364,6 +935,170 @@ unhash_state(struct state *st)
     }
 
     st->st_hashchain_next = st->st_hashchain_prev = NULL;
+    state_index_unlink(st);
+
+    state_count--;
+    state_table_check_load();
+}
+
+/*
+ * Change the connection of a state, keeping the connection's
+ * state list right if the state is in the table.
+ */
+void
+set_state_connection(struct state *st, struct connection *c)
+{
+    state_conn_unlink(st);
+    st->st_connection = c;
+    if (st->st_index_link[STATE_INDEX_SERIAL].le_prev != NULL)
+	state_conn_link(st);
+}
+
+/*
+ * Change the peer address of a state, moving it to the right
+ * peer index chain if the state is in the table.
+ */
+void
+set_state_remoteaddr(struct state *st, const ip_address *addr)
+{
+    bool hashed = st->st_index_link[STATE_INDEX_PEER].le_prev != NULL;
+
+    state_index_unlink_one(st, STATE_INDEX_PEER);
+    st->st_remoteaddr = *addr;
+    if (hashed)
+	state_index_link_one(st, STATE_INDEX_PEER);
+}
+
+/*
+ * Half-open IKE SAs: IKEv2 parents we answered an IKE_SA_INIT for, that
+ * have not authenticated yet.  They are counted in total and per source
+ * prefix (/24 for IPv4, /64 for IPv6), so the IKE_SA_INIT responder can
+ * tell when to start demanding cookies, and from whom.  A prefix is
+ * only kept while it has half-open SAs.
+ */
+#define HALF_OPEN_BUCKETS	1024
+
+struct half_open_prefix {
+    struct half_open_prefix *next;
+    u_char        key[COOKIE_SIZE];	/* the prefix bytes, zero padded */
+    int           af;
+    unsigned int  count;
+    bool          busy;			/* demanding cookies from it */
+};
+
+static struct half_open_prefix *half_open_table[HALF_OPEN_BUCKETS];
+static unsigned long half_open_total;
+static unsigned int half_open_prefixes;
+
+static struct half_open_prefix **
+half_open_chain(const u_char *key)
+{
+    static const u_char zero_cookie[COOKIE_SIZE];
+
+    /* the same keyed hash as the state table */
+    return &half_open_table[compute_icookie_rcookie_hash(key, zero_cookie)
+			    % HALF_OPEN_BUCKETS];
+}
+
+static struct half_open_prefix *
+half_open_lookup(const ip_address *addr, bool create)
+{
+    u_char key[COOKIE_SIZE];
+    unsigned char *bytes;
+    size_t len = addrbytesptr(addr, &bytes);
+    int af = addrtypeof(addr);
+    struct half_open_prefix **pp;
+    struct half_open_prefix *p;
+
+    /* a /24 or a /64 */
+    memset(key, 0, sizeof(key));
+    if (len == 4)
+	memcpy(key, bytes, 3);
+    else if (len >= sizeof(key))
+	memcpy(key, bytes, sizeof(key));
+    pp = half_open_chain(key);
+
+    for (p = *pp; p != NULL; p = p->next)
+	if (p->af == af && memcmp(p->key, key, sizeof(key)) == 0)
+	    return p;
+
+    if (!create)
+	return NULL;
+
+    p = alloc_thing(struct half_open_prefix, "half-open prefix");
+    memcpy(p->key, key, sizeof(key));
+    p->af = af;
+    p->next = *pp;
+    *pp = p;
+    half_open_prefixes++;
+    return p;
+}
+
+void
+state_half_open(struct state *st)
+{
+    struct half_open_prefix *p;
+
+    if (st->st_half_open != NULL)
+	return;
+
+    p = half_open_lookup(&st->st_remoteaddr, TRUE);
+    p->count++;
+    half_open_total++;
+    st->st_half_open = p;
+}
+
+void
+state_half_open_done(struct state *st)
+{
+    struct half_open_prefix *p = st->st_half_open;
+
+    if (p == NULL)
+	return;
+
+    st->st_half_open = NULL;
+    half_open_total--;
+    if (--p->count == 0)
+    {
+	struct half_open_prefix **pp = half_open_chain(p->key);
+
+	while (*pp != p)
+	    pp = &(*pp)->next;
+	*pp = p->next;
+	pfree(p);
+	half_open_prefixes--;
+    }
+}
+
+unsigned long
+half_open_count(void)
+{
+    return half_open_total;
+}
+
+unsigned int
+half_open_prefix_count(void)
+{
+    return half_open_prefixes;
+}
+
+/*
+ * Does src's prefix have too many half-open SAs?  It turns busy at on,
+ * and stays busy until it drops below off.
+ */
+bool
+half_open_prefix_busy(const ip_address *src, unsigned int on, unsigned int off)
+{
+    struct half_open_prefix *p = half_open_lookup(src, FALSE);
+
+    if (p == NULL)
+	return FALSE;
+
+    if (!p->busy && p->count >= on)
+	p->busy = TRUE;
+    else if (p->busy && p->count < off)
+	p->busy = FALSE;
+    return p->busy;
 }
 
 /* Free the Whack socket file descriptor.
@@ -380,16 +1115,10 @@ void free_state(struct state *st)
 {
     delete_event(st);	/* delete any pending timer event */
 
-    {
-	struct msgid_list *p = st->st_used_msgids;
+    state_half_open_done(st);
 
-	while (p != NULL)
-	{
-	    struct msgid_list *q = p;
-	    p = p->next;
-	    pfree(q);
-	}
-    }
+    free_msgid_set(st->st_used_msgids);
+    st->st_used_msgids = NULL;
 
     unreference_key(&st->st_peer_pubkey);
 
@@ -421,6 +1150,8 @@ void free_state(struct state *st)
     freeanychunk(st->st_shared);
     freeanychunk(st->st_ni);
     freeanychunk(st->st_nr);
+    free_sk_keys(st);
+    crypt_key_free(&st->st_enc_ctx);
 #ifdef HAVE_LIBNSS
     free_osw_nss_symkey(st->st_skeyid);
     free_osw_nss_symkey(st->st_skey_d);
@@ -562,6 +1293,9 @@ delete_state(struct state *st)
     /* effectively, this deletes any ISAKMP SA that this state represents */
     unhash_state(st);
 
+    /* it is no longer half-open, even though it is not freed yet */
+    state_half_open_done(st);
+
     /* tell kernel to delete any IPSEC SA
      * ??? we ought to tell peer to delete IPSEC SAs
      */
@@ -591,6 +1325,10 @@ delete_state(struct state *st)
     change_state(st, STATE_UNDEFINED);
     release_whack(st);
 
+    /* the SK key schedules are not needed past here: wipe them now,
+     * rather than whenever the state is finally freed */
+    free_sk_keys(st);
+
     /* object is not deleted here, because it still exists in many stack
      * frames, but instead is added to a to-be-freed list */
     mark_state_freed(st);
@@ -603,30 +1341,147 @@ bool
 states_use_connection(struct connection *c)
 {
     /* are there any states still using it? */
-    struct state *st = NULL;
-    int i;
+    return c->states.lh_first != NULL;
+}
 
-    for (i = 0; st == NULL && i < STATE_TABLE_SIZE; i++)
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
-	    if (st->st_connection == c)
-		return TRUE;
+/*
+ * A set of states picked from the indexes, to be visited in the order
+ * a walk of the whole state table would have visited them.  States
+ * are held by serial number, since visiting one may delete others.
+ */
+struct state_set_entry {
+    so_serial_t  serialno;
+    unsigned int chain;		/* as for state_walk_chain() */
+    unsigned int depth;		/* position on that chain */
+};
 
-    return FALSE;
+struct state_set {
+    struct state_set_entry *entries;
+    unsigned int count;
+    unsigned int room;
+};
+
+static void
+state_set_add(struct state_set *set, struct state *st)
+{
+    struct state_set_entry *e;
+    const struct state *head = st;
+    struct state **p;
+    unsigned int depth = 0;
+
+    if (set->count == set->room)
+    {
+	struct state_set_entry *old = set->entries;
+
+	set->room = set->room == 0 ? 16 : set->room * 2;
+	set->entries = alloc_bytes(set->room * sizeof(*e), "state set");
+	if (old != NULL)
+	{
+	    memcpy(set->entries, old, set->count * sizeof(*e));
+	    pfree(old);
+	}
+    }
+
+    while (head->st_hashchain_prev != NULL)
+    {
+	head = head->st_hashchain_prev;
+	depth++;
+    }
+    p = state_table_chain(compute_icookie_rcookie_hash(st->st_icookie
+							, st->st_rcookie)
+			  , NULL);
+    if (*p != head)
+	p = state_table_chain(compute_icookie_rcookie_hash(st->st_icookie
+							    , zero_cookie)
+			      , NULL);
+    passert(*p == head);
+
+    e = &set->entries[set->count++];
+    e->serialno = st->st_serialno;
+    e->depth = depth;
+    if (p >= state_tables[0].buckets
+	&& p < state_tables[0].buckets + state_tables[0].size)
+	e->chain = p - state_tables[0].buckets;
+    else
+	e->chain = state_tables[0].size + (p - state_tables[1].buckets);
+}
+
+static int
+state_set_compare(const void *a, const void *b)
+{
+    const struct state_set_entry *ea = a;
+    const struct state_set_entry *eb = b;
+
+    if (ea->chain != eb->chain)
+	return ea->chain < eb->chain ? -1 : 1;
+    if (ea->depth != eb->depth)
+	return ea->depth < eb->depth ? -1 : 1;
+    return 0;
+}
+
+/* put the set in walk order, dropping states that were added twice */
+static void
+state_set_sort(struct state_set *set)
+{
+    unsigned int i, n = 0;
+
+    if (set->count == 0)
+	return;
+
+    qsort(set->entries, set->count, sizeof(set->entries[0])
+	  , state_set_compare);
+    for (i = 1; i < set->count; i++)
+	if (set->entries[i].serialno != set->entries[n].serialno)
+	    set->entries[++n] = set->entries[i];
+    set->count = n + 1;
+}
+
+static void
+state_set_free(struct state_set *set)
+{
+    if (set->entries != NULL)
+	pfree(set->entries);
+    set->entries = NULL;
+    set->count = set->room = 0;
+}
+
+/* the states using c, plus the children of parent_sa */
+static void
+state_set_add_family(struct state_set *set, struct connection *c
+		     , so_serial_t parent_sa)
+{
+    struct state *st;
+
+    for (st = c->states.lh_first; st != NULL; st = st->st_conn_link.le_next)
+	state_set_add(set, st);
+
+    if (parent_sa == SOS_NOBODY)
+	return;
+
+    for (st = state_index_chain(STATE_INDEX_PARENT
+				, state_serial_hash(parent_sa))->lh_first
+	     ; st != NULL
+	     ; st = st->st_index_link[STATE_INDEX_PARENT].le_next)
+	if (st->st_clonedfrom == parent_sa)
+	    state_set_add(set, st);
 }
 
 /*
  * delete all states that were created for a given connection,
  * additionally delete any states for which func(st, arg)
  * returns true.
+ *
+ * Only states using c, or children of parent_sa (if it is not
+ * SOS_NOBODY), are offered to comparefunc.
  */
 static void
 foreach_states_by_connection_func(struct connection *c
+				  , so_serial_t parent_sa
 				  , bool (*comparefunc)(struct state *st, struct connection *c, void *arg, int pass)
 				 , void (*successfunc)(struct state *st, struct connection *c, void *arg)
 				 , void *arg)
 {
     int pass;
-    /* this kludge avoids an n^2 algorithm */
 
     /* We take two passes so that we delete any ISAKMP SAs last.
      * This allows Delete Notifications to be sent.
@@ -635,7 +1490,8 @@ foreach_states_by_connection_func(struct connection *c
      */
     for (pass = 0; pass != 2; pass++)
     {
-	int i;
+	struct state_set set = { NULL, 0, 0 };
+	unsigned int i;
 
         if(pass == 0) {
             DBG(DBG_CONTROL, DBG_log("pass 0: considering CHILD SAs to delete"));
@@ -643,47 +1499,46 @@ foreach_states_by_connection_func(struct connection *c
             DBG(DBG_CONTROL, DBG_log("pass 1: considering PARENT SAs to delete"));
         }
 
-	/* For each hash chain... */
-	for (i = 0; i < STATE_TABLE_SIZE; i++)
-	{
-	    struct state *st;
+	state_set_add_family(&set, c, parent_sa);
+	state_set_sort(&set);
 
-	    /* For each state in the hash chain... */
-	    for (st = statetable[i]; st != NULL; )
-	    {
-		struct state *this = st;
+	for (i = 0; i < set.count; i++)
+	{
+	    /* it may have been deleted along with an earlier one */
+	    struct state *this = state_with_serialno(set.entries[i].serialno);
 
-		st = st->st_hashchain_next;	/* before this is deleted */
+	    if (this == NULL)
+		continue;
 
-		/* on pass 0, ignore phase1 states */
- 		if(pass == 0 && IS_ISAKMP_SA_ESTABLISHED(this->st_state)) {
-		    continue;
-		}
+	    /* on pass 0, ignore phase1 states */
+	    if(pass == 0 && IS_ISAKMP_SA_ESTABLISHED(this->st_state)) {
+		continue;
+	    }
 
-		/* on pass 1, ignore phase2 states */
- 		if(pass == 1 && IS_CHILD_SA(this)) {
-		    continue;
-		}
+	    /* on pass 1, ignore phase2 states */
+	    if(pass == 1 && IS_CHILD_SA(this)) {
+		continue;
+	    }
 
-		/* call comparison function */
-                if ((*comparefunc)(this, c, arg, pass))
-                {
-		    struct state *old_cur_state
-			= cur_state == this? NULL : cur_state;
+	    /* call comparison function */
+	    if ((*comparefunc)(this, c, arg, pass))
+	    {
+		struct state *old_cur_state
+		    = cur_state == this? NULL : cur_state;
 #ifdef DEBUG
-		    lset_t old_cur_debugging = cur_debugging;
+		lset_t old_cur_debugging = cur_debugging;
 #endif
 
-                    set_cur_state(this);
-		    (*successfunc)(this, c, arg);
+		set_cur_state(this);
+		(*successfunc)(this, c, arg);
 
-		    cur_state = old_cur_state;
+		cur_state = old_cur_state;
 #ifdef DEBUG
-		    set_debugging(old_cur_debugging);
+		set_debugging(old_cur_debugging);
 #endif
-		}
 	    }
 	}
+	state_set_free(&set);
     }
 }
 
@@ -720,10 +1575,10 @@ static bool same_phase1_sa_relations(struct state *this
 void delete_states_dead_interfaces(void)
 {
     struct state *st = NULL;
-    int i;
+    unsigned int i;
 
-    for (i = 0; st == NULL && i < STATE_TABLE_SIZE; i++)
-	for (st = statetable[i]; st != NULL;){
+    for (i = 0; st == NULL && i < state_walk_size(); i++)
+	for (st = state_walk_chain(i); st != NULL;){
 	    struct state *this = st;
 	    st = st->st_hashchain_next;	/* before this is deleted */
 	    if (this->st_interface && this->st_interface->change == IFN_DELETE )
@@ -761,11 +1616,13 @@ delete_states_by_connection(struct connection *c, bool relations)
 	c->kind = CK_GOING_AWAY;
 
     if(relations) {
-	foreach_states_by_connection_func(c, same_phase1_sa_relations
+	foreach_states_by_connection_func(c, parent_sa
+					  , same_phase1_sa_relations
 					  , delete_state_function
 					  , &parent_sa);
     } else {
-	foreach_states_by_connection_func(c, same_phase1_sa
+	foreach_states_by_connection_func(c, SOS_NOBODY
+					  , same_phase1_sa
 					  , delete_state_function
 					  , &parent_sa);
     }
@@ -810,7 +1667,8 @@ delete_p2states_by_connection(struct connection *c)
     if (ck == CK_INSTANCE)
 	c->kind = CK_GOING_AWAY;
 
-    foreach_states_by_connection_func(c, same_phase1_no_phase2
+    foreach_states_by_connection_func(c, parent_sa
+				      , same_phase1_no_phase2
 				      , delete_state_function
 				      , &parent_sa);
     if (ck == CK_INSTANCE)
@@ -857,7 +1715,8 @@ rekey_p2states_by_connection(struct connection *c)
     if (ck == CK_INSTANCE)
 	c->kind = CK_GOING_AWAY;
 
-    foreach_states_by_connection_func(c, same_phase1_no_phase2
+    foreach_states_by_connection_func(c, parent_sa
+				      , same_phase1_no_phase2
 				      , rekey_state_function
 				      , &parent_sa);
     if (ck == CK_INSTANCE)
@@ -879,7 +1738,7 @@ void
 delete_states_by_peer(ip_address *peer)
 {
     char peerstr[ADDRTOT_BUF];
-    int i, ph1;
+    int ph1;
 
     addrtot(peer, 0, peerstr, sizeof(peerstr));
 
@@ -887,36 +1746,46 @@ delete_states_by_peer(ip_address *peer)
 
     /* first restart the phase1s */
     for(ph1=0; ph1 < 2; ph1++) {
-	/* For each hash chain... */
-	for (i = 0; i < STATE_TABLE_SIZE; i++) {
-	    struct state *st;
-
-	    /* For each state in the hash chain... */
-	    for (st = statetable[i]; st != NULL; ) {
-		struct state *this = st;
-		struct connection *c = this->st_connection;
-		char ra[ADDRTOT_BUF];
-
-		st = st->st_hashchain_next;	/* before this is deleted */
+	struct state_set set = { NULL, 0, 0 };
+	struct state *st;
+	unsigned int i;
 
-		addrtot(&this->st_remoteaddr, 0, ra, sizeof(ra));
-		DBG_log("comparing %s to %s\n", ra, peerstr);
+	/* replacing creates states for this peer: only visit the old ones */
+	for (st = state_index_chain(STATE_INDEX_PEER
+				    , state_peer_hash(peer))->lh_first
+		 ; st != NULL
+		 ; st = st->st_index_link[STATE_INDEX_PEER].le_next) {
+	    char ra[ADDRTOT_BUF];
 
-		if(sameaddr(&this->st_remoteaddr, peer)) {
-		    if(ph1==0 && (IS_PHASE1(this->st_state) || IS_PHASE15(st->st_state ))) {
+	    addrtot(&st->st_remoteaddr, 0, ra, sizeof(ra));
+	    DBG_log("comparing %s to %s\n", ra, peerstr);
 
-			whack_log(RC_COMMENT
-				  , "peer %s for connection %s crashed, replacing"
-				  , peerstr
-				  , c->name);
-			ipsecdoi_replace(this, LEMPTY, LEMPTY, 1);
-		    } else {
-			delete_event(this);
-			event_schedule(EVENT_SA_REPLACE, 0, this);
-		    }
-		}
+	    if(sameaddr(&st->st_remoteaddr, peer))
+		state_set_add(&set, st);
+	}
+	state_set_sort(&set);
+
+	for (i = 0; i < set.count; i++) {
+	    struct state *this = state_with_serialno(set.entries[i].serialno);
+	    struct connection *c;
+
+	    if (this == NULL)
+		continue;
+	    c = this->st_connection;
+
+	    if(ph1==0 && (IS_PHASE1(this->st_state) || IS_PHASE15(this->st_state ))) {
+
+		whack_log(RC_COMMENT
+			  , "peer %s for connection %s crashed, replacing"
+			  , peerstr
+			  , c->name);
+		ipsecdoi_replace(this, LEMPTY, LEMPTY, 1);
+	    } else {
+		delete_event(this);
+		event_schedule(EVENT_SA_REPLACE, 0, this);
 	    }
 	}
+	state_set_free(&set);
     }
 }
 
@@ -1049,9 +1918,9 @@ duplicate_state(struct state *st)
 void for_each_state(void *(f)(struct state *, void *data), void *data)
 {
 	struct state *st, *ocs = cur_state;
-	int i;
-	for (i=0; i<STATE_TABLE_SIZE; i++) {
-		for (st = statetable[i]; st != NULL; st = st->st_hashchain_next) {
+	unsigned int i;
+	for (i=0; i < state_walk_size(); i++) {
+		for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next) {
 			set_cur_state(st);
 			f(st, data);
 		}
@@ -1336,12 +2205,12 @@ find_info_state(const u_char *icookie
 struct state *
 find_sender(size_t packet_len, u_char *packet)
 {
-    int i;
+    unsigned int i;
     struct state *st;
 
     if (packet_len >= sizeof(struct isakmp_hdr))
-	for (i = 0; i < STATE_TABLE_SIZE; i++)
-	    for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+	for (i = 0; i < state_walk_size(); i++)
+	    for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
 		if (st->st_tpacket.ptr != NULL
 		&& st->st_tpacket.len == packet_len
 		&& memcmp(st->st_tpacket.ptr, packet, packet_len) == 0)
@@ -1350,6 +2219,47 @@ find_sender(size_t packet_len, u_char *packet)
     return NULL;
 }
 
+/*
+ * The states whose connection is on host pair hp: walk the state lists
+ * of the connections on hp.  A NULL hp can only be matched by walking
+ * the whole table.
+ */
+struct host_pair_walk {
+    struct IPhost_pair *hp;
+    struct connection  *c;
+    unsigned int        chain;
+};
+
+static struct state *
+host_pair_walk_next(struct host_pair_walk *w, struct state *st)
+{
+    if (w->hp == NULL)
+    {
+	if (st != NULL && st->st_hashchain_next != NULL)
+	    return st->st_hashchain_next;
+	for (w->chain = st == NULL ? 0 : w->chain + 1
+		 ; w->chain < state_walk_size()
+		 ; w->chain++)
+	    if ((st = state_walk_chain(w->chain)) != NULL)
+		return st;
+	return NULL;
+    }
+
+    if (st != NULL && st->st_conn_link.le_next != NULL)
+	return st->st_conn_link.le_next;
+    for (w->c = st == NULL ? w->hp->connections : w->c->IPhp_next
+	     ; w->c != NULL
+	     ; w->c = w->c->IPhp_next)
+	if (w->c->states.lh_first != NULL)
+	    return w->c->states.lh_first;
+    return NULL;
+}
+
+#define FOR_EACH_STATE_ON_HOST_PAIR(st, w, pair) \
+    for ((w).hp = (pair), (st) = host_pair_walk_next(&(w), NULL) \
+	     ; (st) != NULL \
+	     ; (st) = host_pair_walk_next(&(w), (st)))
+
 struct state *
 find_phase2_state_to_delete(const struct state *p1st
 , u_int8_t protoid
@@ -1357,27 +2267,24 @@ find_phase2_state_to_delete(const struct state *p1st
 , bool *bogus)
 {
     struct state *st;
-    int i;
+    struct host_pair_walk w;
 
     *bogus = FALSE;
-    for (i = 0; i < STATE_TABLE_SIZE; i++)
+    FOR_EACH_STATE_ON_HOST_PAIR(st, w, p1st->st_connection->IPhost_pair)
     {
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
-	{
-	    if (IS_IPSEC_SA_ESTABLISHED(st->st_state)
+	if (IS_IPSEC_SA_ESTABLISHED(st->st_state)
 	    && p1st->st_connection->IPhost_pair == st->st_connection->IPhost_pair
 	    && same_peer_ids(p1st->st_connection, st->st_connection, NULL))
-	    {
-		struct ipsec_proto_info *pr = protoid == PROTO_IPSEC_AH
-		    ? &st->st_ah : &st->st_esp;
+	{
+	    struct ipsec_proto_info *pr = protoid == PROTO_IPSEC_AH
+		? &st->st_ah : &st->st_esp;
 
-		if (pr->present)
-		{
-		    if (pr->attrs.spi == spi)
-			return st;
-		    if (pr->our_spi == spi)
-			*bogus = TRUE;
-		}
+	    if (pr->present)
+	    {
+		if (pr->attrs.spi == spi)
+		    return st;
+		if (pr->our_spi == spi)
+		    *bogus = TRUE;
 	    }
 	}
     }
@@ -1392,21 +2299,20 @@ find_phase1_state(const struct connection *c, lset_t ok_states)
     struct state
 	*st,
 	*best = NULL;
-    int i;
+    struct host_pair_walk w;
 
-    for (i = 0; i < STATE_TABLE_SIZE; i++) {
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next) {
-	    if (LHAS(ok_states, st->st_state)
-		&& c->IPhost_pair == st->st_connection->IPhost_pair
-		&& same_peer_ids(c, st->st_connection, NULL)
-		&& IS_PARENT_SA(st)
-		&& samesubnet(&c->spd.this.client, &st->st_connection->spd.this.client)
-		&& samesubnet(&c->spd.that.client, &st->st_connection->spd.that.client)
-		&& (best == NULL
-		    || best->st_serialno < st->st_serialno))
-		{
-		    best = st;
-		}
+    FOR_EACH_STATE_ON_HOST_PAIR(st, w, c->IPhost_pair)
+    {
+	if (LHAS(ok_states, st->st_state)
+	    && c->IPhost_pair == st->st_connection->IPhost_pair
+	    && same_peer_ids(c, st->st_connection, NULL)
+	    && IS_PARENT_SA(st)
+	    && samesubnet(&c->spd.this.client, &st->st_connection->spd.this.client)
+	    && samesubnet(&c->spd.that.client, &st->st_connection->spd.that.client)
+	    && (best == NULL
+		|| best->st_serialno < st->st_serialno))
+	{
+	    best = st;
 	}
     }
 
@@ -1430,11 +2336,11 @@ state_eroute_usage(ip_subnet *ours, ip_subnet *his
 , unsigned long count, time_t nw)
 {
     struct state *st;
-    int i;
+    unsigned int i;
 
-    for (i = 0; i < STATE_TABLE_SIZE; i++)
+    for (i = 0; i < state_walk_size(); i++)
     {
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+	for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
 	{
 	    struct connection *c = st->st_connection;
 
@@ -1532,6 +2438,11 @@ void fmt_state(struct state *st, const time_t n
                 snprintf(msgidbuf, sizeof(msgidbuf), "; msgid=%ld"
                          , msgid_invalid(st->st_msgid));
             }
+        } else if(st->st_used_msgids != NULL) {
+            const struct msgid_set *ms = st->st_used_msgids;
+
+            snprintf(msgidbuf, sizeof(msgidbuf), "; msgids=%u/%u"
+                     , ms->count, msgid_set_capacity(ms));
         }
     }
 
@@ -1670,19 +2581,19 @@ void
 show_states_status(void)
 {
     const time_t n = now();
-    int i;
+    unsigned int i;
     char state_buf[LOG_WIDTH];
     char state_buf2[LOG_WIDTH];
-    int count;
+    unsigned int count;
     struct state **array;
 
     /* make count of states */
     count = 0;
-    for (i = 0; i < STATE_TABLE_SIZE; i++)
+    for (i = 0; i < state_walk_size(); i++)
     {
 	struct state *st;
 
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+	for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
 	{
 	    count++;
 	}
@@ -1693,11 +2604,11 @@ show_states_status(void)
 	/* build the array */
 	array = alloc_bytes(sizeof(struct state *)*count, "state array");
 	count = 0;
-	for (i = 0; i < STATE_TABLE_SIZE; i++)
+	for (i = 0; i < state_walk_size(); i++)
 	{
 	   struct state *st;
 
-	   for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+	   for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
 	   {
 	      array[count++]=st;
 	   }
@@ -1751,15 +2662,15 @@ find_my_cpi_gap(cpi_t *latest_cpi, cpi_t *first_busy_cpi)
     int tries = 0;
     cpi_t base = *latest_cpi;
     cpi_t closest;
-    int i;
+    unsigned int i;
 
 startover:
     closest = ~0;	/* not close at all */
-    for (i = 0; i < STATE_TABLE_SIZE; i++)
+    for (i = 0; i < state_walk_size(); i++)
     {
 	struct state *st;
 
-	for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+	for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
 	{
 	    if (st->st_ipcomp.present)
 	    {
@@ -1802,7 +2713,7 @@ ipsec_spi_t
 uniquify_his_cpi(ipsec_spi_t cpi, struct state *st)
 {
     int tries = 0;
-    int i;
+    unsigned int i;
 
 startover:
 
@@ -1812,11 +2723,11 @@ startover:
     /* Make sure that the result is unique.
      * Hard work.  If there is no unique value, we'll loop forever!
      */
-    for (i = 0; i < STATE_TABLE_SIZE; i++)
+    for (i = 0; i < state_walk_size(); i++)
     {
 	struct state *s;
 
-	for (s = statetable[i]; s != NULL; s = s->st_hashchain_next)
+	for (s = state_walk_chain(i); s != NULL; s = s->st_hashchain_next)
 	{
 	    if (s->st_ipcomp.present
 	    && sameaddr(&s->st_connection->spd.that.host_addr
@@ -1839,11 +2750,11 @@ startover:
 void replace_states_by_peer(ip_address *peer)
 {
     struct state *st = NULL;
-    int i;
+    unsigned int i;
     /* struct event *ev;     currently unused */
 
-    for (i = 0; st == NULL && i < STATE_TABLE_SIZE; i++)
-        for (st = statetable[i]; st != NULL; st = st->st_hashchain_next)
+    for (i = 0; st == NULL && i < state_walk_size(); i++)
+        for (st = state_walk_chain(i); st != NULL; st = st->st_hashchain_next)
             /* Only replace if it already has a replace event. */
             if (sameaddr(&st->st_connection->spd.that.host_addr, peer)
                     && (IS_ISAKMP_SA_ESTABLISHED(st->st_state) || IS_IPSEC_SA_ESTABLISHED(st->st_state))
@@ -1873,7 +2784,7 @@ void set_state_ike_endpoints(struct state *st
 
     st->st_localaddr  = c->spd.this.host_addr;
     st->st_localport  = c->spd.this.host_port;
-    st->st_remoteaddr = c->spd.that.host_addr;
+    set_state_remoteaddr(st, &c->spd.that.host_addr);
     st->st_remoteport = c->spd.that.host_port;
 
     st->st_interface = c->interface;
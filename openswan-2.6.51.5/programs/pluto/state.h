@@ -28,6 +28,7 @@
 #include <gmp.h>    /* GNU MP library */
 #include "pluto/quirks.h"
 #include "id.h"
+#include <sysqueue.h>
 
 #ifdef HAVE_LIBNSS
 # include <nss.h>
@@ -56,6 +57,20 @@
 #define INVALID_MSGID     0xffffffff
 
 struct state;	/* forward declaration of tag */
+struct sk_keys;		/* crypto.h */
+struct crypt_key;	/* crypto.h */
+
+/*
+ * The msgids used on one ISAKMP SA: an open addressed hash set, that
+ * doubles whenever it is half full.
+ */
+#define MSGID_SET_MIN_BITS	4	/* 16 slots, 8 msgids */
+
+struct msgid_set {
+    unsigned int   bits;	/* table has 1 << bits slots */
+    unsigned int   count;	/* msgids in the set, at most half the slots */
+    msgid_t       *table;	/* MAINMODE_MSGID marks an empty slot */
+};
 
 /* used by IKEv1 only */
 extern void reserve_msgid(struct state *isakmp_sa, msgid_t msgid);
@@ -186,6 +201,14 @@ struct xfrm_user_sec_ctx_ike {
 };
 #endif
 
+/* secondary indexes of the state table, besides the cookie hash */
+enum state_index {
+    STATE_INDEX_SERIAL = 0,	/* by st_serialno */
+    STATE_INDEX_PARENT = 1,	/* by st_clonedfrom: children of a parent SA */
+    STATE_INDEX_PEER   = 2,	/* by st_remoteaddr */
+    STATE_INDEX_ROOF   = 3,
+};
+
 /* state object: record the state of a (possibly nascent) SA
  *
  * Invariants (violated only during short transitions):
@@ -258,7 +281,7 @@ struct state
     msgid_t            st_msgid_phase15;       /* msgid for phase 1.5 */
     msgid_t            st_msgid_phase15b;      /* msgid for phase 1.5 */
     /* only for a state representing an ISAKMP SA */
-    struct msgid_list  *st_used_msgids;        /* used-up msgids */
+    struct msgid_set   *st_used_msgids;        /* used-up msgids */
 
     /* IKEv2 things */
     struct {
@@ -378,6 +401,7 @@ struct state
     chunk_t            st_skey_er;       /* KM for ISAKMP encryption */
     chunk_t            st_skey_pi;       /* KM for ISAKMP encryption */
     chunk_t            st_skey_pr;       /* KM for ISAKMP encryption */
+    struct sk_keys    *st_sk_keys;       /* SK_e and SK_a, set up once */
     struct connection *st_childsa;       /* connection included in AUTH */
     struct traffic_selector st_ts_this, st_ts_that;
 
@@ -391,13 +415,20 @@ struct state
     unsigned int       st_ph1_iv_len;
 
     chunk_t            st_enc_key;             /* Oakley Encryption key */
+    struct crypt_key  *st_enc_ctx;             /* st_enc_key, scheduled */
 
     struct event      *st_event;               /* backpointer for certain
 						  events */
     struct state      *st_hashchain_next;      /* Next in list */
     struct state      *st_hashchain_prev;      /* Previous in list */
 
+    /* secondary indexes, maintained by insert_state()/unhash_state() */
+    LIST_ENTRY(state)  st_index_link[STATE_INDEX_ROOF]; /* serial, parent, peer */
+    LIST_ENTRY(state)  st_conn_link;           /* on st_connection->states */
+
     struct hidden_variables hidden_variables;
+    bool                st_nat_ka;              /* on the NAT-T keepalive wheel */
+    struct half_open_prefix *st_half_open;      /* counted as half-open here */
 
     char                st_xauth_username[XAUTH_USERNAME_LEN];
     chunk_t             st_xauth_password;
@@ -428,21 +459,26 @@ extern bool states_use_connection(struct connection *c);
 
 /* state functions */
 
-static inline u_int compute_icookie_rcookie_hash(const u_char *icookie,
-					       const u_char *rcookie)
-{
-    u_int i = 0, j;
-    /* XXX the following hash is pretty pathetic */
-    for (j = 0; j < COOKIE_SIZE; j++)
-	i = i * 407 + icookie[j] + rcookie[j];
-    return i;
-}
+extern u_int compute_icookie_rcookie_hash(const u_char *icookie
+					  , const u_char *rcookie);
 
 extern struct state *new_state(void);
 extern void init_states(void);
 extern void insert_state(struct state *st);
 extern void unhash_state(struct state *st);
 extern void rehash_state(struct state *st);
+extern void set_state_connection(struct state *st, struct connection *c);
+extern void set_state_remoteaddr(struct state *st, const ip_address *addr);
+extern void state_table_rehash_step(void);
+extern void show_state_table_status(void);
+
+/* responder IKE SAs that have not seen their IKE_AUTH yet */
+extern void state_half_open(struct state *st);
+extern void state_half_open_done(struct state *st);
+extern unsigned long half_open_count(void);
+extern unsigned int half_open_prefix_count(void);
+extern bool half_open_prefix_busy(const ip_address *src
+				  , unsigned int on, unsigned int off);
 extern void release_whack(struct state *st);
 extern void state_eroute_usage(ip_subnet *ours, ip_subnet *his
     , unsigned long count, time_t nw);
@@ -20,7 +20,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -56,31 +58,199 @@
 #include "nat_traversal.h"
 #endif
 
-/* This file has the event handling routines. Events are
- * kept as a linked list of event structures. These structures
- * have information like event type, expiration time and a pointer
- * to event specific data (for example, to a state structure).
+/* This file has the event handling routines.  Events are kept in a
+ * binary heap ordered by expiry time, so scheduling and deleting one
+ * costs O(log n) however many SAs there are.  Each event remembers its
+ * slot in the heap, and each state points at its events, so deleting
+ * the event of a state needs no search.
+ *
+ * Expiry times are kept in milliseconds: ev_time is the same time in
+ * whole seconds, for the code that only cares about that.
  */
 
-static struct event *evlist = (struct event *) NULL;
+static struct event **evheap = NULL;	/* evheap[0] expires first */
+static unsigned int evheap_count = 0;
+static unsigned int evheap_room = 0;
+static unsigned long evheap_seq = 0;	/* orders events of the same time */
+
+#define EVHEAP_INITIAL_ROOM 64
 
 unsigned int event_retransmit_delay_0 = EVENT_RETRANSMIT_DELAY_0;
 unsigned int maximum_retransmissions  = MAXIMUM_RETRANSMISSIONS;
 unsigned int maximum_retransmissions_initial =MAXIMUM_RETRANSMISSIONS_INITIAL;
 unsigned int maximum_retransmissions_quick_r1=MAXIMUM_RETRANSMISSIONS_QUICK_R1;
 
+/*
+ * now() in milliseconds.  The seconds are now()'s, so this never goes
+ * backwards either, and regression runs only see whole seconds.
+ */
+unsigned long long
+now_msec(void)
+{
+    static unsigned long long last_msec = 0;
+    unsigned long long n = (unsigned long long)now() * 1000;
+
+    if (!now_regression)
+    {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	n += tv.tv_usec / 1000;
+    }
+    if (n < last_msec)
+	n = last_msec;
+    last_msec = n;
+    return n;
+}
+
+/* does a expire before b?  Of events due at the same time, the one
+ * scheduled last goes first, as it always has.
+ */
+static bool
+event_before(const struct event *a, const struct event *b)
+{
+    if (a->ev_msec != b->ev_msec)
+	return a->ev_msec < b->ev_msec;
+    return a->ev_seq > b->ev_seq;
+}
+
+static void
+evheap_set(unsigned int i, struct event *ev)
+{
+    evheap[i] = ev;
+    ev->ev_index = i;
+}
+
+static void
+evheap_up(unsigned int i)
+{
+    struct event *ev = evheap[i];
+
+    while (i > 0)
+    {
+	unsigned int parent = (i - 1) / 2;
+
+	if (!event_before(ev, evheap[parent]))
+	    break;
+	evheap_set(i, evheap[parent]);
+	i = parent;
+    }
+    evheap_set(i, ev);
+}
+
+static void
+evheap_down(unsigned int i)
+{
+    struct event *ev = evheap[i];
+
+    for (;;)
+    {
+	unsigned int child = 2 * i + 1;
+
+	if (child >= evheap_count)
+	    break;
+	if (child + 1 < evheap_count
+	    && event_before(evheap[child + 1], evheap[child]))
+	    child++;
+	if (!event_before(evheap[child], ev))
+	    break;
+	evheap_set(i, evheap[child]);
+	i = child;
+    }
+    evheap_set(i, ev);
+}
+
+static void
+evheap_insert(struct event *ev)
+{
+    if (evheap_count == evheap_room)
+    {
+	struct event **old = evheap;
+
+	evheap_room = evheap_room == 0 ? EVHEAP_INITIAL_ROOM : evheap_room * 2;
+	evheap = alloc_bytes(evheap_room * sizeof(struct event *)
+			     , "event heap");
+	if (old != NULL)
+	{
+	    memcpy(evheap, old, evheap_count * sizeof(struct event *));
+	    pfree(old);
+	}
+    }
+    evheap_set(evheap_count++, ev);
+    evheap_up(ev->ev_index);
+}
+
+static void
+evheap_remove(struct event *ev)
+{
+    unsigned int i = ev->ev_index;
+    struct event *last;
+
+    passert(i < evheap_count && evheap[i] == ev);
+
+    last = evheap[--evheap_count];
+    if (last != ev)
+    {
+	evheap_set(i, last);
+	evheap_up(i);
+	evheap_down(last->ev_index);
+    }
+    evheap[evheap_count] = NULL;
+}
+
+static struct event *
+evheap_first(void)
+{
+    return evheap_count == 0 ? (struct event *) NULL : evheap[0];
+}
+
+/*
+ * Retransmissions go off up to an eighth of their delay late, at
+ * random, so that SAs started together (a restart, a large group of
+ * connections) do not all retransmit in the same second.  Regression
+ * runs keep exact times.
+ */
+#define RETRANSMIT_JITTER_DIV	8
+
+static unsigned long
+retransmit_jitter_ms(unsigned long delay_ms)
+{
+    unsigned long spread = delay_ms / RETRANSMIT_JITTER_DIV;
+    u_int32_t r;
+
+    if (now_regression || spread == 0)
+	return 0;
+    get_rnd_bytes((u_char *)&r, sizeof(r));
+    return r % spread;
+}
+
 /*
  * This routine places an event in the event list.
  */
 void
 event_schedule(enum event_type type, time_t tm, struct state *st)
+{
+    unsigned long delay_ms;
+
+    passert(tm >= 0);
+    delay_ms = (unsigned long)tm * 1000;
+    if (type == EVENT_RETRANSMIT || type == EVENT_v2_RETRANSMIT)
+	delay_ms += retransmit_jitter_ms(delay_ms);
+    event_schedule_ms(type, delay_ms, st);
+}
+
+void
+event_schedule_ms(enum event_type type, unsigned long delay_ms
+		  , struct state *st)
 {
     struct event *ev = alloc_thing(struct event, "struct event in event_schedule()");
+    struct event *first = evheap_first();
     const char *headqueue;
 
-    passert(tm >= 0);
     ev->ev_type = type;
-    ev->ev_time = tm + now();
+    ev->ev_msec = now_msec() + delay_ms;
+    ev->ev_time = ev->ev_msec / 1000;
+    ev->ev_seq = evheap_seq++;
     ev->ev_state = st;
 
     /* If the event is associated with a state, put a backpointer to the
@@ -100,46 +270,23 @@ event_schedule(enum event_type type, time_t tm, struct state *st)
     }
 
     headqueue = "";
-    if (evlist == (struct event *) NULL
-	|| evlist->ev_time >= ev->ev_time) {
+    if (first == (struct event *) NULL
+	|| first->ev_msec >= ev->ev_msec) {
         headqueue = "(head of queue)";
     }
 
     DBG(DBG_CONTROL,
 	if (st == NULL)
-	    DBG_log("inserting event %s, timeout in %lu seconds %s"
-                    , enum_show(&timer_event_names, type), (unsigned long)tm, headqueue);
+	    DBG_log("inserting event %s, timeout in %lu.%03lu seconds %s"
+                    , enum_show(&timer_event_names, type)
+		    , delay_ms / 1000, delay_ms % 1000, headqueue);
 	else
-	    DBG_log("inserting event %s, timeout in %lu seconds for #%lu %s"
-                    , enum_show(&timer_event_names, type), (unsigned long)tm
+	    DBG_log("inserting event %s, timeout in %lu.%03lu seconds for #%lu %s"
+                    , enum_show(&timer_event_names, type)
+		    , delay_ms / 1000, delay_ms % 1000
                     , ev->ev_state->st_serialno, headqueue));
 
-    if (evlist == (struct event *) NULL
-	|| evlist->ev_time >= ev->ev_time)
-    {
-	ev->ev_next = evlist;
-	evlist = ev;
-    }
-    else
-    {
-	struct event *evt;
-
-	for (evt = evlist; evt->ev_next != NULL; evt = evt->ev_next)
-	    if (evt->ev_next->ev_time >= ev->ev_time)
-		break;
-
-	DBG(DBG_CONTROLMORE,
-	    if (evt->ev_state == NULL)
-		DBG_log("event added after event %s"
-		    , enum_show(&timer_event_names, evt->ev_type));
-	    else
-		DBG_log("event added after event %s for #%lu"
-		    , enum_show(&timer_event_names, evt->ev_type)
-		    , evt->ev_state->st_serialno));
-
-	ev->ev_next = evt->ev_next;
-	evt->ev_next = ev;
-    }
+    evheap_insert(ev);
 }
 
 
@@ -405,8 +552,8 @@ retransmit_v2_msg(struct state *st)
 void
 handle_timer_event(void)
 {
-    time_t tm;
-    struct event *ev = evlist;
+    unsigned long long tm;
+    struct event *ev = evheap_first();
     int type;
 
     if (ev == (struct event *) NULL)    /* Just paranoid */
@@ -416,12 +563,12 @@ handle_timer_event(void)
     }
 
     type = ev->ev_type;
-    tm = now();
+    tm = now_msec();
 
-    if (tm < ev->ev_time)
+    if (tm < ev->ev_msec)
     {
 	DBG(DBG_CONTROL, DBG_log("called while no event expired (%lu/%lu, %s)"
-	    , (unsigned long)tm, (unsigned long)ev->ev_time
+	    , (unsigned long)(tm / 1000), (unsigned long)ev->ev_time
 	    , enum_show(&timer_event_names, type)));
 
 	/* This will happen if the most close-to-expire event was
@@ -436,31 +583,33 @@ handle_timer_event(void)
     /*
      * we can get behind, try and catch up all expired events
      */
-    while (ev && tm >= ev->ev_time) {
+    while (ev && tm >= ev->ev_msec) {
 
 	handle_next_timer_event();
 
-	tm = now();
-    	ev = evlist;
+	tm = now_msec();
+    	ev = evheap_first();
     }
 }
 
 void
 handle_next_timer_event(void)
 {
-    struct event *ev = evlist;
-    time_t tm;
+    struct event *ev = evheap_first();
+    struct event *next;
+    unsigned long long tm;
     int type;
     struct state *st;
 
-    tm = now();
+    tm = now_msec();
 
     if (ev == (struct event *) NULL)
     {
 	return;
     }
 
-    evlist = evlist->ev_next;		/* Ok, we'll handle this event */
+    evheap_remove(ev);			/* Ok, we'll handle this event */
+    next = evheap_first();
     type = ev->ev_type;
     st = ev->ev_state;
 
@@ -470,10 +619,10 @@ handle_next_timer_event(void)
     }
 
     if(DBGP(DBG_CONTROL)) {
-	if (evlist != (struct event *) NULL) {
+	if (next != (struct event *) NULL) {
 	    DBG_log("event after this is %s in %ld seconds"
-		    , enum_show(&timer_event_names, evlist->ev_type)
-		    , (long) (evlist->ev_time - tm));
+		    , enum_show(&timer_event_names, next->ev_type)
+		    , (long) (next->ev_time - (time_t)(tm / 1000)));
 	}
 	else {
 	    DBG_log("no more events are scheduled");
@@ -542,6 +691,7 @@ handle_next_timer_event(void)
 	    {
 		struct connection *c;
 		so_serial_t newest;
+		time_t nw = (time_t)(tm / 1000);	/* st_outbound_time is in seconds */
 
 		passert(st != NULL);
 		c = st->st_connection;
@@ -558,7 +708,7 @@ handle_next_timer_event(void)
 			    , newest));
 		}
 		else if (type == EVENT_SA_REPLACE_IF_USED
-		&& st->st_outbound_time <= tm - c->sa_rekey_margin)
+		&& st->st_outbound_time <= nw - c->sa_rekey_margin)
 		{
 		    /* we observed no recent use: no need to replace
 		     *
@@ -580,7 +730,7 @@ handle_next_timer_event(void)
 		    DBG(DBG_LIFECYCLE
 			, openswan_log("not replacing stale %s SA: inactive for %lus"
 			    , (IS_PHASE1(st->st_state) || IS_PHASE15(st->st_state ))? "ISAKMP" : "IPsec"
-			    , (unsigned long)(tm - st->st_outbound_time)));
+			    , (unsigned long)(nw - st->st_outbound_time)));
 		}
 		else
 		{
@@ -687,33 +837,45 @@ handle_next_timer_event(void)
  * expires (never negative = 0 if one has expired), or -1 if no jobs in queue.
  */
 long
-next_event(void)
+next_event_msec(void)
 {
-    time_t tm;
+    unsigned long long tm;
+    struct event *ev = evheap_first();
 
-    if (evlist == (struct event *) NULL) {
+    if (ev == (struct event *) NULL) {
 	DBG(DBG_CONTROLMORE, DBG_log("no pending events"));
 	return -1;
     }
 
-    tm = now();
+    tm = now_msec();
 
     DBG(DBG_CONTROL,
-	if (evlist->ev_state == NULL)
+	if (ev->ev_state == NULL)
 	    DBG_log("next event %s in %ld seconds"
-		, enum_show(&timer_event_names, evlist->ev_type)
-		, (long)evlist->ev_time - (long)tm);
+		, enum_show(&timer_event_names, ev->ev_type)
+		, (long)ev->ev_time - (long)(tm / 1000));
 	else {
 	    DBG_log("next event %s in %ld seconds for #%lu (%s)"
-		, enum_show(&timer_event_names, evlist->ev_type)
-		, (long)evlist->ev_time - (long)tm
-                    , evlist->ev_state->st_serialno, oswtimestr()));
+		, enum_show(&timer_event_names, ev->ev_type)
+		, (long)ev->ev_time - (long)(tm / 1000)
+                    , ev->ev_state->st_serialno, oswtimestr()));
         }
 
-    if (evlist->ev_time - tm <= 0)
+    if (ev->ev_msec <= tm)
 	return 0;
     else
-	return evlist->ev_time - tm;
+	return (long)(ev->ev_msec - tm);
+}
+
+/* as next_event_msec(), in seconds, rounded up: 0 only if one has expired */
+long
+next_event(void)
+{
+    long ms = next_event_msec();
+
+    if (ms <= 0)
+	return ms;
+    return (ms + 999) / 1000;
 }
 
 /*
@@ -725,28 +887,12 @@ delete_event(struct state *st)
     DBG(DBG_CONTROLMORE, DBG_log("deleting event for #%ld", st->st_serialno));
     if (st->st_event != (struct event *) NULL)
     {
-	struct event **ev;
+	evheap_remove(st->st_event);
 
-	for (ev = &evlist; ; ev = &(*ev)->ev_next)
-	{
-	    if (*ev == NULL)
-	    {
-		DBG(DBG_CONTROL, DBG_log("event %s to be deleted not found",
-		    enum_show(&timer_event_names, st->st_event->ev_type)));
-		break;
-	    }
-	    if ((*ev) == st->st_event)
-	    {
-		*ev = (*ev)->ev_next;
-
-		if (st->st_event->ev_type == EVENT_RETRANSMIT)
-		    st->st_retransmit = 0;
-		pfree(st->st_event);
-		st->st_event = (struct event *) NULL;
-
-		break;
-	    }
-	}
+	if (st->st_event->ev_type == EVENT_RETRANSMIT)
+	    st->st_retransmit = 0;
+	pfree(st->st_event);
+	st->st_event = (struct event *) NULL;
     }
 }
 
@@ -767,29 +913,21 @@ _delete_dpd_event(struct state *st, const char *file, int lineno)
 
     if (st->st_dpd_event != (struct event *) NULL)
     {
-        struct event **ev;
-
-        for (ev = &evlist; ; ev = &(*ev)->ev_next)
-        {
-            if (*ev == NULL)
-            {
-                DBG(DBG_DPD|DBG_CONTROL
-		    , DBG_log("event %s to be deleted not found",
-			      enum_show(&timer_event_names
-					, st->st_dpd_event->ev_type)));
-                break;
-            }
-            if ((*ev) == st->st_dpd_event)
-            {
-                *ev = (*ev)->ev_next;
-                pfree(st->st_dpd_event);
-                st->st_dpd_event = (struct event *) NULL;
-                break;
-            }
-        }
+	evheap_remove(st->st_dpd_event);
+	pfree(st->st_dpd_event);
+	st->st_dpd_event = (struct event *) NULL;
     }
 }
 
+static int
+event_compare(const void *a, const void *b)
+{
+    const struct event *ea = *(const struct event *const *)a;
+    const struct event *eb = *(const struct event *const *)b;
+
+    return event_before(ea, eb) ? -1 : event_before(eb, ea) ? 1 : 0;
+}
+
 /*
  * dump list of events to whacklog
  */
@@ -797,11 +935,12 @@ void
 timer_list(void)
 {
     time_t tm;
-    struct event *ev = evlist;
+    struct event **events;
+    unsigned int i;
     int type;
     struct state *st;
 
-    if (ev == (struct event *) NULL)    /* Just paranoid */
+    if (evheap_count == 0)    /* Just paranoid */
     {
 	whack_log(RC_LOG, "no events are queued");
 	return;
@@ -811,7 +950,14 @@ timer_list(void)
 
     whack_log(RC_LOG, "It is now: %ld seconds since epoch", (unsigned long)tm);
 
-    while(ev) {
+    /* the heap is only partly ordered: sort a copy */
+    events = alloc_bytes(evheap_count * sizeof(struct event *), "event list");
+    memcpy(events, evheap, evheap_count * sizeof(struct event *));
+    qsort(events, evheap_count, sizeof(struct event *), event_compare);
+
+    for (i = 0; i < evheap_count; i++) {
+	struct event *ev = events[i];
+
 	type = ev->ev_type;
 	st = ev->ev_state;
 
@@ -824,9 +970,9 @@ timer_list(void)
 	if(st && st->st_connection) {
 	    whack_log(RC_LOG, "    connection: \"%s\"", st->st_connection->name);
 	}
-
-	ev = ev->ev_next;
     }
+
+    pfree(events);
 }
 
 /*
@@ -20,15 +20,21 @@ struct state;	/* forward declaration */
 
 struct event
 {
-    time_t          ev_time;
+    time_t          ev_time;        /* expiry, in seconds */
+    unsigned long long ev_msec;     /* expiry, in milliseconds */
     enum event_type ev_type;        /* Event type */
     struct state   *ev_state;       /* Pointer to relevant state (if any) */
-    struct event   *ev_next;        /* Pointer to next event */
+    unsigned int    ev_index;       /* slot in the event heap */
+    unsigned long   ev_seq;         /* order of scheduling */
 };
 
 extern void event_schedule(enum event_type type, time_t tm, struct state *st);
+extern void event_schedule_ms(enum event_type type, unsigned long delay_ms
+			      , struct state *st);
 extern void handle_timer_event(void);
 extern long next_event(void);
+extern long next_event_msec(void);
+extern unsigned long long now_msec(void);
 extern void delete_event(struct state *st);
 extern void daily_log_event(void);
 extern void handle_next_timer_event(void);
@@ -214,7 +214,7 @@ struct state
     msgid_t            st_msgid_phase15b;      /* msgid for phase 1.5 */
 
     /* only for a state representing an ISAKMP SA */
-    struct msgid_list  *st_used_msgids;        /* used-up msgids */
+    struct msgid_set   *st_used_msgids;        /* used-up msgids */
 
 /* symmetric stuff */
 
@@ -0,0 +1,544 @@
+/* running the updown script without stopping pluto
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * invoke_command() runs the script with popen() and reads its output
+ * until it exits, and nothing else happens in pluto meanwhile.  With
+ * --updown-workers N, the verbs whose result nobody waits for (prepare,
+ * route, unroute, up and down) are queued instead, and up to N scripts
+ * run at once.  Their output is read by the main loop as it arrives, and
+ * when a script has exited and its output is all read, the result goes
+ * to do_command_done(), which can act on the state it was run for.
+ *
+ * Commands for the same peer client are run one after another, in the
+ * order they were queued: an unroute has to be done before the route
+ * that replaces it.  Any other verb waits for the commands queued for its
+ * peer client, and then runs inline as before.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <openswan.h>
+
+#include "sysdep.h"
+#include "constants.h"
+#include "oswlog.h"
+#include "defs.h"
+#include "id.h"
+#include "pluto/connections.h"	/* needs id.h */
+#include "state.h"
+#include "kernel.h"
+#include "log.h"
+#include "whack.h"	/* for RC_LOG_SERIOUS */
+#include "updown.h"
+
+int updown_workers = 0;
+bool updown_builtin = FALSE;
+unsigned long updown_generation = 0;
+
+/* how far down the queue to look for a command that can start */
+#define UPDOWN_SCAN_WINDOW	64
+
+struct updown_job {
+    struct updown_job *next;
+    char          *cmd;
+    char           verb[32];
+    char           verb_suffix[16];
+    char           key[SUBNETTOT_BUF];	/* the peer client */
+    so_serial_t    serialno;		/* who to tell, or SOS_NOBODY */
+    pid_t          pid;
+    int            fd;			/* the script's stdout and stderr */
+    bool           eof;
+    bool           exited;
+    int            status;
+    size_t         outlen;
+    char           out[256];		/* a longer line is folded */
+};
+
+static struct updown_job *updown_queue = NULL;
+static struct updown_job **updown_queue_tail = &updown_queue;
+static struct updown_job *updown_running = NULL;
+static int updown_nqueued = 0;
+static int updown_nrunning = 0;
+
+static struct {
+    unsigned long queued;
+    unsigned long inline_runs;
+    unsigned long completed;
+    unsigned long failed;
+    unsigned long builtin;
+    int           largest;
+} updown_stats;
+
+/* verbs whose result nobody is waiting for */
+static bool
+updown_can_wait(const char *verb)
+{
+    return streq(verb, "prepare") || streq(verb, "route")
+	|| streq(verb, "unroute") || streq(verb, "up")
+	|| streq(verb, "down");
+}
+
+static void
+updown_key(const struct spd_route *sr, char *key, size_t len)
+{
+    subnettot(&sr->that.client, 0, key, len);
+}
+
+static bool
+updown_busy(const char *key)
+{
+    struct updown_job *j;
+
+    for (j = updown_running; j != NULL; j = j->next)
+	if (streq(j->key, key))
+	    return TRUE;
+    return FALSE;
+}
+
+/*
+ * Log against the state the command was run for, if it is still there.
+ * This can happen in the middle of something else (updown_flush), so
+ * whatever cur_state was is put back afterwards.
+ */
+static struct state *
+updown_enter(const struct updown_job *j)
+{
+    struct state *old = cur_state;
+    struct state *st = j->serialno == SOS_NOBODY
+	? NULL : state_with_serialno(j->serialno);
+
+    if (st != NULL)
+	cur_state = st;
+    return old;
+}
+
+static void
+updown_log_output(struct updown_job *j)
+{
+    struct state *old;
+
+    if (j->outlen == 0)
+	return;
+    j->out[j->outlen] = '\0';
+    old = updown_enter(j);
+    openswan_log("%s%s output: %s", j->verb, j->verb_suffix, j->out);
+    cur_state = old;
+    j->outlen = 0;
+}
+
+/* read what the script has written so far, logging complete lines */
+static void
+updown_read(struct updown_job *j)
+{
+    for (;;)
+    {
+	char buf[512];
+	ssize_t n = read(j->fd, buf, sizeof(buf));
+	ssize_t i;
+
+	if (n == 0)
+	{
+	    updown_log_output(j);
+	    close(j->fd);
+	    j->fd = NULL_FD;
+	    j->eof = TRUE;
+	    updown_generation++;
+	    return;
+	}
+	if (n < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK)
+	    {
+		log_errno((e, "read failed on output of %s%s command"
+			   , j->verb, j->verb_suffix));
+		close(j->fd);
+		j->fd = NULL_FD;
+		j->eof = TRUE;
+		updown_generation++;
+	    }
+	    return;
+	}
+	for (i = 0; i < n; i++)
+	{
+	    if (buf[i] == '\n')
+	    {
+		updown_log_output(j);
+		continue;
+	    }
+	    j->out[j->outlen++] = buf[i];
+	    if (j->outlen == sizeof(j->out) - 1)
+		updown_log_output(j);
+	}
+    }
+}
+
+/* report on the exit status, the way invoke_command() does */
+static bool
+updown_exit_ok(const struct updown_job *j)
+{
+    int r = j->status;
+
+    if (WIFEXITED(r))
+    {
+	if (WEXITSTATUS(r) == 0)
+	    return TRUE;
+	loglog(RC_LOG_SERIOUS, "%s%s command exited with status %d"
+	       , j->verb, j->verb_suffix, WEXITSTATUS(r));
+    }
+    else if (WIFSIGNALED(r))
+    {
+	loglog(RC_LOG_SERIOUS, "%s%s command exited with signal %d"
+	       , j->verb, j->verb_suffix, WTERMSIG(r));
+    }
+    else
+    {
+	loglog(RC_LOG_SERIOUS, "%s%s command exited with unknown status %d"
+	       , j->verb, j->verb_suffix, r);
+    }
+    return FALSE;
+}
+
+static void
+updown_free(struct updown_job *j)
+{
+    pfreeany(j->cmd);
+    pfree(j);
+}
+
+static bool
+updown_start(struct updown_job *j)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0)
+    {
+	log_errno((e, "unable to create a pipe for %s%s command"
+		   , j->verb, j->verb_suffix));
+	return FALSE;
+    }
+
+    j->pid = fork();
+    if (j->pid < 0)
+    {
+	log_errno((e, "unable to fork %s%s command"
+		   , j->verb, j->verb_suffix));
+	close(fds[0]);
+	close(fds[1]);
+	return FALSE;
+    }
+
+    if (j->pid == 0)
+    {
+	/* the child: as popen(cmd, "r") would have run it */
+	close(fds[0]);
+	if (fds[1] != STDOUT_FILENO)
+	{
+	    dup2(fds[1], STDOUT_FILENO);
+	    close(fds[1]);
+	}
+	signal(SIGCHLD, SIG_DFL);
+	execl("/bin/sh", "sh", "-c", j->cmd, (char *)NULL);
+	_exit(127);
+    }
+
+    close(fds[1]);
+    j->fd = fds[0];
+    updown_generation++;
+    (void) fcntl(j->fd, F_SETFD, FD_CLOEXEC);
+    (void) fcntl(j->fd, F_SETFL, O_NONBLOCK);
+
+    DBG(DBG_CONTROL, DBG_log("started %s%s as pid %d: %s"
+			     , j->verb, j->verb_suffix, j->pid, j->cmd));
+
+    /* only the queue needs the command from now on */
+    pfree(j->cmd);
+    j->cmd = NULL;
+    return TRUE;
+}
+
+/* tell whoever asked, and forget the job */
+static void
+updown_finish(struct updown_job *j, bool started)
+{
+    struct state *st = j->serialno == SOS_NOBODY
+	? NULL : state_with_serialno(j->serialno);
+    struct state *old = updown_enter(j);
+    bool success = started && updown_exit_ok(j);
+
+    if (success)
+	updown_stats.completed++;
+    else
+	updown_stats.failed++;
+
+    do_command_done(st, j->verb, success);
+
+    cur_state = old;
+    updown_free(j);
+}
+
+/* start what can be started, in queue order */
+static void
+updown_dispatch(void)
+{
+    struct updown_job **jp = &updown_queue;
+    int scanned = 0;
+
+    while (*jp != NULL && updown_nrunning < updown_workers
+	   && scanned++ < UPDOWN_SCAN_WINDOW)
+    {
+	struct updown_job *j = *jp;
+	struct updown_job *k;
+	bool blocked = updown_busy(j->key);
+
+	/* nor may it overtake one queued ahead of it for the same peer */
+	for (k = updown_queue; !blocked && k != j; k = k->next)
+	    blocked = streq(k->key, j->key);
+
+	if (blocked)
+	{
+	    jp = &j->next;
+	    continue;
+	}
+
+	/* take it off the queue */
+	*jp = j->next;
+	if (updown_queue_tail == &j->next)
+	    updown_queue_tail = jp;
+	updown_nqueued--;
+
+	if (!updown_start(j))
+	{
+	    updown_finish(j, FALSE);
+	    continue;
+	}
+	j->next = updown_running;
+	updown_running = j;
+	updown_nrunning++;
+    }
+}
+
+/* reap finished jobs; the order they finish in does not matter */
+static void
+updown_reap(void)
+{
+    struct updown_job **jp = &updown_running;
+
+    while (*jp != NULL)
+    {
+	struct updown_job *j = *jp;
+
+	if (!j->eof || !j->exited)
+	{
+	    jp = &j->next;
+	    continue;
+	}
+	*jp = j->next;
+	updown_nrunning--;
+	updown_finish(j, TRUE);
+    }
+    updown_dispatch();
+}
+
+bool
+updown_invoke(const struct spd_route *sr
+	      , const char *verb, const char *verb_suffix
+	      , struct state *st, char *cmd)
+{
+    struct updown_job *j;
+
+    if (updown_workers == 0 || !updown_can_wait(verb))
+    {
+	/* whatever is queued for this peer goes first */
+	if (updown_workers != 0)
+	    updown_flush(sr);
+	updown_stats.inline_runs++;
+	return invoke_command(verb, verb_suffix, cmd);
+    }
+
+    j = alloc_thing(struct updown_job, "updown job");
+    j->cmd = clone_str(cmd, "updown command");
+    strncpy(j->verb, verb, sizeof(j->verb) - 1);
+    strncpy(j->verb_suffix, verb_suffix, sizeof(j->verb_suffix) - 1);
+    updown_key(sr, j->key, sizeof(j->key));
+    j->serialno = st == NULL ? SOS_NOBODY : st->st_serialno;
+    j->pid = -1;
+    j->fd = NULL_FD;
+
+    DBG(DBG_CONTROL, DBG_log("queueing %s%s for %s: %s"
+			     , verb, verb_suffix, j->key, cmd));
+
+    *updown_queue_tail = j;
+    updown_queue_tail = &j->next;
+    updown_nqueued++;
+    updown_stats.queued++;
+    if (updown_stats.largest < updown_nqueued)
+	updown_stats.largest = updown_nqueued;
+
+    updown_dispatch();
+    return TRUE;	/* as far as the caller is concerned */
+}
+
+static bool
+updown_waiting_for(const char *key)
+{
+    struct updown_job *j;
+
+    if (key == NULL)
+	return updown_queue != NULL || updown_running != NULL;
+
+    for (j = updown_queue; j != NULL; j = j->next)
+	if (streq(j->key, key))
+	    return TRUE;
+    return updown_busy(key);
+}
+
+/* block until the oldest matching running job (or any) is done */
+static void
+updown_wait_one(const char *key)
+{
+    struct updown_job *j, *victim = NULL;
+
+    for (j = updown_running; j != NULL; j = j->next)
+	if (victim == NULL || (key != NULL && streq(j->key, key)))
+	    victim = j;
+    if (victim == NULL)
+	return;
+
+    while (!victim->eof)
+    {
+	struct pollfd pfd;
+
+	pfd.fd = victim->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+	    break;
+	updown_read(victim);
+    }
+    if (!victim->exited)
+    {
+	int status;
+	pid_t r;
+
+	do {
+	    r = waitpid(victim->pid, &status, 0);
+	} while (r < 0 && errno == EINTR);
+
+	victim->exited = TRUE;
+	/* reapchildren() may have beaten us to it */
+	victim->status = r == victim->pid ? status : 0;
+    }
+    updown_reap();
+}
+
+void
+updown_flush(const struct spd_route *sr)
+{
+    char key[SUBNETTOT_BUF];
+
+    if (sr != NULL)
+	updown_key(sr, key, sizeof(key));
+
+    while (updown_waiting_for(sr == NULL ? NULL : key))
+    {
+	updown_dispatch();
+	updown_wait_one(sr == NULL ? NULL : key);
+    }
+}
+
+void
+updown_sockets(osw_fd_set *readfds, int *maxfd)
+{
+    struct updown_job *j;
+
+    for (j = updown_running; j != NULL; j = j->next)
+    {
+	if (j->fd == NULL_FD)
+	    continue;
+	OSW_FD_SET(j->fd, readfds);
+	if (maxfd != NULL && *maxfd < j->fd)
+	    *maxfd = j->fd;
+    }
+}
+
+int
+updown_ready(osw_fd_set *readfds)
+{
+    struct updown_job *j;
+    int ndes = 0;
+
+    for (j = updown_running; j != NULL; j = j->next)
+    {
+	if (j->fd != NULL_FD && OSW_FD_ISSET(j->fd, readfds))
+	{
+	    updown_read(j);
+	    ndes++;
+	}
+    }
+    updown_reap();
+    return ndes;
+}
+
+bool
+updown_reapchild(pid_t pid, int status)
+{
+    struct updown_job *j;
+
+    for (j = updown_running; j != NULL; j = j->next)
+    {
+	if (j->pid == pid && !j->exited)
+	{
+	    j->exited = TRUE;
+	    j->status = status;
+	    updown_reap();
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+void
+updown_note_builtin(void)
+{
+    updown_stats.builtin++;
+}
+
+void
+show_updown_status(void)
+{
+    whack_log(RC_COMMENT, "stats updown: workers=%d running=%d queued=%d"
+	      " largest=%d async=%lu inline=%lu builtin=%lu"
+	      " completed=%lu failed=%lu"
+	      , updown_workers, updown_nrunning, updown_nqueued
+	      , updown_stats.largest, updown_stats.queued
+	      , updown_stats.inline_runs, updown_stats.builtin
+	      , updown_stats.completed, updown_stats.failed);
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset:4
+ * c-style: pluto
+ * End:
+ */
@@ -0,0 +1,46 @@
+/* running the updown script without stopping pluto
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef _UPDOWN_H
+#define _UPDOWN_H
+
+#include "osw_select.h"
+
+struct spd_route;
+struct state;
+
+#define UPDOWN_WORKERS_MAX	64
+
+extern int updown_workers;	/* --updown-workers; 0: run the script inline */
+extern bool updown_builtin;	/* --updown-builtin */
+
+/* run cmd for verb, or queue it if it can wait; FALSE if it failed */
+extern bool updown_invoke(const struct spd_route *sr
+			  , const char *verb, const char *verb_suffix
+			  , struct state *st, char *cmd);
+
+/* wait for the commands already queued for sr (NULL: for everything) */
+extern void updown_flush(const struct spd_route *sr);
+
+/* main loop hooks; the generation changes when the set of pipes does */
+extern unsigned long updown_generation;
+extern void updown_sockets(osw_fd_set *readfds, int *maxfd);
+extern int updown_ready(osw_fd_set *readfds);
+extern bool updown_reapchild(pid_t pid, int status);
+
+/* --updown-builtin did a verb without the script */
+extern void updown_note_builtin(void);
+
+extern void show_updown_status(void);
+
+#endif /* _UPDOWN_H */
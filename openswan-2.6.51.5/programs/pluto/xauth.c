@@ -370,6 +370,7 @@ stf_status modecfg_resp(struct state *st
 		    st->st_connection->spd.that.client.addr = ia.ipaddr;
 		    st->st_connection->spd.that.client.maskbits = 32;
 		    st->st_connection->spd.that.has_client = TRUE;
+		    route_index_update(st->st_connection);
 		}
 	}
 
@@ -1974,6 +1975,7 @@ modecfg_inR1(struct msg_digest *md)
                     tmp_spd2->next = tmp_spd;
                     tmp_spd2 = tmp_spd;
                     }
+                    route_index_update(c);
 
                 }
                 resp |= LELEM(attr.isaat_af_type);
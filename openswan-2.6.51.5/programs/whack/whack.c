@@ -135,6 +135,9 @@ help(void)
             " [--dpddelay <seconds> --dpdtimeout <seconds>]"
             " [--dpdaction (clear|hold|restart|restart_by_peer)]"
             " \\\n   "
+            " [--ratelimit-new <packets/s>]"
+            " [--ratelimit-existing <packets/s>]"
+            " \\\n   "
 
 #ifdef XAUTH
 	    " [--xauthserver]"
@@ -500,6 +503,8 @@ enum option_enums {
     CD_DPDDELAY,
     CD_DPDTIMEOUT,
     CD_DPDACTION,
+    CD_RATELIMITNEW,
+    CD_RATELIMITEXISTING,
     CD_FORCEENCAPS,
     CD_IKE,
     CD_PFSGROUP,
@@ -696,6 +701,8 @@ static const struct option long_opts[] = {
     { "dpddelay", required_argument, NULL, CD_DPDDELAY + OO + NUMERIC_ARG },
     { "dpdtimeout", required_argument, NULL, CD_DPDTIMEOUT + OO + NUMERIC_ARG },
     { "dpdaction", required_argument, NULL, CD_DPDACTION + OO },
+    { "ratelimit-new", required_argument, NULL, CD_RATELIMITNEW + OO + NUMERIC_ARG },
+    { "ratelimit-existing", required_argument, NULL, CD_RATELIMITEXISTING + OO + NUMERIC_ARG },
 #ifdef XAUTH
     { "xauth", no_argument, NULL, END_XAUTHSERVER + OO },
     { "xauthserver", no_argument, NULL, END_XAUTHSERVER + OO },
@@ -1530,6 +1537,14 @@ main(int argc, char **argv)
             }
             continue;
 
+        case CD_RATELIMITNEW:
+            msg.ratelimit_new = opt_whole;
+            continue;
+
+        case CD_RATELIMITEXISTING:
+            msg.ratelimit_existing = opt_whole;
+            continue;
+
 	case CD_IKE:	/* --ike <ike_alg1,ike_alg2,...> */
 	    msg.ike = optarg;
 	    continue;
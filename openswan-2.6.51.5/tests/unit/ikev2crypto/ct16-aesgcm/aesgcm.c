@@ -0,0 +1,328 @@
+/*
+ * AES-GCM-16 (RFC 5282) known answer and SK payload test.
+ * Copyright (C) 2026 Openswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * The keys are handed to crypt_key_new() the way calc_skeyseed_v2() lays
+ * out SK_ei/SK_er (the key, or under NSS its PK11SymKey, then the salt),
+ * and everything goes through crypt_key_aead(), as ikev2_encrypt_msg()
+ * and ikev2_decrypt_msg() do.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openswan.h>
+
+#include "sysdep.h"
+#include "constants.h"
+#include "oswalloc.h"
+#include "oswlog.h"
+#include "oswcrypto.h"
+#include "pluto/defs.h"
+#include "packet.h"
+#include "demux.h"
+#include "state.h"
+#include "log.h"
+#include "crypto.h"
+#include "ike_alg.h"
+
+#ifdef HAVE_LIBNSS
+# include <nspr.h>
+# include <nss.h>
+# include <pk11pub.h>
+#endif
+
+#include "seam_rnd.c"
+#include "seam_whack.c"
+#include "seam_exitlog.c"
+
+#define TESTNAME "aesgcm"
+
+const char *progname;
+
+/*
+ * GCM spec test cases 4 and 16: the 96 bit nonce cafebabefacedbaddecaf888
+ * is the 4 byte salt from the keying material and the 8 byte IV of the
+ * SK payload.
+ */
+static const char kat_salt[] = "cafebabe";
+static const char kat_iv[]   = "facedbaddecaf888";
+static const char kat_aad[]  = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+static const char kat_plain[] =
+    "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+    "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+
+static const struct kat {
+    const char *key;
+    const char *cipher;
+    const char *tag;
+} kats[] = {
+    { "feffe9928665731c6d6a8f9467308308",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+      "5bc94fbc3221a5db94fae95ae7121a47" },
+    { "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+      "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+      "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+      "76fc6ece0f4e1768cddf8853bb2d551b" },
+};
+
+static size_t unhex(const char *hex, u_char *buf, size_t size)
+{
+    size_t len = strlen(hex) / 2;
+    size_t i;
+
+    passert(len <= size);
+    for(i = 0; i < len; i++) {
+	unsigned int b;
+
+	sscanf(hex + 2 * i, "%2x", &b);
+	buf[i] = b;
+    }
+    return len;
+}
+
+static void print_hex(const char *label, const u_char *buf, size_t len)
+{
+    size_t i;
+
+    printf("%s:", label);
+    for(i = 0; i < len; i++) {
+	if(i % 16 == 0)
+	    printf("\n   ");
+	printf(" %02x", buf[i]);
+    }
+    printf("\n");
+}
+
+/* SK_e as calc_skeyseed_v2() gives it to crypt_key_new() */
+static struct crypt_key *gcm_key(const struct encrypt_desc *e
+				 , const u_char *raw, size_t rawlen
+				 , const u_char *salt)
+{
+    u_char kv[64];
+    struct crypt_key *k;
+    chunk_t ck;
+#ifdef HAVE_LIBNSS
+    PK11SlotInfo *slot = PK11_GetInternalSlot();
+    PK11SymKey *symkey;
+    SECItem item;
+
+    item.type = siBuffer;
+    item.data = (u_char *)raw;
+    item.len  = rawlen;
+    symkey = PK11_ImportSymKey(slot, CKM_AES_GCM, PK11_OriginUnwrap
+			       , CKA_ENCRYPT, &item, NULL);
+    PK11_FreeSlot(slot);
+    passert(symkey != NULL);
+
+    memcpy(kv, &symkey, sizeof(symkey));
+    memcpy(kv + sizeof(symkey), salt, e->salt_size);
+    setchunk(ck, kv, sizeof(symkey) + e->salt_size);
+    k = crypt_key_new(e, ck);
+    PK11_FreeSymKey(symkey);	/* the crypt_key holds its own reference */
+#else
+    passert(rawlen + e->salt_size <= sizeof(kv));
+    memcpy(kv, raw, rawlen);
+    memcpy(kv + rawlen, salt, e->salt_size);
+    setchunk(ck, kv, rawlen + e->salt_size);
+    k = crypt_key_new(e, ck);
+#endif
+    return k;
+}
+
+static int run_kat(const struct encrypt_desc *e, const struct kat *kat)
+{
+    u_char key[32], salt[4], iv[8], aad[20], plain[60];
+    u_char expect[60], expect_tag[16], buf[60 + 16];
+    size_t keylen, aadlen, len;
+    struct crypt_key *k;
+    int fails = 0;
+
+    keylen = unhex(kat->key, key, sizeof(key));
+    unhex(kat_salt, salt, sizeof(salt));
+    unhex(kat_iv, iv, sizeof(iv));
+    aadlen = unhex(kat_aad, aad, sizeof(aad));
+    len = unhex(kat_plain, plain, sizeof(plain));
+    unhex(kat->cipher, expect, sizeof(expect));
+    unhex(kat->tag, expect_tag, sizeof(expect_tag));
+
+    printf("AES-GCM-16 with a %u bit key\n", (unsigned)keylen * BITS_PER_BYTE);
+    k = gcm_key(e, key, keylen, salt);
+
+    memcpy(buf, plain, len);
+    crypt_key_aead(k, buf, len, iv, aad, aadlen, buf + len, TRUE);
+    print_hex("ciphertext", buf, len);
+    print_hex("ICV", buf + len, e->aead_tag_size);
+    if(memcmp(buf, expect, len) != 0
+       || memcmp(buf + len, expect_tag, e->aead_tag_size) != 0) {
+	printf("encrypt: MISMATCH\n");
+	fails++;
+    } else {
+	printf("encrypt: matches\n");
+    }
+
+    if(!crypt_key_aead(k, buf, len, iv, aad, aadlen, buf + len, FALSE)
+       || memcmp(buf, plain, len) != 0) {
+	printf("decrypt: FAILED\n");
+	fails++;
+    } else {
+	printf("decrypt: matches\n");
+    }
+
+    /* a flipped bit in the ciphertext, the AAD or the ICV is caught */
+    memcpy(buf, expect, len);
+    memcpy(buf + len, expect_tag, e->aead_tag_size);
+    buf[3] ^= 0x01;
+    if(crypt_key_aead(k, buf, len, iv, aad, aadlen, buf + len, FALSE)) {
+	printf("forged ciphertext: ACCEPTED\n");
+	fails++;
+    } else {
+	printf("forged ciphertext: rejected\n");
+    }
+
+    memcpy(buf, expect, len);
+    aad[0] ^= 0x80;
+    if(crypt_key_aead(k, buf, len, iv, aad, aadlen, buf + len, FALSE)) {
+	printf("forged AAD: ACCEPTED\n");
+	fails++;
+    } else {
+	printf("forged AAD: rejected\n");
+    }
+    aad[0] ^= 0x80;
+
+    memcpy(buf, expect, len);
+    buf[len + e->aead_tag_size - 1] ^= 0x01;
+    if(crypt_key_aead(k, buf, len, iv, aad, aadlen, buf + len, FALSE)) {
+	printf("forged ICV: ACCEPTED\n");
+	fails++;
+    } else {
+	printf("forged ICV: rejected\n");
+    }
+
+    crypt_key_free(&k);
+    return fails;
+}
+
+/*
+ * An SK payload, laid out as ikev2_encrypt_msg() builds it: the IKE header
+ * and the SK payload header are the AAD, then the IV, the padded
+ * plaintext, and the ICV in place of the HMAC.
+ */
+static int run_sk(const struct encrypt_desc *e)
+{
+    u_char key[16], salt[4];
+    u_char msg[NSIZEOF_isakmp_hdr + 4 + 8 + 64 + 16];
+    u_char *iv, *encstart, *authloc;
+    size_t plainlen = 37, padlen, enclen, i;
+    struct crypt_key *k;
+    int fails = 0;
+
+    memset(key, 0x11, sizeof(key));
+    memset(salt, 0x22, sizeof(salt));
+    for(i = 0; i < sizeof(msg); i++)
+	msg[i] = i;
+
+    iv = msg + NSIZEOF_isakmp_hdr + 4;
+    encstart = iv + e->iv_size;
+    /* enc_blocksize is 1: the pad length byte is all the padding */
+    padlen = e->enc_blocksize - (plainlen + 1) % e->enc_blocksize;
+    if(padlen == e->enc_blocksize)
+	padlen = 0;
+    enclen = plainlen + padlen + 1;
+    encstart[enclen - 1] = padlen;
+    authloc = encstart + enclen;
+
+    printf("SK payload with %u bytes of payloads\n", (unsigned)plainlen);
+    k = gcm_key(e, key, sizeof(key), salt);
+    crypt_key_aead(k, encstart, enclen, iv, msg, iv - msg, authloc, TRUE);
+    print_hex("message", msg, authloc + e->aead_tag_size - msg);
+
+    if(!crypt_key_aead(k, encstart, enclen, iv, msg, iv - msg, authloc, FALSE)) {
+	printf("decrypt: FAILED\n");
+	fails++;
+    } else {
+	for(i = 0; i < plainlen; i++) {
+	    if(encstart[i] != (u_char)(encstart - msg + i))
+		break;
+	}
+	if(i != plainlen || encstart[enclen - 1] != padlen) {
+	    printf("decrypt: MISMATCH\n");
+	    fails++;
+	} else {
+	    printf("decrypt: matches\n");
+	}
+    }
+
+    crypt_key_free(&k);
+    return fails;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct encrypt_desc *e;
+    unsigned int i;
+    int fails = 0;
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    tool_init_log();
+    cur_debugging = DBG_NONE;
+
+#ifdef HAVE_LIBNSS
+    if(NSS_NoDB_Init(".") != SECSuccess) {
+	fprintf(stderr, "%s: NSS initialization failed (err %d)\n"
+		, progname, PR_GetError());
+	exit(10);
+    }
+#endif
+
+    init_crypto();
+    load_oswcrypto();
+    fflush(stderr);
+
+    e = (struct encrypt_desc *)
+	ike_alg_ikev2_find(IKE_ALG_ENCRYPT, IKEv2_ENCR_AES_GCM_16, 0);
+    if(e == NULL) {
+	printf("%s: no IKEv2 AES-GCM-16 cipher\n", TESTNAME);
+	exit(1);
+    }
+    printf("%s: iv %u salt %u ICV %u, %s\n", e->common.name
+	   , (unsigned)e->iv_size, (unsigned)e->salt_size
+	   , (unsigned)e->aead_tag_size
+	   , ike_alg_enc_aead(e) ? "AEAD" : "not AEAD");
+
+    for(i = 0; i < elemsof(kats); i++)
+	fails += run_kat(e, &kats[i]);
+    fails += run_sk(e);
+
+    printf("%d failures\n", fails);
+    fflush(stdout);
+
+#ifdef HAVE_LIBNSS
+    NSS_Shutdown();
+#endif
+    report_leaks();
+    tool_close_log();
+    exit(fails != 0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,676 @@
+/*
+ * DH / PRF / cipher micro-benchmark for the pluto crypto helpers.
+ * Copyright (C) 2026 Openswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * It calls the same entry points that the crypto helpers do (compute_ke(),
+ * calc_dh_v2(), hmac_*(), the encrypt_desc do_crypt() hooks and the
+ * per-SA crypt_key and hmac_key of ikev2_encrypt_msg()), so the
+ * numbers are those of the backend pluto was built with: NSS, or the
+ * software gmp/oswcrypto code.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <openswan.h>
+
+#include "sysdep.h"
+#include "constants.h"
+#include "oswalloc.h"
+#include "oswlog.h"
+#include "oswcrypto.h"
+#include "pluto/defs.h"
+#include "packet.h"
+#include "demux.h"
+#include "state.h"
+#include "log.h"
+#include "crypto.h"
+#include "ike_alg.h"
+#include "pluto_crypt.h"
+
+#ifdef HAVE_LIBNSS
+# include <nspr.h>
+# include <nss.h>
+# include <pk11pub.h>
+# include <keyhi.h>
+#endif
+
+#include "seam_rnd.c"
+#include "seam_whack.c"
+#include "seam_exitlog.c"
+
+#define TESTNAME "dhprfbench"
+
+#ifdef HAVE_LIBNSS
+#define BENCH_BACKEND "nss"
+#else
+#define BENCH_BACKEND "sw"
+#endif
+
+#define BENCH_MAX_SAMPLES 20000
+#define BENCH_MIN_SAMPLES 5
+#define BENCH_CIPHER_BYTES 1024
+#define BENCH_MESSAGE_BYTES 256
+
+const char *progname;
+
+static double bench_seconds = 0.5;	/* time budget for each operation */
+static unsigned bench_iterations = 0;	/* fixed count instead, if set */
+static double samples[BENCH_MAX_SAMPLES];
+
+/* results of the other backend, from --baseline */
+#define BASELINE_MAX 256
+static struct baseline {
+    char kind[16];
+    char name[64];
+    char op[16];
+    double ops_per_sec;
+} baseline[BASELINE_MAX];
+static unsigned baseline_count = 0;
+
+typedef void (*bench_op)(void *arg);
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static const struct baseline *find_baseline(const char *kind
+					    , const char *name
+					    , const char *op)
+{
+    unsigned i;
+
+    for(i = 0; i < baseline_count; i++) {
+	if(streq(baseline[i].kind, kind)
+	   && streq(baseline[i].name, name)
+	   && streq(baseline[i].op, op))
+	    return &baseline[i];
+    }
+    return NULL;
+}
+
+static void load_baseline(const char *file)
+{
+    char line[512];
+    FILE *f = fopen(file, "r");
+
+    if(f == NULL) {
+	fprintf(stderr, "%s: can not open baseline %s\n", progname, file);
+	exit(10);
+    }
+
+    while(fgets(line, sizeof(line), f) != NULL
+	  && baseline_count < BASELINE_MAX) {
+	struct baseline *b = &baseline[baseline_count];
+	const char *kind = strstr(line, "\"kind\":");
+	const char *ops = strstr(line, "\"ops_per_sec\":");
+
+	if(kind == NULL || ops == NULL
+	   || sscanf(kind, "\"kind\":\"%15[^\"]\",\"name\":\"%63[^\"]\",\"op\":\"%15[^\"]\""
+		     , b->kind, b->name, b->op) != 3
+	   || sscanf(ops, "\"ops_per_sec\":%lf", &b->ops_per_sec) != 1)
+	    continue;
+	baseline_count++;
+    }
+    fclose(f);
+}
+
+/*
+ * run op until the time budget (or the fixed iteration count) is used up,
+ * then print its result: one JSON object, on a line of its own.
+ */
+static void run_bench(const char *kind, const char *name, const char *op
+		      , bench_op fn, void *arg, size_t bytes)
+{
+    unsigned n = 0;
+    double start, total;
+    const struct baseline *b;
+
+    /* one untimed call, to fault in tables and NSS slots */
+    (*fn)(arg);
+
+    start = now_us();
+    while(n < BENCH_MAX_SAMPLES) {
+	double t0 = now_us();
+
+	(*fn)(arg);
+	samples[n++] = now_us() - t0;
+
+	if(bench_iterations != 0) {
+	    if(n >= bench_iterations)
+		break;
+	} else if(n >= BENCH_MIN_SAMPLES
+		  && now_us() - start >= bench_seconds * 1e6) {
+	    break;
+	}
+    }
+    total = now_us() - start;
+
+    qsort(samples, n, sizeof(samples[0]), cmp_double);
+
+    printf("{\"backend\":\"%s\",\"kind\":\"%s\",\"name\":\"%s\",\"op\":\"%s\""
+	   ",\"iterations\":%u,\"bytes\":%lu"
+	   ",\"ops_per_sec\":%.1f,\"p50_us\":%.2f,\"p99_us\":%.2f"
+	   , BENCH_BACKEND, kind, name, op, n
+	   , (unsigned long)bytes
+	   , n * 1e6 / total
+	   , samples[n / 2]
+	   , samples[(n * 99) / 100]);
+
+    b = find_baseline(kind, name, op);
+    if(b != NULL && b->ops_per_sec > 0) {
+	printf(",\"baseline_ops_per_sec\":%.1f,\"speedup\":%.3f"
+	       , b->ops_per_sec
+	       , (n * 1e6 / total) / b->ops_per_sec);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+/*
+ * Under NSS, the key arguments of hmac_init() and do_crypt() are really
+ * PK11SymKey pointers, exactly as calc_skeyseed_v2() hands them out.
+ */
+#ifdef HAVE_LIBNSS
+static PK11SymKey *bench_symkey(CK_MECHANISM_TYPE mech, CK_ATTRIBUTE_TYPE op
+				, u_char *raw, size_t len)
+{
+    PK11SlotInfo *slot = PK11_GetInternalSlot();
+    PK11SymKey *key;
+    SECItem item;
+
+    item.type = siBuffer;
+    item.data = raw;
+    item.len  = len;
+
+    key = PK11_ImportSymKey(slot, mech, PK11_OriginUnwrap, op, &item, NULL);
+    PK11_FreeSlot(slot);
+    return key;
+}
+
+static void free_kenonce_keys(struct pcr_kenonce *kn)
+{
+    SECKEYPrivateKey *privk;
+    SECKEYPublicKey  *pubk;
+
+    memcpy(&privk, wire_chunk_ptr(kn, &kn->secret), sizeof(privk));
+    memcpy(&pubk,  wire_chunk_ptr(kn, &kn->pubk),   sizeof(pubk));
+    SECKEY_DestroyPrivateKey(privk);
+    SECKEY_DestroyPublicKey(pubk);
+}
+#else
+static void free_kenonce_keys(struct pcr_kenonce *kn) {}
+#endif
+
+/* DH key pair generation, bypassing the key pair pool */
+static void op_keygen(void *arg)
+{
+    const struct oakley_group_desc *group = arg;
+    struct pluto_crypto_req r;
+
+    pcr_init(&r, pcr_build_kenonce, pcim_demand_crypto);
+    r.pcr_d.kn.oakley_group = group->group;
+    compute_ke(&r.pcr_d.kn);
+    free_kenonce_keys(&r.pcr_d.kn);
+}
+
+/* the IKEv2 g^ir, SKEYSEED and prf+ calculation, as an initiator */
+struct dh_v2_arg {
+    struct pluto_crypto_req req;
+    struct pluto_crypto_req scratch;
+};
+
+static void op_dh_v2(void *arg)
+{
+    struct dh_v2_arg *dv = arg;
+
+    memcpy(&dv->scratch, &dv->req, sizeof(dv->scratch));
+    calc_dh_v2(&dv->scratch);
+    passert(dv->scratch.pcr_success);
+}
+
+static void bench_group(const struct oakley_group_desc *group)
+{
+    const char *name = enum_name(&oakley_group_names, group->group);
+    const struct encrypt_desc *aes = (struct encrypt_desc *)
+	ike_alg_ikev2_find(IKE_ALG_ENCRYPT, IKEv2_ENCR_AES_CBC, 0);
+    static struct dh_v2_arg dv;
+    struct pluto_crypto_req me, peer;
+    struct pcr_skeyid_q *dhq;
+    chunk_t ch;
+    u_char nonce[16];
+    u_char cookie[COOKIE_SIZE];
+
+    passert(aes != NULL);
+    run_bench("dh", name, "keygen", op_keygen, (void *)group, 0);
+
+    pcr_init(&me, pcr_build_kenonce, pcim_demand_crypto);
+    me.pcr_d.kn.oakley_group = group->group;
+    compute_ke(&me.pcr_d.kn);
+
+    pcr_init(&peer, pcr_build_kenonce, pcim_demand_crypto);
+    peer.pcr_d.kn.oakley_group = group->group;
+    rnd_offset = 13;	/* a different non-random secret for the peer */
+    compute_ke(&peer.pcr_d.kn);
+    rnd_offset = 0;
+
+    /* set up the request the way start_dh_v2() would */
+    pcr_init(&dv.req, pcr_compute_dh_v2, pcim_demand_crypto);
+    dhq = &dv.req.pcr_d.dhq;
+    dhq->auth         = OAKLEY_PRESHARED_KEY;
+    dhq->prf_hash     = IKEv2_PRF_HMAC_SHA1;
+    dhq->integ_hash   = IKEv2_AUTH_HMAC_SHA1_96;
+    dhq->oakley_group = group->group;
+    dhq->init         = INITIATOR;
+    dhq->keysize      = aes->keydeflen / BITS_PER_BYTE;
+
+    memset(nonce, 0x5a, sizeof(nonce));
+    setchunk(ch, nonce, sizeof(nonce));
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->ni, ch);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->nr, ch);
+    setchunk_fromwire(ch, &me.pcr_d.kn.gi, &me.pcr_d.kn);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->gi, ch);
+    setchunk_fromwire(ch, &peer.pcr_d.kn.gi, &peer.pcr_d.kn);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->gr, ch);
+    setchunk_fromwire(ch, &me.pcr_d.kn.secret, &me.pcr_d.kn);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->secret, ch);
+    dhq->encrypter = aes;
+#ifdef HAVE_LIBNSS
+    setchunk_fromwire(ch, &me.pcr_d.kn.pubk, &me.pcr_d.kn);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->pubk, ch);
+#endif
+    memset(cookie, 0xc0, sizeof(cookie));
+    setchunk(ch, cookie, sizeof(cookie));
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->icookie, ch);
+    pluto_crypto_copychunk(&dhq->thespace, dhq->space, &dhq->rcookie, ch);
+
+    run_bench("dh", name, "dh_v2", op_dh_v2, &dv, 0);
+
+    free_kenonce_keys(&me.pcr_d.kn);
+    free_kenonce_keys(&peer.pcr_d.kn);
+}
+
+/* prf(Ni | Nr, g^ir), the SKEYSEED step, with a 2048 bit g^ir */
+struct prf_arg {
+    const struct hash_desc *hasher;
+    u_char key[32];
+    u_char data[256];
+    u_char out[MAX_DIGEST_LEN];
+#ifdef HAVE_LIBNSS
+    PK11SymKey *symkey;
+#endif
+};
+
+static void op_prf(void *arg)
+{
+    struct prf_arg *pa = arg;
+    struct hmac_ctx ctx;
+
+#ifdef HAVE_LIBNSS
+    hmac_init(&ctx, pa->hasher, (u_char *)&pa->symkey, sizeof(pa->symkey));
+#else
+    hmac_init(&ctx, pa->hasher, pa->key, sizeof(pa->key));
+#endif
+    hmac_update(&ctx, pa->data, sizeof(pa->data));
+    hmac_final(pa->out, &ctx);
+}
+
+static void bench_hash(const struct hash_desc *hasher)
+{
+    static struct prf_arg pa;
+
+    pa.hasher = hasher;
+    memset(pa.key, 0x11, sizeof(pa.key));
+    memset(pa.data, 0x22, sizeof(pa.data));
+#ifdef HAVE_LIBNSS
+    pa.symkey = bench_symkey(CKM_GENERIC_SECRET_KEY_GEN, CKA_DERIVE
+			     , pa.key, sizeof(pa.key));
+    if(pa.symkey == NULL) {
+	fprintf(stderr, "%s: can not import hmac key for %s\n"
+		, progname, hasher->common.name);
+	return;
+    }
+#endif
+
+    run_bench("prf", hasher->common.name, "hmac", op_prf, &pa
+	      , sizeof(pa.data));
+
+#ifdef HAVE_LIBNSS
+    PK11_FreeSymKey(pa.symkey);
+#endif
+}
+
+/* one 1k chunk of an IKE message, encrypted in place */
+struct cipher_arg {
+    const struct encrypt_desc *encrypter;
+    u_char key[64];
+    size_t keylen;
+    u_char iv[MAX_DIGEST_LEN];
+    u_char buf[BENCH_CIPHER_BYTES];
+#ifdef HAVE_LIBNSS
+    PK11SymKey *symkey;
+#endif
+    chunk_t crypt_key;		/* what do_crypt() is handed as its key */
+};
+
+static void op_cipher(void *arg)
+{
+    struct cipher_arg *ca = arg;
+
+    ca->encrypter->do_crypt(ca->buf, sizeof(ca->buf)
+			    , ca->crypt_key.ptr, ca->crypt_key.len
+			    , ca->iv, TRUE);
+}
+
+/*
+ * The SK payload of one IKEv2 message: encrypt it, then HMAC it, the way
+ * ikev2_encrypt_msg() does.  "per_msg_keys" sets both keys up again for
+ * every message, as pluto used to; "per_sa_keys" uses the crypt_key and
+ * hmac_key a parent SA now keeps.
+ */
+struct message_arg {
+    struct cipher_arg *ca;
+    const struct hash_desc *integ;
+    chunk_t integ_key;
+    struct crypt_key *ck;
+    struct hmac_key *hk;
+    u_char msg[BENCH_MESSAGE_BYTES];
+    u_char icv[MAX_DIGEST_LEN];
+};
+
+static void op_message_per_msg(void *arg)
+{
+    struct message_arg *ma = arg;
+    struct cipher_arg *ca = ma->ca;
+    struct hmac_ctx ctx;
+
+    ca->encrypter->do_crypt(ma->msg, sizeof(ma->msg)
+			    , ca->crypt_key.ptr, ca->crypt_key.len
+			    , ca->iv, TRUE);
+    hmac_init_chunk(&ctx, ma->integ, ma->integ_key);
+    hmac_update(&ctx, ma->msg, sizeof(ma->msg));
+    hmac_final(ma->icv, &ctx);
+}
+
+static void op_message_per_sa(void *arg)
+{
+    struct message_arg *ma = arg;
+    struct hmac_ctx ctx;
+
+    crypt_key_crypt(ma->ck, ma->msg, sizeof(ma->msg), ma->ca->iv, TRUE);
+    hmac_init_key(&ctx, ma->hk);
+    hmac_update(&ctx, ma->msg, sizeof(ma->msg));
+    hmac_final(ma->icv, &ctx);
+}
+
+static void bench_message(struct cipher_arg *ca)
+{
+    static struct message_arg ma;
+    const struct hash_desc *integ = (struct hash_desc *)
+	ike_alg_ikev2_find(IKE_ALG_INTEG, IKEv2_AUTH_HMAC_SHA1_96, 0);
+    u_char integ_raw[SHA1_DIGEST_SIZE];
+    chunk_t ck;
+#ifdef HAVE_LIBNSS
+    PK11SymKey *integ_symkey;
+#endif
+
+    if(integ == NULL)
+	return;
+    memset(integ_raw, 0x66, sizeof(integ_raw));
+    memset(ma.msg, 0x77, sizeof(ma.msg));
+    ma.ca = ca;
+    ma.integ = integ;
+
+#ifdef HAVE_LIBNSS
+    integ_symkey = bench_symkey(CKM_GENERIC_SECRET_KEY_GEN, CKA_DERIVE
+				, integ_raw, sizeof(integ_raw));
+    if(integ_symkey == NULL) {
+	fprintf(stderr, "%s: can not import integrity key\n", progname);
+	return;
+    }
+    setchunk(ma.integ_key, (u_char *)&integ_symkey, sizeof(integ_symkey));
+#else
+    setchunk(ma.integ_key, integ_raw, sizeof(integ_raw));
+#endif
+    ck = ca->crypt_key;
+
+    run_bench("message", ca->encrypter->common.name, "per_msg_keys"
+	      , op_message_per_msg, &ma, sizeof(ma.msg));
+
+    ma.ck = crypt_key_new(ca->encrypter, ck);
+    ma.hk = hmac_key_new(integ, ma.integ_key);
+    run_bench("message", ca->encrypter->common.name, "per_sa_keys"
+	      , op_message_per_sa, &ma, sizeof(ma.msg));
+    crypt_key_free(&ma.ck);
+    hmac_key_free(&ma.hk);
+
+#ifdef HAVE_LIBNSS
+    PK11_FreeSymKey(integ_symkey);
+#endif
+}
+
+/*
+ * An AEAD cipher protects the SK payload in one pass, with no HMAC: the
+ * IKE header and SK payload header are the AAD, and the ICV is its tag.
+ */
+struct aead_arg {
+    struct crypt_key *ck;
+    u_char aad[NSIZEOF_isakmp_hdr + 4];
+    u_char msg[BENCH_MESSAGE_BYTES];
+    u_char icv[MAX_DIGEST_LEN];
+    u_char iv[MAX_DIGEST_LEN];
+};
+
+static void op_message_aead(void *arg)
+{
+    struct aead_arg *aa = arg;
+
+    crypt_key_aead(aa->ck, aa->msg, sizeof(aa->msg), aa->iv
+		   , aa->aad, sizeof(aa->aad), aa->icv, TRUE);
+}
+
+static void bench_aead(struct cipher_arg *ca)
+{
+    const struct encrypt_desc *encrypter = ca->encrypter;
+    static struct aead_arg aa;
+    u_char kv[64 + 4];
+    chunk_t ck;
+#ifdef HAVE_LIBNSS
+    PK11SymKey *symkey;
+#endif
+
+    if(encrypter->aead_tag_size > sizeof(aa.icv)
+       || encrypter->iv_size > sizeof(aa.iv)
+       || encrypter->salt_size > 4)
+	return;
+    memset(aa.aad, 0x22, sizeof(aa.aad));
+    memset(aa.iv, 0x44, sizeof(aa.iv));
+    memset(aa.msg, 0x77, sizeof(aa.msg));
+
+#ifdef HAVE_LIBNSS
+    /* as calc_skeyseed_v2() gives it: the PK11SymKey, then the salt */
+    symkey = bench_symkey(CKM_AES_GCM, CKA_ENCRYPT, ca->key, ca->keylen);
+    if(symkey == NULL) {
+	fprintf(stderr, "%s: can not import cipher key for %s\n"
+		, progname, encrypter->common.name);
+	return;
+    }
+    memcpy(kv, &symkey, sizeof(symkey));
+    memset(kv + sizeof(symkey), 0x33, encrypter->salt_size);
+    setchunk(ck, kv, sizeof(symkey) + encrypter->salt_size);
+#else
+    memcpy(kv, ca->key, ca->keylen);
+    memset(kv + ca->keylen, 0x33, encrypter->salt_size);
+    setchunk(ck, kv, ca->keylen + encrypter->salt_size);
+#endif
+
+    aa.ck = crypt_key_new(encrypter, ck);
+    run_bench("message", encrypter->common.name, "aead"
+	      , op_message_aead, &aa, sizeof(aa.msg));
+    crypt_key_free(&aa.ck);
+
+#ifdef HAVE_LIBNSS
+    PK11_FreeSymKey(symkey);
+#endif
+}
+
+static void bench_cipher(const struct encrypt_desc *encrypter)
+{
+    static struct cipher_arg ca;
+
+    ca.encrypter = encrypter;
+    ca.keylen = encrypter->keydeflen / BITS_PER_BYTE;
+    if(ca.keylen > sizeof(ca.key) || encrypter->enc_blocksize > sizeof(ca.iv))
+	return;
+    memset(ca.key, 0x33, sizeof(ca.key));
+    memset(ca.iv, 0x44, sizeof(ca.iv));
+    memset(ca.buf, 0x55, sizeof(ca.buf));
+
+    /* no do_crypt(), so no "encrypt" result either */
+    if(ike_alg_enc_aead(encrypter)) {
+	bench_aead(&ca);
+	return;
+    }
+
+    setchunk(ca.crypt_key, ca.key, ca.keylen);
+#ifdef HAVE_LIBNSS
+    /*
+     * Only AES-CBC goes through NSS; do_3des() stays in software and
+     * takes the raw key even in an NSS build.  pluto has no NSS
+     * mechanism for the others, so they are not measured.
+     */
+    ca.symkey = NULL;
+    switch(encrypter->common.algo_id) {
+    case OAKLEY_AES_CBC:
+	ca.symkey = bench_symkey(CKM_AES_CBC, CKA_ENCRYPT, ca.key, ca.keylen);
+	if(ca.symkey == NULL) {
+	    fprintf(stderr, "%s: can not import cipher key for %s\n"
+		    , progname, encrypter->common.name);
+	    return;
+	}
+	setchunk(ca.crypt_key, (u_char *)&ca.symkey, sizeof(ca.symkey));
+	break;
+    case OAKLEY_3DES_CBC:
+	break;
+    default:
+	return;
+    }
+#endif
+
+    run_bench("encrypt", encrypter->common.name, "cbc", op_cipher, &ca
+	      , sizeof(ca.buf));
+    bench_message(&ca);
+
+#ifdef HAVE_LIBNSS
+    if(ca.symkey != NULL)
+	PK11_FreeSymKey(ca.symkey);
+#endif
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [--seconds S] [--iterations N] [--baseline FILE]\n"
+	    , progname);
+    exit(10);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_opts[] = {
+	{ "seconds",    required_argument, NULL, 's' },
+	{ "iterations", required_argument, NULL, 'n' },
+	{ "baseline",   required_argument, NULL, 'b' },
+	{ 0, 0, 0, 0 }
+    };
+    struct ike_alg *a;
+    unsigned int i;
+    int c;
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    while((c = getopt_long(argc, argv, "s:n:b:", long_opts, NULL)) != EOF) {
+	switch(c) {
+	case 's':
+	    bench_seconds = atof(optarg);
+	    break;
+	case 'n':
+	    bench_iterations = atoi(optarg);
+	    if(bench_iterations > BENCH_MAX_SAMPLES)
+		bench_iterations = BENCH_MAX_SAMPLES;
+	    break;
+	case 'b':
+	    load_baseline(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if(optind != argc)
+	usage();
+
+    tool_init_log();
+    cur_debugging = DBG_NONE;
+
+#ifdef HAVE_LIBNSS
+    if(NSS_NoDB_Init(".") != SECSuccess) {
+	fprintf(stderr, "%s: NSS initialization failed (err %d)\n"
+		, progname, PR_GetError());
+	exit(10);
+    }
+#endif
+
+    init_crypto();
+    load_oswcrypto();
+
+    for(i = 0; i < oakley_group_size; i++)
+	bench_group(&oakley_group[i]);
+
+    IKE_HALG_FOR_EACH(a) {
+	bench_hash((struct hash_desc *)a);
+    }
+
+    IKE_EALG_FOR_EACH(a) {
+	bench_cipher((struct encrypt_desc *)a);
+    }
+
+#ifdef HAVE_LIBNSS
+    NSS_Shutdown();
+#endif
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make bench"
+ * End:
+ */
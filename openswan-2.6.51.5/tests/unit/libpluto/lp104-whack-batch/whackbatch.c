@@ -0,0 +1,79 @@
+#include "whackbatch_head.c"
+
+#define TESTNAME "whackbatch"
+
+static bool all_records(unsigned int i)
+{
+    return TRUE;
+}
+
+static void show_conns(void)
+{
+    unsigned int i;
+
+    for(i = 0; i < record_count; i++)
+	if(record_conn(i) != NULL)
+	    show_conn(record_conn(i));
+}
+
+int main(int argc, char *argv[])
+{
+    char *ctlpath;
+    unsigned int i;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    if(argc != 3) {
+	fprintf(stderr, "Usage: %s <whackrecord> <ctlsocket>\n", progname);
+	exit(10);
+    }
+    ctlpath = argv[2];
+
+    tool_init_log();
+    init_crypto();
+    load_oswcrypto();
+    init_fake_vendorid();
+    init_parker_interface(TRUE);
+
+    cur_debugging = DBG_NONE;
+    read_records(argv[1]);
+
+    /* every conn and key of the file, in one request */
+    send_batch(ctlpath, 0, 0, all_records);
+    show_conns();
+
+    /* the same again: each conn replaces the one of the same name */
+    send_batch(ctlpath, 0, 0, all_records);
+    show_conns();
+
+    /* a message that does not unpack is skipped, and counted as failed */
+    record_msg(0)->magic = ~WHACK_MAGIC;
+    send_batch(ctlpath, 0, 0, all_records);
+    record_msg(0)->magic = WHACK_MAGIC;
+
+    /* a batch that ends early is reported, after what it did have */
+    send_batch(ctlpath, 0, 1, all_records);
+
+    for(i = 0; i < record_count; i++)
+	if(record_conn(i) != NULL)
+	    delete_connections_by_name(record_conn(i), FALSE);
+    show_conns();
+
+    free_records();
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
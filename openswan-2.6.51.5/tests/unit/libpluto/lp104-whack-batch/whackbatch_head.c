@@ -0,0 +1,187 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../lp02-parentI1/parentI1_head.c"
+#include "seam_gi_md5.c"
+#include "seam_finish.c"
+#include "seam_ikev2_sendI1.c"
+#include "seam_demux.c"
+#include "seam_x509.c"
+#include "seam_pending.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_keys.c"
+#include "seam_dnskey.c"
+#include "seam_host_parker.c"
+
+/*
+ * The messages of a whack record file, each as addconn would put it in a
+ * batch: a u_int32_t length, and then the packed message.
+ */
+struct batch_record {
+    u_int32_t len;
+    unsigned char *msg;
+};
+
+#define MAX_RECORDS 64
+static struct batch_record records[MAX_RECORDS];
+static unsigned int record_count;
+
+static void read_records(const char *infile)
+{
+    FILE *record;
+    char  b1[8192];
+    u_int32_t plen;
+
+    if((record = fopen(infile, "r")) == NULL) {
+	perror(infile);
+	exit(9);
+    }
+
+    /* the first line is a comment */
+    if(fgets(b1, sizeof(b1), record) == NULL) {
+	fprintf(stderr, "%s: empty whack record\n", infile);
+	exit(9);
+    }
+
+    while(fread(&plen, 4, 1, record) == 1) {
+	u_int32_t a[2];
+	size_t abuflen;
+	struct whack_message *m;
+
+	if(fread(&a, 4, 2, record) != 2)
+	    break;
+
+	/* 4 bytes of plen, 8 bytes of time stamp */
+	plen -= 12;
+	abuflen = (plen + 3) & ~0x3;
+	if(abuflen > sizeof(struct whack_message) || record_count == MAX_RECORDS) {
+	    fprintf(stderr, "%s: too big a record\n", infile);
+	    exit(6);
+	}
+
+	m = alloc_bytes(sizeof(struct whack_message), "batch record");
+	if(fread(m, abuflen, 1, record) != 1) {
+	    pfree(m);
+	    break;
+	}
+
+	/* the basic commands are not packed, so they are not batched */
+	if(plen <= 4 || m->magic != WHACK_MAGIC) {
+	    pfree(m);
+	    continue;
+	}
+
+	records[record_count].len = plen;
+	records[record_count].msg = (unsigned char *)m;
+	record_count++;
+    }
+    fclose(record);
+}
+
+static void free_records(void)
+{
+    unsigned int i;
+
+    for(i = 0; i < record_count; i++)
+	pfree(records[i].msg);
+    record_count = 0;
+}
+
+static struct whack_message *record_msg(unsigned int i)
+{
+    return (struct whack_message *)records[i].msg;
+}
+
+/* the name of the conn that record i adds, or NULL for a key */
+static const char *record_conn(unsigned int i)
+{
+    struct whack_message *m = record_msg(i);
+
+    if(!m->whack_connection)
+	return NULL;
+
+    /* the name is the first packed string */
+    return (const char *)m->string;
+}
+
+/*
+ * Hand whack_handle() a batch of the records that sel selects, as
+ * addconn would send it.  If short_by is not zero, the batch claims that
+ * many more messages than it has.
+ */
+static void send_batch(const char *ctlpath, u_int32_t flags, unsigned int short_by
+		       , bool (*sel)(unsigned int i))
+{
+    struct sockaddr_un ctl;
+    struct whack_batch wb;
+    int lfd, wfd;
+    unsigned int i;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.sun_family = AF_UNIX;
+    strncpy(ctl.sun_path, ctlpath, sizeof(ctl.sun_path) - 1);
+    unlink(ctlpath);
+
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    wfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(lfd < 0 || wfd < 0
+       || bind(lfd, (struct sockaddr *)&ctl, sizeof(ctl)) < 0
+       || listen(lfd, 1) < 0
+       || connect(wfd, (struct sockaddr *)&ctl, sizeof(ctl)) < 0) {
+	perror(ctlpath);
+	exit(20);
+    }
+
+    wb.magic = WHACK_BATCH_MAGIC;
+    wb.count = short_by;
+    wb.flags = flags;
+    for(i = 0; i < record_count; i++)
+	if(sel(i))
+	    wb.count++;
+    openswan_log("sending a whack batch of %u messages%s"
+		 , wb.count, flags & WHACK_BATCH_RELOAD ? " to reload" : "");
+
+    /* it all fits in the socket buffer: pluto reads it after */
+    if(write(wfd, &wb, sizeof(wb)) != sizeof(wb)) {
+	perror("write");
+	exit(21);
+    }
+    for(i = 0; i < record_count; i++) {
+	if(!sel(i))
+	    continue;
+	if(write(wfd, &records[i].len, sizeof(records[i].len)) != sizeof(records[i].len)
+	   || write(wfd, records[i].msg, records[i].len) != (ssize_t)records[i].len) {
+	    perror("write");
+	    exit(21);
+	}
+    }
+    shutdown(wfd, SHUT_WR);
+
+    whack_handle(lfd);
+
+    close(wfd);
+    close(lfd);
+    unlink(ctlpath);
+}
+
+static void show_conn(const char *name)
+{
+    struct connection *c = con_by_name(name, FALSE);
+
+    if(c == NULL) {
+	openswan_log("  \"%s\" is not loaded", name);
+	return;
+    }
+    openswan_log("  \"%s\" is loaded, ike_life %lus, policy %s"
+		 , name, (unsigned long)c->sa_ike_life_seconds
+		 , prettypolicy(c->policy));
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,155 @@
+#include "../lp104-whack-batch/whackbatch_head.c"
+
+#define TESTNAME "whackreload"
+
+/*
+ * The conns of the whack record, in order.  Each one's keys come just
+ * before it, and go in whichever batch it goes in.
+ */
+static const char *conn_of(unsigned int i)
+{
+    for(; i < record_count; i++)
+	if(record_conn(i) != NULL)
+	    return record_conn(i);
+    return "";
+}
+
+static bool in_first(unsigned int i)
+{
+    const char *name = conn_of(i);
+
+    return streq(name, "mytunnel") || streq(name, "alttunnel")
+	|| streq(name, "gcmtunnel") || streq(name, "mytunnel-no-ikev2");
+}
+
+/* mytunnel-no-ikev2 is left out, mytunnel-no-ikev1 is new */
+static bool in_reload(unsigned int i)
+{
+    const char *name = conn_of(i);
+
+    return streq(name, "mytunnel") || streq(name, "alttunnel")
+	|| streq(name, "gcmtunnel") || streq(name, "mytunnel-no-ikev1");
+}
+
+static bool only_mytunnel(unsigned int i)
+{
+    return streq(conn_of(i), "mytunnel");
+}
+
+static bool no_records(unsigned int i)
+{
+    return FALSE;
+}
+
+/* add a conn with its own whack messages, as whack itself would */
+static void add_by_hand(const char *name)
+{
+    unsigned int i;
+
+    for(i = 0; i < record_count; i++) {
+	struct whack_message m;
+	struct whackpacker wp;
+	err_t ugh;
+
+	if(!streq(conn_of(i), name))
+	    continue;
+
+	memcpy(&m, records[i].msg, records[i].len);
+	wp.msg = &m;
+	wp.n   = records[i].len;
+	wp.cnt = 0;
+	wp.str_next = m.string;
+	wp.str_roof = (unsigned char *)&m + records[i].len;
+	if((ugh = unpack_whack_msg(&wp)) != NULL) {
+	    fprintf(stderr, "failed to unpack record %u: %s\n", i, ugh);
+	    exit(12);
+	}
+	m.keyval.ptr = wp.str_next;
+	whack_process(NULL_FD, m);
+    }
+}
+
+static struct whack_message *conn_msg(const char *name)
+{
+    unsigned int i;
+
+    for(i = 0; i < record_count; i++)
+	if(record_conn(i) != NULL && streq(record_conn(i), name))
+	    return record_msg(i);
+    fprintf(stderr, "no conn %s in the whack record\n", name);
+    exit(13);
+}
+
+static void show_conns(void)
+{
+    unsigned int i;
+
+    for(i = 0; i < record_count; i++)
+	if(record_conn(i) != NULL)
+	    show_conn(record_conn(i));
+}
+
+int main(int argc, char *argv[])
+{
+    char *ctlpath;
+    unsigned int i;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    if(argc != 3) {
+	fprintf(stderr, "Usage: %s <whackrecord> <ctlsocket>\n", progname);
+	exit(10);
+    }
+    ctlpath = argv[2];
+
+    tool_init_log();
+    init_crypto();
+    load_oswcrypto();
+    init_fake_vendorid();
+    init_parker_interface(TRUE);
+
+    cur_debugging = DBG_NONE;
+    read_records(argv[1]);
+
+    /* ipsec.conf as loaded at startup, and a conn added with whack */
+    send_batch(ctlpath, 0, 0, in_first);
+    add_by_hand("mytunnelnets");
+    show_conns();
+
+    /* alttunnel only changes its timers, gcmtunnel its policy */
+    conn_msg("alttunnel")->sa_ike_life_seconds = 7200;
+    conn_msg("gcmtunnel")->policy &= ~POLICY_PFS;
+
+    send_batch(ctlpath, WHACK_BATCH_RELOAD, 0, in_reload);
+    show_conns();
+
+    /* a reload that was cut short removes nothing */
+    send_batch(ctlpath, WHACK_BATCH_RELOAD, 1, only_mytunnel);
+    show_conns();
+
+    /* an empty one removes all of ipsec.conf, but not mytunnelnets */
+    send_batch(ctlpath, WHACK_BATCH_RELOAD, 0, no_records);
+    show_conns();
+
+    for(i = 0; i < record_count; i++)
+	if(record_conn(i) != NULL)
+	    delete_connections_by_name(record_conn(i), FALSE);
+
+    free_records();
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,220 @@
+#define LEAK_DETECTIVE
+#define DEBUG 1
+
+#include <stdlib.h>
+#include "sysdep.h"
+#include "efencedef.h"
+#include "constants.h"
+#include "openswan.h"
+#include "oswtime.h"
+#include "oswalloc.h"
+#include "whack.h"
+
+#include "pluto/defs.h"
+#include "pluto/connections.h"
+#include "pluto/server.h"
+#include "state.h"
+#include "pluto/log.h"
+#include "packet.h"
+#include "timer.h"
+#include "kernel.h"
+#include "pluto/vendor.h"
+#include "pluto/nat_traversal.h"
+
+/* seams */
+#include "seam_log.c"
+#include "seam_whack.c"
+#include "seam_exitlog.c"
+
+const char *progname=NULL;
+int verbose=0;
+int warningsarefatal = 0;
+
+#define TESTNAME "nattkeepalive"
+
+#define NSTATES 40
+#define NSLOTS  32	/* NAT_KA_SLOTS */
+
+/* server.c, kernel.c SEAMs: nat_traversal.o needs them, the wheel does not */
+struct iface_port *interfaces = NULL;
+enum kernel_interface kern_interface = NO_KERNEL;
+u_int16_t pluto_port500  = 500;
+u_int16_t pluto_port4500 = 4500;
+
+bool out_vid(u_int8_t np, pb_stream *outs, unsigned int vid) { return TRUE; }
+int update_pending(struct state *os, struct state *ns) { return 0; }
+void set_state_remoteaddr(struct state *st, const ip_address *addr) {}
+
+/* state.c SEAM: the states of the test, by serial number */
+static struct state *states[NSTATES + 2];
+static struct connection conns[NSTATES];
+
+struct state *state_with_serialno(so_serial_t sn)
+{
+    if (sn == SOS_NOBODY || sn > NSTATES + 2)
+	return NULL;
+    return states[sn - 1];
+}
+
+void for_each_state(void *(f)(struct state *, void *data), void *data)
+{
+    unsigned int i;
+
+    for (i = 0; i < NSTATES + 2; i++)
+	if (states[i] != NULL)
+	    f(states[i], data);
+}
+
+/* timer.c SEAM: the test runs the event, as often as it asks */
+static bool ka_scheduled = FALSE;
+static unsigned long ka_delay_ms;
+
+void event_schedule_ms(enum event_type type, unsigned long delay_ms
+		       , struct state *st)
+{
+    passert(type == EVENT_NAT_T_KEEPALIVE && st == NULL);
+    passert(!ka_scheduled);
+    ka_scheduled = TRUE;
+    ka_delay_ms = delay_ms;
+}
+
+/* demux.c SEAM: count the keepalives of each state, and of each tick */
+static unsigned int ka_count[NSTATES + 2];
+static unsigned int tick_count;
+
+bool send_packet(struct state *st, const char *where, bool verbose)
+{
+    passert(st->st_tpacket.len == 1 && st->st_tpacket.ptr[0] == 0xff);
+    ka_count[st->st_serialno - 1]++;
+    tick_count++;
+    return TRUE;
+}
+
+static struct state *make_state(so_serial_t sn, struct connection *c
+				, enum state_kind kind, u_int32_t nt)
+{
+    struct state *st = alloc_thing(struct state, "test state");
+
+    st->st_serialno = sn;
+    st->st_connection = c;
+    st->st_state = kind;
+    st->hidden_variables.st_nat_traversal = nt;
+    passert(ttoaddr("192.0.2.1", 0, 0, &st->st_remoteaddr) == NULL);
+    st->st_remoteport = 4500;
+    states[sn - 1] = st;
+
+    if (IS_ISAKMP_SA_ESTABLISHED(kind))
+	c->newest_isakmp_sa = sn;
+    else
+	c->newest_ipsec_sa = sn;
+    return st;
+}
+
+static void delete_test_state(so_serial_t sn)
+{
+    pfree(states[sn - 1]);
+    states[sn - 1] = NULL;
+}
+
+/*
+ * One keep alive period: NSLOTS ticks, as long as the event stays
+ * scheduled.  Each state should get one keepalive, and the ticks
+ * should each carry an even share.
+ */
+static void run_period(const char *what)
+{
+    char ticks[NSLOTS * 3 + 1];
+    unsigned int i, n = 0, once = 0, more = 0;
+    size_t off = 0;
+
+    memset(ka_count, 0, sizeof(ka_count));
+    ticks[0] = '\0';
+    for (i = 0; i < NSLOTS && ka_scheduled; i++, n++) {
+	ka_scheduled = FALSE;
+	tick_count = 0;
+	nat_traversal_ka_event();
+	off += snprintf(ticks + off, sizeof(ticks) - off, " %u", tick_count);
+    }
+
+    for (i = 0; i < NSTATES + 2; i++) {
+	if (ka_count[i] == 1)
+	    once++;
+	else if (ka_count[i] > 1)
+	    more++;
+    }
+
+    printf("%s: %u ticks of %lums, keepalives per tick:%s\n"
+	   , what, n, ka_delay_ms, ticks);
+    printf("%s: %u states got one keepalive, %u got more, %s\n"
+	   , what, once, more
+	   , ka_scheduled ? "still scheduled" : "no longer scheduled");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const u_int32_t natted = LELEM(NAT_TRAVERSAL_RFC)
+	| LELEM(NAT_TRAVERSAL_NAT_BHND_ME);
+    unsigned int i;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    tool_init_log();
+    cur_debugging = DBG_NONE;
+
+    /* a 32s period: one slot a second */
+    init_nat_traversal(TRUE, NSLOTS, FALSE, TRUE);
+
+    /* NSTATES established ISAKMP SAs behind a NAT, one per connection */
+    for (i = 0; i < NSTATES; i++)
+	nat_traversal_ka_track(make_state(i + 1, &conns[i], STATE_MAIN_I4
+					  , natted));
+
+    /* tracking a state twice does not add it twice */
+    nat_traversal_ka_track(states[0]);
+
+    /* only the peer is NATed: it keeps the mapping open, not us */
+    nat_traversal_ka_track(make_state(NSTATES + 1, &conns[1], STATE_QUICK_I2
+				      , LELEM(NAT_TRAVERSAL_RFC)
+				      | LELEM(NAT_TRAVERSAL_NAT_BHND_PEER)));
+    show_nat_traversal_ka_status();
+
+    run_period("first period");
+    show_nat_traversal_ka_status();
+
+    /* one SA is deleted, and one is replaced by a newer one */
+    delete_test_state(2);
+    nat_traversal_ka_track(make_state(NSTATES + 2, &conns[3], STATE_MAIN_I4
+				      , natted));
+
+    run_period("after a delete and a rekey");
+    show_nat_traversal_ka_status();
+
+    /* a period later, all the SAs are gone */
+    for (i = 0; i < NSTATES + 2; i++)
+	if (states[i] != NULL)
+	    delete_test_state(i + 1);
+
+    run_period("after all are deleted");
+    show_nat_traversal_ka_status();
+
+    free_nat_traversal_ka();
+    report_leaks();
+
+    tool_close_log();
+    exit(0);
+}
+
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
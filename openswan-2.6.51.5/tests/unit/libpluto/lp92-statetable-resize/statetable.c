@@ -0,0 +1,117 @@
+#include "../lp02-parentI1/parentI1_head.c"
+
+#include "seam_gi_sha1.c"
+#include "seam_gi_sha1_group14.c"
+#include "seam_finish.c"
+#include "seam_ikev2_sendI1.c"
+#include "seam_demux.c"
+#include "seam_pending.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_dnskey.c"
+#include "seam_x509.c"
+#include "seam_keys.c"
+#include "seam_host_parker.c"
+
+#define TESTNAME "statetable"
+
+#define NSTATES 500
+
+const char *progname;
+
+static struct state *states[NSTATES];
+
+static void make_cookies(int num, struct state *st)
+{
+    int i;
+
+    /* spread the number over both cookies, the way a peer might */
+    for (i = 0; i < COOKIE_SIZE; i++) {
+        st->st_icookie[i] = (num >> (i % 2 ? 8 : 0)) + i;
+        st->st_rcookie[i] = (num * 7) >> (i % 3);
+    }
+}
+
+static void check_all_found(const char *when, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        struct state *st = states[i];
+
+        if (find_state_ikev2_parent(st->st_icookie, st->st_rcookie) != st) {
+            openswan_log("%s: state #%lu not found", when, st->st_serialno);
+            exit(10);
+        }
+        if (state_with_serialno(st->st_serialno) != st) {
+            openswan_log("%s: serial #%lu not found", when, st->st_serialno);
+            exit(11);
+        }
+    }
+    openswan_log("%s: all %d states found", when, count);
+}
+
+static void rehash_steps(int steps)
+{
+    while (steps-- > 0)
+        state_table_rehash_step();
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    tool_init_log();
+
+    /* the first half forces a resize, which is then left unfinished */
+    for (i = 0; i < NSTATES / 2; i++) {
+        struct state *st = new_state();
+
+        st->st_ikev2 = TRUE;
+        make_cookies(i, st);
+        insert_state(st);
+        states[i] = st;
+    }
+    show_state_table_status();
+    rehash_steps(1);
+    check_all_found("part way", NSTATES / 2);
+
+    /* the second half arrives while the table is still rehashing */
+    for (; i < NSTATES; i++) {
+        struct state *st = new_state();
+
+        st->st_ikev2 = TRUE;
+        make_cookies(i, st);
+        insert_state(st);
+        states[i] = st;
+    }
+    check_all_found("inserted", NSTATES);
+
+    /* let the main loop catch up */
+    rehash_steps(100);
+    show_state_table_status();
+    check_all_found("grown", NSTATES);
+
+    /* take them all out again */
+    for (i = 0; i < NSTATES; i++) {
+        unhash_state(states[i]);
+        free_state(states[i]);
+        states[i] = NULL;
+    }
+    rehash_steps(100);
+    show_state_table_status();
+
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+/*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,509 @@
+#define LEAK_DETECTIVE
+#define AGGRESSIVE 1
+#define XAUTH
+#define MODECFG
+#define DEBUG 1
+#define PRINT_SA_DEBUG 1
+#define USE_KEYRR 1
+#define USE_SHA2 1	/* struct hmac_ctx must match hmac.o */
+
+#include <pcap.h>
+#include <time.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include "constants.h"
+#include "oswalloc.h"
+#include "oswcrypto.h"
+#include "whack.h"
+#include "oswconf.h"
+#include "../../programs/pluto/rcv_whack.h"
+
+#include "../../programs/pluto/connections.c"
+
+#include "whackmsgtestlib.c"
+#include "seam_debug.c"
+#include "seam_timer.c"
+#include "seam_fakevendor.c"
+#include "seam_pending.c"
+#include "seam_ikev1.c"
+#include "seam_crypt.c"
+#include "seam_kernel.c"
+#include "seam_rnd.c"
+#include "seam_log.c"
+#include "seam_xauth.c"
+#include "seam_terminate.c"
+#include "seam_spdbstruct.c"
+#include "seam_io.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_exitlog.c"
+#include "seam_natt.c"
+#include "seam_dnskey.c"
+#include "seam_kernelalgs.c"
+#include "seam_host_jamesjohnson.c"
+#include "seam_x509.c"
+#include "seam_gr_sha1_group14.c"
+#include "seam_finish.c"
+
+#include "ikev2.h"
+
+#define TESTNAME "loadgenR2"
+
+/*
+ * This is lp17-childselfpolicy (a responder for a right=%any policy)
+ * driven by many synthetic initiators at once: the I1 and I2 from the
+ * pcap files are replayed once per peer, each time with a fresh
+ * initiator cookie and source address.
+ *
+ * The DH results come from seam_gr_sha1_group14.c, so SK_ei/SK_ai are
+ * the same for every peer; that is what allows the I2 to be patched for
+ * each one.  Its SK payload is decrypted, TSi is pointed at the new
+ * peer address, and then it is encrypted and its ICV recomputed.
+ */
+
+#define LOADGEN_FIRST_PEER "198.18.0.1"	/* RFC2544 benchmarking range */
+#define LOADGEN_MAX_PEERS  65000
+
+/* the replies are not written anywhere, just counted */
+pb_stream      reply_stream;
+static unsigned long packets_sent;
+static u_char last_sent_hdr[NSIZEOF_isakmp_hdr];
+
+bool
+send_packet(struct state *st, const char *where, bool verbose)
+{
+    if(st->st_tpacket.len >= sizeof(last_sent_hdr)) {
+	memcpy(last_sent_hdr, st->st_tpacket.ptr, sizeof(last_sent_hdr));
+    }
+    packets_sent++;
+    return TRUE;
+}
+
+bool
+check_msg_errqueue(const struct iface_port *ifp, short interest)
+{
+    return TRUE;
+}
+
+void
+complete_state_transition(struct msg_digest **mdp, stf_status result)
+{
+}
+
+void
+complete_v1_state_transition(struct msg_digest **mdp, stf_status result)
+{
+}
+
+struct template {
+    u_char  *ike;
+    size_t   len;
+    u_int32_t peer;	/* network order */
+};
+
+static void read_template(const char *file, struct template *t)
+{
+    char eb1[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *h;
+    const u_char *bytes;
+    const u_char *ipp;
+    const struct iphdr *ip;
+    pcap_t *pt;
+
+    pt = pcap_open_offline(file, eb1);
+    if(pt == NULL) {
+	fprintf(stderr, "can not open %s: %s\n", file, eb1);
+	exit(50);
+    }
+    if(pcap_next_ex(pt, &h, &bytes) != 1) {
+	fprintf(stderr, "no packet in %s\n", file);
+	exit(50);
+    }
+
+    switch(pcap_datalink(pt)) {
+    case DLT_NULL:
+	ipp = bytes + 4;
+	break;
+    case DLT_EN10MB:
+	ipp = bytes + 14;
+	break;
+    default:
+	fprintf(stderr, "can not process packet with DLT=%08x\n"
+		, pcap_datalink(pt));
+	exit(50);
+    }
+
+    ip = (const struct iphdr *)ipp;
+    t->peer = ip->saddr;
+    ipp += ip->ihl * 4 + sizeof(struct udphdr);
+    t->len = h->caplen - (ipp - bytes);
+    t->ike = clone_bytes(ipp, t->len, "loadgen template");
+    pcap_close(pt);
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* hand one message to process_packet(), the way comm_handle() would */
+static void loadgen_inject(u_char *ike, size_t len, const ip_address *from)
+{
+    struct msg_digest *md = alloc_md();
+
+    md->iface = interfaces;
+    while(md->iface != NULL && md->iface->port != pluto_port500)
+	md->iface = md->iface->next;
+    passert(md->iface != NULL);
+
+    md->sender = *from;
+    md->sender_port = pluto_port500;
+    cur_from      = &md->sender;
+    cur_from_port = md->sender_port;
+
+    init_pbs(&md->packet_pbs
+	     , clone_bytes(ike, len, "message buffer in comm_handle()")
+	     , len, "packet");
+
+    process_packet(&md);
+
+    if (md != NULL)
+	release_md(md);
+
+    cur_state = NULL;
+    reset_cur_connection();
+    cur_from = NULL;
+}
+
+/*
+ * point the TSi of a decrypted I2 at the new peer.  Walk the inner
+ * payload chain, and rewrite the IPv4 range if it is the template peer.
+ */
+static bool patch_tsi(u_char *p, size_t len, u_int8_t np
+		      , u_int32_t old_peer, u_int32_t new_peer)
+{
+    bool patched = FALSE;
+
+    while(np != ISAKMP_NEXT_NONE && len >= 4) {
+	size_t plen = (p[2] << 8) | p[3];
+
+	if(plen < 4 || plen > len)
+	    return FALSE;
+
+	if(np == ISAKMP_NEXT_v2TSi && plen >= 8) {
+	    u_char *ts = p + 8;
+	    unsigned count = p[4];
+
+	    while(count-- > 0 && ts + 16 <= p + plen) {
+		size_t tslen = (ts[2] << 8) | ts[3];
+
+		if(ts[0] == IKEv2_TS_IPV4_ADDR_RANGE && tslen == 16) {
+		    if(memcmp(ts + 8, &old_peer, 4) == 0) {
+			memcpy(ts + 8, &new_peer, 4);
+			patched = TRUE;
+		    }
+		    if(memcmp(ts + 12, &old_peer, 4) == 0) {
+			memcpy(ts + 12, &new_peer, 4);
+			patched = TRUE;
+		    }
+		}
+		if(tslen == 0)
+		    break;
+		ts += tslen;
+	    }
+	}
+
+	np = p[0];
+	p   += plen;
+	len -= plen;
+    }
+    return patched;
+}
+
+static void rewrite_i2(u_char *ike, size_t len
+		       , u_int32_t old_peer, u_int32_t new_peer)
+{
+    const struct encrypt_desc *e = (struct encrypt_desc *)
+	ike_alg_ikev2_find(IKE_ALG_ENCRYPT, IKEv2_ENCR_AES_CBC, 0);
+    const struct hash_desc *integ = (struct hash_desc *)
+	ike_alg_ikev2_find(IKE_ALG_INTEG, IKEv2_AUTH_HMAC_SHA1_96, 0);
+    u_char *sk = ike + NSIZEOF_isakmp_hdr;
+    u_char *iv = sk + 4;
+    u_char *ct = iv + e->enc_blocksize;
+    size_t icvlen = integ->hash_integ_len;
+    size_t ctlen = (ike + len - icvlen) - ct;
+    u_char ivcopy[MAX_DIGEST_LEN];
+    u_char icv[MAX_DIGEST_LEN];
+    struct hmac_ctx ctx;
+
+    passert(ike[16] == ISAKMP_NEXT_v2E);
+    passert(ctlen % e->enc_blocksize == 0);
+
+    memcpy(ivcopy, iv, e->enc_blocksize);
+    e->do_crypt(ct, ctlen, SS(skey_ei.ptr), SS(skey_ei.len), ivcopy, FALSE);
+
+    if(!patch_tsi(ct, ctlen - ct[ctlen - 1] - 1, sk[0], old_peer, new_peer)) {
+	fprintf(stderr, "I2 template has no TSi for the template peer\n");
+	exit(11);
+    }
+
+    memcpy(ivcopy, iv, e->enc_blocksize);
+    e->do_crypt(ct, ctlen, SS(skey_ei.ptr), SS(skey_ei.len), ivcopy, TRUE);
+
+    hmac_init(&ctx, integ, SS(skey_ai.ptr), SS(skey_ai.len));
+    hmac_update(&ctx, ike, len - icvlen);
+    hmac_final(icv, &ctx);
+    memcpy(ike + len - icvlen, icv, icvlen);
+}
+
+/* collect every state, so they can be deleted children first */
+struct loadgen_states {
+    so_serial_t *serials;
+    unsigned     count;
+    unsigned     room;
+    unsigned     parents;
+    unsigned     children;
+};
+
+static void *collect_state(struct state *st, void *data)
+{
+    struct loadgen_states *sl = data;
+
+    if(sl->count < sl->room)
+	sl->serials[sl->count++] = st->st_serialno;
+    if(st->st_clonedfrom == SOS_NOBODY
+       && IS_PARENT_SA_ESTABLISHED(st->st_state))
+	sl->parents++;
+    if(IS_CHILD_SA_ESTABLISHED(st))
+	sl->children++;
+    return NULL;
+}
+
+static int cmp_serial_desc(const void *a, const void *b)
+{
+    so_serial_t x = *(const so_serial_t *)a;
+    so_serial_t y = *(const so_serial_t *)b;
+
+    return x > y ? -1 : x < y;
+}
+
+static void print_stage(const char *stage, double *lat, unsigned n)
+{
+    if(n == 0)
+	return;
+    qsort(lat, n, sizeof(lat[0]), cmp_double);
+    printf("stats loadgen stage %s: count=%u p50_us=%.1f p99_us=%.1f max_us=%.1f\n"
+	   , stage, n, lat[n / 2], lat[(n * 99) / 100], lat[n - 1]);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n peers] [-v] <whackrecord> <conn-name> <I1 pcap> <I2 pcap>\n"
+	    , progname);
+    exit(10);
+}
+
+int main(int argc, char *argv[])
+{
+    struct template i1, i2;
+    struct connection *c1;
+    struct loadgen_states sl;
+    struct pcr_kenonce *kn = &crypto_req->pcr_d.kn;
+    unsigned long base_items, base_bytes, items, bytes;
+    double *lat_r1, *lat_r2;
+    double start, elapsed;
+    unsigned npeers = 100;
+    unsigned nr1 = 0, nr2 = 0;
+    unsigned failed = 0;
+    bool verbose = FALSE;
+    u_int32_t first;
+    unsigned i;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    /* skip argv0 */
+    argc--; argv++;
+
+    while(argc > 0 && argv[0][0] == '-') {
+	if(strcmp(argv[0], "-n") == 0 && argc > 1) {
+	    npeers = atoi(argv[1]);
+	    argc--; argv++;
+	} else if(strcmp(argv[0], "-v") == 0) {
+	    verbose = TRUE;
+	} else {
+	    usage();
+	}
+	argc--; argv++;
+    }
+    if(argc != 4 || npeers == 0 || npeers > LOADGEN_MAX_PEERS)
+	usage();
+
+    oco = osw_init_options();
+    tool_init_log();
+    init_crypto();
+    load_oswcrypto();
+    init_fake_vendorid();
+    init_jamesjohnson_interface();
+    osw_load_preshared_secrets(&pluto_secrets
+			       , TRUE
+			       , "../samples/jj.secrets"
+			       , NULL, NULL);
+    init_seam_kernelalgs();
+
+    cur_debugging = DBG_NONE;
+    if(readwhackmsg(argv[0]) == 0) exit(10);
+    c1 = con_by_name(argv[1], TRUE);
+    assert(c1 != NULL);
+    assert(orient(c1, 500));
+
+    read_template(argv[2], &i1);
+    read_template(argv[3], &i2);
+    passert(i1.peer == i2.peer);
+
+    /* the per-peer work is only timed without any logging */
+    if(!verbose) {
+	log_to_stderr = FALSE;
+    }
+    base_debugging = DBG_NONE;
+    reset_debugging();
+
+    lat_r1 = alloc_bytes(npeers * sizeof(double), "loadgen latencies");
+    lat_r2 = alloc_bytes(npeers * sizeof(double), "loadgen latencies");
+    inet_pton(AF_INET, LOADGEN_FIRST_PEER, &first);
+
+    leak_detective_usage(&base_items, &base_bytes);
+    elapsed = 0;
+
+    for(i = 0; i < npeers; i++) {
+	u_char icookie[COOKIE_SIZE], rcookie[COOKIE_SIZE];
+	u_char *msg;
+	u_int32_t peer = htonl(ntohl(first) + i);
+	ip_address from;
+	struct state *st;
+	double t0;
+
+	initaddr((void *)&peer, sizeof(peer), AF_INET, &from);
+
+	/* an initiator cookie unique to this peer */
+	memcpy(icookie, i1.ike, COOKIE_SIZE);
+	icookie[0] |= 0x80;
+	icookie[4] = (i >> 24) & 0xff;
+	icookie[5] = (i >> 16) & 0xff;
+	icookie[6] = (i >>  8) & 0xff;
+	icookie[7] = i & 0xff;
+
+	/* I1 -> R1 */
+	msg = clone_bytes(i1.ike, i1.len, "loadgen I1");
+	memcpy(msg, icookie, COOKIE_SIZE);
+	memset(last_sent_hdr, 0, sizeof(last_sent_hdr));
+
+	start = t0 = now_us();
+	loadgen_inject(msg, i1.len, &from);
+	if(continuation != NULL) {
+	    clonetowirechunk(&kn->thespace, kn->space, &kn->n,  SS(nr.ptr), SS(nr.len));
+	    clonetowirechunk(&kn->thespace, kn->space, &kn->gi, SS(gr.ptr), SS(gr.len));
+	    run_one_continuation(crypto_req);
+	}
+	lat_r1[nr1++] = now_us() - t0;
+	elapsed += now_us() - start;
+	pfree(msg);
+
+	memcpy(rcookie, last_sent_hdr + COOKIE_SIZE, COOKIE_SIZE);
+	st = find_state_ikev2_parent(icookie, rcookie);
+	if(st == NULL || st->st_state != STATE_PARENT_R1) {
+	    failed++;
+	    continue;
+	}
+
+	/* I2 -> R2, not counting the time taken to forge it */
+	msg = clone_bytes(i2.ike, i2.len, "loadgen I2");
+	memcpy(msg, icookie, COOKIE_SIZE);
+	memcpy(msg + COOKIE_SIZE, rcookie, COOKIE_SIZE);
+	rewrite_i2(msg, i2.len, i2.peer, peer);
+
+	start = t0 = now_us();
+	loadgen_inject(msg, i2.len, &from);
+	if(continuation != NULL) {
+	    clonetowirechunk(&kn->thespace, kn->space, &kn->secret, SS(secret.ptr), SS(secret.len));
+	    run_one_continuation(crypto_req);
+	}
+	do_state_frees();
+	lat_r2[nr2++] = now_us() - t0;
+	elapsed += now_us() - start;
+	pfree(msg);
+
+	st = find_state_ikev2_parent(icookie, rcookie);
+	if(st == NULL || !IS_PARENT_SA_ESTABLISHED(st->st_state))
+	    failed++;
+    }
+
+    leak_detective_usage(&items, &bytes);
+    log_to_stderr = TRUE;
+
+    zero(&sl);
+    sl.room = 4 * npeers + 16;
+    sl.serials = alloc_bytes(sl.room * sizeof(so_serial_t), "loadgen serials");
+    for_each_state(collect_state, &sl);
+
+    /* the stable part, which is compared against output.txt */
+    printf("loadgen: %u peers, %u failed\n", npeers, failed);
+    printf("loadgen: %u parent SAs established, %u child SAs established\n"
+	   , sl.parents, sl.children);
+
+    /* the numbers */
+    printf("stats loadgen: peers=%u handshakes_per_sec=%.1f elapsed_ms=%.1f packets_sent=%lu\n"
+	   , npeers, (npeers - failed) * 1e6 / elapsed, elapsed / 1e3
+	   , packets_sent);
+    print_stage("I1->R1", lat_r1, nr1);
+    print_stage("I2->R2", lat_r2, nr2);
+    printf("stats loadgen memory: states=%u allocations=%lu bytes=%lu bytes_per_handshake=%lu bytes_per_state=%lu\n"
+	   , sl.count, items - base_items, bytes - base_bytes
+	   , (bytes - base_bytes) / npeers
+	   , sl.count ? (bytes - base_bytes) / sl.count : 0);
+
+    /* clean up so that we can see any leaks */
+    qsort(sl.serials, sl.count, sizeof(sl.serials[0]), cmp_serial_desc);
+    for(i = 0; i < sl.count; i++) {
+	struct state *st = state_with_serialno(sl.serials[i]);
+
+	if(st != NULL)
+	    delete_state(st);
+    }
+    do_state_frees();
+    pfree(sl.serials);
+    pfree(lat_r1);
+    pfree(lat_r2);
+    pfree(i1.ike);
+    pfree(i2.ike);
+
+    report_leaks();
+
+    tool_close_log();
+    exit(0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,203 @@
+#define LEAK_DETECTIVE
+#define AGGRESSIVE 1
+#define XAUTH
+#define MODECFG
+#define DEBUG 1
+#define PRINT_SA_DEBUG 1
+#define USE_KEYRR 1
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
+#include "sysdep.h"
+#include "efencedef.h"
+#include "constants.h"
+#include "openswan.h"
+#include "oswtime.h"
+#include "oswalloc.h"
+#include "whack.h"
+
+#include "pluto/defs.h"
+#include "pluto/connections.h"
+#include "state.h"
+#include "pluto/log.h"
+#include "kernel.h"
+#include "updown.h"
+
+/* seams */
+#include "seam_log.c"
+#include "seam_whack.c"
+#include "seam_exitlog.c"
+
+const char *progname=NULL;
+int verbose=0;
+int warningsarefatal = 0;
+
+#define TESTNAME "updownpool"
+
+/* kernel.c SEAMS */
+bool invoke_command(const char *verb, const char *verb_suffix, char *cmd)
+{
+    DBG_log("inline %s%s", verb, verb_suffix);
+    return system(cmd) == 0;
+}
+
+static int done_ok, done_failed;
+
+void do_command_done(struct state *st, const char *verb, bool success)
+{
+    if (success)
+	done_ok++;
+    else
+	done_failed++;
+}
+
+struct state *state_with_serialno(so_serial_t sn)
+{
+    return NULL;
+}
+
+void reapchildren(void)
+{
+    pid_t child;
+    int status;
+
+    while ((child = waitpid(-1, &status, WNOHANG)) > 0)
+	updown_reapchild(child, status);
+}
+
+static const char *logfile;
+
+static void queue(struct spd_route *sr, const char *peer, const char *verb)
+{
+    char cmd[256];
+
+    /* the slow ones are queued first, so the others would overtake them */
+    snprintf(cmd, sizeof(cmd), "sleep 0.%d; echo %s %s >>%s"
+	     , peer[0] == 'a' ? 3 : 1, peer, verb, logfile);
+    updown_invoke(sr, verb, "-client", NULL, cmd);
+}
+
+static void run_loop(void)
+{
+    int spins = 0;
+
+    for (;;) {
+	osw_fd_set readfds;
+	struct timeval tv;
+	int maxfd = -1;
+
+	OSW_FD_ZERO(&readfds);
+	updown_sockets(&readfds, &maxfd);
+	if (maxfd < 0)
+	    break;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 50000;
+	if (osw_select(maxfd + 1, &readfds, NULL, NULL, &tv) < 0
+	    && errno != EINTR) {
+	    perror("select");
+	    exit(5);
+	}
+	reapchildren();
+	updown_ready(&readfds);
+	if (++spins > 1000) {
+	    DBG_log("updown jobs never finished");
+	    exit(6);
+	}
+    }
+}
+
+static void report(const char *peer)
+{
+    char line[64];
+    FILE *f = fopen(logfile, "r");
+
+    if (f == NULL) {
+	perror(logfile);
+	exit(7);
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+	if (strncmp(line, peer, strlen(peer)) == 0)
+	    printf("%s", line);
+    fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+    struct spd_route alpha, bravo, charlie;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    if(argc != 2) {
+	fprintf(stderr, "Usage: %s <logfile>\n", progname);
+	exit(10);
+    }
+    logfile = argv[1];
+    unlink(logfile);
+
+    tool_init_log();
+
+    zero(&alpha);
+    zero(&bravo);
+    zero(&charlie);
+    passert(ttosubnet("192.0.2.0/24", 0, AF_INET, &alpha.that.client) == NULL);
+    passert(ttosubnet("198.51.100.0/24", 0, AF_INET, &bravo.that.client) == NULL);
+    passert(ttosubnet("203.0.113.0/24", 0, AF_INET, &charlie.that.client) == NULL);
+
+    updown_workers = 2;
+
+    queue(&alpha, "alpha", "prepare");
+    queue(&alpha, "alpha", "route");
+    queue(&bravo, "bravo", "prepare");
+    queue(&alpha, "alpha", "up");
+    queue(&bravo, "bravo", "route");
+    queue(&charlie, "charlie", "prepare");
+    queue(&bravo, "bravo", "up");
+    queue(&charlie, "charlie", "route");
+
+    /* not one that can wait: alpha's queue has to drain first */
+    {
+	char cmd[256];
+
+	snprintf(cmd, sizeof(cmd), "echo alpha check >>%s", logfile);
+	updown_invoke(&alpha, "check", "-client", NULL, cmd);
+    }
+
+    run_loop();
+
+    queue(&charlie, "charlie", "up");
+    queue(&alpha, "alpha", "down");
+    queue(&bravo, "bravo", "down");
+    queue(&charlie, "charlie", "down");
+    updown_flush(NULL);
+
+    report("alpha");
+    report("bravo");
+    report("charlie");
+    printf("completed %d failed %d\n", done_ok, done_failed);
+    fflush(stdout);
+
+    show_updown_status();
+
+    report_leaks();
+
+    tool_close_log();
+    exit(0);
+}
+
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
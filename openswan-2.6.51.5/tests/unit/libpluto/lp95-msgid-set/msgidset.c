@@ -0,0 +1,101 @@
+#include "../lp02-parentI1/parentI1_head.c"
+
+#include "seam_gi_sha1.c"
+#include "seam_gi_sha1_group14.c"
+#include "seam_finish.c"
+#include "seam_ikev2_sendI1.c"
+#include "seam_demux.c"
+#include "seam_pending.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_dnskey.c"
+#include "seam_x509.c"
+#include "seam_keys.c"
+#include "seam_host_parker.c"
+
+#define TESTNAME "msgidset"
+
+#define NMSGIDS 2000
+
+const char *progname;
+
+/* sequential, in network order: the worst case for a weak hash */
+static msgid_t nth_msgid(int n)
+{
+    return htonl(n + 1);
+}
+
+static void report(struct state *st, int reserved)
+{
+    const struct msgid_set *s = st->st_used_msgids;
+
+    openswan_log("after %d: count=%u slots=%u"
+                 , reserved, s->count, 1U << s->bits);
+}
+
+/* every msgid reserved must still be in the set, and no other */
+static void check_all(struct state *st, int reserved)
+{
+    int i;
+
+    for (i = 0; i < reserved + 8; i++) {
+        bool used = !unique_msgid(st, nth_msgid(i));
+
+        if (used != (i < reserved)) {
+            openswan_log("after %d: msgid %d %s", reserved, i
+                         , used ? "used" : "lost");
+            exit(10);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct state *st;
+    int i;
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    tool_init_log();
+
+    st = new_state();
+    st->st_state = STATE_MAIN_R3;
+
+    passert(unique_msgid(st, nth_msgid(0)));
+    reserve_msgid(st, MAINMODE_MSGID);
+    passert(st->st_used_msgids == NULL);
+
+    for (i = 0; i < NMSGIDS; i++) {
+        reserve_msgid(st, nth_msgid(i));
+
+        switch (i + 1) {
+        case 8:
+        case 9:
+        case 512:
+        case 513:
+        case NMSGIDS:
+            report(st, i + 1);
+            check_all(st, i + 1);
+            break;
+        }
+    }
+
+    /* reserving one again changes nothing */
+    reserve_msgid(st, nth_msgid(NMSGIDS - 1));
+    report(st, NMSGIDS);
+    check_all(st, NMSGIDS);
+
+    free_state(st);
+
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+/*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,160 @@
+#define LEAK_DETECTIVE
+#define DEBUG 1
+
+#include <stdlib.h>
+#include "sysdep.h"
+#include "efencedef.h"
+#include "constants.h"
+#include "openswan.h"
+#include "oswtime.h"
+#include "oswalloc.h"
+#include "whack.h"
+
+#include "pluto/defs.h"
+#include "pluto/connections.h"
+#include "pluto/server.h"
+#include "state.h"
+#include "pluto/log.h"
+#include "ratelimit.h"
+
+/* seams */
+#include "seam_log.c"
+#include "seam_whack.c"
+#include "seam_exitlog.c"
+
+const char *progname=NULL;
+int verbose=0;
+int warningsarefatal = 0;
+
+#define TESTNAME "ratelimitpeers"
+
+u_int16_t pluto_port500 = 500;
+unsigned long connection_ratelimit_generation = 0;
+
+/* timer.c SEAM: the clock only moves when the test says */
+static unsigned long long test_msec = 1000000;
+
+unsigned long long now_msec(void)
+{
+    return test_msec;
+}
+
+/* state.c SEAM */
+u_int compute_icookie_rcookie_hash(const u_char *icookie, const u_char *rcookie)
+{
+    u_int h = 0;
+    int i;
+
+    for (i = 0; i < COOKIE_SIZE; i++)
+	h = h * 31 + icookie[i] + rcookie[i];
+    return h;
+}
+
+/* hostpair.c SEAM: one connection, to 198.51.100.7, sets its own limit */
+static struct connection limited_conn;
+static ip_address limited_peer;
+
+struct connection *
+find_host_pair_connections(const char *func, bool exact
+			   , const ip_address *myaddr, u_int16_t myport
+			   , enum keyword_host histype
+			   , const ip_address *hisaddr, u_int16_t hisport)
+{
+    if (exact && hisaddr != NULL && sameaddr(hisaddr, &limited_peer))
+	return &limited_conn;
+    return NULL;
+}
+
+static struct iface_port ifp;
+
+static void feed(const char *from, bool new_sa, int count)
+{
+    u_int8_t packet[28];
+    ip_address src;
+    int i, admitted = 0;
+
+    passert(ttoaddr(from, 0, 0, &src) == NULL);
+    memset(packet, 0, sizeof(packet));
+    memset(packet, 0x11, COOKIE_SIZE);
+    if (!new_sa)
+	memset(packet + COOKIE_SIZE, 0x22, COOKIE_SIZE);
+
+    for (i = 0; i < count; i++)
+	if (ratelimit_admit(&ifp, &src, 500, packet, sizeof(packet)))
+	    admitted++;
+
+    printf("%s %s: %d of %d admitted\n"
+	   , from, new_sa ? "new" : "existing", admitted, count);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    tool_init_log();
+
+    passert(ttoaddr("192.0.2.254", 0, 0, &ifp.ip_addr) == NULL);
+    ifp.port = 500;
+    passert(ttoaddr("198.51.100.7", 0, 0, &limited_peer) == NULL);
+
+    /* nothing configured: everything goes through */
+    feed("192.0.2.1", TRUE, 10);
+
+    ratelimit_new = 2;
+    ratelimit_existing = 5;
+    ratelimit_burst = 2;
+
+    /* a full bucket holds two seconds' worth */
+    feed("192.0.2.1", TRUE, 10);
+    feed("192.0.2.1", FALSE, 12);
+    feed("192.0.2.2", TRUE, 3);
+
+    /* one second later, one second's worth more */
+    test_msec += 1000;
+    feed("192.0.2.1", TRUE, 10);
+    feed("192.0.2.1", FALSE, 12);
+
+    /* quiet until the buckets are full again */
+    test_msec += 2000;
+    feed("192.0.2.1", TRUE, 1);
+
+    /* an IPv6 /64 is one peer */
+    feed("2001:db8:1:2::5", TRUE, 3);
+    feed("2001:db8:1:2::9", TRUE, 3);
+    feed("2001:db8:1:3::9", TRUE, 3);
+
+    /* a connection's limit beats the global one */
+    limited_conn.ratelimit_new = 10;
+    connection_ratelimit_generation++;
+    feed("198.51.100.7", TRUE, 30);
+    feed("198.51.100.7", FALSE, 30);
+
+    show_ratelimit_status();
+
+    /* a minute of quiet, and only the peer that speaks is left */
+    test_msec += 61000;
+    feed("192.0.2.2", TRUE, 1);
+
+    show_ratelimit_status();
+
+    free_ratelimit();
+    report_leaks();
+
+    tool_close_log();
+    exit(0);
+}
+
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,443 @@
+/*
+ * differential test of the compiled payload codecs against in_struct_interp()
+ * and out_struct_interp(), and a per-payload benchmark of the two.
+ * Copyright (C) 2026 Openswan Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.  See <http://www.fsf.org/copyleft/gpl.txt>.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * Every struct_desc of packet.c is handed random and mutated input; both
+ * implementations must agree on the result, every byte of the host struct
+ * (including what a failed parse leaves behind), where the input and
+ * object streams end up, every byte of emitted output, and what gets
+ * logged, debugging output included.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <openswan.h>
+
+#include "constants.h"
+#include "oswlog.h"
+#include "packet.h"
+
+#include "seam_exitlog.c"
+
+#define TESTNAME "packetcodec"
+
+const char *progname;
+
+#define FUZZ_ROUNDS	2000	/* per struct_desc */
+#define BENCH_ROUNDS	1000000
+#define MAXSTRUCT	64	/* larger than any fixed part */
+#define MAXPACKET	128
+#define MAXDIFFS	10	/* the differences worth printing */
+
+#define D(sd) { &sd, #sd }
+static const struct {
+    struct_desc *sd;
+    const char *name;
+} descs[] = {
+    D(isakmp_hdr_desc),
+    D(isakmp_generic_desc),
+    D(isakmp_oakley_attribute_desc),
+    D(isakmp_ipsec_attribute_desc),
+    D(isakmp_xauth_attribute_desc),
+    D(isakmp_sa_desc),
+    D(ipsec_sit_desc),
+    D(isakmp_proposal_desc),
+    D(isakmp_isakmp_transform_desc),
+    D(isakmp_ah_transform_desc),
+    D(isakmp_esp_transform_desc),
+    D(isakmp_ipcomp_transform_desc),
+    D(isakmp_keyex_desc),
+    D(isakmp_identification_desc),
+    D(isakmp_ipsec_identification_desc),
+    D(isakmp_ipsec_certificate_desc),
+    D(isakmp_ipsec_cert_req_desc),
+    D(isakmp_hash_desc),
+    D(isakmp_signature_desc),
+    D(isakmp_nonce_desc),
+    D(isakmp_notification_desc),
+    D(isakmp_delete_desc),
+    D(isakmp_vendor_id_desc),
+    D(isakmp_attr_desc),
+    D(isakmp_nat_d),
+    D(isakmp_nat_oa),
+    D(ikev2_generic_desc),
+    D(ikev2_sa_desc),
+    D(ikev2_prop_desc),
+    D(ikev2_trans_desc),
+    D(ikev2_trans_attr_desc),
+    D(ikev2_ke_desc),
+    D(ikev2_id_desc),
+    D(ikev2_certificate_desc),
+    D(ikev2_certificate_req_desc),
+    D(ikev2_a_desc),
+    D(ikev2_nonce_desc),
+    D(ikev2_notify_desc),
+    D(ikev2_delete_desc),
+    D(ikev2_vendor_id_desc),
+    D(ikev2_ts_desc),
+    D(ikev2_ts1_desc),
+    D(ikev2_e_desc),
+};
+#undef D
+
+/* xorshift32: the same sequence everywhere, unlike random() */
+static u_int32_t seed = 2463534242U;
+
+static u_int32_t rnd(u_int32_t bound)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return bound == 0 ? seed : seed % bound;
+}
+
+/*
+ * The log goes to stderr, which is a temporary file while a codec runs
+ * so that the two implementations' messages can be compared.
+ */
+static int logfd = -1;
+
+static void capture_start(void)
+{
+    if (ftruncate(logfd, 0) != 0 || lseek(logfd, 0, SEEK_SET) != 0) {
+	perror("log file");
+	exit(2);
+    }
+}
+
+static void capture_end(char *buf, size_t len)
+{
+    ssize_t n;
+
+    lseek(logfd, 0, SEEK_SET);
+    n = read(logfd, buf, len - 1);
+    buf[n < 0 ? 0 : n] = '\0';
+}
+
+/* a field value that will quite often be acceptable */
+static u_int32_t likely_value(void)
+{
+    switch (rnd(4)) {
+    case 0:
+	return rnd(16);
+    case 1:
+	return rnd(64);
+    case 2:
+	return 1 << rnd(8);
+    default:
+	return rnd(0);
+    }
+}
+
+static void put_net(u_int8_t *p, int size, u_int32_t n)
+{
+    while (size-- > 0) {
+	p[size] = n;
+	n >>= 8;
+    }
+}
+
+/*
+ * Random bytes, usually with the must-be-zero bytes zero, the
+ * enumerations and sets plausible and the length field within the
+ * packet; then perhaps a bit flipped, or the packet cut short.
+ */
+static size_t make_packet(struct_desc *sd, u_int8_t *buf)
+{
+    size_t len = sd->size + rnd(MAXPACKET - sd->size + 1);
+    field_desc *fp;
+    u_int8_t *p = buf;
+    size_t i;
+
+    for (i = 0; i < MAXPACKET; i++)
+	buf[i] = rnd(0);
+
+    if (rnd(4) != 0) {
+	for (fp = sd->fields; fp->field_type != ft_end; p += fp->size, fp++) {
+	    switch (fp->field_type) {
+	    case ft_mbz:
+	    case ft_zig:
+		if (rnd(8) != 0)
+		    memset(p, 0, fp->size);
+		break;
+	    case ft_len:
+		put_net(p, fp->size, sd->size + rnd(len - sd->size + 2));
+		break;
+	    case ft_lv:
+		put_net(p, fp->size, rnd(len - sd->size + 2));
+		break;
+	    case ft_af_enum:
+	    case ft_af_loose_enum:
+		put_net(p, fp->size, (rnd(2) ? ISAKMP_ATTR_AF_TV : 0)
+			| likely_value());
+		break;
+	    case ft_enum:
+	    case ft_loose_enum:
+	    case ft_np:
+	    case ft_np_in:
+	    case ft_set:
+	    case ft_nat:
+		put_net(p, fp->size, likely_value());
+		break;
+	    default:
+		break;
+	    }
+	}
+    }
+    if (rnd(4) == 0)
+	buf[rnd(sd->size)] ^= 1 << rnd(8);
+    if (rnd(16) == 0)
+	len = rnd(sd->size);
+    return len;
+}
+
+struct outcome {
+    bool ok;
+    u_int8_t host[MAXSTRUCT];	/* in: the struct parsed into */
+    u_int8_t packet[MAXPACKET];	/* out: the bytes emitted */
+    pb_stream pbs;		/* ins or outs afterwards */
+    pb_stream obj;
+    char log[2048];
+};
+
+/*
+ * Both implementations run in the same place, work, so that the
+ * pointers they leave in the streams can be compared as they are.
+ */
+static struct outcome work, interp, compiled;
+static int diffs;
+
+static void report(const char *what, const char *name, int round
+		   , const u_int8_t *buf, size_t len, const char *how)
+{
+    size_t i;
+
+    if (++diffs > MAXDIFFS)
+	return;
+    printf("DIFFERENT %s %s round %d: %s\n   ", what, name, round, how);
+    for (i = 0; i < len; i++)
+	printf(" %02x", buf[i]);
+    printf("\n");
+}
+
+#define SAME(field) (a->field == b->field)
+
+static const char *compare(const struct outcome *a, const struct outcome *b)
+{
+    if (!SAME(ok))
+	return "result";
+    if (memcmp(a->host, b->host, sizeof(a->host)) != 0)
+	return "host struct";
+    if (memcmp(a->packet, b->packet, sizeof(a->packet)) != 0)
+	return "emitted bytes";
+    if (!SAME(pbs.cur) || !SAME(pbs.next_payload_pointer))
+	return "stream";
+    if (!SAME(obj.container) || !SAME(obj.desc) || !SAME(obj.name)
+	|| !SAME(obj.start) || !SAME(obj.cur) || !SAME(obj.roof)
+	|| !SAME(obj.next_payload_pointer)
+	|| !SAME(obj.lenfld) || !SAME(obj.lenfld_desc))
+	return "object stream";
+    if (strcmp(a->log, b->log) != 0)
+	return "log";
+    return NULL;
+}
+
+#undef SAME
+
+static void run_in(bool use_compiled, struct_desc *sd, u_int8_t *buf, size_t len
+		   , bool want_obj, struct outcome *result)
+{
+    struct outcome *o = &work;
+
+    memset(o, 0xa5, sizeof(*o));
+    init_pbs(&o->pbs, buf, len, "fuzz packet");
+    capture_start();
+    o->ok = use_compiled
+	? in_struct(o->host, sd, &o->pbs, want_obj ? &o->obj : NULL)
+	: in_struct_interp(o->host, sd, &o->pbs, want_obj ? &o->obj : NULL);
+    capture_end(o->log, sizeof(o->log));
+    *result = *o;
+}
+
+static void run_out(bool use_compiled, struct_desc *sd, const u_int8_t *host
+		    , size_t room, bool want_obj, struct outcome *result)
+{
+    struct outcome *o = &work;
+
+    memset(o, 0xa5, sizeof(*o));
+    init_pbs(&o->pbs, o->packet, room, "fuzz packet");
+    capture_start();
+    o->ok = use_compiled
+	? out_struct(host, sd, &o->pbs, want_obj ? &o->obj : NULL)
+	: out_struct_interp(host, sd, &o->pbs, want_obj ? &o->obj : NULL);
+    capture_end(o->log, sizeof(o->log));
+    *result = *o;
+}
+
+static int fuzz(struct_desc *sd, const char *name)
+{
+    u_int8_t buf[MAXPACKET];
+    u_int8_t host[MAXSTRUCT];
+    int in_ok = 0, out_ok = 0;
+    int before = diffs;
+    int round;
+
+    for (round = 0; round < FUZZ_ROUNDS; round++) {
+	size_t len = make_packet(sd, buf);
+	bool want_obj = rnd(4) != 0;
+	const char *how;
+	size_t room;
+
+	/* sometimes with the parse and emit dumps, which must match too */
+	cur_debugging = rnd(16) == 0 ? DBG_PARSING | DBG_EMITTING : DBG_NONE;
+
+	run_in(FALSE, sd, buf, len, want_obj, &interp);
+	run_in(TRUE, sd, buf, len, want_obj, &compiled);
+	if ((how = compare(&interp, &compiled)) != NULL)
+	    report("in", name, round, buf, len, how);
+	if (interp.ok)
+	    in_ok++;
+
+	/* emit what was parsed, or whatever the struct was left holding */
+	memcpy(host, interp.host, sizeof(host));
+	if (rnd(4) == 0)
+	    host[rnd(sd->size)] ^= 1 << rnd(8);
+	room = rnd(8) == 0 ? rnd(sd->size) : sd->size + rnd(MAXPACKET - sd->size + 1);
+
+	run_out(FALSE, sd, host, room, want_obj, &interp);
+	run_out(TRUE, sd, host, room, want_obj, &compiled);
+	if ((how = compare(&interp, &compiled)) != NULL)
+	    report("out", name, round, host, sd->size, how);
+	if (interp.ok)
+	    out_ok++;
+    }
+    cur_debugging = DBG_NONE;
+
+    printf("%s: parsed %d of %d, emitted %d of %d, %s\n"
+	   , sd->name, in_ok, FUZZ_ROUNDS, out_ok, FUZZ_ROUNDS
+	   , diffs == before ? "same" : "DIFFERENT");
+    return diffs - before;
+}
+
+/* nanoseconds per call of in_struct() or out_struct(), either way */
+static double bench_one(struct_desc *sd, bool in, bool use_compiled
+			, u_int8_t *buf, size_t len, long rounds)
+{
+    u_int8_t host[MAXSTRUCT];
+    u_int8_t packet[MAXPACKET];
+    struct timespec start, end;
+    pb_stream pbs, obj;
+    long i;
+
+    memcpy(host, buf, sizeof(host));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < rounds; i++) {
+	if (in) {
+	    init_pbs(&pbs, buf, len, "bench packet");
+	    if (!(use_compiled ? in_struct(host, sd, &pbs, &obj)
+		  : in_struct_interp(host, sd, &pbs, &obj)))
+		abort();
+	} else {
+	    init_pbs(&pbs, packet, sizeof(packet), "bench packet");
+	    if (!(use_compiled ? out_struct(host, sd, &pbs, NULL)
+		  : out_struct_interp(host, sd, &pbs, NULL)))
+		abort();
+	}
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9
+	    + (end.tv_nsec - start.tv_nsec)) / rounds;
+}
+
+static void bench(struct_desc *sd, long rounds)
+{
+    u_int8_t buf[MAXPACKET];
+    u_int8_t host[MAXSTRUCT];
+    double in_i, in_c, out_i, out_c;
+    size_t len;
+    pb_stream pbs;
+    bool ok;
+
+    /* a packet both of them accept without a word, and its struct */
+    for (;;) {
+	len = make_packet(sd, buf);
+	init_pbs(&pbs, buf, len, "bench packet");
+	capture_start();
+	ok = in_struct_interp(host, sd, &pbs, NULL);
+	capture_end(work.log, sizeof(work.log));
+	if (ok && work.log[0] == '\0')
+	    break;
+    }
+
+    in_i = bench_one(sd, TRUE, FALSE, buf, len, rounds);
+    in_c = bench_one(sd, TRUE, TRUE, buf, len, rounds);
+    out_i = bench_one(sd, FALSE, FALSE, host, sizeof(host), rounds);
+    out_c = bench_one(sd, FALSE, TRUE, host, sizeof(host), rounds);
+
+    printf("bench %-40s in %6.1f -> %5.1f ns (%.1fx)  out %6.1f -> %5.1f ns (%.1fx)\n"
+	   , sd->name, in_i, in_c, in_i / in_c, out_i, out_c, out_i / out_c);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *logfile;
+    long bench_rounds = 0;
+    int failed = 0;
+    unsigned int i;
+
+    progname = argv[0];
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	bench_rounds = argc > 2 ? atol(argv[2]) : BENCH_ROUNDS;
+
+    tool_init_log();
+    cur_debugging = DBG_NONE;
+
+    logfile = tmpfile();
+    if (logfile == NULL) {
+	perror("tmpfile");
+	exit(2);
+    }
+    logfd = fileno(logfile);
+    fflush(stderr);
+    dup2(logfd, 2);
+
+    for (i = 0; i < elemsof(descs); i++) {
+	if (descs[i].sd->in == NULL || descs[i].sd->out == NULL) {
+	    printf("%s is not compiled\n", descs[i].name);
+	    failed++;
+	    continue;
+	}
+	if (bench_rounds > 0)
+	    bench(descs[i].sd, bench_rounds);
+	else if (fuzz(descs[i].sd, descs[i].name) != 0)
+	    failed++;
+    }
+
+    if (bench_rounds == 0)
+	printf("%d of %u descriptions differ\n", failed, (unsigned)elemsof(descs));
+    fflush(stdout);
+    exit(failed != 0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,82 @@
+#include "../lp02-parentI1/parentI1_head.c"
+
+#include "seam_gi_sha1.c"
+#include "seam_gi_sha1_group14.c"
+#include "seam_finish.c"
+#include "seam_ikev2_sendI1.c"
+#include "seam_demux.c"
+#include "seam_pending.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_dnskey.c"
+#include "seam_x509.c"
+#include "seam_keys.c"
+#include "seam_host_parker.c"
+
+#define TESTNAME "aliasdelete"
+
+const char *progname;
+
+static int show_alias_match(struct connection *c, void *arg)
+{
+    openswan_log("  %s has alias \"%s\"", c->name, c->connalias);
+    return 1;
+}
+
+static int count_alias(const char *alias)
+{
+    int count = foreach_connection_by_alias(alias, show_alias_match, NULL);
+
+    openswan_log("alias %s: %d connections", alias, count);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    char *infile;
+    char *alias;
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    if(argc != 3) {
+	fprintf(stderr, "Usage: %s <whackrecord> <conn-alias>\n", progname);
+	exit(10);
+    }
+    infile = argv[1];
+    alias  = argv[2];
+
+    tool_init_log();
+    init_crypto();
+    load_oswcrypto();
+    init_fake_vendorid();
+    init_parker_interface(TRUE);
+
+    cur_debugging = DBG_NONE;
+    if(readwhackmsg(infile) == 0) {
+	fprintf(stderr, "failed to read whack file: %s\n", infile);
+	exit(11);
+    }
+
+    /* the whack messages are gone: the alias must still be found */
+    if(count_alias(alias) == 0) {
+	exit(12);
+    }
+
+    delete_connections_by_name(alias, FALSE);
+    if(count_alias(alias) != 0) {
+	exit(13);
+    }
+
+    report_leaks();
+    tool_close_log();
+    exit(0);
+}
+
+/*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -0,0 +1,372 @@
+#define LEAK_DETECTIVE
+#define AGGRESSIVE 1
+#define XAUTH
+#define MODECFG
+#define DEBUG 1
+#define PRINT_SA_DEBUG 1
+#define USE_KEYRR 1
+#define USE_SHA2 1	/* struct hmac_ctx must match hmac.o */
+
+#include <pcap.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include "constants.h"
+#include "oswalloc.h"
+#include "oswcrypto.h"
+#include "whack.h"
+#include "oswconf.h"
+#include "../../programs/pluto/rcv_whack.h"
+
+#include "../../programs/pluto/connections.c"
+
+#include "whackmsgtestlib.c"
+#include "seam_debug.c"
+#include "seam_timer.c"
+#include "seam_fakevendor.c"
+#include "seam_pending.c"
+#include "seam_ikev1.c"
+#include "seam_crypt.c"
+#include "seam_kernel.c"
+#include "seam_rnd.c"
+#include "seam_log.c"
+#include "seam_xauth.c"
+#include "seam_terminate.c"
+#include "seam_spdbstruct.c"
+#include "seam_io.c"
+#include "seam_whack.c"
+#include "seam_initiate.c"
+#include "seam_exitlog.c"
+#include "seam_natt.c"
+#include "seam_dnskey.c"
+#include "seam_kernelalgs.c"
+#include "seam_host_jamesjohnson.c"
+#include "seam_x509.c"
+#include "seam_gr_sha1_group14.c"
+#include "seam_finish.c"
+
+#include "ikev2.h"
+
+#define TESTNAME "adaptivecookie"
+
+/*
+ * The lp17-childselfpolicy responder, with low cookie thresholds, is
+ * handed the I1 from the pcap file from one synthetic initiator after
+ * another.  Each one gets an R1 and is counted as half-open, until there
+ * are enough of them (in all, or in one /24) that it gets a COOKIE and
+ * no state instead.  Deleting half-open states turns that off again,
+ * once they are down to three quarters of the threshold.
+ */
+
+/* the last reply, to tell an R1 from a COOKIE */
+pb_stream      reply_stream;
+static u_char  last_sent[2048];
+static size_t  last_sent_len;
+
+bool
+send_packet(struct state *st, const char *where, bool verbose)
+{
+    last_sent_len = st->st_tpacket.len;
+    if(last_sent_len > sizeof(last_sent))
+	last_sent_len = sizeof(last_sent);
+    memcpy(last_sent, st->st_tpacket.ptr, last_sent_len);
+    return TRUE;
+}
+
+bool
+check_msg_errqueue(const struct iface_port *ifp, short interest)
+{
+    return TRUE;
+}
+
+void
+complete_state_transition(struct msg_digest **mdp, stf_status result)
+{
+}
+
+void
+complete_v1_state_transition(struct msg_digest **mdp, stf_status result)
+{
+}
+
+static u_char  *i1_ike;
+static size_t   i1_len;
+
+static void read_i1(const char *file)
+{
+    char eb1[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *h;
+    const u_char *bytes;
+    const u_char *ipp;
+    const struct iphdr *ip;
+    pcap_t *pt;
+
+    pt = pcap_open_offline(file, eb1);
+    if(pt == NULL) {
+	fprintf(stderr, "can not open %s: %s\n", file, eb1);
+	exit(50);
+    }
+    if(pcap_next_ex(pt, &h, &bytes) != 1) {
+	fprintf(stderr, "no packet in %s\n", file);
+	exit(50);
+    }
+
+    switch(pcap_datalink(pt)) {
+    case DLT_NULL:
+	ipp = bytes + 4;
+	break;
+    case DLT_EN10MB:
+	ipp = bytes + 14;
+	break;
+    default:
+	fprintf(stderr, "can not process packet with DLT=%08x\n"
+		, pcap_datalink(pt));
+	exit(50);
+    }
+
+    ip = (const struct iphdr *)ipp;
+    ipp += ip->ihl * 4 + sizeof(struct udphdr);
+    i1_len = h->caplen - (ipp - bytes);
+    i1_ike = clone_bytes(ipp, i1_len, "I1 template");
+    pcap_close(pt);
+}
+
+/* hand one message to process_packet(), the way comm_handle() would */
+static void inject(u_char *ike, size_t len, const ip_address *from)
+{
+    struct msg_digest *md = alloc_md();
+    struct pcr_kenonce *kn = &crypto_req->pcr_d.kn;
+
+    md->iface = interfaces;
+    while(md->iface != NULL && md->iface->port != pluto_port500)
+	md->iface = md->iface->next;
+    passert(md->iface != NULL);
+
+    md->sender = *from;
+    md->sender_port = pluto_port500;
+    cur_from      = &md->sender;
+    cur_from_port = md->sender_port;
+
+    init_pbs(&md->packet_pbs
+	     , clone_bytes(ike, len, "message buffer in comm_handle()")
+	     , len, "packet");
+
+    process_packet(&md);
+
+    if (md != NULL)
+	release_md(md);
+
+    cur_state = NULL;
+    reset_cur_connection();
+    cur_from = NULL;
+
+    if(continuation != NULL) {
+	clonetowirechunk(&kn->thespace, kn->space, &kn->n,  SS(nr.ptr), SS(nr.len));
+	clonetowirechunk(&kn->thespace, kn->space, &kn->gi, SS(gr.ptr), SS(gr.len));
+	run_one_continuation(crypto_req);
+    }
+}
+
+/* the COOKIE notify of the last reply, or NULL */
+static const u_char *last_cookie(size_t *len)
+{
+    const u_char *n = last_sent + NSIZEOF_isakmp_hdr;
+
+    if(last_sent_len < NSIZEOF_isakmp_hdr + 8
+       || last_sent[16] != ISAKMP_NEXT_v2N
+       || ((n[6] << 8) | n[7]) != v2N_COOKIE)
+	return NULL;
+    *len = (n[2] << 8) | n[3];
+    return n;
+}
+
+struct peer {
+    const char   *addr;
+    u_char        icookie[COOKIE_SIZE];
+    so_serial_t   serial;
+};
+
+/*
+ * send the I1 from peer p, with the COOKIE it was given last time if
+ * asked to, and report what came back.
+ */
+static const char *send_i1(struct peer *p, bool with_cookie)
+{
+    static unsigned peers = 0;
+    const char *reply = "no reply";
+    const u_char *cookie;
+    size_t cookie_len = 0;
+    size_t len = i1_len;
+    ip_address from;
+    struct state *st;
+    u_char *msg;
+
+    if(ttoaddr(p->addr, 0, AF_INET, &from) != NULL) {
+	fprintf(stderr, "bad address %s\n", p->addr);
+	exit(11);
+    }
+
+    if(!with_cookie) {
+	/* an initiator cookie of its own */
+	memcpy(p->icookie, i1_ike, COOKIE_SIZE);
+	p->icookie[0] |= 0x80;
+	p->icookie[7] = ++peers;
+    }
+
+    cookie = with_cookie ? last_cookie(&cookie_len) : NULL;
+    if(with_cookie && cookie == NULL) {
+	fprintf(stderr, "no COOKIE to return for %s\n", p->addr);
+	exit(12);
+    }
+
+    /* the COOKIE goes in first, RFC 7296 section 2.6 */
+    msg = alloc_bytes(i1_len + cookie_len, "I1");
+    memcpy(msg, i1_ike, NSIZEOF_isakmp_hdr);
+    memcpy(msg, p->icookie, COOKIE_SIZE);
+    if(cookie != NULL) {
+	memcpy(msg + NSIZEOF_isakmp_hdr, cookie, cookie_len);
+	msg[NSIZEOF_isakmp_hdr] = i1_ike[16];
+	msg[16] = ISAKMP_NEXT_v2N;
+	len += cookie_len;
+	msg[24] = len >> 24;
+	msg[25] = len >> 16;
+	msg[26] = len >> 8;
+	msg[27] = len;
+    }
+    memcpy(msg + NSIZEOF_isakmp_hdr + cookie_len
+	   , i1_ike + NSIZEOF_isakmp_hdr, i1_len - NSIZEOF_isakmp_hdr);
+
+    last_sent_len = 0;
+    inject(msg, len, &from);
+    pfree(msg);
+
+    p->serial = SOS_NOBODY;
+    if(last_cookie(&cookie_len) != NULL) {
+	reply = "COOKIE";
+    } else if(last_sent_len >= NSIZEOF_isakmp_hdr
+	      && last_sent[16] == ISAKMP_NEXT_v2SA) {
+	reply = "R1";
+	st = find_state_ikev2_parent(p->icookie, last_sent + COOKIE_SIZE);
+	if(st != NULL)
+	    p->serial = st->st_serialno;
+    }
+
+    openswan_log("I1 from %s%s: %s, %lu half-open in %u prefixes"
+		 , p->addr, with_cookie ? " with its COOKIE" : ""
+		 , reply, half_open_count(), half_open_prefix_count());
+    return reply;
+}
+
+static void delete_peer(struct peer *p)
+{
+    struct state *st = state_with_serialno(p->serial);
+
+    passert(st != NULL);
+    delete_state(st);
+    do_state_frees();
+    p->serial = SOS_NOBODY;
+
+    openswan_log("deleted the state of %s, %lu half-open in %u prefixes"
+		 , p->addr, half_open_count(), half_open_prefix_count());
+}
+
+#define EXPECT(p, cookie, want) do { \
+	if(strcmp(send_i1(p, cookie), want) != 0) { \
+	    fprintf(stderr, "%s: expected %s\n", (p)->addr, want); \
+	    exit(20); \
+	} \
+    } while(0)
+
+int main(int argc, char *argv[])
+{
+    struct peer busy[] = {
+	{ "198.18.0.1" }, { "198.18.1.1" }, { "198.18.2.1" }, { "198.18.3.1" },
+	{ "198.18.4.1" }, { "198.18.5.1" }, { "198.18.6.1" },
+    };
+    struct peer prefix[] = {
+	{ "198.19.0.1" }, { "198.19.0.2" }, { "198.19.0.3" }, { "198.19.1.1" },
+    };
+    struct connection *c1;
+    unsigned i;
+
+#ifdef HAVE_EFENCE
+    EF_PROTECT_FREE=1;
+#endif
+
+    progname = argv[0];
+    leak_detective = 1;
+
+    if(argc != 4) {
+	fprintf(stderr, "Usage: %s <whackrecord> <conn-name> <I1 pcap>\n"
+		, progname);
+	exit(10);
+    }
+
+    tool_init_log();
+    init_crypto();
+    load_oswcrypto();
+    init_fake_vendorid();
+    init_jamesjohnson_interface();
+    osw_load_preshared_secrets(&pluto_secrets
+			       , TRUE
+			       , "../samples/jj.secrets"
+			       , NULL, NULL);
+    init_seam_kernelalgs();
+
+    cur_debugging = DBG_NONE;
+    if(readwhackmsg(argv[1]) == 0) exit(10);
+    c1 = con_by_name(argv[2], TRUE);
+    assert(c1 != NULL);
+    assert(orient(c1, 500));
+
+    read_i1(argv[3]);
+
+    /* busy at 4 half-open IKE SAs in all, not any more below 3 */
+    ikev2_cookie_threshold = 4;
+    ikev2_cookie_prefix_threshold = 0;
+
+    for(i = 0; i < 4; i++)
+	EXPECT(&busy[i], FALSE, "R1");
+    EXPECT(&busy[4], FALSE, "COOKIE");
+    EXPECT(&busy[4], TRUE, "R1");
+
+    delete_peer(&busy[0]);
+    delete_peer(&busy[1]);
+    EXPECT(&busy[5], FALSE, "COOKIE");
+    delete_peer(&busy[2]);
+    EXPECT(&busy[6], FALSE, "R1");
+
+    for(i = 0; i < elemsof(busy); i++)
+	if(busy[i].serial != SOS_NOBODY)
+	    delete_peer(&busy[i]);
+
+    /* now only per /24: busy at 2 half-open IKE SAs from it */
+    ikev2_cookie_threshold = 0;
+    ikev2_cookie_prefix_threshold = 2;
+
+    EXPECT(&prefix[0], FALSE, "R1");
+    EXPECT(&prefix[1], FALSE, "R1");
+    EXPECT(&prefix[2], FALSE, "COOKIE");
+    EXPECT(&prefix[2], TRUE, "R1");
+    EXPECT(&prefix[3], FALSE, "R1");
+
+    show_ikev2_dcookie_status();
+
+    for(i = 0; i < elemsof(prefix); i++)
+	if(prefix[i].serial != SOS_NOBODY)
+	    delete_peer(&prefix[i]);
+
+    pfree(i1_ike);
+    report_leaks();
+
+    tool_close_log();
+    exit(0);
+}
+
+ /*
+ * Local Variables:
+ * c-style: pluto
+ * c-basic-offset: 4
+ * compile-command: "make check"
+ * End:
+ */
@@ -6,11 +6,13 @@ void finish_dh_v2(struct state *st,
 {
 	//struct pcr_skeycalc_v2 *dhv2 = &r->pcr_d.dhv2;
 
+    /* an AEAD cipher has no SK_a: leave those empty */
 #define CLONEIT(X) \
-    clonetochunk(st->st_##X \
-		 , SS(X.ptr) \
-		 , SS(X.len) \
-		 ,   "calculated " #X "shared secret");
+    if(SS(X.len) != 0) \
+	clonetochunk(st->st_##X \
+		     , SS(X.ptr) \
+		     , SS(X.len) \
+		     ,   "calculated " #X "shared secret");
 
     CLONEIT(shared);
     CLONEIT(skey_d);
@@ -0,0 +1,63 @@
+#ifndef __seam_gr_gcm_c__
+#define __seam_gr_gcm_c__
+#include "seam_gr_md5.c"
+
+/*
+ * conn gcmtunnel
+ *     also=mytunnel
+ *     ike=aes_gcm_c128-sha2_256;modp2048
+ *
+ * The same exchange as seam_gr_md5.c, with keys sized the way
+ * calc_skeyseed_v2() sizes them for AES-GCM-16 and a 128 bit key: each
+ * SK_e is the 16 byte key followed by the 4 byte salt (RFC5282), there
+ * is no SK_a, and SK_d and SK_p are as long as the SHA2-256 PRF.
+ */
+
+unsigned char __tc72_gcm_results_skey_d[]= {
+0x0d, 0x4c, 0xc9, 0xc5,  0xdf, 0x68, 0xcd, 0x37,  0xb6, 0x01, 0x3d, 0x3d,  0xd2, 0x9c, 0x2b, 0x64,
+0xf0, 0xac, 0xd3, 0x12,  0x1c, 0xd4, 0x68, 0x74,  0x9a, 0x61, 0x18, 0xe8,  0xd1, 0x43, 0x7b, 0x35,
+};
+
+unsigned char __tc72_gcm_results_skey_ei[]= {
+0xb2, 0x0d, 0x3b, 0xab,  0x6e, 0x84, 0x6e, 0xb6,  0x5b, 0xaf, 0x5d, 0x4c,  0x99, 0x2e, 0x0d, 0x77,
+0x84, 0x74, 0xa2, 0x95,
+};
+
+unsigned char __tc72_gcm_results_skey_er[]= {
+0x56, 0x12, 0xe3, 0xd5,  0xec, 0x1d, 0x7a, 0x81,  0x80, 0xab, 0xfc, 0xd1,  0x96, 0xd1, 0xfd, 0x0b,
+0x40, 0xd9, 0x5d, 0x31,
+};
+
+unsigned char __tc72_gcm_results_skey_pi[]= {
+0xbd, 0xa7, 0x7c, 0x72,  0x84, 0xdf, 0xaf, 0x5b,  0xde, 0x17, 0x44, 0x67,  0x23, 0xfc, 0x1b, 0x1a,
+0xe5, 0xa5, 0x0f, 0x18,  0x54, 0x63, 0xcc, 0x71,  0xbc, 0x5e, 0xba, 0xf6,  0x6f, 0x66, 0xcf, 0xe5,
+};
+
+unsigned char __tc72_gcm_results_skey_pr[]= {
+0x31, 0x83, 0x24, 0xfd,  0xb6, 0x1e, 0x70, 0xbf,  0x71, 0x82, 0xdf, 0x9e,  0xcf, 0xf0, 0x7b, 0xb4,
+0xd0, 0x88, 0xdc, 0x91,  0x90, 0x08, 0x68, 0x2e,  0x95, 0xfe, 0x1b, 0xa2,  0x1e, 0xe6, 0x3a, 0x39,
+};
+
+SEAM_SECRETS_DECLARE(tc72_gcm_secrets,
+		     OAKLEY_GROUP_MODP2048,
+		     AUTH_ALGORITHM_HMAC_SHA2_256,
+		     OAKLEY_SHA2_256,
+		     RESPONDER,
+		     __SS_SET(__tc72,gi),
+		     __SS_SET(__tc72,gr),
+		     __SS_SET(__tc72,ni),
+		     __SS_SET(__tc72,nr),
+		     __SS_SET(__tc72,icookie),
+		     __SS_SET(__tc72,rcookie),
+		     __SS_SET(__tc72,secret),
+		     __SS_SET(__tc72_results,shared),
+		     __SS_SET(__tc72_results,skeyseed),
+		     __SS_SET(__tc72_gcm_results,skey_d),
+		     __SS_SET(__tc72_gcm_results,skey_ei),
+		     __SS_SET(__tc72_gcm_results,skey_er),
+		     __SS_SET(__tc72_gcm_results,skey_pi),
+		     __SS_SET(__tc72_gcm_results,skey_pr));
+#undef SECRETS
+#define SECRETS (&tc72_gcm_secrets)
+
+#endif
@@ -16,6 +16,6 @@ void nat_traversal_natd_lookup(struct msg_digest *md) {}
 void nat_traversal_show_result (u_int32_t nt, u_int16_t sport) {}
 u_int32_t nat_traversal_vid_to_method(unsigned short nat_t_vid) { return LELEM(NAT_TRAVERSAL_RFC); }
 
-void nat_traversal_new_ka_event (void) {}
+void nat_traversal_ka_track (struct state *st) {}
 
 #endif
@@ -4,8 +4,10 @@
 void timer_list(void) {}
 
 void event_schedule(enum event_type type, time_t tm, struct state *st) { }
+void event_schedule_ms(enum event_type type, unsigned long delay_ms, struct state *st) { }
 void _delete_dpd_event(struct state *st, const char *file, int lineno) {}
 void delete_event(struct state *st) {}
+unsigned long long now_msec(void) { return (unsigned long long)now() * 1000; }
 
 
 